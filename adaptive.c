@@ -0,0 +1,275 @@
+#include "adaptive.h"
+#include "timing.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const int ladder_scales[] = { 100, 75, 50 };    // Percent of the native size
+static const int ladder_divisors[] = { 1, 2 };         // Native and half refresh
+
+// Most expensive rung first
+static int compare_rungs(const void *a, const void *b) {
+    double ra = ((const AdaptiveRung *)a)->pixel_rate;
+    double rb = ((const AdaptiveRung *)b)->pixel_rate;
+    return (ra < rb) - (ra > rb);
+}
+
+// Fill the ladder from the native mode - sizes are kept to CVT's 8-pixel width granularity and even heights
+static void build_ladder(AdaptiveController *ctrl, const ScreenInfo *screen, double refresh) {
+    ctrl->rung_count = 0;
+    for (size_t s = 0; s < sizeof(ladder_scales) / sizeof(ladder_scales[0]); s++) {
+        for (size_t d = 0; d < sizeof(ladder_divisors) / sizeof(ladder_divisors[0]); d++) {
+            AdaptiveRung rung = { 0 };
+            if (s == 0) {
+                rung.spec.width = screen->width;
+                rung.spec.height = screen->height;
+            } else {
+                rung.spec.width = (screen->width * ladder_scales[s] / 100) & ~7u;
+                rung.spec.height = (screen->height * ladder_scales[s] / 100) & ~1u;
+            }
+            rung.spec.refresh_rate = refresh / ladder_divisors[d];
+            if (rung.spec.width < 64 || rung.spec.height < 64) continue;
+            rung.pixel_rate = (double)rung.spec.width * rung.spec.height * rung.spec.refresh_rate;
+            if (s == 0 && d == 0) rung.mode = screen->mode_id;   // The native mode is already there
+            ctrl->rungs[ctrl->rung_count++] = rung;
+        }
+    }
+    // The native rung has the highest pixel rate, so it stays rungs[0]
+    qsort(ctrl->rungs, ctrl->rung_count, sizeof(AdaptiveRung), compare_rungs);
+}
+
+// Create every rung's mode and attach them all to the output with one sync
+static int attach_ladder(AdaptiveController *ctrl, ScreenInfo *screen) {
+    DisplayManager *dm = ctrl->dm;
+    for (int i = 0; i < ctrl->rung_count; i++) {
+        AdaptiveRung *rung = &ctrl->rungs[i];
+        if (rung->mode) continue;
+        rung->mode = mode_create_cvt_pinned(dm, rung->spec.width, rung->spec.height, rung->spec.refresh_rate,
+                                            rung->spec.reduced_blanking);
+        if (!rung->mode) return -1;
+    }
+    
+    dm_trap_errors(dm);
+    for (int i = 0; i < ctrl->rung_count; i++) {
+        if (dm_screen_has_mode(screen, ctrl->rungs[i].mode)) continue;
+        XRRAddOutputMode(dm->display, screen->output_id, ctrl->rungs[i].mode);
+        dm_screen_add_mode(screen, ctrl->rungs[i].mode);
+    }
+    int error = dm_untrap_errors(dm);
+    if (error != 0) {
+        fprintf(stderr, "Adaptive: attaching the ladder to %s failed (X error %d)\n", ctrl->output, error);
+        return -1;
+    }
+    return 0;
+}
+
+// Precompute the ladder below the output's current mode
+AdaptiveController* adaptive_create(DisplayManager *dm, const char *output_name, double budget_mbps) {
+    if (!dm || !output_name) return NULL;
+    if (dm_ensure_screens(dm) < 0) return NULL;
+    
+    ScreenInfo *screen = dm_find_screen(dm, output_name);
+    double refresh = screen ? dm_mode_refresh(dm_find_mode(dm, screen->mode_id)) : 0;
+    if (!screen || !screen->crtc_id || !screen->mode_id || refresh <= 0) {
+        fprintf(stderr, "Adaptive: %s has no active mode to build a ladder from\n", output_name);
+        return NULL;
+    }
+    
+    AdaptiveController *ctrl = calloc(1, sizeof(AdaptiveController));
+    if (!ctrl) return NULL;
+    ctrl->dm = dm;
+    snprintf(ctrl->output, sizeof(ctrl->output), "%s", output_name);
+    ctrl->budget_bps = budget_mbps * 1e6;
+    ctrl->up_wait = ADAPTIVE_UP_INTERVALS;
+    ctrl->since_up = -1;
+    
+    build_ladder(ctrl, screen, refresh);
+    if (attach_ladder(ctrl, screen) != 0) {
+        free(ctrl);
+        return NULL;
+    }
+    ctrl->current = 0;
+    return ctrl;
+}
+
+// Start measuring a new pipeline - also the point where a switch has taken effect
+void adaptive_begin(AdaptiveController *ctrl, Pipeline *pipeline, Transport *transport) {
+    if (!ctrl) return;
+    
+    ctrl->pipeline = pipeline;
+    ctrl->transport = transport;
+    ctrl->started_ns = timing_now();
+    ctrl->window_ns = ctrl->started_ns;
+    ctrl->queue_sum = 0;
+    ctrl->queue_samples = 0;
+    ctrl->healthy = 0;
+    ctrl->last_dropped = 0;             // Stage counters start over with every pipeline
+    transport_get_stats(transport, &ctrl->last_transport);
+    
+    // Follow the output - a mode nobody on the ladder set means someone else is in charge
+    ScreenInfo *screen = dm_find_screen(ctrl->dm, ctrl->output);
+    int rung = -1;
+    for (int i = 0; screen && i < ctrl->rung_count; i++) {
+        if (ctrl->rungs[i].mode == screen->mode_id) rung = i;
+    }
+    if (rung < 0 && ctrl->current >= 0) {
+        printf("Adaptive: %s left the ladder, no more mode switches\n", ctrl->output);
+    }
+    ctrl->current = rung;
+}
+
+// Point the output's CRTC at another rung - the RandR events restart the pipeline
+static int switch_rung(AdaptiveController *ctrl, int rung, const char *reason) {
+    DisplayManager *dm = ctrl->dm;
+    ScreenInfo *screen = dm_find_screen(dm, ctrl->output);
+    CrtcState *crtc = screen ? dm_find_crtc(dm, screen->crtc_id) : NULL;
+    if (!crtc || dm_ensure_resources(dm) != 0) return -1;
+    
+    const AdaptiveRung *to = &ctrl->rungs[rung];
+    dm_trap_errors(dm);
+    Status status = XRRSetCrtcConfig(dm->display, dm->resources, crtc->id, CurrentTime, crtc->x, crtc->y,
+                                     to->mode, crtc->rotation, crtc->outputs, crtc->noutput);
+    int error = dm_untrap_errors(dm);
+    if (status != RRSetConfigSuccess || error != 0) {
+        // Most likely a rung was garbage collected - stay where we are rather than create modes now
+        fprintf(stderr, "Adaptive: switching %s to %ux%u@%.0f failed, no more mode switches\n",
+                ctrl->output, to->spec.width, to->spec.height, to->spec.refresh_rate);
+        ctrl->current = -1;
+        return 0;
+    }
+    
+    printf("Adaptive: %s %s to %ux%u@%.0f (%s, %.1f Mbit/s)\n", ctrl->output,
+           rung > ctrl->current ? "down" : "up", to->spec.width, to->spec.height,
+           to->spec.refresh_rate, reason, ctrl->rate_bps / 1e6);
+    if (rung > ctrl->current) {
+        ctrl->steps_down++;
+    } else {
+        ctrl->steps_up++;
+    }
+    ctrl->current = rung;
+    ctrl->healthy = 0;
+    return 1;
+}
+
+// Judge one finished period - returns 1 if the mode was switched
+static int judge_period(AdaptiveController *ctrl, double seconds) {
+    TransportStats now;
+    transport_get_stats(ctrl->transport, &now);
+    unsigned long dropped = pipeline_stage_dropped(ctrl->pipeline, PIPE_CONVERT) +
+                            pipeline_stage_dropped(ctrl->pipeline, PIPE_ENCODE) +
+                            pipeline_stage_dropped(ctrl->pipeline, PIPE_SEND);
+    double queue = ctrl->queue_samples ? ctrl->queue_sum / ctrl->queue_samples : 0;
+    unsigned long errors = (now.send_errors - ctrl->last_transport.send_errors) +
+                           (now.oversize - ctrl->last_transport.oversize);
+    unsigned long nacks = now.nacks - ctrl->last_transport.nacks;
+    ctrl->rate_bps = (double)(now.bytes - ctrl->last_transport.bytes) * 8 / seconds;
+    
+    const char *reason = NULL;
+    if (queue >= ADAPTIVE_QUEUE_HIGH) {
+        reason = "encoder backlog";
+    } else if (dropped != ctrl->last_dropped) {
+        reason = "frames dropped";
+    } else if (errors > 0) {
+        reason = "send errors";
+    } else if (nacks >= ADAPTIVE_NACKS_HIGH) {
+        reason = "packet loss";
+    } else if (ctrl->budget_bps > 0 && ctrl->rate_bps > ctrl->budget_bps) {
+        reason = "over budget";
+    }
+    ctrl->last_transport = now;
+    ctrl->last_dropped = dropped;
+    if (ctrl->since_up >= 0) ctrl->since_up++;
+    
+    if (reason) {
+        // The last step up did not hold - be slower to try again
+        if (ctrl->since_up >= 0 && ctrl->since_up <= ADAPTIVE_UP_INTERVALS) {
+            ctrl->up_wait = ctrl->up_wait * 2 > ADAPTIVE_UP_MAX_INTERVALS ? ADAPTIVE_UP_MAX_INTERVALS : ctrl->up_wait * 2;
+        }
+        ctrl->since_up = -1;
+        ctrl->healthy = 0;
+        if (ctrl->current + 1 >= ctrl->rung_count) return 0;
+        return switch_rung(ctrl, ctrl->current + 1, reason);
+    }
+    
+    if (++ctrl->healthy < ctrl->up_wait || ctrl->current == 0) return 0;
+    const AdaptiveRung *up = &ctrl->rungs[ctrl->current - 1];
+    double projected = ctrl->rate_bps * up->pixel_rate / ctrl->rungs[ctrl->current].pixel_rate;
+    if (ctrl->budget_bps > 0 && projected > ctrl->budget_bps * ADAPTIVE_HEADROOM) return 0;
+    
+    int result = switch_rung(ctrl, ctrl->current - 1, "headroom");
+    if (result == 1) ctrl->since_up = 0;
+    return result;
+}
+
+// Accumulate one sample and judge the period once it is complete
+int adaptive_sample(AdaptiveController *ctrl) {
+    if (!ctrl || !ctrl->pipeline) return -1;
+    if (ctrl->current < 0) return 0;
+    
+    uint64_t now = timing_now();
+    if (now - ctrl->started_ns < (uint64_t)ADAPTIVE_SETTLE_MS * 1000000) {
+        // Keyframes and a filling pipeline are not a verdict on the mode
+        ctrl->window_ns = now;
+        ctrl->last_dropped = pipeline_stage_dropped(ctrl->pipeline, PIPE_CONVERT) +
+                             pipeline_stage_dropped(ctrl->pipeline, PIPE_ENCODE) +
+                             pipeline_stage_dropped(ctrl->pipeline, PIPE_SEND);
+        transport_get_stats(ctrl->transport, &ctrl->last_transport);
+        return 0;
+    }
+    
+    ctrl->queue_sum += (double)pipeline_queue_depth(ctrl->pipeline, PIPE_ENCODE);
+    ctrl->queue_samples++;
+    if (now - ctrl->window_ns < (uint64_t)ADAPTIVE_INTERVAL_MS * 1000000) return 0;
+    
+    int result = judge_period(ctrl, (now - ctrl->window_ns) / 1e9);
+    ctrl->window_ns = now;
+    ctrl->queue_sum = 0;
+    ctrl->queue_samples = 0;
+    return result;
+}
+
+void adaptive_print_ladder(const AdaptiveController *ctrl, FILE *out) {
+    if (!ctrl) return;
+    fprintf(out, "Adaptive ladder for %s", ctrl->output);
+    if (ctrl->budget_bps > 0) fprintf(out, " (budget %.1f Mbit/s)", ctrl->budget_bps / 1e6);
+    fprintf(out, ":\n");
+    for (int i = 0; i < ctrl->rung_count; i++) {
+        const AdaptiveRung *r = &ctrl->rungs[i];
+        fprintf(out, "  %c %4ux%-4u @ %5.2f Hz  mode %lu\n", i == ctrl->current ? '*' : ' ',
+                r->spec.width, r->spec.height, r->spec.refresh_rate, r->mode);
+    }
+}
+
+void adaptive_print_stats(const AdaptiveController *ctrl, FILE *out) {
+    if (!ctrl) return;
+    fprintf(out, "Adaptive: %lu steps down, %lu up, last period %.1f Mbit/s\n",
+            ctrl->steps_down, ctrl->steps_up, ctrl->rate_bps / 1e6);
+}
+
+// A lower rung nobody else has in use - no CRTC on it, no other output listing it
+static bool rung_unshared(AdaptiveController *ctrl, RRMode mode) {
+    DisplayManager *dm = ctrl->dm;
+    for (int i = 0; i < dm->topology.crtc_count; i++) {
+        if (dm->topology.crtcs[i].mode == mode) return false;
+    }
+    for (int i = 0; i < dm->screen_count; i++) {
+        if (strcmp(dm->screens[i].name, ctrl->output) != 0 && dm_screen_has_mode(&dm->screens[i], mode)) return false;
+    }
+    return true;
+}
+
+// Leave the output in the mode it had before streaming, unless someone else
+// took over, and unpin the ladder by deleting the rungs this stream kept attached
+void adaptive_destroy(AdaptiveController *ctrl) {
+    if (!ctrl) return;
+    if (ctrl->current > 0) switch_rung(ctrl, 0, "stream ended");
+    
+    RRMode rungs[ADAPTIVE_MAX_RUNGS];
+    int count = 0;
+    for (int i = 1; i < ctrl->rung_count; i++) {
+        if (ctrl->rungs[i].mode && rung_unshared(ctrl, ctrl->rungs[i].mode)) rungs[count++] = ctrl->rungs[i].mode;
+    }
+    if (count > 0 && mode_gc_delete(ctrl->dm, rungs, count) != 0) {
+        fprintf(stderr, "Adaptive: some ladder modes of %s could not be deleted\n", ctrl->output);
+    }
+    free(ctrl);
+}
@@ -0,0 +1,81 @@
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "display_manager.h"
+#include "mode_manager.h"
+#include "pipeline.h"
+#include "transport.h"
+
+// Adaptive resolution/refresh for --stream: when the link or the encoder
+// cannot keep up, a smaller mode is better than a stuttering one. At session
+// start a ladder of modes - 100%, 75% and 50% of the native size at the native
+// and half refresh rate, ordered by pixel rate - is created once with
+// mode_create_cvt_pinned and attached to the output. Afterwards the controller only
+// switches the CRTC between these modes; nothing is created in the hot path.
+//
+// Every ADAPTIVE_INTERVAL_MS it looks at what happened since the last look:
+// mean encode queue depth, frames dropped by the pipeline, transport send
+// errors and NACKs, and the sent bit rate against an optional budget. Any sign
+// of congestion steps one rung down; ADAPTIVE_UP_INTERVALS healthy intervals in
+// a row step one rung up, provided the rate scaled to that rung still fits the
+// budget. A step up that is followed by congestion doubles the wait before the
+// next one. The switch itself is an ordinary mode change, which --stream
+// already follows by restarting the pipeline at the new size.
+//
+// The lower rungs are attached but drive no CRTC. Their MODE_PINNED_PREFIX
+// names keep any mode GC, in this process or a daemon's, off them while they
+// stay attached; adaptive_destroy deletes them again.
+
+#define ADAPTIVE_MAX_RUNGS 6
+#define ADAPTIVE_INTERVAL_MS 1000       // Decision period
+#define ADAPTIVE_SETTLE_MS 2000         // After a (re)start, ignore this long before judging (keyframes, warm-up)
+#define ADAPTIVE_UP_INTERVALS 5         // Healthy periods before trying the next rung up
+#define ADAPTIVE_UP_MAX_INTERVALS 120   // Cap for the doubled wait
+#define ADAPTIVE_QUEUE_HIGH 1.0         // Mean frames waiting for the encoder that count as backlog
+#define ADAPTIVE_NACKS_HIGH 3           // NACKs per period that count as loss
+#define ADAPTIVE_HEADROOM 0.8           // Step up only if the projected rate fits this share of the budget
+
+typedef struct {
+    ModeSpec spec;
+    RRMode mode;
+    double pixel_rate;                  // width * height * refresh, the rung's cost
+} AdaptiveRung;
+
+typedef struct {
+    DisplayManager *dm;                 // Main connection mode switches go through (borrowed)
+    char output[32];
+    AdaptiveRung rungs[ADAPTIVE_MAX_RUNGS]; // Most expensive first, rungs[0] is the native mode
+    int rung_count;
+    int current;                        // Rung the output is on (-1 = mode changed by someone else, controller idle)
+    double budget_bps;                  // Link budget (0 = unknown, loss and backlog only)
+    
+    Pipeline *pipeline;                 // Running pipeline being measured (borrowed)
+    Transport *transport;               // Borrowed, may be NULL
+    uint64_t started_ns;                // adaptive_begin time
+    uint64_t window_ns;                 // Start of the current period
+    double queue_sum;                   // Encode queue depth samples this period
+    int queue_samples;
+    TransportStats last_transport;      // Totals at the start of the period
+    unsigned long last_dropped;
+    double rate_bps;                    // Bit rate of the last full period
+    
+    int healthy;                        // Healthy periods in a row
+    int up_wait;                        // Healthy periods required before stepping up
+    int since_up;                       // Periods since the last step up (-1 = none yet)
+    unsigned long steps_down;
+    unsigned long steps_up;
+} AdaptiveController;
+
+AdaptiveController* adaptive_create(DisplayManager *dm, const char *output_name,
+                                    double budget_mbps);            // Ladder from the output's current mode - NULL on failure
+void adaptive_begin(AdaptiveController *ctrl, Pipeline *pipeline,
+                    Transport *transport);                          // A pipeline (re)started - fresh period, settle first
+int adaptive_sample(AdaptiveController *ctrl);                      // Call every few ms while streaming - 1 if it switched mode, 0 if not, -1 on error
+void adaptive_print_ladder(const AdaptiveController *ctrl, FILE *out);
+void adaptive_print_stats(const AdaptiveController *ctrl, FILE *out);
+void adaptive_destroy(AdaptiveController *ctrl);                    // Switches back to rungs[0] if on a lower rung and deletes the lower rungs no one else uses - safe to call with NULL
+
+#endif
@@ -0,0 +1,128 @@
+#include "batch.h"
+#include "command.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BATCH_LINE_MAX 512
+
+// Outcome of one batch line, resolved after the final sync
+typedef struct {
+    char text[BATCH_LINE_MAX];  // Original line for the report
+    CommandType type;
+    int local_result;           // 0 = ok, -1 = parse/local failure
+    unsigned long first_serial; // Requests issued by this line: [first_serial, end_serial)
+    unsigned long end_serial;
+    RRMode created_mode;        // Mode ID created by a create line
+} BatchLine;
+
+// Grow the line array when needed
+static BatchLine* append_line(BatchLine **lines, int *count, int *capacity) {
+    if (*count == *capacity) {
+        int new_capacity = *capacity ? *capacity * 2 : 32;
+        BatchLine *grown = realloc(*lines, new_capacity * sizeof(BatchLine));
+        if (!grown) return NULL;
+        *lines = grown;
+        *capacity = new_capacity;
+    }
+    BatchLine *line = &(*lines)[(*count)++];
+    memset(line, 0, sizeof(*line));
+    return line;
+}
+
+// Resolve a $N reference against modes created by earlier lines
+static int resolve_mode_ref(Command *cmd, const BatchLine *lines, int current) {
+    if (cmd->mode_ref == 0) return 0;
+    
+    int index = cmd->mode_ref - 1;
+    if (index >= current || lines[index].type != CMD_CREATE || lines[index].created_mode == 0) {
+        fprintf(stderr, "Line $%d did not create a mode\n", cmd->mode_ref);
+        return -1;
+    }
+    cmd->mode_id = lines[index].created_mode;
+    return 0;
+}
+
+// Print one result line per input line
+static void print_report(DisplayManager *dm, const BatchLine *lines, int count, int *failed) {
+    *failed = 0;
+    printf("Batch results:\n");
+    
+    for (int i = 0; i < count; i++) {
+        const BatchLine *line = &lines[i];
+        if (line->type == CMD_NONE && line->local_result == 0) continue;
+        
+        int error_code = (line->local_result == 0)
+            ? dm_trapped_error_in(line->first_serial, line->end_serial)
+            : 0;
+        
+        if (line->local_result != 0) {
+            printf("  %d: ERROR %s\n", i + 1, line->text);
+            (*failed)++;
+        } else if (error_code != 0) {
+            char error_text[128];
+            XGetErrorText(dm->display, error_code, error_text, sizeof(error_text));
+            printf("  %d: ERROR (%s) %s\n", i + 1, error_text, line->text);
+            (*failed)++;
+        } else if (line->type == CMD_CREATE) {
+            printf("  %d: OK %s -> mode ID %lu\n", i + 1, line->text, line->created_mode);
+        } else {
+            printf("  %d: OK %s\n", i + 1, line->text);
+        }
+    }
+}
+
+// Execute all lines with deferred syncs, then sync and report once
+int batch_run(DisplayManager *dm, FILE *input) {
+    if (!dm || !input) return -1;
+    
+    BatchLine *lines = NULL;
+    int count = 0, capacity = 0;
+    char buffer[BATCH_LINE_MAX];
+    
+    dm->defer_sync = true;
+    dm_trap_errors(dm);
+    
+    while (fgets(buffer, sizeof(buffer), input)) {
+        BatchLine *line = append_line(&lines, &count, &capacity);
+        if (!line) {
+            fprintf(stderr, "Out of memory reading batch\n");
+            break;
+        }
+        
+        buffer[strcspn(buffer, "\r\n")] = '\0';
+        snprintf(line->text, sizeof(line->text), "%s", buffer);
+        
+        Command cmd;
+        line->first_serial = NextRequest(dm->display);
+        
+        if (command_parse(buffer, &cmd) != 0) {
+            line->local_result = -1;
+        } else if (cmd.type == CMD_QUIT) {
+            line->type = CMD_QUIT;
+            line->end_serial = line->first_serial;
+            break;
+        } else if (cmd.type == CMD_PROVISION || cmd.type == CMD_CONNECT || cmd.type == CMD_GC) {
+            // These run their own error trap and sync, they cannot share the batch sync
+            fprintf(stderr, "%s is not supported in batch mode\n", command_name(cmd.type));
+            line->local_result = -1;
+        } else if (resolve_mode_ref(&cmd, lines, count - 1) != 0) {
+            line->local_result = -1;
+        } else {
+            line->type = cmd.type;
+            line->local_result = command_execute(dm, &cmd, &line->created_mode);
+        }
+        
+        line->end_serial = NextRequest(dm->display);
+    }
+    
+    // The single sync for the whole batch - errors land in the trap
+    dm_untrap_errors(dm);
+    dm->defer_sync = false;
+    
+    int failed = 0;
+    print_report(dm, lines, count, &failed);
+    
+    free(lines);
+    return failed;
+}
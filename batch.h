@@ -0,0 +1,13 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "display_manager.h"
+#include <stdio.h>
+
+// Batch mode: run many create/add/remove/delete lines (see command.h) on one
+// connection with a single XSync at the end. X errors are trapped and matched
+// back to the line whose requests caused them; a per-line result is printed.
+
+int batch_run(DisplayManager *dm, FILE *input);   // Returns number of failed lines, -1 on error
+
+#endif
@@ -0,0 +1,839 @@
+#define _GNU_SOURCE
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+#include <libxcvt/libxcvt.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "capture.h"
+#include "colorspace.h"
+#include "display_manager.h"
+#include "encoder.h"
+#include "mode_manager.h"
+#include "timing.h"
+
+// Benchmark suite: starts a private X server (Xvfb with the requested number
+// of outputs, or Xorg with the dummy driver's one), times the display and mode
+// paths and the capture/convert/encode stages against it, and appends one
+// JSON object per scenario to the results file. Every timed scenario runs
+// twice, once on a clean server and once with hundreds of leftover tc_ modes
+// attached to the outputs, which is what a long-lived desktop looks like
+// after many tablet sessions.
+
+#define BENCH_DEFAULT_ITERATIONS 50
+#define BENCH_DEFAULT_OUTPUTS 4
+#define BENCH_DEFAULT_MODES 20          // Monitor modes (not ours) on every output
+#define BENCH_DEFAULT_LEFTOVER 500      // Stale tc_ modes for the leftover pass
+#define BENCH_DEFAULT_OUTPUT_FILE "bench_output.txt"
+#define BENCH_GC_ROUNDS 3               // Each round recreates every leftover mode first
+#define BENCH_SERVER_TIMEOUT_MS 10000
+#define BENCH_MONITOR_PREFIX "bench_"
+#define BENCH_XORG_CONFIG "tabcaster-bench.conf"   // Relative to the server's working directory
+#define BENCH_XORG_CONFIGDIR "xorg.conf.d"          // Left empty, so no system snippet is read
+#define BENCH_XORG_LOG "xorg.log"
+
+#ifndef BENCH_VERSION
+#define BENCH_VERSION "unknown"
+#endif
+
+typedef enum {
+    SERVER_XVFB,
+    SERVER_DUMMY,                       // Xorg + xf86-video-dummy
+    SERVER_EXISTING                     // --display: benchmark a server we did not start
+} ServerKind;
+
+typedef struct {
+    ServerKind server;
+    const char *display;                // SERVER_EXISTING only
+    int outputs;
+    int modes;
+    int leftover;
+    int iterations;
+    unsigned int width;                 // Root window size of a started server
+    unsigned int height;
+    const char *output_path;
+    bool verbose;                       // Keep the library's per-operation messages on stdout
+    const char *xorg;                   // Xorg binary for dummy (NULL = the first unwrapped one found)
+    bool privileged;                    // Dummy may run as root, through the Xorg.wrap wrapper in PATH
+} BenchConfig;
+
+typedef struct {
+    pid_t pid;
+    char display[16];
+    char dir[64];                       // Private directory with the generated config and log (dummy only)
+} XServer;
+
+// The server itself, not the setuid Xorg.wrap that "Xorg" in PATH often is
+static const char *xorg_paths[] = { "/usr/lib/xorg/Xorg", "/usr/libexec/Xorg", "/usr/lib/Xorg" };
+
+typedef struct {
+    FILE *out;
+    const BenchConfig *config;
+    int outputs;                        // Found on the server
+    int leftover;                       // Leftover modes present in this pass
+    uint64_t *samples;                  // config->iterations durations, reused by every scenario
+} BenchRun;
+
+static const char *server_names[] = {
+    [SERVER_XVFB]     = "xvfb",
+    [SERVER_DUMMY]    = "dummy",
+    [SERVER_EXISTING] = "existing",
+};
+
+static RRMode *monitor_modes;           // Created by setup, removed again on an existing server
+static int monitor_mode_count;
+
+static void print_usage(const char *program_name) {
+    printf("Usage: %s [options]\n", program_name);
+    printf("Options:\n");
+    printf("  --server xvfb|dummy       X server to start (default: xvfb)\n");
+    printf("  --display NAME            Benchmark an already running server instead of starting one\n");
+    printf("  --outputs N               Outputs the started server should expose (default: %d, dummy: 1 only)\n",
+           BENCH_DEFAULT_OUTPUTS);
+    printf("  --modes N                 Monitor modes added to every output before timing (default: %d)\n",
+           BENCH_DEFAULT_MODES);
+    printf("  --leftover N              Stale tc_ modes for the leftover pass (default: %d, 0 = skip the pass)\n",
+           BENCH_DEFAULT_LEFTOVER);
+    printf("  --iterations N            Samples per scenario (default: %d)\n", BENCH_DEFAULT_ITERATIONS);
+    printf("  --size WxH                Root window size of the started server (default: 1920x1080)\n");
+    printf("  --output FILE             Append JSON results to FILE (default: %s, - for stdout)\n",
+           BENCH_DEFAULT_OUTPUT_FILE);
+    printf("  --verbose                 Keep per-operation messages and server output\n");
+    printf("  --xorg PATH               Xorg binary for --server dummy (default: the first of /usr/lib/xorg/Xorg,\n");
+    printf("                            /usr/libexec/Xorg and /usr/lib/Xorg)\n");
+    printf("  --privileged              Let --server dummy run Xorg as root, through Xorg.wrap in PATH\n");
+    printf("  --help                    Show this help\n");
+}
+
+// Path of a file in the dummy server's directory
+static void server_file(const XServer *server, const char *name, char *path, size_t size) {
+    snprintf(path, size, "%s/%s", server->dir, name);
+}
+
+// Dummy driver config in a private directory the server runs in: a privileged
+// Xorg only takes relative -config paths, and ignoring an absolute one would
+// mean silently starting on the system config, i.e. the real hardware
+static int write_dummy_config(const BenchConfig *config, XServer *server) {
+    snprintf(server->dir, sizeof(server->dir), "/tmp/tabcaster-bench-XXXXXX");
+    if (!mkdtemp(server->dir)) {
+        perror("mkdtemp");
+        server->dir[0] = '\0';
+        return -1;
+    }
+    char path[128];
+    server_file(server, BENCH_XORG_CONFIGDIR, path, sizeof(path));
+    if (mkdir(path, 0700) != 0) {
+        perror(path);
+        return -1;
+    }
+    server_file(server, BENCH_XORG_CONFIG, path, sizeof(path));
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+    unsigned long video_ram_kb = (unsigned long)config->width * config->height * 4 / 1024 + 16384;
+    fprintf(file,
+            "Section \"Device\"\n"
+            "    Identifier \"bench-device\"\n"
+            "    Driver \"dummy\"\n"
+            "    VideoRam %lu\n"
+            "EndSection\n"
+            "Section \"Monitor\"\n"
+            "    Identifier \"bench-monitor\"\n"
+            "    HorizSync 5.0-1000.0\n"
+            "    VertRefresh 5.0-200.0\n"
+            "EndSection\n"
+            "Section \"Screen\"\n"
+            "    Identifier \"bench-screen\"\n"
+            "    Device \"bench-device\"\n"
+            "    Monitor \"bench-monitor\"\n"
+            "    DefaultDepth 24\n"
+            "    SubSection \"Display\"\n"
+            "        Depth 24\n"
+            "        Virtual %u %u\n"
+            "    EndSubSection\n"
+            "EndSection\n",
+            video_ram_kb, config->width, config->height);
+    if (fclose(file) != 0) {
+        perror("fclose");
+        return -1;
+    }
+    return 0;
+}
+
+// Unwrapped Xorg to run as the calling user, or the wrapper when privileged - NULL if none
+static const char* dummy_server_binary(const BenchConfig *config) {
+    if (config->privileged) return "Xorg";
+    if (geteuid() == 0) {
+        fprintf(stderr, "Refusing to run Xorg as root without --privileged\n");
+        return NULL;
+    }
+    if (config->xorg) return config->xorg;
+    for (size_t i = 0; i < sizeof(xorg_paths) / sizeof(xorg_paths[0]); i++) {
+        if (access(xorg_paths[i], X_OK) == 0) return xorg_paths[i];
+    }
+    fprintf(stderr, "No Xorg binary found, pass --xorg PATH\n");
+    return NULL;
+}
+
+// The log names the config Xorg really read - anything but ours is the system
+// one. A privileged server may not pick its log file, it writes the usual one
+static bool dummy_config_used(const BenchConfig *config, const XServer *server, int display) {
+    char path[256];
+    if (!config->privileged) {
+        server_file(server, BENCH_XORG_LOG, path, sizeof(path));
+    } else {
+        snprintf(path, sizeof(path), "/var/log/Xorg.%d.log", display);
+        if (access(path, R_OK) != 0 && getenv("HOME")) {
+            snprintf(path, sizeof(path), "%s/.local/share/xorg/Xorg.%d.log", getenv("HOME"), display);
+        }
+    }
+    FILE *log = fopen(path, "r");
+    if (!log) return false;
+    char line[512];
+    bool used = false;
+    while (!used && fgets(line, sizeof(line), log)) {
+        const char *file = strstr(line, "Using config file: \"");
+        if (!file) continue;
+        file += strlen("Using config file: \"");
+        const char *end = strchr(file, '"');
+        size_t length = end ? (size_t)(end - file) : 0;
+        size_t name = strlen(BENCH_XORG_CONFIG);
+        used = length >= name && memcmp(file + length - name, BENCH_XORG_CONFIG, name) == 0;
+    }
+    fclose(log);
+    return used;
+}
+
+// Start the server on a free display it picks itself (-displayfd) and wait until it is up
+static int server_start(const BenchConfig *config, int outputs, XServer *server) {
+    memset(server, 0, sizeof(XServer));
+    server->pid = -1;
+    if (config->server == SERVER_EXISTING) {
+        snprintf(server->display, sizeof(server->display), "%s", config->display);
+        return setenv("DISPLAY", server->display, 1);
+    }
+    const char *xorg = NULL;
+    if (config->server == SERVER_DUMMY) {
+        xorg = dummy_server_binary(config);
+        if (!xorg || write_dummy_config(config, server) != 0) return -1;
+    }
+    
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return -1;
+    }
+    char fd_arg[16];
+    char geometry[32];
+    char crtcs[16];
+    snprintf(fd_arg, sizeof(fd_arg), "%d", fds[1]);
+    snprintf(geometry, sizeof(geometry), "%ux%ux24", config->width, config->height);
+    snprintf(crtcs, sizeof(crtcs), "%d", outputs);
+    
+    const char *argv[16];
+    int argc = 0;
+    if (config->server == SERVER_XVFB) {
+        argv[argc++] = "Xvfb";
+        argv[argc++] = "-screen";
+        argv[argc++] = "0";
+        argv[argc++] = geometry;
+        if (outputs > 1) {              // Older Xvfb has a single output and no -crtcs
+            argv[argc++] = "-crtcs";
+            argv[argc++] = crtcs;
+        }
+    } else {
+        argv[argc++] = xorg;
+        argv[argc++] = "-config";
+        argv[argc++] = BENCH_XORG_CONFIG;
+        argv[argc++] = "-configdir";
+        argv[argc++] = BENCH_XORG_CONFIGDIR;
+        if (!config->privileged) {
+            argv[argc++] = "-logfile";
+            argv[argc++] = BENCH_XORG_LOG;
+        }
+    }
+    argv[argc++] = "-displayfd";
+    argv[argc++] = fd_arg;
+    argv[argc++] = "-nolisten";
+    argv[argc++] = "tcp";
+    argv[argc++] = "-noreset";
+    argv[argc] = NULL;
+    
+    server->pid = fork();
+    if (server->pid < 0) {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (server->pid == 0) {
+        prctl(PR_SET_PDEATHSIG, SIGTERM);   // Never outlive a crashed bench
+        close(fds[0]);
+        if (server->dir[0] && chdir(server->dir) != 0) _exit(127);  // Where the relative paths point
+        if (!config->verbose) {
+            int null_fd = open("/dev/null", O_WRONLY);
+            if (null_fd >= 0) {
+                dup2(null_fd, STDOUT_FILENO);
+                dup2(null_fd, STDERR_FILENO);
+            }
+        }
+        execvp(argv[0], (char **)argv);
+        _exit(127);
+    }
+    close(fds[1]);
+    
+    // The server writes its display number once it accepts connections
+    char number[16] = { 0 };
+    size_t length = 0;
+    struct pollfd pfd = { .fd = fds[0], .events = POLLIN };
+    uint64_t deadline = timing_now() + (uint64_t)BENCH_SERVER_TIMEOUT_MS * 1000000;
+    while (length < sizeof(number) - 1 && !memchr(number, '\n', length)) {
+        uint64_t now = timing_now();
+        if (now >= deadline || poll(&pfd, 1, (int)((deadline - now) / 1000000) + 1) <= 0) break;
+        ssize_t got = read(fds[0], number + length, sizeof(number) - 1 - length);
+        if (got <= 0) break;
+        length += (size_t)got;
+    }
+    close(fds[0]);
+    if (!memchr(number, '\n', length)) {
+        fprintf(stderr, "%s did not start\n", argv[0]);
+        kill(server->pid, SIGTERM);
+        waitpid(server->pid, NULL, 0);
+        server->pid = -1;
+        return -1;
+    }
+    if (server->dir[0] && !dummy_config_used(config, server, atoi(number))) {
+        fprintf(stderr, "%s did not use the bench config (or its log cannot be read), stopping it\n", argv[0]);
+        kill(server->pid, SIGTERM);
+        waitpid(server->pid, NULL, 0);
+        server->pid = -1;
+        return -1;
+    }
+    snprintf(server->display, sizeof(server->display), ":%d", atoi(number));
+    return setenv("DISPLAY", server->display, 1);
+}
+
+static void server_stop(XServer *server) {
+    if (server->pid > 0) {
+        kill(server->pid, SIGTERM);
+        waitpid(server->pid, NULL, 0);
+    }
+    if (!server->dir[0]) return;
+    static const char *files[] = { BENCH_XORG_CONFIG, BENCH_XORG_LOG, BENCH_XORG_LOG ".old" };
+    char path[128];
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        server_file(server, files[i], path, sizeof(path));
+        unlink(path);
+    }
+    server_file(server, BENCH_XORG_CONFIGDIR, path, sizeof(path));
+    rmdir(path);
+    rmdir(server->dir);
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of the sorted samples
+static double percentile_us(const uint64_t *sorted, int count, double p) {
+    int rank = (int)(p * count + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+    return sorted[rank - 1] / 1000.0;
+}
+
+// One JSON line per scenario, plus a summary on stderr
+static void report(BenchRun *run, const char *scenario, const char *variant, int count) {
+    if (count <= 0) {
+        fprintf(stderr, "  %-10s %-10s failed, no samples\n", scenario, variant);
+        return;
+    }
+    uint64_t *sorted = run->samples;
+    qsort(sorted, (size_t)count, sizeof(uint64_t), compare_u64);
+    uint64_t total = 0;
+    for (int i = 0; i < count; i++) total += sorted[i];
+    double mean = total / 1000.0 / count;
+    double per_second = total ? count * 1e9 / total : 0;
+    
+    fprintf(run->out, "{\"scenario\":\"%s\",\"variant\":\"%s\",\"outputs\":%d,\"modes\":%d,\"leftover\":%d,"
+            "\"samples\":%d,\"min_us\":%.1f,\"p50_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f,\"mean_us\":%.1f,"
+            "\"per_second\":%.1f}\n",
+            scenario, variant, run->outputs, run->config->modes, run->leftover, count,
+            sorted[0] / 1000.0, percentile_us(sorted, count, 0.50), percentile_us(sorted, count, 0.99),
+            sorted[count - 1] / 1000.0, mean, per_second);
+    fflush(run->out);
+    fprintf(stderr, "  %-10s %-10s p50 %9.1f us  p99 %9.1f us  max %9.1f us\n", scenario, variant,
+            percentile_us(sorted, count, 0.50), percentile_us(sorted, count, 0.99), sorted[count - 1] / 1000.0);
+}
+
+static DisplayManager* open_dm(void) {
+    DisplayManager *dm = dm_init(DM_ENUM_CURRENT);
+    if (dm && dm_ensure_screens(dm) >= 0 && dm->screen_count > 0) return dm;
+    fprintf(stderr, "Cannot enumerate outputs on %s\n", getenv("DISPLAY"));
+    dm_cleanup(dm);
+    return NULL;
+}
+
+// Add a non-TabCaster mode to every output, like a monitor's EDID list
+static RRMode create_monitor_mode(DisplayManager *dm, unsigned int width, unsigned int height, double refresh) {
+    struct libxcvt_mode_info *cvt = libxcvt_gen_mode_info(width, height, refresh, false, false);
+    if (!cvt) return 0;
+    char name[64];
+    snprintf(name, sizeof(name), BENCH_MONITOR_PREFIX "%ux%u_%.0f", width, height, refresh);
+    XRRModeInfo info = {
+        .width = cvt->hdisplay, .height = cvt->vdisplay,
+        .dotClock = (unsigned long)(cvt->dot_clock * 1000),
+        .hSyncStart = cvt->hsync_start, .hSyncEnd = cvt->hsync_end, .hTotal = cvt->htotal,
+        .vSyncStart = cvt->vsync_start, .vSyncEnd = cvt->vsync_end, .vTotal = cvt->vtotal,
+        .name = name, .nameLength = (unsigned int)strlen(name), .modeFlags = cvt->mode_flags,
+    };
+    free(cvt);
+    RRMode mode = XRRCreateMode(dm->display, dm->root, &info);
+    for (int i = 0; mode && i < dm->screen_count; i++) {
+        XRRAddOutputMode(dm->display, dm->screens[i].output_id, mode);
+    }
+    return mode;
+}
+
+static int setup_monitor_modes(const BenchConfig *config) {
+    if (config->modes <= 0) return 0;
+    DisplayManager *dm = open_dm();
+    if (!dm) return -1;
+    monitor_modes = calloc((size_t)config->modes, sizeof(RRMode));
+    if (!monitor_modes) {
+        dm_cleanup(dm);
+        return -1;
+    }
+    for (int i = 0; i < config->modes; i++) {
+        RRMode mode = create_monitor_mode(dm, 640 + 64 * (unsigned)(i % 32), 480 + 36 * (unsigned)(i / 32), 75.0);
+        if (mode) monitor_modes[monitor_mode_count++] = mode;
+    }
+    XSync(dm->display, False);
+    dm_cleanup(dm);
+    return 0;
+}
+
+static void remove_monitor_modes(void) {
+    DisplayManager *dm = monitor_mode_count ? open_dm() : NULL;
+    for (int m = 0; dm && m < monitor_mode_count; m++) {
+        for (int i = 0; i < dm->screen_count; i++) {
+            if (dm_screen_has_mode(&dm->screens[i], monitor_modes[m])) {
+                XRRDeleteOutputMode(dm->display, dm->screens[i].output_id, monitor_modes[m]);
+            }
+        }
+        XRRDestroyMode(dm->display, monitor_modes[m]);
+    }
+    if (dm) XSync(dm->display, False);
+    dm_cleanup(dm);
+    free(monitor_modes);
+    monitor_modes = NULL;
+    monitor_mode_count = 0;
+}
+
+// Stale tc_ modes spread over the outputs, all created with a single sync
+static int create_leftover_modes(int count) {
+    DisplayManager *dm = open_dm();
+    if (!dm) return -1;
+    dm->defer_sync = true;
+    int created = 0;
+    for (int i = 0; i < count; i++) {
+        RRMode mode = mode_create_cvt(dm, 640 + 8 * (unsigned)(i % 200), 480 + 8 * (unsigned)(i / 200), 60.0, false);
+        if (!mode) continue;
+        mode_add_to_output(dm, dm->screens[i % dm->screen_count].name, mode);
+        created++;
+    }
+    XSync(dm->display, False);
+    dm_cleanup(dm);
+    return created;
+}
+
+// Connect to the server (dm_init), then fetch screen resources
+static void bench_init(BenchRun *run) {
+    int count = 0;
+    for (int i = 0; i < run->config->iterations; i++) {
+        uint64_t start = timing_now();
+        DisplayManager *dm = dm_init(DM_ENUM_CURRENT);
+        if (!dm) break;
+        run->samples[count++] = timing_now() - start;
+        dm_cleanup(dm);
+    }
+    report(run, "dm_init", "connect", count);
+    
+    count = 0;
+    for (int i = 0; i < run->config->iterations; i++) {
+        DisplayManager *dm = dm_init(DM_ENUM_CURRENT);
+        if (!dm) break;
+        uint64_t start = timing_now();
+        int result = dm_ensure_resources(dm);
+        uint64_t elapsed = timing_now() - start;
+        dm_cleanup(dm);
+        if (result != 0) break;
+        run->samples[count++] = elapsed;
+    }
+    report(run, "dm_init", "resources", count);
+}
+
+// Full enumeration on a fresh connection, as every one-shot command pays it
+static void bench_enumerate(BenchRun *run, DmBackend backend) {
+    int count = 0;
+    for (int i = 0; i < run->config->iterations; i++) {
+        DisplayManager *dm = dm_init(DM_ENUM_CURRENT);
+        if (!dm) break;
+        dm->backend = backend;
+        uint64_t start = timing_now();
+        int result = dm_get_screens(dm);
+        uint64_t elapsed = timing_now() - start;
+        dm_cleanup(dm);
+        if (result < 0) break;
+        run->samples[count++] = elapsed;
+    }
+    report(run, "enumerate", dm_backend_name(backend), count);
+}
+
+// dm_refresh against an unchanged server, and after one CRTC was set
+static void bench_refresh(BenchRun *run) {
+    DisplayManager *dm = open_dm();
+    if (!dm) return;
+    DmChangeSet changes = { 0 };
+    int count = 0;
+    for (int i = 0; i < run->config->iterations; i++) {
+        uint64_t start = timing_now();
+        if (dm_refresh(dm, &changes) < 0) break;
+        run->samples[count++] = timing_now() - start;
+    }
+    report(run, "refresh", "idle", count);
+    
+    // Setting a CRTC to its own configuration moves the server's set timestamp
+    RRCrtc crtc_id = 0;
+    for (int i = 0; i < dm->screen_count && !crtc_id; i++) {
+        if (dm->screens[i].mode_id) crtc_id = dm->screens[i].crtc_id;
+    }
+    CrtcState *crtc = crtc_id ? dm_find_crtc(dm, crtc_id) : NULL;
+    count = 0;
+    for (int i = 0; crtc && i < run->config->iterations; i++) {
+        if (XRRSetCrtcConfig(dm->display, dm->resources, crtc->id, CurrentTime, crtc->x, crtc->y, crtc->mode,
+                             crtc->rotation, crtc->outputs, crtc->noutput) != RRSetConfigSuccess) break;
+        uint64_t start = timing_now();
+        if (dm_refresh(dm, &changes) < 0) break;
+        run->samples[count++] = timing_now() - start;
+        crtc = dm_find_crtc(dm, crtc_id);
+    }
+    if (crtc) report(run, "refresh", "crtc_set", count);
+    dm_change_set_free(&changes);
+    dm_cleanup(dm);
+}
+
+// New modes, reuse of an existing one, and reuse from a cold process (connect + mode index build)
+static void bench_create(BenchRun *run) {
+    int iterations = run->config->iterations;
+    DisplayManager *dm = open_dm();
+    if (!dm) return;
+    RRMode *created = calloc((size_t)iterations, sizeof(RRMode));
+    if (!created) {
+        dm_cleanup(dm);
+        return;
+    }
+    
+    int count = 0;
+    for (int i = 0; i < iterations; i++) {
+        uint64_t start = timing_now();
+        created[i] = mode_create_cvt(dm, 1600, 1000 + 2 * (unsigned)i, 50.0, false);
+        if (!created[i]) break;
+        run->samples[count++] = timing_now() - start;
+    }
+    report(run, "create", "new", count);
+    
+    count = 0;
+    for (int i = 0; created[0] && i < iterations; i++) {
+        uint64_t start = timing_now();
+        if (!mode_create_cvt(dm, 1600, 1000, 50.0, false)) break;
+        run->samples[count++] = timing_now() - start;
+    }
+    report(run, "create", "reuse", count);
+    
+    count = 0;
+    for (int i = 0; created[0] && i < iterations; i++) {
+        uint64_t start = timing_now();
+        DisplayManager *cold = dm_init(DM_ENUM_CURRENT);
+        RRMode mode = cold ? mode_create_cvt(cold, 1600, 1000, 50.0, false) : 0;
+        uint64_t elapsed = timing_now() - start;
+        dm_cleanup(cold);
+        if (!mode) break;
+        run->samples[count++] = elapsed;
+    }
+    report(run, "create", "cold", count);
+    
+    for (int i = 0; i < iterations && created[i]; i++) mode_delete_from_xrandr(dm, created[i]);
+    free(created);
+    dm_cleanup(dm);
+}
+
+// Create, add, remove and delete one mode per sample
+static void bench_churn(BenchRun *run) {
+    DisplayManager *dm = open_dm();
+    if (!dm) return;
+    ScreenInfo *target = dm_get_primary_screen(dm);
+    if (!target) target = &dm->screens[0];
+    char output[32];
+    snprintf(output, sizeof(output), "%s", target->name);
+    
+    int count = 0;
+    for (int i = 0; i < run->config->iterations; i++) {
+        uint64_t start = timing_now();
+        RRMode mode = mode_create_cvt(dm, 1600, 1000 + 2 * (unsigned)i, 55.0, false);
+        if (!mode) break;
+        int result = mode_add_to_output(dm, output, mode);
+        if (result == 0) result = mode_remove_from_output(dm, output, mode);
+        if (mode_delete_from_xrandr(dm, mode) != 0 || result != 0) break;
+        run->samples[count++] = timing_now() - start;
+    }
+    report(run, "churn", output, count);
+    dm_cleanup(dm);
+}
+
+// Capture the first active output, convert each frame, and encode it if any backend opens
+static void bench_frames(BenchRun *run) {
+    DisplayManager *dm = open_dm();
+    if (!dm) return;
+    ScreenInfo *screen = NULL;
+    for (int i = 0; i < dm->screen_count && !screen; i++) {
+        if (dm->screens[i].crtc_id && dm->screens[i].width) screen = &dm->screens[i];
+    }
+    Capture *cap = screen ? capture_create(dm->display, dm->root, screen) : NULL;
+    if (!cap) {
+        fprintf(stderr, "  No active output to capture, skipping frame scenarios\n");
+        dm_cleanup(dm);
+        return;
+    }
+    
+    int iterations = run->config->iterations;
+    int count = 0;
+    for (int i = 0; i < iterations; i++) {
+        uint64_t start = timing_now();
+        if (capture_frame(cap) != 0) break;
+        run->samples[count++] = timing_now() - start;
+    }
+    report(run, "capture", cap->use_shm ? "shm" : "getimage", count);
+    
+    EncoderConfig encoder_config = { cap->width, cap->height, 60.0, ENCODER_DEFAULT_BITRATE_KBPS, NULL, false };
+    EncoderBackend backend = encoder_probe(&encoder_config);
+    Encoder *encoder = backend < ENC_BACKEND_COUNT ? encoder_open(backend, &encoder_config) : NULL;
+    CsFormat format = encoder ? encoder_input_format(encoder) : CS_FORMAT_NV12;
+    CsKernel kernel = colorspace_detect();
+    YuvImage image = { 0 };
+    if (cap->image->bits_per_pixel == 32 && colorspace_image_alloc(&image, format, cap->width, cap->height) == 0) {
+        count = 0;
+        for (int i = 0; i < iterations; i++) {
+            uint64_t start = timing_now();
+            if (colorspace_convert(kernel, (const uint8_t *)cap->image->data, cap->image->bytes_per_line,
+                                   NULL, &image) != 0) break;
+            run->samples[count++] = timing_now() - start;
+        }
+        report(run, "convert", colorspace_kernel_name(kernel), count);
+        
+        count = 0;
+        for (int i = 0; encoder && i < iterations; i++) {
+            EncodedPacket packet;
+            uint64_t start = timing_now();
+            if (encoder_encode(encoder, &image, &packet) != 0) break;
+            run->samples[count++] = timing_now() - start;
+        }
+        if (encoder) report(run, "encode", encoder_backend_name(backend), count);
+        else fprintf(stderr, "  No encoder backend opens, skipping encode\n");
+    }
+    colorspace_image_free(&image);
+    encoder_close(encoder);
+    capture_destroy(cap);
+    dm_cleanup(dm);
+}
+
+// GC of every leftover mode - the modes are recreated before each round
+static void bench_gc(BenchRun *run) {
+    int count = 0;
+    for (int round = 0; round < BENCH_GC_ROUNDS; round++) {
+        if (round > 0 && create_leftover_modes(run->leftover) < 0) break;
+        DisplayManager *dm = open_dm();
+        if (!dm) break;
+        uint64_t start = timing_now();
+        int deleted = mode_gc(dm);
+        uint64_t elapsed = timing_now() - start;
+        dm_cleanup(dm);
+        if (deleted < 0) break;
+        run->samples[count++] = elapsed;
+    }
+    report(run, "gc", "leftover", count);
+}
+
+static void run_pass(BenchRun *run) {
+    fprintf(stderr, "Pass with %d leftover mode%s:\n", run->leftover, run->leftover == 1 ? "" : "s");
+    bench_init(run);
+    bench_enumerate(run, DM_BACKEND_XCB);
+    bench_enumerate(run, DM_BACKEND_XLIB);
+    bench_refresh(run);
+    bench_create(run);
+    bench_churn(run);
+}
+
+static int parse_count(const char *value, int min, int *out) {
+    char *end;
+    long parsed = strtol(value, &end, 10);
+    if (*end != '\0' || parsed < min || parsed > 100000) return -1;
+    *out = (int)parsed;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    BenchConfig config = {
+        .server = SERVER_XVFB,
+        .outputs = BENCH_DEFAULT_OUTPUTS,
+        .modes = BENCH_DEFAULT_MODES,
+        .leftover = BENCH_DEFAULT_LEFTOVER,
+        .iterations = BENCH_DEFAULT_ITERATIONS,
+        .width = 1920,
+        .height = 1080,
+        .output_path = BENCH_DEFAULT_OUTPUT_FILE,
+    };
+    bool outputs_set = false;
+    
+    for (int i = 1; i < argc; i++) {
+        bool bad = false;
+        if (strcmp(argv[i], "--server") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            if (strcmp(name, "xvfb") == 0) config.server = SERVER_XVFB;
+            else if (strcmp(name, "dummy") == 0) config.server = SERVER_DUMMY;
+            else bad = true;
+        } else if (strcmp(argv[i], "--display") == 0 && i + 1 < argc) {
+            config.server = SERVER_EXISTING;
+            config.display = argv[++i];
+        } else if (strcmp(argv[i], "--outputs") == 0 && i + 1 < argc) {
+            bad = parse_count(argv[++i], 1, &config.outputs) != 0;
+            outputs_set = true;
+        } else if (strcmp(argv[i], "--modes") == 0 && i + 1 < argc) {
+            bad = parse_count(argv[++i], 0, &config.modes) != 0;
+        } else if (strcmp(argv[i], "--leftover") == 0 && i + 1 < argc) {
+            bad = parse_count(argv[++i], 0, &config.leftover) != 0;
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            bad = parse_count(argv[++i], 1, &config.iterations) != 0;
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            bad = sscanf(argv[++i], "%ux%u", &config.width, &config.height) != 2 ||
+                  config.width == 0 || config.height == 0;
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            config.output_path = argv[++i];
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            config.verbose = true;
+        } else if (strcmp(argv[i], "--xorg") == 0 && i + 1 < argc) {
+            config.xorg = argv[++i];
+        } else if (strcmp(argv[i], "--privileged") == 0) {
+            config.privileged = true;
+        } else if (strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (bad) {
+            fprintf(stderr, "Invalid value for %s: %s\n", argv[i - 1], argv[i]);
+            return 1;
+        }
+    }
+    
+    // One Device and Screen make one output - more Screens would be separate X screens, not RandR outputs
+    if (config.server == SERVER_DUMMY) {
+        if (outputs_set && config.outputs > 1) {
+            fprintf(stderr, "--server dummy exposes a single output, use xvfb for --outputs %d\n", config.outputs);
+            return 1;
+        }
+        config.outputs = 1;
+    }
+    if (config.xorg && config.privileged) {
+        fprintf(stderr, "--xorg and --privileged exclude each other\n");
+        return 1;
+    }
+    
+    // Results on stdout get their own stream - stdout itself is silenced below
+    bool to_stdout = strcmp(config.output_path, "-") == 0;
+    FILE *out = to_stdout ? fdopen(dup(STDOUT_FILENO), "w") : fopen(config.output_path, "a");
+    if (!out) {
+        perror(config.output_path);
+        return 1;
+    }
+    BenchRun run = { .out = out, .config = &config };
+    run.samples = calloc((size_t)config.iterations, sizeof(uint64_t));
+    XServer server = { .pid = -1 };
+    int started = run.samples ? server_start(&config, config.outputs, &server) : -1;
+    if (started != 0 && run.samples && config.server == SERVER_XVFB && config.outputs > 1) {
+        fprintf(stderr, "Retrying with a single output (Xvfb without -crtcs support?)\n");
+        started = server_start(&config, 1, &server);
+    }
+    if (started != 0) {
+        server_stop(&server);
+        free(run.samples);
+        fclose(out);
+        return 1;
+    }
+    
+    // Mode operations report every step on stdout - keep that out of the timings
+    if (!config.verbose && !freopen("/dev/null", "w", stdout)) {
+        perror("/dev/null");
+    }
+    
+    int status = 0;
+    DisplayManager *dm = open_dm();
+    if (!dm || setup_monitor_modes(&config) != 0) {
+        status = 1;
+    } else {
+        run.outputs = dm->screen_count;
+        int connected = dm_count_connected_screens(dm);
+        dm_cleanup(dm);
+        fprintf(stderr, "Benchmarking %s on %s: %d output%s (%d connected), %d monitor modes each\n",
+                server_names[config.server], server.display, run.outputs, run.outputs == 1 ? "" : "s",
+                connected, monitor_mode_count);
+        if (config.server != SERVER_EXISTING && run.outputs < config.outputs) {
+            fprintf(stderr, "Warning: asked for %d outputs, the server only exposes %d\n",
+                    config.outputs, run.outputs);
+        }
+        fprintf(out, "{\"bench\":\"tabcaster\",\"version\":\"%s\",\"time\":%ld,\"server\":\"%s\","
+                "\"requested_outputs\":%d,\"outputs\":%d,\"connected\":%d,\"modes\":%d,\"leftover\":%d,"
+                "\"iterations\":%d}\n",
+                BENCH_VERSION, (long)time(NULL), server_names[config.server], config.outputs, run.outputs,
+                connected, monitor_mode_count, config.leftover, config.iterations);
+        
+        run_pass(&run);
+        bench_frames(&run);
+        if (config.leftover > 0) {
+            int created = create_leftover_modes(config.leftover);
+            if (created > 0) {
+                run.leftover = created;
+                run_pass(&run);
+                bench_gc(&run);
+            } else {
+                fprintf(stderr, "Could not create leftover modes, skipping the leftover pass\n");
+                status = 1;
+            }
+        }
+    }
+    
+    if (config.server == SERVER_EXISTING) remove_monitor_modes();
+    server_stop(&server);
+    free(monitor_modes);
+    free(run.samples);
+    fclose(out);
+    if (!to_stdout) fprintf(stderr, "Results appended to %s\n", config.output_path);
+    return status;
+}
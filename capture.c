@@ -0,0 +1,242 @@
+#include "capture.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+// Release the image and the shared segment behind it
+static void release_image(Capture *cap) {
+    if (cap->use_shm) {
+        XShmDetach(cap->display, &cap->shm);
+        shmdt(cap->shm.shmaddr);
+    }
+    if (cap->image) XDestroyImage(cap->image);    // SHM images do not own their data
+    cap->image = NULL;
+    cap->use_shm = false;
+    memset(&cap->shm, 0, sizeof(cap->shm));
+    cap->shm.shmid = -1;
+}
+
+// Shared-memory image of the current size - returns 0 on success
+// cap->use_shm is only set once the server has attached the segment
+static int allocate_shm_image(Capture *cap) {
+    int screen = DefaultScreen(cap->display);
+    Visual *visual = DefaultVisual(cap->display, screen);
+    int depth = DefaultDepth(cap->display, screen);
+    
+    XImage *image = XShmCreateImage(cap->display, visual, depth, ZPixmap, NULL,
+                                    &cap->shm, cap->width, cap->height);
+    if (!image) return -1;
+    
+    cap->shm.shmid = shmget(IPC_PRIVATE, (size_t)image->bytes_per_line * image->height,
+                            IPC_CREAT | 0600);
+    if (cap->shm.shmid < 0) {
+        perror("shmget");
+        XDestroyImage(image);
+        return -1;
+    }
+    
+    cap->shm.shmaddr = shmat(cap->shm.shmid, NULL, 0);
+    if (cap->shm.shmaddr == (char *)-1) {
+        perror("shmat");
+        shmctl(cap->shm.shmid, IPC_RMID, NULL);
+        XDestroyImage(image);
+        return -1;
+    }
+    cap->shm.readOnly = False;
+    image->data = cap->shm.shmaddr;
+    
+    // XShmAttach fails asynchronously (e.g. server on another host) - catch it on
+    // this connection's sync, without touching other threads' error handling
+    DmErrorWatch watch;
+    dm_watch_errors(&watch, cap->display);
+    XShmAttach(cap->display, &cap->shm);
+    bool attach_failed = dm_unwatch_errors(&watch) != 0;
+    
+    // Both sides are attached (or never will be) - the segment goes away with the last detach
+    shmctl(cap->shm.shmid, IPC_RMID, NULL);
+    if (attach_failed) {
+        shmdt(cap->shm.shmaddr);
+        XDestroyImage(image);
+        return -1;
+    }
+    
+    cap->image = image;
+    cap->use_shm = true;
+    return 0;
+}
+
+// Plain client-side image for XGetSubImage - allocated once per size
+static int allocate_plain_image(Capture *cap) {
+    int screen = DefaultScreen(cap->display);
+    Visual *visual = DefaultVisual(cap->display, screen);
+    int depth = DefaultDepth(cap->display, screen);
+    int pad = BitmapPad(cap->display);
+    
+    cap->image = XCreateImage(cap->display, visual, depth, ZPixmap, 0, NULL,
+                              cap->width, cap->height, pad, 0);
+    if (!cap->image) return -1;
+    
+    cap->image->data = malloc((size_t)cap->image->bytes_per_line * cap->height);
+    if (!cap->image->data) {
+        XDestroyImage(cap->image);
+        cap->image = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// (Re)allocate the frame buffer for the current rectangle, preferring SHM
+static int allocate_image(Capture *cap) {
+    release_image(cap);
+    
+    if (XShmQueryExtension(cap->display) && allocate_shm_image(cap) == 0) return 0;
+    release_image(cap);
+    
+    fprintf(stderr, "MIT-SHM unavailable, capturing %s with XGetSubImage\n", cap->output);
+    return allocate_plain_image(cap);
+}
+
+// Copy the CRTC rectangle out of a ScreenInfo - returns -1 if the output is not scanning out
+static int take_geometry(Capture *cap, const ScreenInfo *screen) {
+    if (!screen->connected || screen->crtc_id == 0 || screen->width == 0 || screen->height == 0) {
+        fprintf(stderr, "Output %s has no active CRTC to capture\n", screen->name);
+        return -1;
+    }
+    
+    cap->crtc_id = screen->crtc_id;
+    cap->x = screen->x;
+    cap->y = screen->y;
+    cap->width = screen->width;
+    cap->height = screen->height;
+    return 0;
+}
+
+// Create a capture for the CRTC region of an output
+Capture* capture_create(Display *display, Window root, const ScreenInfo *screen) {
+    if (!display || !screen) return NULL;
+    
+    Capture *cap = calloc(1, sizeof(Capture));
+    if (!cap) return NULL;
+    
+    cap->display = display;
+    cap->root = root;
+    cap->shm.shmid = -1;
+    snprintf(cap->output, sizeof(cap->output), "%s", screen->name);
+    
+    if (take_geometry(cap, screen) != 0 || allocate_image(cap) != 0) {
+        capture_destroy(cap);
+        return NULL;
+    }
+    return cap;
+}
+
+// Grab one frame into cap->image
+int capture_frame(Capture *cap) {
+    if (!cap || !cap->image) return -1;
+    
+    uint64_t start = timing_now();
+    if (cap->use_shm) {
+        if (!XShmGetImage(cap->display, cap->root, cap->image, cap->x, cap->y, AllPlanes)) {
+            fprintf(stderr, "XShmGetImage failed for %s\n", cap->output);
+            return -1;
+        }
+    } else if (!XGetSubImage(cap->display, cap->root, cap->x, cap->y, cap->width, cap->height,
+                             AllPlanes, ZPixmap, cap->image, 0, 0)) {
+        fprintf(stderr, "XGetSubImage failed for %s\n", cap->output);
+        return -1;
+    }
+    
+    timing_record(TIMING_CAPTURE, start);
+    cap->frames++;
+    return 0;
+}
+
+// Bytes per row the server uses for an image of this width (scanline padded)
+static int padded_stride(const XImage *image, unsigned int width) {
+    int pad = image->bitmap_pad;
+    return (int)((((unsigned long)width * image->bits_per_pixel + pad - 1) / pad) * pad / 8);
+}
+
+// Grab a list of dirty rectangles
+// SHM: the server writes each rectangle with its own row pitch, so they are
+// packed back to back in the segment. XGetSubImage: written in place.
+int capture_rects(Capture *cap, const XRectangle *rects, int count, CaptureTile *tiles) {
+    if (!cap || !cap->image || (count > 0 && (!rects || !tiles))) return -1;
+    
+    size_t capacity = (size_t)cap->image->bytes_per_line * cap->height;
+    size_t offset = 0;
+    for (int i = 0; i < count; i++) {
+        int stride = padded_stride(cap->image, rects[i].width);
+        offset += (size_t)stride * rects[i].height;
+    }
+    
+    // Overlapping rectangles could overflow the segment - the whole frame is cheaper anyway
+    if (cap->use_shm && offset > capacity) {
+        if (capture_frame(cap) != 0) return -1;
+        for (int i = 0; i < count; i++) {
+            tiles[i].rect = rects[i];
+            tiles[i].stride = cap->image->bytes_per_line;
+            tiles[i].data = cap->image->data + (size_t)rects[i].y * tiles[i].stride
+                            + (size_t)rects[i].x * (cap->image->bits_per_pixel / 8);
+        }
+        return 0;
+    }
+    
+    uint64_t start = timing_now();
+    offset = 0;
+    for (int i = 0; i < count; i++) {
+        const XRectangle *r = &rects[i];
+        tiles[i].rect = *r;
+        
+        if (cap->use_shm) {
+            // Header copy describing a rect-sized image inside the same segment
+            XImage sub = *cap->image;
+            sub.width = r->width;
+            sub.height = r->height;
+            sub.bytes_per_line = padded_stride(cap->image, r->width);
+            sub.data = cap->shm.shmaddr + offset;
+            if (!XShmGetImage(cap->display, cap->root, &sub, cap->x + r->x, cap->y + r->y, AllPlanes)) {
+                fprintf(stderr, "XShmGetImage failed for %s\n", cap->output);
+                return -1;
+            }
+            tiles[i].data = sub.data;
+            tiles[i].stride = sub.bytes_per_line;
+            offset += (size_t)sub.bytes_per_line * r->height;
+        } else {
+            if (!XGetSubImage(cap->display, cap->root, cap->x + r->x, cap->y + r->y, r->width, r->height,
+                              AllPlanes, ZPixmap, cap->image, r->x, r->y)) {
+                fprintf(stderr, "XGetSubImage failed for %s\n", cap->output);
+                return -1;
+            }
+            tiles[i].stride = cap->image->bytes_per_line;
+            tiles[i].data = cap->image->data + (size_t)r->y * tiles[i].stride
+                            + (size_t)r->x * (cap->image->bits_per_pixel / 8);
+        }
+    }
+    timing_record(TIMING_CAPTURE, start);
+    
+    cap->frames++;
+    return 0;
+}
+
+// Follow a CRTC that moved or changed mode - only a size change reallocates
+int capture_update_geometry(Capture *cap, const ScreenInfo *screen) {
+    if (!cap || !screen) return -1;
+    
+    unsigned int old_width = cap->width;
+    unsigned int old_height = cap->height;
+    if (take_geometry(cap, screen) != 0) return -1;
+    
+    if (cap->width == old_width && cap->height == old_height) return 0;
+    return allocate_image(cap) == 0 ? 1 : -1;
+}
+
+// Free the capture and its buffer
+void capture_destroy(Capture *cap) {
+    if (!cap) return;
+    release_image(cap);
+    free(cap);
+}
@@ -0,0 +1,43 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <X11/Xlib.h>
+#include <X11/extensions/XShm.h>
+#include <stdbool.h>
+#include "display_manager.h"
+
+// Captures the rectangle of the root window scanned out by one CRTC into a
+// single reusable image. With MIT-SHM the server writes straight into a shared
+// segment (no per-frame copy or allocation); on displays without it (remote X)
+// XGetSubImage refills the same client-side buffer instead.
+
+// One captured dirty rectangle - pixels start at data, rows are stride bytes apart
+typedef struct {
+    XRectangle rect;            // Relative to the capture rectangle
+    char *data;
+    int stride;
+} CaptureTile;
+
+typedef struct {
+    Display *display;           // Connection frames are read on (borrowed)
+    Window root;
+    RRCrtc crtc_id;             // CRTC the region belongs to
+    char output[32];            // Output name, for messages
+    int x;                      // Captured rectangle in root coordinates
+    int y;
+    unsigned int width;
+    unsigned int height;
+    XImage *image;              // Frame buffer, valid after capture_frame
+    XShmSegmentInfo shm;        // Shared segment (shmid -1 when not using SHM)
+    bool use_shm;
+    unsigned long frames;       // Frames captured so far
+} Capture;
+
+Capture* capture_create(Display *display, Window root, const ScreenInfo *screen); // NULL if output is inactive or on failure
+int capture_frame(Capture *cap);                                  // Refill cap->image - returns 0 on success, -1 on error
+int capture_rects(Capture *cap, const XRectangle *rects, int count,
+                  CaptureTile *tiles);                            // Grab only rects (capture-relative) - returns 0 on success, -1 on error
+int capture_update_geometry(Capture *cap, const ScreenInfo *screen); // Follow a moved/resized CRTC - 1 if buffer was reallocated, 0 if unchanged, -1 on error
+void capture_destroy(Capture *cap);                               // Safe to call with NULL
+
+#endif
@@ -0,0 +1,147 @@
+#include "colorspace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Convert packed capture tiles - they start exactly at their rectangle
+int colorspace_convert_tiles(CsKernel kernel, const CaptureTile *tiles, int count, YuvImage *out) {
+    if (!out || !out->planes[0] || (count > 0 && !tiles)) return -1;
+    
+    for (int i = 0; i < count; i++) {
+        const XRectangle *r = &tiles[i].rect;
+        if ((r->x & 1) || (r->y & 1)) {
+            fprintf(stderr, "Tile at %d,%d is not chroma aligned\n", r->x, r->y);
+            return -1;
+        }
+        
+        int w = r->width;
+        int h = r->height;
+        if (r->x + w > (int)out->width) w = (int)out->width - r->x;
+        if (r->y + h > (int)out->height) h = (int)out->height - r->y;
+        if (w <= 0 || h <= 0) continue;
+        colorspace_convert_block(kernel, (const uint8_t *)tiles[i].data, tiles[i].stride, r->x, r->y, w, h, out);
+    }
+    return 0;
+}
+
+// Surface, one buffer per frame in flight, and one for the latest whole frame
+#define STAGE_POOL_BUFFERS (PIPELINE_DEPTH + 2)
+
+struct ColorspaceStage {
+    CsKernel kernel;
+    CsFormat format;
+    FramePool *pool;                    // Every YUV buffer this stage writes
+    FrameBuffer *surface_buffer;
+    YuvImage surface;                   // Current frame for damage frames to patch
+    FrameBuffer *latest;                // Last whole frame, held until the surface catches up (NULL = surface current)
+    YuvImage images[PIPELINE_DEPTH];    // Per-descriptor view of its buffer, handed downstream
+};
+
+// Take the surface out of the pool and start it from black, not garbage
+static int stage_init_surface(ColorspaceStage *stage, unsigned int width, unsigned int height) {
+    stage->surface_buffer = frame_pool_acquire(stage->pool);
+    if (!stage->surface_buffer) return -1;
+    colorspace_image_wrap(&stage->surface, stage->format, width, height, stage->surface_buffer->data);
+    
+    YuvImage *s = &stage->surface;
+    size_t luma = (size_t)(s->planes[1] - s->planes[0]);
+    memset(s->planes[0], 16, luma);
+    memset(s->planes[1], 128, colorspace_image_size(s->format, width, height) - luma);
+    return 0;
+}
+
+// Size the pool for the output's mode
+static ColorspaceStage* stage_create(CsKernel kernel, CsFormat format, unsigned int width,
+                                     unsigned int height, int extra_buffers, bool shared) {
+    if (width == 0 || height == 0 || extra_buffers < 0) return NULL;
+    
+    ColorspaceStage *stage = calloc(1, sizeof(ColorspaceStage));
+    if (!stage) return NULL;
+    stage->kernel = kernel;
+    stage->format = format;
+    
+    size_t size = colorspace_image_size(format, width, height);
+    int capacity = STAGE_POOL_BUFFERS + extra_buffers;
+    stage->pool = shared ? frame_pool_create_shared(capacity, size) : frame_pool_create(capacity, size);
+    if (!stage->pool || stage_init_surface(stage, width, height) != 0) {
+        colorspace_stage_destroy(stage);
+        return NULL;
+    }
+    return stage;
+}
+
+ColorspaceStage* colorspace_stage_create(CsKernel kernel, CsFormat format,
+                                         unsigned int width, unsigned int height) {
+    return stage_create(kernel, format, width, height, 0, false);
+}
+
+// Extra buffers cover the frames another process holds on to
+ColorspaceStage* colorspace_stage_create_shared(CsKernel kernel, CsFormat format, unsigned int width,
+                                                unsigned int height, int extra_buffers) {
+    return stage_create(kernel, format, width, height, extra_buffers, true);
+}
+
+// Rebuild the pool for a new mode - the pipeline must have let go of every frame
+int colorspace_stage_resize(ColorspaceStage *stage, unsigned int width, unsigned int height) {
+    if (!stage || width == 0 || height == 0) return -1;
+    if (width == stage->surface.width && height == stage->surface.height) return 0;
+    
+    frame_buffer_unref(stage->latest);
+    frame_buffer_unref(stage->surface_buffer);
+    stage->latest = NULL;
+    stage->surface_buffer = NULL;
+    if (frame_pool_resize(stage->pool, colorspace_image_size(stage->format, width, height)) != 0) return -1;
+    return stage_init_surface(stage, width, height);
+}
+
+FramePool* colorspace_stage_pool(ColorspaceStage *stage) {
+    return stage ? stage->pool : NULL;
+}
+
+// Whole frames convert straight into a fresh buffer. Damage frames patch the
+// surface and copy it out - a memcpy is far cheaper than converting it all
+int colorspace_stage_process(void *ctx, FrameDesc *frame) {
+    ColorspaceStage *stage = ctx;
+    if (!stage || !frame || frame->slot < 0 || frame->slot >= PIPELINE_DEPTH) return -1;
+    
+    FrameBuffer *buffer = frame_pool_acquire(stage->pool);
+    if (!buffer) return 1;              // Cannot happen with the pool sized for the pipeline, drop rather than stall
+    frame->buffers[PIPE_CONVERT] = buffer;
+    
+    unsigned int width = stage->surface.width;
+    unsigned int height = stage->surface.height;
+    size_t bytes = frame_pool_buffer_size(stage->pool);
+    YuvImage *image = &stage->images[frame->slot];
+    colorspace_image_wrap(image, stage->format, width, height, buffer->data);
+    
+    const XRectangle *r = &frame->tiles[0].rect;
+    bool whole = frame->tile_count == 1 && r->x == 0 && r->y == 0 && r->width >= width && r->height >= height;
+    
+    if (whole) {
+        if (colorspace_convert_tiles(stage->kernel, frame->tiles, 1, image) != 0) return -1;
+        
+        // Only copied into the surface if a damage frame ever needs it
+        frame_buffer_unref(stage->latest);
+        stage->latest = frame_buffer_ref(buffer);
+    } else {
+        // Our reference keeps the latest whole frame intact however far downstream it got
+        if (stage->latest) {
+            memcpy(stage->surface.planes[0], stage->latest->data, bytes);
+            frame_buffer_unref(stage->latest);
+            stage->latest = NULL;
+        }
+        if (colorspace_convert_tiles(stage->kernel, frame->tiles, frame->tile_count, &stage->surface) != 0) return -1;
+        memcpy(image->planes[0], stage->surface.planes[0], bytes);
+    }
+    
+    frame->stage_data[PIPE_CONVERT] = image;
+    return 0;
+}
+
+void colorspace_stage_destroy(ColorspaceStage *stage) {
+    if (!stage) return;
+    frame_buffer_unref(stage->latest);
+    frame_buffer_unref(stage->surface_buffer);
+    frame_pool_destroy(stage->pool);
+    free(stage);
+}
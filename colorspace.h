@@ -0,0 +1,33 @@
+#ifndef COLORSPACE_H
+#define COLORSPACE_H
+
+#include <X11/Xlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "colorspace_kernels.h"
+#include "frame_pool.h"
+#include "pipeline.h"
+
+// Pipeline side of the BGRX to YUV conversion - the kernels and YuvImage are
+// in colorspace_kernels.h
+
+int colorspace_convert_tiles(CsKernel kernel, const CaptureTile *tiles, int count,
+                             YuvImage *out);                            // Convert packed dirty rectangles into their place in out
+
+// Pipeline convert stage - keeps one YUV surface up to date from dirty
+// rectangles and hands each frame its own copy in stage_data[PIPE_CONVERT].
+// Every buffer comes from a frame pool sized for the output's mode; the frame
+// carries its buffer's reference in buffers[PIPE_CONVERT]
+typedef struct ColorspaceStage ColorspaceStage;
+
+ColorspaceStage* colorspace_stage_create(CsKernel kernel, CsFormat format,
+                                         unsigned int width, unsigned int height); // NULL on failure
+ColorspaceStage* colorspace_stage_create_shared(CsKernel kernel, CsFormat format, unsigned int width,
+                                                unsigned int height, int extra_buffers); // Pool in a memfd, extra_buffers more of them - NULL on failure
+int colorspace_stage_resize(ColorspaceStage *stage, unsigned int width,
+                            unsigned int height);               // Follow a mode change, with no frames in flight - returns 0 on success
+FramePool* colorspace_stage_pool(ColorspaceStage *stage);       // For stats and sharing
+int colorspace_stage_process(void *stage, FrameDesc *frame);    // PipelineStageFn
+void colorspace_stage_destroy(ColorspaceStage *stage);          // Safe to call with NULL
+
+#endif
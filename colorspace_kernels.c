@@ -0,0 +1,423 @@
+#include "colorspace_kernels.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CS_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#define CS_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Fixed-point BT.601 limited range, 7-bit coefficients so every SIMD kernel
+// can use 8x8-bit multiply-adds and still match the reference exactly:
+//   Y = ((13B + 64G + 33R + 64) >> 7) + 16
+//   U = ((56B - 37G - 19R + 64) >> 7) + 128
+//   V = ((56R - 47G -  9B + 64) >> 7) + 128
+// Chroma input is avg(avg(top row), avg(bottom row)) with (a + b + 1) >> 1
+// rounding per step, which is what pavgb / vrhadd compute.
+
+// Convert one pair of rows: width pixels of src0/src1 into two Y rows and one
+// chroma row. NV12 writes interleaved UV to u and ignores v.
+typedef void (*RowPairFn)(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                          uint8_t *u, uint8_t *v, int width, bool nv12);
+
+static const char *kernel_names[CS_KERNEL_COUNT] = {
+    [CS_KERNEL_SCALAR] = "scalar",
+    [CS_KERNEL_SSE41]  = "sse4.1",
+    [CS_KERNEL_AVX2]   = "avx2",
+    [CS_KERNEL_NEON]   = "neon",
+};
+
+static inline uint8_t luma(const uint8_t *p) {
+    return (uint8_t)(((13 * p[0] + 64 * p[1] + 33 * p[2] + 64) >> 7) + 16);
+}
+
+static inline int avg_round(int a, int b) {
+    return (a + b + 1) >> 1;
+}
+
+// Reference kernel - also finishes the tail of every SIMD kernel
+static void row_pair_scalar(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                            uint8_t *u, uint8_t *v, int width, bool nv12) {
+    for (int x = 0; x < width; x += 2) {
+        const uint8_t *a0 = src0 + x * 4;
+        const uint8_t *b0 = src1 + x * 4;
+        
+        // Odd width: the last chroma sample covers a single column
+        bool pair = x + 1 < width;
+        const uint8_t *a1 = pair ? a0 + 4 : a0;
+        const uint8_t *b1 = pair ? b0 + 4 : b0;
+        
+        y0[x] = luma(a0);
+        y1[x] = luma(b0);
+        if (pair) {
+            y0[x + 1] = luma(a1);
+            y1[x + 1] = luma(b1);
+        }
+        
+        int c[3];
+        for (int ch = 0; ch < 3; ch++) {
+            c[ch] = avg_round(avg_round(a0[ch], b0[ch]), avg_round(a1[ch], b1[ch]));
+        }
+        // Arithmetic right shift of negative sums floors, as psraw/vshr do
+        uint8_t cu = (uint8_t)(((56 * c[0] - 37 * c[1] - 19 * c[2] + 64) >> 7) + 128);
+        uint8_t cv = (uint8_t)(((56 * c[2] - 47 * c[1] - 9 * c[0] + 64) >> 7) + 128);
+        
+        if (nv12) {
+            u[x] = cu;
+            u[x + 1] = cv;
+        } else {
+            u[x / 2] = cu;
+            v[x / 2] = cv;
+        }
+    }
+}
+
+#ifdef CS_HAVE_X86
+
+// 8 luma values from 8 BGRX pixels
+__attribute__((target("sse4.1")))
+static inline __m128i luma8_sse(__m128i p0, __m128i p1, __m128i coef) {
+    __m128i sum = _mm_hadd_epi16(_mm_maddubs_epi16(p0, coef), _mm_maddubs_epi16(p1, coef));
+    sum = _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(64)), 7);
+    sum = _mm_add_epi16(sum, _mm_set1_epi16(16));
+    return _mm_packus_epi16(sum, sum);
+}
+
+// 8 pixels per iteration
+__attribute__((target("sse4.1")))
+static void row_pair_sse41(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                           uint8_t *u, uint8_t *v, int width, bool nv12) {
+    const __m128i ycoef = _mm_setr_epi8(13, 64, 33, 0, 13, 64, 33, 0, 13, 64, 33, 0, 13, 64, 33, 0);
+    const __m128i ucoef = _mm_setr_epi8(56, -37, -19, 0, 56, -37, -19, 0, 56, -37, -19, 0, 56, -37, -19, 0);
+    const __m128i vcoef = _mm_setr_epi8(-9, -47, 56, 0, -9, -47, 56, 0, -9, -47, 56, 0, -9, -47, 56, 0);
+    const __m128i interleave = _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+    
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i a0 = _mm_loadu_si128((const __m128i *)(src0 + x * 4));
+        __m128i a1 = _mm_loadu_si128((const __m128i *)(src0 + x * 4 + 16));
+        __m128i b0 = _mm_loadu_si128((const __m128i *)(src1 + x * 4));
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(src1 + x * 4 + 16));
+        
+        _mm_storel_epi64((__m128i *)(y0 + x), luma8_sse(a0, a1, ycoef));
+        _mm_storel_epi64((__m128i *)(y1 + x), luma8_sse(b0, b1, ycoef));
+        
+        // Vertical then horizontal rounding average -> 4 chroma pixels
+        __m128 m0 = _mm_castsi128_ps(_mm_avg_epu8(a0, b0));
+        __m128 m1 = _mm_castsi128_ps(_mm_avg_epu8(a1, b1));
+        __m128i even = _mm_castps_si128(_mm_shuffle_ps(m0, m1, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i odd = _mm_castps_si128(_mm_shuffle_ps(m0, m1, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m128i c = _mm_avg_epu8(even, odd);
+        
+        // U0..U3 V0..V3 as 16-bit
+        __m128i uv = _mm_hadd_epi16(_mm_maddubs_epi16(c, ucoef), _mm_maddubs_epi16(c, vcoef));
+        uv = _mm_srai_epi16(_mm_add_epi16(uv, _mm_set1_epi16(64)), 7);
+        uv = _mm_add_epi16(uv, _mm_set1_epi16(128));
+        __m128i bytes = _mm_packus_epi16(uv, uv);
+        
+        if (nv12) {
+            _mm_storel_epi64((__m128i *)(u + x), _mm_shuffle_epi8(bytes, interleave));
+        } else {
+            uint32_t uw = (uint32_t)_mm_cvtsi128_si32(bytes);
+            uint32_t vw = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(bytes, 4));
+            memcpy(u + x / 2, &uw, 4);
+            memcpy(v + x / 2, &vw, 4);
+        }
+    }
+    
+    if (x < width) {
+        row_pair_scalar(src0 + x * 4, src1 + x * 4, y0 + x, y1 + x,
+                        nv12 ? u + x : u + x / 2, nv12 ? v : v + x / 2, width - x, nv12);
+    }
+}
+
+// 16 luma values from 16 BGRX pixels - hadd/packus work per 128-bit lane,
+// the dword permute puts the four groups of four back in order
+__attribute__((target("avx2")))
+static inline __m128i luma16_avx2(__m256i p0, __m256i p1, __m256i coef) {
+    __m256i sum = _mm256_hadd_epi16(_mm256_maddubs_epi16(p0, coef), _mm256_maddubs_epi16(p1, coef));
+    sum = _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(64)), 7);
+    sum = _mm256_add_epi16(sum, _mm256_set1_epi16(16));
+    __m256i bytes = _mm256_packus_epi16(sum, sum);
+    bytes = _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+    return _mm256_castsi256_si128(bytes);
+}
+
+// 16 pixels per iteration
+__attribute__((target("avx2")))
+static void row_pair_avx2(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                          uint8_t *u, uint8_t *v, int width, bool nv12) {
+    const __m256i ycoef = _mm256_setr_epi8(13, 64, 33, 0, 13, 64, 33, 0, 13, 64, 33, 0, 13, 64, 33, 0,
+                                           13, 64, 33, 0, 13, 64, 33, 0, 13, 64, 33, 0, 13, 64, 33, 0);
+    const __m256i ucoef = _mm256_setr_epi8(56, -37, -19, 0, 56, -37, -19, 0, 56, -37, -19, 0, 56, -37, -19, 0,
+                                           56, -37, -19, 0, 56, -37, -19, 0, 56, -37, -19, 0, 56, -37, -19, 0);
+    const __m256i vcoef = _mm256_setr_epi8(-9, -47, 56, 0, -9, -47, 56, 0, -9, -47, 56, 0, -9, -47, 56, 0,
+                                           -9, -47, 56, 0, -9, -47, 56, 0, -9, -47, 56, 0, -9, -47, 56, 0);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    // After the permute: U0 U1 U4 U5 U2 U3 U6 U7 V0 V1 V4 V5 V2 V3 V6 V7
+    const __m128i planar = _mm_setr_epi8(0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15);
+    const __m128i interleave = _mm_setr_epi8(0, 8, 1, 9, 4, 12, 5, 13, 2, 10, 3, 11, 6, 14, 7, 15);
+    
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)(src0 + x * 4));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *)(src0 + x * 4 + 32));
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)(src1 + x * 4));
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(src1 + x * 4 + 32));
+        
+        _mm_storeu_si128((__m128i *)(y0 + x), luma16_avx2(a0, a1, ycoef));
+        _mm_storeu_si128((__m128i *)(y1 + x), luma16_avx2(b0, b1, ycoef));
+        
+        __m256 m0 = _mm256_castsi256_ps(_mm256_avg_epu8(a0, b0));
+        __m256 m1 = _mm256_castsi256_ps(_mm256_avg_epu8(a1, b1));
+        __m256i even = _mm256_castps_si256(_mm256_shuffle_ps(m0, m1, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m256i odd = _mm256_castps_si256(_mm256_shuffle_ps(m0, m1, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m256i c = _mm256_avg_epu8(even, odd);
+        
+        __m256i uv = _mm256_hadd_epi16(_mm256_maddubs_epi16(c, ucoef), _mm256_maddubs_epi16(c, vcoef));
+        uv = _mm256_srai_epi16(_mm256_add_epi16(uv, _mm256_set1_epi16(64)), 7);
+        uv = _mm256_add_epi16(uv, _mm256_set1_epi16(128));
+        __m256i bytes = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(uv, uv), order);
+        __m128i low = _mm256_castsi256_si128(bytes);
+        
+        if (nv12) {
+            _mm_storeu_si128((__m128i *)(u + x), _mm_shuffle_epi8(low, interleave));
+        } else {
+            __m128i sorted = _mm_shuffle_epi8(low, planar);
+            _mm_storel_epi64((__m128i *)(u + x / 2), sorted);
+            _mm_storel_epi64((__m128i *)(v + x / 2), _mm_srli_si128(sorted, 8));
+        }
+    }
+    
+    if (x < width) {
+        row_pair_sse41(src0 + x * 4, src1 + x * 4, y0 + x, y1 + x,
+                       nv12 ? u + x : u + x / 2, nv12 ? v : v + x / 2, width - x, nv12);
+    }
+}
+
+#endif // CS_HAVE_X86
+
+#ifdef CS_HAVE_NEON
+
+// 8 luma values from deinterleaved B, G, R
+static inline uint8x8_t luma8_neon(uint8x8_t b, uint8x8_t g, uint8x8_t r) {
+    uint16x8_t sum = vmull_u8(b, vdup_n_u8(13));
+    sum = vmlal_u8(sum, g, vdup_n_u8(64));
+    sum = vmlal_u8(sum, r, vdup_n_u8(33));
+    return vadd_u8(vshrn_n_u16(vaddq_u16(sum, vdupq_n_u16(64)), 7), vdup_n_u8(16));
+}
+
+// One chroma channel from 8 averaged samples: (cb * B + cg * G + cr * R + 64) >> 7, + 128
+static inline uint8x8_t chroma8_neon(int16x8_t b, int16x8_t g, int16x8_t r, int16_t cb, int16_t cg, int16_t cr) {
+    int16x8_t sum = vmulq_n_s16(b, cb);
+    sum = vmlaq_n_s16(sum, g, cg);
+    sum = vmlaq_n_s16(sum, r, cr);
+    sum = vshrq_n_s16(vaddq_s16(sum, vdupq_n_s16(64)), 7);
+    return vqmovun_s16(vaddq_s16(sum, vdupq_n_s16(128)));
+}
+
+// Average horizontal pairs of 16 samples into 8
+static inline int16x8_t pair_average(uint8x16_t top, uint8x16_t bottom) {
+    uint8x16_t vert = vrhaddq_u8(top, bottom);
+    uint8x16x2_t split = vuzpq_u8(vert, vert);
+    return vreinterpretq_s16_u16(vmovl_u8(vrhadd_u8(vget_low_u8(split.val[0]), vget_low_u8(split.val[1]))));
+}
+
+// 16 pixels per iteration
+static void row_pair_neon(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                          uint8_t *u, uint8_t *v, int width, bool nv12) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t a = vld4q_u8(src0 + x * 4);
+        uint8x16x4_t b = vld4q_u8(src1 + x * 4);
+        
+        vst1q_u8(y0 + x, vcombine_u8(luma8_neon(vget_low_u8(a.val[0]), vget_low_u8(a.val[1]), vget_low_u8(a.val[2])),
+                                     luma8_neon(vget_high_u8(a.val[0]), vget_high_u8(a.val[1]), vget_high_u8(a.val[2]))));
+        vst1q_u8(y1 + x, vcombine_u8(luma8_neon(vget_low_u8(b.val[0]), vget_low_u8(b.val[1]), vget_low_u8(b.val[2])),
+                                     luma8_neon(vget_high_u8(b.val[0]), vget_high_u8(b.val[1]), vget_high_u8(b.val[2]))));
+        
+        int16x8_t cb = pair_average(a.val[0], b.val[0]);
+        int16x8_t cg = pair_average(a.val[1], b.val[1]);
+        int16x8_t cr = pair_average(a.val[2], b.val[2]);
+        uint8x8x2_t uv = { { chroma8_neon(cb, cg, cr, 56, -37, -19),
+                             chroma8_neon(cb, cg, cr, -9, -47, 56) } };
+        
+        if (nv12) {
+            vst2_u8(u + x, uv);
+        } else {
+            vst1_u8(u + x / 2, uv.val[0]);
+            vst1_u8(v + x / 2, uv.val[1]);
+        }
+    }
+    
+    if (x < width) {
+        row_pair_scalar(src0 + x * 4, src1 + x * 4, y0 + x, y1 + x,
+                        nv12 ? u + x : u + x / 2, nv12 ? v : v + x / 2, width - x, nv12);
+    }
+}
+
+#endif // CS_HAVE_NEON
+
+// Kernels compiled into this build are the only candidates
+bool colorspace_kernel_supported(CsKernel kernel) {
+    switch (kernel) {
+    case CS_KERNEL_SCALAR:
+        return true;
+#ifdef CS_HAVE_X86
+    case CS_KERNEL_SSE41:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.1");
+    case CS_KERNEL_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+#ifdef CS_HAVE_NEON
+    case CS_KERNEL_NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+// Fastest supported kernel
+CsKernel colorspace_detect(void) {
+    static const CsKernel preference[] = { CS_KERNEL_AVX2, CS_KERNEL_NEON, CS_KERNEL_SSE41 };
+    for (size_t i = 0; i < sizeof(preference) / sizeof(preference[0]); i++) {
+        if (colorspace_kernel_supported(preference[i])) return preference[i];
+    }
+    return CS_KERNEL_SCALAR;
+}
+
+const char* colorspace_kernel_name(CsKernel kernel) {
+    return kernel < CS_KERNEL_COUNT ? kernel_names[kernel] : "unknown";
+}
+
+// Row-pair function of a kernel (scalar when not built in)
+static RowPairFn kernel_fn(CsKernel kernel) {
+    switch (kernel) {
+#ifdef CS_HAVE_X86
+    case CS_KERNEL_SSE41: return row_pair_sse41;
+    case CS_KERNEL_AVX2:  return row_pair_avx2;
+#endif
+#ifdef CS_HAVE_NEON
+    case CS_KERNEL_NEON:  return row_pair_neon;
+#endif
+    default:              return row_pair_scalar;
+    }
+}
+
+static size_t align64(size_t n) {
+    return (n + 63) & ~(size_t)63;
+}
+
+// Plane layout shared by owned and borrowed images - returns the bytes it spans
+static size_t image_layout(YuvImage *image, CsFormat format, unsigned int width, unsigned int height,
+                           uint8_t *memory) {
+    unsigned int chroma_w = (width + 1) / 2;
+    unsigned int chroma_h = (height + 1) / 2;
+    image->format = format;
+    image->width = width;
+    image->height = height;
+    image->strides[0] = (int)align64(width);
+    image->strides[1] = (int)align64(format == CS_FORMAT_NV12 ? chroma_w * 2 : chroma_w);
+    image->strides[2] = format == CS_FORMAT_NV12 ? 0 : image->strides[1];
+    
+    size_t y_size = align64((size_t)image->strides[0] * height);
+    size_t c_size = align64((size_t)image->strides[1] * chroma_h);
+    image->planes[0] = memory;
+    image->planes[1] = memory ? memory + y_size : NULL;
+    image->planes[2] = memory && format == CS_FORMAT_I420 ? memory + y_size + c_size : NULL;
+    return y_size + (format == CS_FORMAT_NV12 ? c_size : 2 * c_size);
+}
+
+size_t colorspace_image_size(CsFormat format, unsigned int width, unsigned int height) {
+    YuvImage image;
+    return image_layout(&image, format, width, height, NULL);
+}
+
+// Allocate all planes in one 64-byte aligned block
+int colorspace_image_alloc(YuvImage *image, CsFormat format, unsigned int width, unsigned int height) {
+    if (!image || width == 0 || height == 0) return -1;
+    memset(image, 0, sizeof(*image));
+    
+    size_t total = colorspace_image_size(format, width, height);
+    image->storage = aligned_alloc(64, total);
+    if (!image->storage) return -1;
+    image_layout(image, format, width, height, image->storage);
+    return 0;
+}
+
+// Lay planes over caller-owned memory (64-byte aligned, colorspace_image_size bytes)
+int colorspace_image_wrap(YuvImage *image, CsFormat format, unsigned int width, unsigned int height,
+                          void *memory) {
+    if (!image || !memory || ((uintptr_t)memory & 63) || width == 0 || height == 0) return -1;
+    memset(image, 0, sizeof(*image));
+    image_layout(image, format, width, height, memory);
+    return 0;
+}
+
+void colorspace_image_free(YuvImage *image) {
+    if (!image) return;
+    free(image->storage);
+    memset(image, 0, sizeof(*image));
+}
+
+// Convert a w x h block whose top-left pixel is src into out at (dst_x, dst_y)
+// dst_x/dst_y must be even so the block maps onto whole chroma samples
+void colorspace_convert_block(CsKernel kernel, const uint8_t *src, int stride, int dst_x, int dst_y,
+                              int w, int h, YuvImage *out) {
+    RowPairFn fn = kernel_fn(kernel);
+    bool nv12 = out->format == CS_FORMAT_NV12;
+    
+    for (int row = 0; row < h; row += 2) {
+        const uint8_t *src0 = src + (size_t)row * stride;
+        const uint8_t *src1 = row + 1 < h ? src0 + stride : src0;    // Odd height: repeat the last row
+        
+        int y = dst_y + row;
+        uint8_t *y0 = out->planes[0] + (size_t)y * out->strides[0] + dst_x;
+        uint8_t *y1 = row + 1 < h ? y0 + out->strides[0] : y0;
+        uint8_t *u = out->planes[1] + (size_t)(y / 2) * out->strides[1] + (nv12 ? dst_x : dst_x / 2);
+        uint8_t *v = nv12 ? NULL : out->planes[2] + (size_t)(y / 2) * out->strides[2] + dst_x / 2;
+        
+        fn(src0, src1, y0, y1, u, v, w, nv12);
+    }
+}
+
+// Clip rect to the frame and widen it to even coordinates
+static bool clip_rect(const CsRect *rect, const YuvImage *out, int *x, int *y, int *w, int *h) {
+    int x0 = rect ? rect->x : 0;
+    int y0 = rect ? rect->y : 0;
+    int x1 = rect ? rect->x + rect->width : (int)out->width;
+    int y1 = rect ? rect->y + rect->height : (int)out->height;
+    
+    x0 = x0 < 0 ? 0 : x0 & ~1;
+    y0 = y0 < 0 ? 0 : y0 & ~1;
+    x1 = (x1 + 1) & ~1;
+    y1 = (y1 + 1) & ~1;
+    if (x1 > (int)out->width) x1 = out->width;
+    if (y1 > (int)out->height) y1 = out->height;
+    if (x1 <= x0 || y1 <= y0) return false;
+    
+    *x = x0;
+    *y = y0;
+    *w = x1 - x0;
+    *h = y1 - y0;
+    return true;
+}
+
+// Convert part of a full BGRX frame
+int colorspace_convert(CsKernel kernel, const uint8_t *bgrx, int stride,
+                       const CsRect *rect, YuvImage *out) {
+    if (!bgrx || !out || !out->planes[0]) return -1;
+    
+    int x, y, w, h;
+    if (!clip_rect(rect, out, &x, &y, &w, &h)) return 0;
+    colorspace_convert_block(kernel, bgrx + (size_t)y * stride + (size_t)x * 4, stride, x, y, w, h, out);
+    return 0;
+}
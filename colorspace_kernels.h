@@ -0,0 +1,56 @@
+#ifndef COLORSPACE_KERNELS_H
+#define COLORSPACE_KERNELS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// BGRX (32-bit ZPixmap, little endian) to NV12/I420, BT.601 limited range.
+// Kernels for AVX2, SSE4.1 and NEON are picked at runtime; all of them produce
+// bit-identical output to the scalar reference, which stays available for
+// checking them. Chroma is the rounded average of each 2x2 block. Plain C
+// with no X or pipeline types, so the kernels build and test on their own.
+
+typedef enum {
+    CS_FORMAT_NV12,         // Y plane + interleaved UV plane
+    CS_FORMAT_I420          // Y, U and V planes
+} CsFormat;
+
+typedef enum {
+    CS_KERNEL_SCALAR,       // Portable reference
+    CS_KERNEL_SSE41,
+    CS_KERNEL_AVX2,
+    CS_KERNEL_NEON,
+    CS_KERNEL_COUNT
+} CsKernel;
+
+// Same layout as XRectangle, so damage rectangles can be passed as they are
+typedef struct {
+    short x, y;
+    unsigned short width, height;
+} CsRect;
+
+// Destination frame - planes[2]/strides[2] unused for NV12
+typedef struct {
+    CsFormat format;
+    unsigned int width;
+    unsigned int height;
+    uint8_t *planes[3];
+    int strides[3];
+    void *storage;          // Owned allocation behind the planes (NULL if borrowed)
+} YuvImage;
+
+CsKernel colorspace_detect(void);                   // Fastest kernel this CPU supports
+bool colorspace_kernel_supported(CsKernel kernel);
+const char* colorspace_kernel_name(CsKernel kernel);
+int colorspace_image_alloc(YuvImage *image, CsFormat format,
+                           unsigned int width, unsigned int height);    // 64-byte aligned planes - returns 0 on success
+size_t colorspace_image_size(CsFormat format, unsigned int width, unsigned int height); // Bytes an image spans
+int colorspace_image_wrap(YuvImage *image, CsFormat format, unsigned int width, unsigned int height,
+                          void *memory);                                // Borrow 64-byte aligned memory - returns 0 on success
+void colorspace_image_free(YuvImage *image);        // Safe on zeroed image (borrowed memory is left alone)
+int colorspace_convert(CsKernel kernel, const uint8_t *bgrx, int stride,
+                       const CsRect *rect, YuvImage *out);              // Convert rect of a BGRX frame (NULL = all) into the same place in out
+void colorspace_convert_block(CsKernel kernel, const uint8_t *src, int stride, int dst_x, int dst_y,
+                              int w, int h, YuvImage *out);             // w x h pixels from src into out at even (dst_x, dst_y), no clipping
+#endif
@@ -0,0 +1,177 @@
+#include "command.h"
+#include "profile.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Parse a mode ID argument - either a plain number or a $N line reference
+static int parse_mode_arg(const char *arg, Command *cmd) {
+    char *end = NULL;
+    
+    if (arg[0] == '$') {
+        long ref = strtol(arg + 1, &end, 10);
+        if (*end != '\0' || ref <= 0) return -1;
+        cmd->mode_ref = (int)ref;
+        return 0;
+    }
+    
+    cmd->mode_id = (RRMode)strtoul(arg, &end, 10);
+    return (*end == '\0' && cmd->mode_id != 0) ? 0 : -1;
+}
+
+// Parse one command line (modified in place by strtok_r)
+int command_parse(char *line, Command *cmd) {
+    if (!line || !cmd) return -1;
+    memset(cmd, 0, sizeof(*cmd));
+    
+    char *saveptr = NULL;
+    char *verb = strtok_r(line, " \t\r\n", &saveptr);
+    if (!verb || verb[0] == '#') return 0;    // CMD_NONE
+    
+    char *arg1 = strtok_r(NULL, " \t\r\n", &saveptr);
+    char *arg2 = strtok_r(NULL, " \t\r\n", &saveptr);
+    char *arg3 = strtok_r(NULL, " \t\r\n", &saveptr);
+    
+    if (strcmp(verb, "quit") == 0) {
+        cmd->type = CMD_QUIT;
+        return 0;
+    }
+    
+    if (strcmp(verb, "list") == 0) {
+        cmd->type = CMD_LIST;
+        return 0;
+    }
+    
+    if (strcmp(verb, "gc") == 0) {
+        cmd->type = CMD_GC;
+        return 0;
+    }
+    
+    if (strcmp(verb, "timing") == 0) {
+        cmd->type = CMD_TIMING;
+        return 0;
+    }
+    
+    if (strcmp(verb, "create") == 0 && arg1) {
+        cmd->type = CMD_CREATE;
+        cmd->spec.reduced_blanking = arg2 && strcmp(arg2, "rb") == 0;
+        return parse_mode_spec(arg1, &cmd->spec.width, &cmd->spec.height, &cmd->spec.refresh_rate);
+    }
+    
+    if (strcmp(verb, "provision") == 0 && arg1 && arg2) {
+        cmd->type = CMD_PROVISION;
+        snprintf(cmd->output, sizeof(cmd->output), "%s", arg1);
+        if (arg3) snprintf(cmd->anchor, sizeof(cmd->anchor), "%s", arg3);
+        return parse_mode_spec(arg2, &cmd->spec.width, &cmd->spec.height, &cmd->spec.refresh_rate);
+    }
+    
+    if (strcmp(verb, "connect") == 0 && arg1 && arg2) {
+        cmd->type = CMD_CONNECT;
+        snprintf(cmd->device, sizeof(cmd->device), "%s", arg1);
+        snprintf(cmd->output, sizeof(cmd->output), "%s", arg2);
+        if (arg3) snprintf(cmd->anchor, sizeof(cmd->anchor), "%s", arg3);
+        return 0;
+    }
+    
+    if ((strcmp(verb, "add") == 0 || strcmp(verb, "remove") == 0) && arg1 && arg2) {
+        cmd->type = (verb[0] == 'a') ? CMD_ADD : CMD_REMOVE;
+        snprintf(cmd->output, sizeof(cmd->output), "%s", arg1);
+        return parse_mode_arg(arg2, cmd);
+    }
+    
+    if (strcmp(verb, "delete") == 0 && arg1) {
+        cmd->type = CMD_DELETE;
+        return parse_mode_arg(arg1, cmd);
+    }
+    
+    fprintf(stderr, "Unknown or incomplete command: %s\n", verb);
+    return -1;
+}
+
+// Print the cached topology (no X round trip)
+static int command_list(DisplayManager *dm) {
+    int connected = dm_ensure_screens(dm);
+    if (connected < 0) return -1;
+    
+    printf("Found %d total output%s, %d connected\n",
+           dm->screen_count, dm->screen_count == 1 ? "" : "s", connected);
+    dm_print_screens(dm);
+    return 0;
+}
+
+// Execute a parsed command - mode_ref must already be resolved into mode_id
+int command_execute(DisplayManager *dm, const Command *cmd, RRMode *created_mode) {
+    if (!dm || !cmd) return -1;
+    if (created_mode) *created_mode = 0;
+    
+    switch (cmd->type) {
+    case CMD_NONE:
+    case CMD_QUIT:
+        return 0;
+        
+    case CMD_LIST:
+        return command_list(dm);
+        
+    case CMD_CREATE: {
+        RRMode mode_id = mode_create_cvt(dm, cmd->spec.width, cmd->spec.height,
+                                         cmd->spec.refresh_rate, cmd->spec.reduced_blanking);
+        if (created_mode) *created_mode = mode_id;
+        return mode_id != 0 ? 0 : -1;
+    }
+        
+    case CMD_PROVISION: {
+        RRMode mode_id = mode_provision(dm, cmd->output, &cmd->spec,
+                                        cmd->anchor[0] ? cmd->anchor : NULL);
+        if (created_mode) *created_mode = mode_id;
+        return mode_id != 0 ? 0 : -1;
+    }
+        
+    case CMD_CONNECT: {
+        RRMode mode_id = profile_connect(dm, dm->profiles, cmd->device, cmd->output,
+                                         cmd->anchor[0] ? cmd->anchor : NULL);
+        if (created_mode) *created_mode = mode_id;
+        return mode_id != 0 ? 0 : -1;
+    }
+        
+    case CMD_GC:
+        return mode_gc(dm) >= 0 ? 0 : -1;
+        
+    case CMD_TIMING:
+        if (!timing_enabled()) {
+            fprintf(stderr, "Timing is not enabled\n");
+            return -1;
+        }
+        timing_print_histograms(stdout);
+        return 0;
+        
+    case CMD_ADD:
+        return mode_add_to_output(dm, cmd->output, cmd->mode_id);
+        
+    case CMD_REMOVE:
+        return mode_remove_from_output(dm, cmd->output, cmd->mode_id);
+        
+    case CMD_DELETE:
+        return mode_delete_from_xrandr(dm, cmd->mode_id);
+    }
+    
+    return -1;
+}
+
+// Command verb as written in the command language
+const char* command_name(CommandType type) {
+    switch (type) {
+    case CMD_LIST:      return "list";
+    case CMD_CREATE:    return "create";
+    case CMD_ADD:       return "add";
+    case CMD_REMOVE:    return "remove";
+    case CMD_DELETE:    return "delete";
+    case CMD_PROVISION: return "provision";
+    case CMD_CONNECT:   return "connect";
+    case CMD_GC:        return "gc";
+    case CMD_TIMING:    return "timing";
+    case CMD_QUIT:      return "quit";
+    case CMD_NONE:      break;
+    }
+    return "";
+}
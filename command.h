@@ -0,0 +1,42 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include "display_manager.h"
+#include "mode_manager.h"
+
+// Line-based command language shared by daemon and batch mode:
+//   list | create WxH@R [rb] | add OUTPUT ID | remove OUTPUT ID | delete ID |
+//   provision OUTPUT WxH@R [RIGHT_OF] | connect DEVICE OUTPUT [RIGHT_OF] | gc | timing | quit
+// connect provisions OUTPUT with the prewarmed mode of DEVICE's profile (see profile.h).
+// In batch mode a mode ID may be written as $N to refer to the mode created on line N.
+
+typedef enum {
+    CMD_NONE,           // Blank line or comment
+    CMD_LIST,
+    CMD_CREATE,
+    CMD_ADD,
+    CMD_REMOVE,
+    CMD_DELETE,
+    CMD_PROVISION,
+    CMD_CONNECT,        // Provision from a device profile
+    CMD_GC,
+    CMD_TIMING,         // Print latency histograms
+    CMD_QUIT
+} CommandType;
+
+typedef struct {
+    CommandType type;
+    char output[32];        // Target output (add/remove/provision)
+    char anchor[32];        // Optional right-of output (provision/connect)
+    char device[32];        // Tablet profile (connect)
+    ModeSpec spec;          // Mode to create (create/provision)
+    RRMode mode_id;         // Mode to act on (add/remove/delete)
+    int mode_ref;           // Line number referenced by $N instead of mode_id (0 = none)
+} Command;
+
+int command_parse(char *line, Command *cmd);                   // Parse line in place - returns 0 on success, -1 on syntax error
+int command_execute(DisplayManager *dm, const Command *cmd,
+                    RRMode *created_mode);                     // Run command - returns 0 on success, -1 on failure
+const char* command_name(CommandType type);
+
+#endif
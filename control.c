@@ -0,0 +1,693 @@
+#define _GNU_SOURCE     // accept4
+#include "control.h"
+#include "command.h"
+#include "mode_manager.h"
+#include "profile.h"
+#include "timing.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define CONTROL_JSON_FIELDS 8           // Fields a request object may have
+
+// Growable byte buffer
+typedef struct {
+    char *data;
+    size_t used;
+    size_t capacity;
+} Buffer;
+
+typedef struct {
+    int fd;                             // -1 = free slot
+    bool subscribed;
+    bool binary_events;                 // Encoding of the subscribe request
+    bool dead;                          // Protocol error or too far behind - drop after this pass
+    char in[CONTROL_INPUT_MAX];
+    size_t in_used;
+    Buffer out;                         // Replies not yet written
+} ControlClient;
+
+struct Control {
+    int listen_fd;
+    char path[108];                     // sizeof(sockaddr_un.sun_path)
+    ControlClient clients[CONTROL_MAX_CLIENTS];
+    Buffer json_event;                  // Scratch for topology events
+    Buffer binary_event;
+};
+
+// What a request did, for either encoding's reply
+typedef struct {
+    bool ok;
+    const char *error;
+    bool outputs;                       // Reply carries the output list
+    bool has_mode;                      // Reply carries mode_id
+    RRMode mode_id;
+    bool has_deleted;                   // Reply carries deleted (gc)
+    int deleted;
+} ControlOutcome;
+
+// One "key": value pair of a flat JSON object, value unescaped
+typedef struct {
+    char key[16];
+    char value[64];
+    bool string;
+} JsonField;
+
+static int buffer_reserve(Buffer *buffer, size_t extra) {
+    if (buffer->used + extra <= buffer->capacity) return 0;
+    size_t capacity = buffer->capacity ? buffer->capacity : 1024;
+    while (capacity < buffer->used + extra) capacity *= 2;
+    char *data = realloc(buffer->data, capacity);
+    if (!data) return -1;
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+static int buffer_append(Buffer *buffer, const void *data, size_t size) {
+    if (buffer_reserve(buffer, size) != 0) return -1;
+    memcpy(buffer->data + buffer->used, data, size);
+    buffer->used += size;
+    return 0;
+}
+
+static int buffer_printf(Buffer *buffer, const char *format, ...) {
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (length < 0 || length >= (int)sizeof(text)) return -1;
+    return buffer_append(buffer, text, (size_t)length);
+}
+
+// JSON string literal, quotes included
+static int buffer_json_string(Buffer *buffer, const char *text) {
+    if (buffer_append(buffer, "\"", 1) != 0) return -1;
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        int result;
+        if (*p == '"' || *p == '\\') result = buffer_printf(buffer, "\\%c", *p);
+        else if (*p < 0x20) result = buffer_printf(buffer, "\\u%04x", *p);
+        else result = buffer_append(buffer, p, 1);
+        if (result != 0) return -1;
+    }
+    return buffer_append(buffer, "\"", 1);
+}
+
+// Refresh of the mode driving a screen in millihertz (0 when inactive)
+static uint32_t screen_refresh_mhz(DisplayManager *dm, const ScreenInfo *screen) {
+    ModeEntry *mode = screen->mode_id ? dm_find_mode(dm, screen->mode_id) : NULL;
+    return mode ? (uint32_t)(dm_mode_refresh(mode) * 1000.0 + 0.5) : 0;
+}
+
+// "outputs":[...] from the cached topology
+static int emit_outputs_json(Buffer *buffer, DisplayManager *dm) {
+    if (buffer_printf(buffer, "\"outputs\":[") != 0) return -1;
+    for (int i = 0; i < dm->screen_count; i++) {
+        const ScreenInfo *screen = &dm->screens[i];
+        uint32_t refresh = screen_refresh_mhz(dm, screen);
+        if (buffer_printf(buffer, "%s{\"name\":", i ? "," : "") != 0 ||
+            buffer_json_string(buffer, screen->name) != 0 ||
+            buffer_printf(buffer, ",\"output_id\":%lu,\"crtc_id\":%lu,\"mode_id\":%lu",
+                          (unsigned long)screen->output_id, (unsigned long)screen->crtc_id,
+                          (unsigned long)screen->mode_id) != 0 ||
+            buffer_printf(buffer, ",\"x\":%d,\"y\":%d,\"width\":%u,\"height\":%u,\"refresh\":%u.%03u",
+                          screen->x, screen->y, screen->width, screen->height,
+                          refresh / 1000, refresh % 1000) != 0 ||
+            buffer_printf(buffer, ",\"connected\":%s,\"primary\":%s}",
+                          screen->connected ? "true" : "false", screen->primary ? "true" : "false") != 0) {
+            return -1;
+        }
+    }
+    return buffer_printf(buffer, "]");
+}
+
+// uint16 count + ControlOutput records
+static int emit_outputs_binary(Buffer *buffer, DisplayManager *dm) {
+    uint16_t count = htons((uint16_t)dm->screen_count);
+    if (buffer_append(buffer, &count, sizeof(count)) != 0) return -1;
+    for (int i = 0; i < dm->screen_count; i++) {
+        const ScreenInfo *screen = &dm->screens[i];
+        ControlOutput record;
+        memset(&record, 0, sizeof(record));
+        snprintf(record.name, sizeof(record.name), "%s", screen->name);
+        record.output_id = htonl((uint32_t)screen->output_id);
+        record.crtc_id = htonl((uint32_t)screen->crtc_id);
+        record.mode_id = htonl((uint32_t)screen->mode_id);
+        record.x = (int32_t)htonl((uint32_t)screen->x);
+        record.y = (int32_t)htonl((uint32_t)screen->y);
+        record.width = htonl(screen->width);
+        record.height = htonl(screen->height);
+        record.refresh_mhz = htonl(screen_refresh_mhz(dm, screen));
+        record.connected = screen->connected;
+        record.primary = screen->primary;
+        if (buffer_append(buffer, &record, sizeof(record)) != 0) return -1;
+    }
+    return 0;
+}
+
+// Header with its length patched in once the payload is written
+static size_t begin_binary(Buffer *buffer, uint8_t op, uint32_t id) {
+    ControlHeader header = {
+        .magic = htons(CONTROL_MAGIC),
+        .version = CONTROL_VERSION,
+        .op = op,
+        .id = htonl(id),
+        .length = 0,
+    };
+    size_t start = buffer->used;
+    return buffer_append(buffer, &header, sizeof(header)) == 0 ? start : (size_t)-1;
+}
+
+static void end_binary(Buffer *buffer, size_t start) {
+    ControlHeader *header = (ControlHeader *)(buffer->data + start);
+    header->length = htonl((uint32_t)(buffer->used - start - sizeof(ControlHeader)));
+}
+
+static int reply_json(Buffer *buffer, DisplayManager *dm, uint32_t id, const ControlOutcome *outcome) {
+    if (buffer_printf(buffer, "{\"id\":%u,\"ok\":%s", id, outcome->ok ? "true" : "false") != 0) return -1;
+    if (!outcome->ok) {
+        if (buffer_printf(buffer, ",\"error\":") != 0 || buffer_json_string(buffer, outcome->error) != 0) return -1;
+    }
+    if (outcome->has_mode && buffer_printf(buffer, ",\"mode_id\":%lu", (unsigned long)outcome->mode_id) != 0) return -1;
+    if (outcome->has_deleted && buffer_printf(buffer, ",\"deleted\":%d", outcome->deleted) != 0) return -1;
+    if (outcome->outputs && (buffer_printf(buffer, ",") != 0 || emit_outputs_json(buffer, dm) != 0)) return -1;
+    return buffer_printf(buffer, "}\n");
+}
+
+static int reply_binary(Buffer *buffer, DisplayManager *dm, uint32_t id, const ControlOutcome *outcome) {
+    size_t start = begin_binary(buffer, outcome->ok ? CONTROL_REPLY_OK : CONTROL_REPLY_ERROR, id);
+    if (start == (size_t)-1) return -1;
+    
+    int result = 0;
+    if (!outcome->ok) {
+        result = buffer_append(buffer, outcome->error, strlen(outcome->error));
+    } else if (outcome->outputs) {
+        result = emit_outputs_binary(buffer, dm);
+    } else if (outcome->has_mode || outcome->has_deleted) {
+        uint32_t value = htonl(outcome->has_mode ? (uint32_t)outcome->mode_id : (uint32_t)outcome->deleted);
+        result = buffer_append(buffer, &value, sizeof(value));
+    }
+    if (result != 0) return -1;
+    end_binary(buffer, start);
+    return 0;
+}
+
+static const char* skip_space(const char *p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+    return p;
+}
+
+// Parse {"key": value, ...} with string, number, true/false/null values
+static int parse_json_object(const char *text, JsonField *fields, int max_fields) {
+    const char *p = text;
+    int count = 0;
+    
+    p = skip_space(p);
+    if (*p++ != '{') return -1;
+    p = skip_space(p);
+    if (*p == '}') return 0;
+    
+    for (;;) {
+        if (count == max_fields) return -1;
+        JsonField *field = &fields[count++];
+        memset(field, 0, sizeof(*field));
+        
+        // Key and value are both scanned by the same loop: pass 0 key, pass 1 value
+        for (int pass = 0; pass < 2; pass++) {
+            char *out = pass ? field->value : field->key;
+            size_t size = pass ? sizeof(field->value) : sizeof(field->key);
+            size_t length = 0;
+            
+            p = skip_space(p);
+            if (*p == '"') {
+                p++;
+                while (*p != '"') {
+                    char c = *p++;
+                    if (c == '\0') return -1;
+                    if (c == '\\') {
+                        c = *p++;
+                        if (c == 'n') c = '\n';
+                        else if (c == 't') c = '\t';
+                        else if (c != '"' && c != '\\' && c != '/') return -1;
+                    }
+                    if (length + 1 >= size) return -1;
+                    out[length++] = c;
+                }
+                p++;
+                if (pass) field->string = true;
+            } else if (pass) {
+                while (*p && strchr(",} \t\r", *p) == NULL) {
+                    if (length + 1 >= size) return -1;
+                    out[length++] = *p++;
+                }
+                if (length == 0) return -1;
+            } else {
+                return -1;
+            }
+            out[length] = '\0';
+        
+            p = skip_space(p);
+            if (pass == 0 && *p++ != ':') return -1;
+        }
+    
+        if (*p == '}') return count;
+        if (*p++ != ',') return -1;
+    }
+}
+
+static const JsonField* json_field(const JsonField *fields, int count, const char *key) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(fields[i].key, key) == 0) return &fields[i];
+    }
+    return NULL;
+}
+
+static unsigned long json_number(const JsonField *field) {
+    if (!field || field->string) return 0;
+    char *end = NULL;
+    unsigned long value = strtoul(field->value, &end, 10);
+    return *end == '\0' ? value : 0;
+}
+
+static int op_from_name(const char *name) {
+    static const char *names[] = {
+        [CONTROL_OP_LIST] = "list", [CONTROL_OP_CREATE] = "create", [CONTROL_OP_ADD] = "add",
+        [CONTROL_OP_REMOVE] = "remove", [CONTROL_OP_DELETE] = "delete",
+        [CONTROL_OP_PROVISION] = "provision", [CONTROL_OP_GC] = "gc", [CONTROL_OP_SUBSCRIBE] = "subscribe",
+        [CONTROL_OP_CONNECT] = "connect",
+    };
+    for (int op = CONTROL_OP_LIST; op <= CONTROL_OP_CONNECT; op++) {
+        if (strcmp(name, names[op]) == 0) return op;
+    }
+    return 0;
+}
+
+// Run one request - its arguments are already in cmd, the command.h form
+static ControlOutcome execute(ControlClient *client, DisplayManager *dm, int op, const Command *cmd, bool binary) {
+    ControlOutcome outcome = { .ok = false, .error = "unknown op" };
+
+    switch (op) {
+    case CONTROL_OP_LIST:
+        if (dm_ensure_screens(dm) < 0) {
+            outcome.error = "enumeration failed";
+            return outcome;
+        }
+        outcome.outputs = true;
+        break;
+
+    case CONTROL_OP_SUBSCRIBE:
+        client->subscribed = true;
+        client->binary_events = binary;
+        break;
+
+    case CONTROL_OP_GC:
+        outcome.deleted = mode_gc(dm);
+        if (outcome.deleted < 0) {
+            outcome.error = "gc failed";
+            return outcome;
+        }
+        outcome.has_deleted = true;
+        break;
+
+    case CONTROL_OP_CREATE:
+    case CONTROL_OP_PROVISION:
+        if (cmd->spec.width == 0 || cmd->spec.height == 0 || cmd->spec.refresh_rate <= 0) {
+            outcome.error = "missing or invalid mode";
+            return outcome;
+        }
+        // fall through
+    case CONTROL_OP_ADD:
+    case CONTROL_OP_REMOVE:
+    case CONTROL_OP_DELETE:
+    case CONTROL_OP_CONNECT:
+        if (op != CONTROL_OP_CREATE && op != CONTROL_OP_DELETE && !dm_find_screen(dm, cmd->output)) {
+            outcome.error = "unknown output";
+            return outcome;
+        }
+        if (op == CONTROL_OP_CONNECT && !profile_find(dm->profiles, cmd->device)) {
+            outcome.error = "unknown device";
+            return outcome;
+        }
+        if ((op == CONTROL_OP_ADD || op == CONTROL_OP_REMOVE || op == CONTROL_OP_DELETE) && cmd->mode_id == 0) {
+            outcome.error = "missing mode_id";
+            return outcome;
+        }
+        if (command_execute(dm, cmd, &outcome.mode_id) != 0) {
+            outcome.error = op == CONTROL_OP_PROVISION || op == CONTROL_OP_CONNECT ? "provision failed" :
+                            op == CONTROL_OP_CREATE ? "mode creation failed" : "mode operation failed";
+            return outcome;
+        }
+        outcome.has_mode = op == CONTROL_OP_CREATE || op == CONTROL_OP_PROVISION || op == CONTROL_OP_CONNECT;
+        break;
+
+    default:
+        return outcome;
+    }
+    outcome.ok = true;
+    outcome.error = NULL;
+    return outcome;
+}
+
+static const CommandType command_types[] = {
+    [CONTROL_OP_CREATE] = CMD_CREATE, [CONTROL_OP_ADD] = CMD_ADD, [CONTROL_OP_REMOVE] = CMD_REMOVE,
+    [CONTROL_OP_DELETE] = CMD_DELETE, [CONTROL_OP_PROVISION] = CMD_PROVISION, [CONTROL_OP_GC] = CMD_NONE,
+    [CONTROL_OP_SUBSCRIBE] = CMD_NONE, [CONTROL_OP_CONNECT] = CMD_CONNECT,
+};
+
+static CommandType command_type(int op) {
+    return op >= CONTROL_OP_CREATE && op <= CONTROL_OP_CONNECT ? command_types[op] : CMD_NONE;
+}
+
+// One JSON request line - malformed ones get an error reply, not a disconnect
+static int serve_json(ControlClient *client, DisplayManager *dm, const char *line) {
+    JsonField fields[CONTROL_JSON_FIELDS];
+    int count = parse_json_object(line, fields, CONTROL_JSON_FIELDS);
+    uint32_t id = count > 0 ? (uint32_t)json_number(json_field(fields, count, "id")) : 0;
+    const JsonField *op_field = count > 0 ? json_field(fields, count, "op") : NULL;
+
+    ControlOutcome outcome = { .ok = false, .error = "malformed request" };
+    int op = op_field && op_field->string ? op_from_name(op_field->value) : 0;
+    if (count > 0 && op_field && !op) outcome.error = "unknown op";
+
+    if (op) {
+        Command cmd;
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.type = command_type(op);
+        const JsonField *output = json_field(fields, count, "output");
+        const JsonField *right_of = json_field(fields, count, "right_of");
+        const JsonField *device = json_field(fields, count, "device");
+        const JsonField *mode = json_field(fields, count, "mode");
+        const JsonField *rb = json_field(fields, count, "rb");
+        if (output) snprintf(cmd.output, sizeof(cmd.output), "%s", output->value);
+        if (right_of) snprintf(cmd.anchor, sizeof(cmd.anchor), "%s", right_of->value);
+        if (device) snprintf(cmd.device, sizeof(cmd.device), "%s", device->value);
+        cmd.mode_id = (RRMode)json_number(json_field(fields, count, "mode_id"));
+        cmd.spec.reduced_blanking = rb && !rb->string && strcmp(rb->value, "true") == 0;
+        if (mode && parse_mode_spec(mode->value, &cmd.spec.width, &cmd.spec.height, &cmd.spec.refresh_rate) != 0) {
+            outcome.error = "invalid mode";
+        } else {
+            outcome = execute(client, dm, op, &cmd, false);
+        }
+    }
+    return reply_json(&client->out, dm, id, &outcome);
+}
+
+// One binary request, header already validated
+static int serve_binary(ControlClient *client, DisplayManager *dm, const ControlHeader *header, const uint8_t *payload) {
+    uint32_t id = ntohl(header->id);
+    uint32_t length = ntohl(header->length);
+
+    Command cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type = command_type(header->op);
+    if (length >= CONTROL_REQUEST_V1_SIZE) {
+        // Older clients stop before device - the missing tail reads as zero
+        ControlRequest request;
+        memset(&request, 0, sizeof(request));
+        memcpy(&request, payload, length < sizeof(request) ? length : sizeof(request));
+        snprintf(cmd.output, sizeof(cmd.output), "%.*s", (int)sizeof(request.output), request.output);
+        snprintf(cmd.anchor, sizeof(cmd.anchor), "%.*s", (int)sizeof(request.right_of), request.right_of);
+        snprintf(cmd.device, sizeof(cmd.device), "%.*s", (int)sizeof(request.device), request.device);
+        cmd.mode_id = ntohl(request.mode_id);
+        cmd.spec.width = ntohs(request.width);
+        cmd.spec.height = ntohs(request.height);
+        cmd.spec.refresh_rate = ntohl(request.refresh_mhz) / 1000.0;
+        cmd.spec.reduced_blanking = request.reduced_blanking != 0;
+    }
+
+    ControlOutcome outcome = execute(client, dm, header->op, &cmd, true);
+    return reply_binary(&client->out, dm, id, &outcome);
+}
+
+// Apply topology changes that arrived before a request, as the stdin loop does
+static void catch_up(Control *control, DisplayManager *dm) {
+    if (dm_process_events(dm) > 0) control_notify_topology(control, dm);
+}
+
+// Serve every complete request in the client's buffer, in order
+static int drain_requests(Control *control, ControlClient *client, DisplayManager *dm) {
+    size_t start = 0;
+    int served = 0;
+
+    while (!client->dead && start < client->in_used) {
+        char *message = client->in + start;
+        size_t available = client->in_used - start;
+
+        if (strchr(" \t\r\n", *message)) {
+            start++;                    // Blank lines between JSON requests
+            continue;
+        }
+
+        if (*message == '{') {
+            char *newline = memchr(message, '\n', available);
+            if (!newline) break;
+            *newline = '\0';
+            catch_up(control, dm);
+            uint64_t started = timing_now();
+            if (serve_json(client, dm, message) != 0) client->dead = true;
+            timing_record(TIMING_COMMAND, started);
+            served++;
+            start += (size_t)(newline - message) + 1;
+            continue;
+        }
+    
+        if (available < sizeof(ControlHeader)) break;
+        ControlHeader header;
+        memcpy(&header, message, sizeof(header));
+        uint32_t length = ntohl(header.length);
+        if (ntohs(header.magic) != CONTROL_MAGIC || header.version != CONTROL_VERSION ||
+            length > CONTROL_INPUT_MAX - sizeof(ControlHeader)) {
+            fprintf(stderr, "Control: bad request header, dropping client\n");
+            client->dead = true;            // No way to find the next message
+            break;
+        }
+        if (available < sizeof(ControlHeader) + length) break;
+        catch_up(control, dm);
+        uint64_t started = timing_now();
+        if (serve_binary(client, dm, &header, (const uint8_t *)message + sizeof(header)) != 0) client->dead = true;
+        timing_record(TIMING_COMMAND, started);
+        served++;
+        start += sizeof(ControlHeader) + length;
+    }
+
+    memmove(client->in, client->in + start, client->in_used - start);
+    client->in_used -= start;
+    if (client->in_used == sizeof(client->in)) {
+        fprintf(stderr, "Control: request too long, dropping client\n");
+        client->dead = true;
+    }
+    return served;
+}
+
+// Write as much queued output as the socket takes
+static void flush_client(ControlClient *client) {
+    size_t written = 0;
+    while (written < client->out.used) {
+        ssize_t n = send(client->fd, client->out.data + written, client->out.used - written,
+                         MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) client->dead = true;
+            break;
+        }
+        written += (size_t)n;
+    }
+    memmove(client->out.data, client->out.data + written, client->out.used - written);
+    client->out.used -= written;
+    if (client->out.used > CONTROL_OUTPUT_MAX) {
+        fprintf(stderr, "Control: client is not reading its replies, dropping it\n");
+        client->dead = true;
+    }
+}
+
+static void drop_client(ControlClient *client) {
+    close(client->fd);
+    free(client->out.data);
+    memset(client, 0, sizeof(*client));
+    client->fd = -1;
+}
+
+static void accept_clients(Control *control) {
+    for (;;) {
+        int fd = accept4(control->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("Control: accept");
+            return;
+        }
+        ControlClient *slot = NULL;
+        for (int i = 0; i < CONTROL_MAX_CLIENTS && !slot; i++) {
+            if (control->clients[i].fd < 0) slot = &control->clients[i];
+        }
+        if (!slot) {
+            fprintf(stderr, "Control: %d clients connected, refusing another\n", CONTROL_MAX_CLIENTS);
+            close(fd);
+            continue;
+        }
+        slot->fd = fd;
+    }
+}
+
+// Remove a socket file left by an earlier run, which would make bind fail -
+// returns -1 if path is something else or a daemon still answers on it
+static int remove_stale_socket(const struct sockaddr_un *addr) {
+    struct stat st;
+    if (lstat(addr->sun_path, &st) != 0) return errno == ENOENT ? 0 : -1;
+    if (!S_ISSOCK(st.st_mode)) {
+        fprintf(stderr, "Control: %s exists and is not a socket, not replacing it\n", addr->sun_path);
+        return -1;
+    }
+
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe < 0) return -1;
+    bool live = connect(probe, (const struct sockaddr *)addr, sizeof(*addr)) == 0;
+    close(probe);
+    if (live) {
+        fprintf(stderr, "Control: another daemon is already listening on %s\n", addr->sun_path);
+        return -1;
+    }
+    return unlink(addr->sun_path) == 0 || errno == ENOENT ? 0 : -1;
+}
+
+Control* control_open(const char *path) {
+    if (!path) return NULL;
+
+    Control *control = calloc(1, sizeof(Control));
+    if (!control) return NULL;
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) control->clients[i].fd = -1;
+    if (snprintf(control->path, sizeof(control->path), "%s", path) >= (int)sizeof(control->path)) {
+        fprintf(stderr, "Control: socket path %s is too long\n", path);
+        free(control);
+        return NULL;
+    }
+
+    control->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (control->listen_fd < 0) {
+        perror("Control: socket");
+        free(control);
+        return NULL;
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    memcpy(addr.sun_path, control->path, sizeof(control->path));
+    if (remove_stale_socket(&addr) != 0) {
+        control->path[0] = '\0';            // Not ours to unlink
+        control_close(control);
+        return NULL;
+    }
+
+    // The socket drives the X server as this user - owner only (0600)
+    mode_t previous_umask = umask(0177);
+    int bound = bind(control->listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(previous_umask);
+    if (bound != 0 || listen(control->listen_fd, CONTROL_MAX_CLIENTS) != 0) {
+        fprintf(stderr, "Control: cannot listen on %s: %s\n", control->path, strerror(errno));
+        if (bound != 0) control->path[0] = '\0';   // Not ours to unlink
+        control_close(control);
+        return NULL;
+    }
+    return control;
+}
+
+// Listening socket first, then every client - wanting POLLOUT while replies are queued
+int control_poll_fds(Control *control, struct pollfd *fds, int max) {
+    if (!control || max < 1) return 0;
+
+    int count = 0;
+    fds[count++] = (struct pollfd){ .fd = control->listen_fd, .events = POLLIN };
+    for (int i = 0; i < CONTROL_MAX_CLIENTS && count < max; i++) {
+        ControlClient *client = &control->clients[i];
+        if (client->fd < 0) continue;
+        fds[count++] = (struct pollfd){
+            .fd = client->fd,
+            .events = (short)(POLLIN | (client->out.used ? POLLOUT : 0)),
+        };
+    }
+    return count;
+}
+
+int control_process(Control *control, DisplayManager *dm, const struct pollfd *fds, int count) {
+    if (!control || !dm) return -1;
+
+    int served = 0;
+    for (int f = 0; f < count; f++) {
+        if (!fds[f].revents) continue;
+        if (fds[f].fd == control->listen_fd) {
+            accept_clients(control);
+            continue;
+        }
+    
+        ControlClient *client = NULL;
+        for (int i = 0; i < CONTROL_MAX_CLIENTS && !client; i++) {
+            if (control->clients[i].fd == fds[f].fd) client = &control->clients[i];
+        }
+        if (!client) continue;
+    
+        if (fds[f].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = recv(client->fd, client->in + client->in_used,
+                             sizeof(client->in) - client->in_used, MSG_DONTWAIT);
+            if (n > 0) {
+                client->in_used += (size_t)n;
+                served += drain_requests(control, client, dm);
+            } else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                client->dead = true;        // Hung up - its pending replies have nowhere to go
+            }
+        }
+    }
+
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        ControlClient *client = &control->clients[i];
+        if (client->fd < 0) continue;
+        if (!client->dead && client->out.used) flush_client(client);
+        if (client->dead) drop_client(client);
+    }
+    return served;
+}
+
+// Encode the event once per encoding, queue it for every subscriber
+void control_notify_topology(Control *control, DisplayManager *dm) {
+    if (!control || !dm) return;
+
+    Buffer *json = &control->json_event;
+    Buffer *binary = &control->binary_event;
+    json->used = 0;
+    binary->used = 0;
+    bool json_ok = buffer_printf(json, "{\"event\":\"topology\",") == 0 &&
+                   emit_outputs_json(json, dm) == 0 && buffer_printf(json, "}\n") == 0;
+    size_t start = begin_binary(binary, CONTROL_EVENT_TOPOLOGY, 0);
+    bool binary_ok = start != (size_t)-1 && emit_outputs_binary(binary, dm) == 0;
+    if (binary_ok) end_binary(binary, start);
+
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        ControlClient *client = &control->clients[i];
+        if (client->fd < 0 || !client->subscribed || client->dead) continue;
+        Buffer *event = client->binary_events ? binary : json;
+        bool ok = client->binary_events ? binary_ok : json_ok;
+        if (!ok || buffer_append(&client->out, event->data, event->used) != 0) {
+            client->dead = true;
+            continue;
+        }
+        flush_client(client);
+    }
+}
+
+void control_close(Control *control) {
+    if (!control) return;
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        if (control->clients[i].fd >= 0) drop_client(&control->clients[i]);
+    }
+    if (control->listen_fd >= 0) close(control->listen_fd);
+    if (control->path[0] && control->listen_fd >= 0) unlink(control->path);
+    free(control->json_event.data);
+    free(control->binary_event.data);
+    free(control);
+}
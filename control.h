@@ -0,0 +1,105 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "display_manager.h"
+
+// Control socket for orchestrators: the daemon's commands (see command.h) as
+// structured requests and replies over a UNIX stream socket, instead of
+// forking the binary and scraping its text output. Any number of requests
+// may be written back to back; each client's replies come back in request
+// order, tagged with the request's id. Subscribed clients also get a
+// topology event after every RandR change, so nobody has to poll.
+//
+// Every message is in one of two encodings, told apart by its first byte,
+// and a reply uses the encoding of its request:
+//   JSON    one object per line. Requests:
+//             {"id":1,"op":"list"}
+//             {"id":2,"op":"create","mode":"2336x1080@60","rb":true}
+//             {"id":3,"op":"add","output":"HDMI-1","mode_id":123}       (also "remove")
+//             {"id":4,"op":"delete","mode_id":123}
+//             {"id":5,"op":"provision","output":"VIRTUAL1","mode":"2336x1080@60","right_of":"eDP-1"}
+//             {"id":6,"op":"connect","device":"galaxy-tab-s8","output":"VIRTUAL1"}  (profile.h)
+//             {"id":7,"op":"gc"}    {"id":8,"op":"subscribe"}
+//           replies {"id":N,"ok":true[,"mode_id":M][,"outputs":[...]]} or
+//           {"id":N,"ok":false,"error":"..."}; events {"event":"topology","outputs":[...]}
+//   binary  ControlHeader + length payload bytes (network byte order).
+//           Requests carry a ControlRequest (none for list/gc/subscribe),
+//           replies a ControlOutput list, a uint32 mode ID or an error text.
+//           A request as short as CONTROL_REQUEST_V1_SIZE (written before
+//           the device field existed) is accepted with device empty
+// Clients that stop reading are disconnected once CONTROL_OUTPUT_MAX bytes
+// are queued for them.
+
+#define CONTROL_MAGIC 0x5453            // "TS"
+#define CONTROL_VERSION 1
+#define CONTROL_MAX_CLIENTS 16
+#define CONTROL_INPUT_MAX 4096          // Longest request
+#define CONTROL_OUTPUT_MAX (1 << 20)    // Queued reply bytes per client
+
+enum {
+    CONTROL_OP_LIST = 1,
+    CONTROL_OP_CREATE = 2,
+    CONTROL_OP_ADD = 3,
+    CONTROL_OP_REMOVE = 4,
+    CONTROL_OP_DELETE = 5,
+    CONTROL_OP_PROVISION = 6,
+    CONTROL_OP_GC = 7,
+    CONTROL_OP_SUBSCRIBE = 8,
+    CONTROL_OP_CONNECT = 9,
+    CONTROL_REPLY_OK = 0x80,            // Reply ops
+    CONTROL_REPLY_ERROR = 0x81,
+    CONTROL_EVENT_TOPOLOGY = 0x90,      // id 0, payload as a list reply
+};
+
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t op;                         // CONTROL_OP_* / CONTROL_REPLY_* / CONTROL_EVENT_*
+    uint32_t id;                        // Echoed in the reply
+    uint32_t length;                    // Payload bytes that follow
+} ControlHeader;
+
+// Arguments of create/add/remove/delete/provision/connect - unused fields zero
+typedef struct __attribute__((packed)) {
+    char output[32];
+    char right_of[32];                  // Provision/connect anchor (empty = right of the desktop)
+    uint32_t mode_id;
+    uint16_t width;
+    uint16_t height;
+    uint32_t refresh_mhz;               // Refresh rate in millihertz
+    uint8_t reduced_blanking;
+    uint8_t reserved[3];
+    char device[32];                    // Tablet profile (connect)
+} ControlRequest;
+
+#define CONTROL_REQUEST_V1_SIZE offsetof(ControlRequest, device) // Fields every version 1 client sends
+
+// One output in a list reply or topology event, after a uint16 count
+typedef struct __attribute__((packed)) {
+    char name[32];
+    uint32_t output_id;
+    uint32_t crtc_id;                   // 0 = inactive
+    uint32_t mode_id;
+    int32_t x;
+    int32_t y;
+    uint32_t width;
+    uint32_t height;
+    uint32_t refresh_mhz;
+    uint8_t connected;
+    uint8_t primary;
+    uint8_t reserved[2];
+} ControlOutput;
+
+typedef struct Control Control;
+
+Control* control_open(const char *path);                       // Listen on path - NULL on failure
+int control_poll_fds(Control *control, struct pollfd *fds, int max); // Fill fds to poll - returns count
+int control_process(Control *control, DisplayManager *dm,
+                    const struct pollfd *fds, int count);      // Accept, serve and flush after poll - returns requests served, -1 on error
+void control_notify_topology(Control *control, DisplayManager *dm); // Push the new topology to subscribers
+void control_close(Control *control);                          // Removes the socket - safe to call with NULL
+
+#endif
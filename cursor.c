@@ -0,0 +1,215 @@
+#include "cursor.h"
+#include "timing.h"
+#include <X11/extensions/Xfixes.h>
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CURSOR_CHUNK (TRANSPORT_MTU - sizeof(TransportCursor))  // Shape bytes per packet
+
+// Common part of every cursor packet
+static TransportCursor packet_header(uint8_t kind, uint32_t serial) {
+    TransportCursor h = {
+        .magic = htons(TRANSPORT_MAGIC),
+        .version = TRANSPORT_VERSION,
+        .flags = TRANSPORT_FLAG_CURSOR,
+        .kind = kind,
+        .serial = htonl(serial),
+        .timestamp_us = htonl((uint32_t)(timing_now() / 1000)),
+    };
+    return h;
+}
+
+static const CursorSprite* find_shape(const CursorTracker *tracker, uint32_t serial) {
+    for (int i = 0; i < CURSOR_CACHE; i++) {
+        if (tracker->cache[i].serial == serial && tracker->cache[i].argb) return &tracker->cache[i];
+    }
+    return NULL;
+}
+
+// Send one cached shape, chunk by chunk
+static int send_shape(CursorTracker *tracker, const CursorSprite *shape) {
+    uint8_t packet[TRANSPORT_MTU];
+    size_t bytes = (size_t)shape->width * shape->height * 4;
+    size_t chunks = bytes ? (bytes + CURSOR_CHUNK - 1) / CURSOR_CHUNK : 1;
+    
+    for (size_t i = 0; i < chunks; i++) {
+        TransportCursor h = packet_header(TRANSPORT_CURSOR_SHAPE, shape->serial);
+        h.chunk = htons((uint16_t)i);
+        h.x = (int16_t)htons((uint16_t)shape->xhot);
+        h.y = (int16_t)htons((uint16_t)shape->yhot);
+        h.width = htons((uint16_t)shape->width);
+        h.height = htons((uint16_t)shape->height);
+        memcpy(packet, &h, sizeof(h));
+        
+        size_t offset = i * CURSOR_CHUNK;
+        size_t length = bytes - offset < CURSOR_CHUNK ? bytes - offset : CURSOR_CHUNK;
+        if (bytes) memcpy(packet + sizeof(h), (const uint8_t *)shape->argb + offset, length);
+        if (transport_send_sideband(tracker->transport, packet, sizeof(h) + (bytes ? length : 0)) != 0) return -1;
+    }
+    tracker->shapes++;
+    return 0;
+}
+
+// Adopt the shape XFixes reports, caching and sending it the first time its serial shows up
+static int take_shape(CursorTracker *tracker, const XFixesCursorImage *image) {
+    uint32_t serial = (uint32_t)image->cursor_serial;
+    if (find_shape(tracker, serial)) {
+        tracker->serial = serial;
+        return 0;
+    }
+    if (image->width > CURSOR_MAX_SIZE || image->height > CURSOR_MAX_SIZE) {
+        tracker->oversized++;
+        return 0;
+    }
+    
+    size_t count = (size_t)image->width * image->height;
+    uint32_t *argb = malloc(count ? count * sizeof(uint32_t) : 1);
+    if (!argb) return -1;
+    // Xlib hands out 32-bit pixels in unsigned longs
+    for (size_t i = 0; i < count; i++) argb[i] = htonl((uint32_t)image->pixels[i]);
+    
+    CursorSprite *slot = &tracker->cache[tracker->cache_next];
+    tracker->cache_next = (tracker->cache_next + 1) % CURSOR_CACHE;
+    free(slot->argb);
+    *slot = (CursorSprite){
+        .serial = serial,
+        .width = image->width,
+        .height = image->height,
+        .xhot = image->xhot,
+        .yhot = image->yhot,
+        .argb = argb,
+    };
+    tracker->serial = serial;
+    return send_shape(tracker, slot);
+}
+
+// Clip a root position to the output and send it if anything moved
+static int send_position(CursorTracker *tracker, int root_x, int root_y, bool on_screen) {
+    int x = root_x - tracker->bounds.x;
+    int y = root_y - tracker->bounds.y;
+    bool visible = on_screen && x >= 0 && y >= 0 && x < tracker->bounds.width && y < tracker->bounds.height;
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (x >= tracker->bounds.width) x = tracker->bounds.width - 1;
+    if (y >= tracker->bounds.height) y = tracker->bounds.height - 1;
+    
+    bool moved = !tracker->sent || x != tracker->x || y != tracker->y ||
+                 visible != tracker->visible || tracker->serial != tracker->sent_serial;
+    if (!moved && ++tracker->since_sent < CURSOR_KEEPALIVE) return 0;
+    
+    TransportCursor h = packet_header(TRANSPORT_CURSOR_POSITION, tracker->serial);
+    h.visible = visible;
+    h.x = (int16_t)htons((uint16_t)x);
+    h.y = (int16_t)htons((uint16_t)y);
+    if (transport_send_sideband(tracker->transport, &h, sizeof(h)) != 0) return -1;
+    
+    tracker->x = x;
+    tracker->y = y;
+    tracker->visible = visible;
+    tracker->sent_serial = tracker->serial;
+    tracker->sent = true;
+    tracker->since_sent = 0;
+    tracker->positions++;
+    return 0;
+}
+
+// Subscribe to cursor shape changes on the root window
+CursorTracker* cursor_create(Display *display, Window root, const ScreenInfo *screen, Transport *transport) {
+    if (!display || !screen || !transport) return NULL;
+    
+    int event_base, error_base, major = 0, minor = 0;
+    if (!XFixesQueryExtension(display, &event_base, &error_base) ||
+        !XFixesQueryVersion(display, &major, &minor) || major < 2) {
+        fprintf(stderr, "XFixes 2.0 is not available\n");
+        return NULL;
+    }
+    
+    CursorTracker *tracker = calloc(1, sizeof(CursorTracker));
+    if (!tracker) return NULL;
+    tracker->display = display;
+    tracker->root = root;
+    tracker->transport = transport;
+    tracker->event_base = event_base;
+    tracker->shape_dirty = true;    // Fetch the shape already showing
+    cursor_set_bounds(tracker, screen);
+    
+    XFixesSelectCursorInput(display, root, XFixesDisplayCursorNotifyMask);
+    return tracker;
+}
+
+// Mark the shape stale on its CursorNotify
+bool cursor_handle_event(CursorTracker *tracker, const XEvent *event) {
+    if (!tracker || !event) return false;
+    if (event->type != tracker->event_base + XFixesCursorNotify) return false;
+    
+    const XFixesCursorNotifyEvent *ev = (const XFixesCursorNotifyEvent *)event;
+    if (ev->subtype != XFixesDisplayCursorNotify) return false;
+    tracker->shape_dirty = true;
+    return true;
+}
+
+// Per tick: serve a shape request, pick up a new shape, send a moved position
+int cursor_update(CursorTracker *tracker) {
+    if (!tracker) return -1;
+    
+    XEvent event;
+    while (XCheckTypedEvent(tracker->display, tracker->event_base + XFixesCursorNotify, &event)) {
+        cursor_handle_event(tracker, &event);
+    }
+    
+    uint32_t request = transport_take_cursor_request(tracker->transport);
+    if (request) {
+        const CursorSprite *shape = find_shape(tracker, request);
+        if (shape && send_shape(tracker, shape) != 0) return -1;
+    }
+    
+    int root_x, root_y;
+    bool on_screen = true;
+    if (tracker->shape_dirty) {
+        // The image carries the position too - one round trip instead of two
+        XFixesCursorImage *image = XFixesGetCursorImage(tracker->display);
+        if (!image) {
+            fprintf(stderr, "Cursor: cannot read the cursor image\n");
+            return -1;
+        }
+        tracker->shape_dirty = false;
+        root_x = image->x;
+        root_y = image->y;
+        int result = take_shape(tracker, image);
+        XFree(image);
+        if (result != 0) return -1;
+    } else {
+        Window root_return, child;
+        int win_x, win_y;
+        unsigned int mask;
+        // False when the pointer is on another X screen
+        on_screen = XQueryPointer(tracker->display, tracker->root, &root_return, &child,
+                                  &root_x, &root_y, &win_x, &win_y, &mask);
+    }
+    return send_position(tracker, root_x, root_y, on_screen);
+}
+
+// Follow the output - the next update resends the position
+void cursor_set_bounds(CursorTracker *tracker, const ScreenInfo *screen) {
+    if (!tracker || !screen) return;
+    tracker->bounds.x = (short)screen->x;
+    tracker->bounds.y = (short)screen->y;
+    tracker->bounds.width = (unsigned short)screen->width;
+    tracker->bounds.height = (unsigned short)screen->height;
+    tracker->sent = false;
+}
+
+void cursor_print_stats(const CursorTracker *tracker, FILE *out) {
+    if (!tracker) return;
+    fprintf(out, "Cursor: %lu position updates, %lu shapes sent, %lu too large\n",
+            tracker->positions, tracker->shapes, tracker->oversized);
+}
+
+// Unsubscribe and free the cached shapes
+void cursor_destroy(CursorTracker *tracker) {
+    if (!tracker) return;
+    XFixesSelectCursorInput(tracker->display, tracker->root, 0);
+    for (int i = 0; i < CURSOR_CACHE; i++) free(tracker->cache[i].argb);
+    free(tracker);
+}
@@ -0,0 +1,61 @@
+#ifndef CURSOR_H
+#define CURSOR_H
+
+#include <X11/Xlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "display_manager.h"
+#include "transport.h"
+
+// Cursor sideband: the pointer travels next to, not inside, the video. The
+// captured image never contains the cursor sprite, so sending its position and
+// shape separately lets the client draw it at the local refresh rate while the
+// encoder sees no change at all. XFixes reports shape changes; each shape goes
+// out once per serial and is cached so the client can ask for it again.
+// Position is polled once per frame tick, clipped to the output and sent only
+// when it moved (plus a slow keepalive for lost packets).
+
+#define CURSOR_CACHE 8                  // Shapes kept for client requests
+#define CURSOR_MAX_SIZE 256             // Larger shapes are not sent
+#define CURSOR_KEEPALIVE 30             // Ticks between repeats of an unchanged position
+
+typedef struct {
+    uint32_t serial;                    // XFixes cursor serial (0 = empty slot)
+    unsigned int width;
+    unsigned int height;
+    int xhot;
+    int yhot;
+    uint32_t *argb;                     // width * height premultiplied ARGB32 pixels
+} CursorSprite;
+
+typedef struct {
+    Display *display;                   // Connection events and queries go through (borrowed)
+    Window root;
+    Transport *transport;               // Sideband to send on (borrowed)
+    int event_base;
+    XRectangle bounds;                  // Output in root coordinates
+    bool shape_dirty;                   // CursorNotify seen since the last update
+    uint32_t serial;                    // Shape being shown
+    CursorSprite cache[CURSOR_CACHE];
+    int cache_next;                     // Slot the next new shape replaces
+    int x;                              // Last position sent, output-relative
+    int y;
+    bool visible;
+    uint32_t sent_serial;               // Shape named by the last position packet
+    bool sent;                          // A position went out since the last reset
+    int since_sent;                     // Ticks since the last position packet
+    unsigned long positions;            // Position packets sent
+    unsigned long shapes;               // Shapes sent (first sight or client request)
+    unsigned long oversized;            // Shapes over CURSOR_MAX_SIZE, shown as the last good one
+} CursorTracker;
+
+CursorTracker* cursor_create(Display *display, Window root, const ScreenInfo *screen,
+                             Transport *transport);          // NULL without XFixes 2.0
+bool cursor_handle_event(CursorTracker *tracker, const XEvent *event); // Feed an event from another loop - true if it was ours
+int cursor_update(CursorTracker *tracker);                   // Once per tick: send shape/position changes - returns 0 on success, -1 on error
+void cursor_set_bounds(CursorTracker *tracker, const ScreenInfo *screen); // Follow a moved/resized output
+void cursor_print_stats(const CursorTracker *tracker, FILE *out);
+void cursor_destroy(CursorTracker *tracker);                 // Safe to call with NULL
+
+#endif
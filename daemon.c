@@ -0,0 +1,287 @@
+#include "daemon.h"
+#include "command.h"
+#include "control.h"
+#include "input.h"
+#include "profile.h"
+#include "timing.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DAEMON_LINE_MAX 512
+
+static volatile sig_atomic_t daemon_stop = 0;
+
+// Signal handler - only flags the loop to exit
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    daemon_stop = 1;
+}
+
+// Install SIGINT/SIGTERM handlers without SA_RESTART so poll() wakes up
+static void install_signal_handlers(void) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
+
+// Stale mode candidates from the previous GC pass
+typedef struct {
+    RRMode *modes;
+    int count;
+} GcState;
+
+// Monotonic clock in milliseconds
+static long long monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Delete orphans that were already orphans on the previous pass, remember the rest -
+// nobody asked, so modes still attached to an output are left alone
+static void run_gc_pass(DisplayManager *dm, GcState *gc) {
+    int capacity = dm->topology.mode_count;
+    RRMode *current = capacity > 0 ? calloc(capacity, sizeof(RRMode)) : NULL;
+    int current_count = current ? mode_find_stale(dm, current, capacity, true) : 0;
+    
+    RRMode *confirmed = current_count > 0 ? calloc(current_count, sizeof(RRMode)) : NULL;
+    int confirmed_count = 0;
+    for (int i = 0; confirmed && i < current_count; i++) {
+        for (int j = 0; j < gc->count; j++) {
+            if (gc->modes[j] == current[i]) {
+                confirmed[confirmed_count++] = current[i];
+                break;
+            }
+        }
+    }
+    
+    if (confirmed_count > 0) {
+        int failures = mode_gc_delete(dm, confirmed, confirmed_count);
+        fprintf(stderr, "GC: deleted %d stale mode%s%s\n", confirmed_count,
+                confirmed_count == 1 ? "" : "s", failures ? " (with errors)" : "");
+    }
+    free(confirmed);
+    
+    // Deleted modes are gone from the snapshot; keep the unconfirmed ones for next pass
+    free(gc->modes);
+    gc->modes = current;
+    gc->count = 0;
+    for (int i = 0; i < current_count; i++) {
+        if (dm_find_mode(dm, current[i])) current[gc->count++] = current[i];
+    }
+}
+
+// Execute a single command line - returns 0 on success, -1 on failure, 1 to quit
+static int execute_line(DisplayManager *dm, char *line) {
+    Command cmd;
+    if (command_parse(line, &cmd) != 0) return -1;
+    if (cmd.type == CMD_QUIT) return 1;
+    
+    // $N references only make sense inside a batch file
+    if (cmd.mode_ref != 0) {
+        fprintf(stderr, "Mode references ($N) are only supported in batch mode\n");
+        return -1;
+    }
+    return command_execute(dm, &cmd, NULL);
+}
+
+// Split buffered stdin data into lines and execute each complete one
+// Returns 1 if a quit command was seen, 0 otherwise
+static int drain_command_lines(DisplayManager *dm, char *buffer, size_t *used) {
+    char *start = buffer;
+    char *newline;
+    
+    while ((newline = memchr(start, '\n', *used - (start - buffer))) != NULL) {
+        *newline = '\0';
+        if (newline > start && newline[-1] == '\r') newline[-1] = '\0';
+        
+        // Apply any topology changes that arrived before this command
+        dm_process_events(dm);
+        
+        uint64_t started = timing_now();
+        int result = execute_line(dm, start);
+        timing_record(TIMING_COMMAND, started);
+        if (result == 1) return 1;
+        
+        printf("%s\n", result == 0 ? "OK" : "ERROR");
+        fflush(stdout);
+        start = newline + 1;
+    }
+    
+    // Keep the trailing partial line for the next read
+    size_t remaining = *used - (start - buffer);
+    memmove(buffer, start, remaining);
+    *used = remaining;
+    return 0;
+}
+
+// Main daemon loop - multiplex X events and stdin commands
+int daemon_run(DisplayManager *dm, const DaemonConfig *config) {
+    if (!dm || !config) return -1;
+    
+    // Select events before enumerating so no change can slip in between
+    if (dm_select_events(dm) != 0) return -1;
+    if (dm_ensure_screens(dm) < 0) return -1;
+    
+    // Prewarm before the first GC pass, which would otherwise reap the idle modes
+    ProfileRegistry profiles = { NULL, 0 };
+    if (config->profiles_path) {
+        if (profile_load(config->profiles_path, &profiles) != 0) return -1;
+        uint64_t prewarm_started = timing_now();
+        int failures = profile_prewarm(dm, &profiles);
+        printf("Prewarmed %d profile mode%s in %.1f ms%s\n", profiles.count - failures,
+               profiles.count - failures == 1 ? "" : "s", (timing_now() - prewarm_started) / 1e6,
+               failures ? " (some failed)" : "");
+        dm->profiles = &profiles;
+    }
+    
+    InputInjector *input = NULL;
+    if (config->input_output) {
+        InputConfig input_config = { .port = config->input_port, .bind = config->input_bind,
+                                     .peer = config->input_peer, .token = config->input_token };
+        input = input_open(dm->display, &input_config);
+        if (!input) {
+            dm->profiles = NULL;
+            profile_free(&profiles);
+            return -1;
+        }
+        ScreenInfo *target = dm_find_screen(dm, config->input_output);
+        input_set_output(input, target);
+        printf("Injecting input into %s from UDP %s port %d%s%s\n", config->input_output,
+               config->input_bind ? config->input_bind : INPUT_DEFAULT_BIND, config->input_port,
+               config->input_token ? ", paired" : "",
+               target && target->crtc_id ? "" : " (inactive, input dropped until it is enabled)");
+    }
+    Control *control = NULL;
+    if (config->control_path) {
+        control = control_open(config->control_path);
+        if (!control) {
+            input_close(input);
+            dm->profiles = NULL;
+            profile_free(&profiles);
+            return -1;
+        }
+        printf("Control socket listening on %s\n", config->control_path);
+    }
+    install_signal_handlers();
+    
+    printf("Daemon ready, tracking %d output%s\n",
+           dm->screen_count, dm->screen_count == 1 ? "" : "s");
+    fflush(stdout);
+    
+    char buffer[DAEMON_LINE_MAX];
+    size_t used = 0;
+    int result = 0;
+    bool stdin_open = true;
+    
+    GcState gc = { NULL, 0 };
+    long long gc_interval_ms = (long long)config->gc_interval * 1000;
+    long long next_gc = monotonic_ms();     // first pass right away records candidates
+    
+    while (!daemon_stop) {
+        // Events may already sit in Xlib's queue, poll() would not see them
+        uint64_t started = timing_now();
+        int changes = dm_process_events(dm);
+        if (changes < 0) {
+            fprintf(stderr, "Failed to refresh topology\n");
+            result = -1;
+            break;
+        }
+        if (changes > 0) {
+            timing_record(TIMING_EVENTS, started);
+            if (input) input_set_output(input, dm_find_screen(dm, config->input_output));
+            control_notify_topology(control, dm);
+        }
+        
+        int timeout = -1;
+        if (gc_interval_ms > 0) {
+            long long now = monotonic_ms();
+            if (now >= next_gc) {
+                run_gc_pass(dm, &gc);
+                next_gc = now + gc_interval_ms;
+            }
+            timeout = (int)(next_gc - now);
+        }
+        
+        struct pollfd fds[3 + 1 + CONTROL_MAX_CLIENTS];
+        fds[0].fd = ConnectionNumber(dm->display);
+        fds[0].events = POLLIN;
+        fds[1].fd = stdin_open ? STDIN_FILENO : -1;
+        fds[1].events = POLLIN;
+        fds[2].fd = input_fd(input);    // Negative fds are ignored by poll
+        fds[2].events = POLLIN;
+        int control_count = control_poll_fds(control, fds + 3, 1 + CONTROL_MAX_CLIENTS);
+        
+        int ready = poll(fds, 3 + control_count, timeout);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            result = -1;
+            break;
+        }
+        
+        if (fds[0].revents & (POLLERR | POLLHUP)) {
+            fprintf(stderr, "Lost connection to X server\n");
+            result = -1;
+            break;
+        }
+        
+        // Input first - a command may take a while, the pen should not wait for it
+        if ((fds[2].revents & POLLIN) && input_process(input) < 0) {
+            result = -1;
+            break;
+        }
+        
+        // Socket requests in arrival order, each client's replies in request order
+        int served = control_process(control, dm, fds + 3, control_count);
+        if (served < 0) {
+            result = -1;
+            break;
+        }
+        if (served > 0 && input) input_set_output(input, dm_find_screen(dm, config->input_output));
+        
+        if (!(fds[1].revents & (POLLIN | POLLHUP))) continue;
+        
+        ssize_t n = read(STDIN_FILENO, buffer + used, sizeof(buffer) - used - 1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("read");
+            result = -1;
+            break;
+        }
+        if (n == 0) {
+            // EOF - controlling process went away; socket clients keep the daemon running
+            if (!control) break;
+            stdin_open = false;
+            continue;
+        }
+        
+        used += n;
+        int quit = drain_command_lines(dm, buffer, &used);
+        // A command may have moved or enabled the input output
+        if (input) input_set_output(input, dm_find_screen(dm, config->input_output));
+        if (quit == 1) break;
+        
+        if (used == sizeof(buffer) - 1) {
+            fprintf(stderr, "Command line too long, discarding\n");
+            used = 0;
+        }
+    }
+    
+    control_close(control);
+    input_print_stats(input, stderr);
+    input_close(input);
+    dm->profiles = NULL;
+    profile_free(&profiles);
+    free(gc.modes);
+    return result;
+}
@@ -0,0 +1,35 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "display_manager.h"
+
+// Persistent mode: keep one DisplayManager alive, track RandR changes through
+// notify events and serve line-based commands (see command.h) read from stdin.
+// Every command reply is terminated by a single "OK" or "ERROR" line.
+// Orphaned TabCaster modes (on no CRTC and in no output's list) are garbage
+// collected periodically: a mode is only deleted once it has been an orphan for
+// two consecutive passes, so a mode that was just created and not yet added
+// survives, and one that was added for later use is never touched. With input_output set, tablet
+// pen/touch datagrams are injected on the same connection, and the transform
+// follows that output through topology changes. With control_path set, the same
+// commands are also served as JSON/binary requests on a UNIX socket, and stdin
+// EOF no longer ends the daemon. With profiles_path set, every profile's mode
+// is created before the daemon is ready, so connect only sets a CRTC.
+
+// Daemon settings
+typedef struct {
+    int gc_interval;    // Seconds between stale mode GC passes (0 = disabled)
+    const char *input_output; // Inject tablet input into this output (NULL = no input, see input.h)
+    int input_port;     // UDP port tablet input arrives on
+    const char *input_bind; // Address the input socket binds (NULL = loopback)
+    const char *input_peer; // Only accept input from this host (NULL = any source)
+    const char *input_token; // Pairing token input datagrams must carry (NULL = none)
+    const char *control_path; // Also serve requests on this UNIX socket (NULL = stdin only, see control.h)
+    const char *profiles_path; // Tablet profiles to load and prewarm at startup (NULL = none, see profile.h)
+} DaemonConfig;
+
+#define DAEMON_DEFAULT_GC_INTERVAL 60
+
+int daemon_run(DisplayManager *dm, const DaemonConfig *config);    // Run event loop until quit, stdin EOF (without control socket) or SIGINT/SIGTERM - returns 0 on clean exit, -1 on error
+
+#endif
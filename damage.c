@@ -0,0 +1,183 @@
+#include "damage.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Area of a rectangle in pixels
+static long rect_area(const XRectangle *r) {
+    return (long)r->width * r->height;
+}
+
+// Smallest rectangle covering both
+static XRectangle rect_union(const XRectangle *a, const XRectangle *b) {
+    int x1 = a->x < b->x ? a->x : b->x;
+    int y1 = a->y < b->y ? a->y : b->y;
+    int x2 = (a->x + a->width > b->x + b->width) ? a->x + a->width : b->x + b->width;
+    int y2 = (a->y + a->height > b->y + b->height) ? a->y + a->height : b->y + b->height;
+    XRectangle u = { (short)x1, (short)y1, (unsigned short)(x2 - x1), (unsigned short)(y2 - y1) };
+    return u;
+}
+
+// Clip a root-relative rectangle to bounds and make it bounds-relative - false if it misses
+// Edges are widened to even coordinates so rectangles map onto whole 2x2 chroma blocks
+static bool clip_to_bounds(const XRectangle *bounds, const XRectangle *in, XRectangle *out) {
+    int x1 = in->x - bounds->x;
+    int y1 = in->y - bounds->y;
+    int x2 = x1 + in->width;
+    int y2 = y1 + in->height;
+    
+    x1 = x1 < 0 ? 0 : x1 & ~1;
+    y1 = y1 < 0 ? 0 : y1 & ~1;
+    x2 = (x2 + 1) & ~1;
+    y2 = (y2 + 1) & ~1;
+    if (x2 > bounds->width) x2 = bounds->width;
+    if (y2 > bounds->height) y2 = bounds->height;
+    if (x2 <= x1 || y2 <= y1) return false;
+    
+    out->x = (short)x1;
+    out->y = (short)y1;
+    out->width = (unsigned short)(x2 - x1);
+    out->height = (unsigned short)(y2 - y1);
+    return true;
+}
+
+// Add one rectangle, merging with any neighbour where the union wastes little
+static void add_rect(DamageTracker *tracker, XRectangle rect) {
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (int i = 0; i < tracker->rect_count; i++) {
+            XRectangle u = rect_union(&tracker->rects[i], &rect);
+            if (rect_area(&u) - rect_area(&tracker->rects[i]) - rect_area(&rect) > DAMAGE_MERGE_SLACK) continue;
+            
+            // Absorb the neighbour and retry - the bigger rectangle may now touch others
+            rect = u;
+            tracker->rects[i] = tracker->rects[--tracker->rect_count];
+            merged = true;
+            break;
+        }
+    }
+    
+    if (tracker->rect_count < DAMAGE_MAX_RECTS) {
+        tracker->rects[tracker->rect_count++] = rect;
+        return;
+    }
+    
+    // Too fragmented - one bounding box costs fewer round trips than many slivers
+    for (int i = 0; i < tracker->rect_count; i++) rect = rect_union(&rect, &tracker->rects[i]);
+    tracker->rects[0] = rect;
+    tracker->rect_count = 1;
+}
+
+// Start tracking damage inside the capture rectangle
+DamageTracker* damage_create(Display *display, Window root, const Capture *cap) {
+    if (!display || !cap) return NULL;
+    
+    int fixes_event, fixes_error, major = 0, minor = 0;
+    if (!XFixesQueryExtension(display, &fixes_event, &fixes_error) ||
+        !XFixesQueryVersion(display, &major, &minor) || major < 2) {
+        fprintf(stderr, "XFixes 2.0 is not available\n");
+        return NULL;
+    }
+    
+    DamageTracker *tracker = calloc(1, sizeof(DamageTracker));
+    if (!tracker) return NULL;
+    tracker->display = display;
+    
+    if (!XDamageQueryExtension(display, &tracker->event_base, &tracker->error_base) ||
+        !XDamageQueryVersion(display, &major, &minor)) {
+        fprintf(stderr, "XDamage is not available\n");
+        free(tracker);
+        return NULL;
+    }
+    
+    tracker->damage = XDamageCreate(display, root, XDamageReportNonEmpty);
+    tracker->parts = XFixesCreateRegion(display, NULL, 0);
+    damage_set_bounds(tracker, cap);
+    return tracker;
+}
+
+// Mark the tracker dirty on its DamageNotify
+bool damage_handle_event(DamageTracker *tracker, const XEvent *event) {
+    if (!tracker || !event) return false;
+    if (event->type != tracker->event_base + XDamageNotify) return false;
+    
+    const XDamageNotifyEvent *ev = (const XDamageNotifyEvent *)event;
+    if (ev->damage != tracker->damage) return false;
+    tracker->dirty = true;
+    return true;
+}
+
+// Collect this frame's dirty rectangles
+int damage_collect(DamageTracker *tracker) {
+    if (!tracker) return -1;
+    
+    // Notifications are already read by Xlib if anything else touched the connection
+    XEvent event;
+    while (XCheckTypedEvent(tracker->display, tracker->event_base + XDamageNotify, &event)) {
+        damage_handle_event(tracker, &event);
+    }
+    
+    tracker->rect_count = 0;
+    if (tracker->full_pending) {
+        // Still subtract so the next notification is armed
+        XDamageSubtract(tracker->display, tracker->damage, None, None);
+        tracker->full_pending = false;
+        tracker->dirty = false;
+        XRectangle all = { 0, 0, tracker->bounds.width, tracker->bounds.height };
+        tracker->rects[tracker->rect_count++] = all;
+        tracker->frames_collected++;
+        return tracker->rect_count;
+    }
+    
+    if (!tracker->dirty) {
+        tracker->frames_skipped++;
+        return 0;
+    }
+    
+    // Move all damage into our region (re-arms DamageNotify) and read it back
+    uint64_t start = timing_now();
+    XDamageSubtract(tracker->display, tracker->damage, None, tracker->parts);
+    int count = 0;
+    XRectangle *parts = XFixesFetchRegion(tracker->display, tracker->parts, &count);
+    timing_record(TIMING_DAMAGE, start);
+    tracker->dirty = false;
+    
+    for (int i = 0; parts && i < count; i++) {
+        XRectangle clipped;
+        if (clip_to_bounds(&tracker->bounds, &parts[i], &clipped)) add_rect(tracker, clipped);
+    }
+    if (parts) XFree(parts);
+    
+    // Damage elsewhere on the desktop - nothing for this output
+    if (tracker->rect_count == 0) {
+        tracker->frames_skipped++;
+        return 0;
+    }
+    tracker->frames_collected++;
+    return tracker->rect_count;
+}
+
+// Track a new rectangle - the client has nothing valid yet, send it whole
+void damage_set_bounds(DamageTracker *tracker, const Capture *cap) {
+    if (!tracker || !cap) return;
+    tracker->bounds.x = (short)cap->x;
+    tracker->bounds.y = (short)cap->y;
+    tracker->bounds.width = (unsigned short)cap->width;
+    tracker->bounds.height = (unsigned short)cap->height;
+    tracker->full_pending = true;
+}
+
+// Rectangles already handed out never reached the client - resend everything
+void damage_invalidate(DamageTracker *tracker) {
+    if (tracker) tracker->full_pending = true;
+}
+
+// Drop the damage object and scratch region
+void damage_destroy(DamageTracker *tracker) {
+    if (!tracker) return;
+    if (tracker->parts) XFixesDestroyRegion(tracker->display, tracker->parts);
+    if (tracker->damage) XDamageDestroy(tracker->display, tracker->damage);
+    free(tracker);
+}
@@ -0,0 +1,39 @@
+#ifndef DAMAGE_H
+#define DAMAGE_H
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xdamage.h>
+#include <stdbool.h>
+#include "capture.h"
+
+// XDamage tracking of one capture rectangle. The server sends a single
+// DamageNotify when the root goes from clean to dirty; damage_collect then
+// fetches and merges the dirty rectangles and re-arms the notification. A frame
+// with no notification costs no round trip at all.
+
+#define DAMAGE_MAX_RECTS 16         // More merged rectangles than this collapse to their bounding box
+#define DAMAGE_MERGE_SLACK 4096     // Merge two rectangles if their union wastes at most this many pixels
+
+typedef struct {
+    Display *display;               // Connection the damage object lives on (borrowed)
+    Damage damage;
+    XserverRegion parts;            // Scratch region XDamageSubtract moves damage into
+    int event_base;
+    int error_base;
+    XRectangle bounds;              // Tracked rectangle in root coordinates (the CRTC)
+    bool dirty;                     // DamageNotify seen since the last collect
+    bool full_pending;              // Next collect reports the whole rectangle (first frame, resize)
+    XRectangle rects[DAMAGE_MAX_RECTS]; // Merged dirty rectangles, relative to bounds
+    int rect_count;
+    unsigned long frames_collected; // Frames with something to send
+    unsigned long frames_skipped;   // Frames skipped because nothing changed
+} DamageTracker;
+
+DamageTracker* damage_create(Display *display, Window root, const Capture *cap); // Track cap's rectangle - NULL without XDamage/XFixes
+bool damage_handle_event(DamageTracker *tracker, const XEvent *event);          // Feed an event from another loop - true if it was ours
+int damage_collect(DamageTracker *tracker);          // Dirty rectangles for this frame in tracker->rects - returns count (0 = skip frame), -1 on error
+void damage_set_bounds(DamageTracker *tracker, const Capture *cap); // Follow a moved/resized capture, forces a full frame
+void damage_invalidate(DamageTracker *tracker);      // Next collect reports the whole rectangle (damage already collected was lost)
+void damage_destroy(DamageTracker *tracker);         // Safe to call with NULL
+
+#endif
@@ -0,0 +1,103 @@
+#include "display_backend.h"
+#include "capture.h"
+#include "damage.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// X11 capture: one SHM image per frame descriptor, XDamage on the first
+struct CaptureSource {
+    Capture *captures[PIPELINE_DEPTH];
+    DamageTracker *damage;              // NULL = whole frames
+};
+
+static void x11_capture_close(CaptureSource *source) {
+    if (!source) return;
+    damage_destroy(source->damage);
+    for (int i = 0; i < PIPELINE_DEPTH; i++) capture_destroy(source->captures[i]);
+    free(source);
+}
+
+static CaptureSource* x11_capture_open(Display *display, const ScreenInfo *screen, bool use_damage) {
+    CaptureSource *source = calloc(1, sizeof(CaptureSource));
+    if (!source) return NULL;
+    
+    Window root = DefaultRootWindow(display);
+    for (int i = 0; i < PIPELINE_DEPTH; i++) {
+        source->captures[i] = capture_create(display, root, screen);
+        if (!source->captures[i]) {
+            x11_capture_close(source);
+            return NULL;
+        }
+    }
+    if (source->captures[0]->image->bits_per_pixel != 32) {
+        fprintf(stderr, "Pipeline: %d bpp root window, only 32 bpp is supported\n",
+                source->captures[0]->image->bits_per_pixel);
+        x11_capture_close(source);
+        return NULL;
+    }
+    if (use_damage) {
+        source->damage = damage_create(display, root, source->captures[0]);
+        if (!source->damage) {
+            x11_capture_close(source);
+            return NULL;
+        }
+    }
+    return source;
+}
+
+// The dropped frame took its damage with it
+static void x11_capture_invalidate(CaptureSource *source) {
+    damage_invalidate(source->damage);
+}
+
+// Damaged rectangles only, or the whole frame as one tile
+static int x11_capture_grab(CaptureSource *source, FrameDesc *frame) {
+    Capture *cap = source->captures[frame->slot];
+    frame->capture = cap;
+    if (source->damage) {
+        int count = damage_collect(source->damage);
+        if (count <= 0) return count < 0 ? -1 : 1;
+        frame->tile_count = count;
+        return capture_rects(cap, source->damage->rects, count, frame->tiles);
+    }
+    
+    if (capture_frame(cap) != 0) return -1;
+    frame->tile_count = 1;
+    frame->tiles[0].rect = (XRectangle){ 0, 0, (unsigned short)cap->width, (unsigned short)cap->height };
+    frame->tiles[0].data = cap->image->data;
+    frame->tiles[0].stride = cap->image->bytes_per_line;
+    return 0;
+}
+
+const DisplayBackend display_backend_x11 = {
+    .name = "x11",
+    .gpu_frames = false,
+    .enumerate = dm_ensure_screens,
+    .provision = mode_provision,
+    .gc_modes = mode_gc,
+    .capture_open = x11_capture_open,
+    .capture_grab = x11_capture_grab,
+    .capture_invalidate = x11_capture_invalidate,
+    .capture_close = x11_capture_close,
+};
+
+static const DisplayBackend *backends[DISPLAY_BACKEND_COUNT] = {
+    [DISPLAY_BACKEND_X11] = &display_backend_x11,
+    [DISPLAY_BACKEND_KMS] = &display_backend_kms,
+};
+
+const DisplayBackend* display_backend_get(DisplayBackendKind kind) {
+    return (unsigned)kind < DISPLAY_BACKEND_COUNT ? backends[kind] : &display_backend_x11;
+}
+
+int display_backend_from_name(const char *name, DisplayBackendKind *kind) {
+    if (!name || !kind) return -1;
+    for (int i = 0; i < DISPLAY_BACKEND_COUNT; i++) {
+        if (strcmp(name, backends[i]->name) == 0) {
+            *kind = (DisplayBackendKind)i;
+            return 0;
+        }
+    }
+    return -1;
+}
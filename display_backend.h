@@ -0,0 +1,72 @@
+#ifndef DISPLAY_BACKEND_H
+#define DISPLAY_BACKEND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "display_manager.h"
+#include "mode_manager.h"
+#include "pipeline.h"
+
+// Where outputs, modes and frames come from. The X11 backend is
+// DisplayManager/mode_manager plus root window capture over MIT-SHM and
+// XDamage. The KMS backend enumerates and sets modes through the same RandR
+// calls - the X server holds DRM master, so modes can only change through it -
+// but captures a CRTC's scanout framebuffer straight from the kernel
+// (drmModeGetFB2 + PRIME export) and hands the DMA-BUF to the VAAPI encoder,
+// which converts it on the GPU: no CPU readback, no convert stage. Reading
+// another client's framebuffer needs CAP_SYS_ADMIN (or DRM master). Built
+// only with `make WITH_KMS=1`; otherwise the KMS backend cannot capture.
+
+#define DMABUF_MAX_PLANES 4
+#define KMS_FB_CACHE 8                  // Exported framebuffers kept (a swapchain is 2-3)
+
+typedef enum {
+    DISPLAY_BACKEND_X11,
+    DISPLAY_BACKEND_KMS,
+    DISPLAY_BACKEND_COUNT
+} DisplayBackendKind;
+
+// One captured GPU frame - fds stay owned by the capture source
+typedef struct {
+    uint32_t fb_id;                     // KMS framebuffer the planes belong to
+    uint32_t fourcc;                    // DRM_FORMAT_* (fourcc code)
+    uint64_t modifier;                  // DRM_FORMAT_MOD_* (tiling)
+    unsigned int width;                 // Whole framebuffer
+    unsigned int height;
+    int crop_x;                         // The output's part of it
+    int crop_y;
+    unsigned int crop_width;
+    unsigned int crop_height;
+    int plane_count;
+    int fds[DMABUF_MAX_PLANES];
+    uint32_t offsets[DMABUF_MAX_PLANES];
+    uint32_t pitches[DMABUF_MAX_PLANES];
+} DmaBufFrame;
+
+typedef struct CaptureSource CaptureSource;
+
+typedef struct DisplayBackend {
+    const char *name;
+    bool gpu_frames;                    // Frames are DMA-BUFs in stage_data[PIPE_CAPTURE], not pixels in tiles
+
+    // Enumeration and mode handling
+    int (*enumerate)(DisplayManager *dm);                       // Connected outputs, -1 on error
+    RRMode (*provision)(DisplayManager *dm, const char *output_name,
+                        const ModeSpec *spec, const char *right_of); // New mode ID, 0 on failure
+    int (*gc_modes)(DisplayManager *dm);                        // Stale modes deleted, -1 on error
+
+    // Capture, from the pipeline's capture thread on its own X connection
+    bool (*capture_probe)(const ScreenInfo *screen);            // Could capture_open find the screen's scanout - NULL = always
+    CaptureSource* (*capture_open)(Display *display, const ScreenInfo *screen, bool use_damage); // NULL on failure
+    int (*capture_grab)(CaptureSource *source, FrameDesc *frame); // 0 = captured, 1 = nothing changed, -1 on error
+    void (*capture_invalidate)(CaptureSource *source);          // A grabbed frame was dropped, next grab is whole - NULL if every grab is
+    void (*capture_close)(CaptureSource *source);               // Safe to call with NULL
+} DisplayBackend;
+
+extern const DisplayBackend display_backend_x11;
+extern const DisplayBackend display_backend_kms;
+
+const DisplayBackend* display_backend_get(DisplayBackendKind kind);     // X11 for unknown kinds
+int display_backend_from_name(const char *name, DisplayBackendKind *kind); // "x11", "kms" - returns 0 on success
+
+#endif
@@ -0,0 +1,258 @@
+#include "display_backend.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef TABCASTER_WITH_KMS
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <drm_fourcc.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#define KMS_MAX_CARDS 8
+
+// One exported scanout buffer
+typedef struct {
+    DmaBufFrame frame;
+    uint64_t last_grab;                 // Grab that last handed it out
+    bool used;
+} KmsFb;
+
+struct CaptureSource {
+    int fd;                             // DRM card node
+    uint32_t crtc_id;
+    char output[32];                    // For messages
+    uint64_t grabs;
+    KmsFb cache[KMS_FB_CACHE];
+};
+
+static void release_fb(KmsFb *fb) {
+    for (int i = 0; i < fb->frame.plane_count; i++) {
+        bool shared = false;
+        for (int j = 0; j < i; j++) shared |= fb->frame.fds[j] == fb->frame.fds[i];
+        if (!shared && fb->frame.fds[i] >= 0) close(fb->frame.fds[i]);
+    }
+    memset(fb, 0, sizeof(*fb));
+}
+
+static void kms_capture_close(CaptureSource *source) {
+    if (!source) return;
+    for (int i = 0; i < KMS_FB_CACHE; i++) {
+        if (source->cache[i].used) release_fb(&source->cache[i]);
+    }
+    if (source->fd >= 0) close(source->fd);
+    free(source);
+}
+
+// The CRTC scanning out the output: same rectangle of a shared framebuffer,
+// else the same size at the origin of its own (TearFree, PRIME)
+static uint32_t find_crtc(int fd, const ScreenInfo *screen) {
+    drmModeRes *res = drmModeGetResources(fd);
+    if (!res) return 0;
+    
+    uint32_t exact = 0;
+    uint32_t sized = 0;
+    int sized_count = 0;
+    for (int i = 0; i < res->count_crtcs && !exact; i++) {
+        drmModeCrtc *crtc = drmModeGetCrtc(fd, res->crtcs[i]);
+        if (!crtc) continue;
+        if (crtc->mode_valid && crtc->buffer_id && crtc->width == screen->width && crtc->height == screen->height) {
+            if ((int)crtc->x == screen->x && (int)crtc->y == screen->y) {
+                exact = crtc->crtc_id;
+            } else if (crtc->x == 0 && crtc->y == 0) {
+                sized = crtc->crtc_id;
+                sized_count++;
+            }
+        }
+        drmModeFreeCrtc(crtc);
+    }
+    drmModeFreeResources(res);
+    return exact ? exact : sized_count == 1 ? sized : 0;
+}
+
+// Some card has a CRTC scanning the output out - VIRTUAL heads of the X
+// server's own have none, there is nothing in KMS to read them from
+static bool kms_capture_probe(const ScreenInfo *screen) {
+    bool found = false;
+    for (int card = 0; card < KMS_MAX_CARDS && !found; card++) {
+        char path[32];
+        snprintf(path, sizeof(path), "/dev/dri/card%d", card);
+        int fd = open(path, O_RDWR | O_CLOEXEC);
+        if (fd < 0) continue;
+        found = find_crtc(fd, screen) != 0;
+        close(fd);
+    }
+    return found;
+}
+
+static CaptureSource* kms_capture_open(Display *display, const ScreenInfo *screen, bool use_damage) {
+    (void)display;
+    if (use_damage) {
+        fprintf(stderr, "KMS capture: damage tracking is X11 only, capturing whole frames\n");
+    }
+    
+    CaptureSource *source = calloc(1, sizeof(CaptureSource));
+    if (!source) return NULL;
+    source->fd = -1;
+    snprintf(source->output, sizeof(source->output), "%s", screen->name);
+    
+    for (int card = 0; card < KMS_MAX_CARDS && !source->crtc_id; card++) {
+        char path[32];
+        snprintf(path, sizeof(path), "/dev/dri/card%d", card);
+        int fd = open(path, O_RDWR | O_CLOEXEC);
+        if (fd < 0) continue;
+        source->crtc_id = find_crtc(fd, screen);
+        if (source->crtc_id) source->fd = fd;
+        else close(fd);
+    }
+    if (!source->crtc_id) {
+        fprintf(stderr, "KMS capture: no CRTC scans out %s (%ux%u+%d+%d)\n", screen->name,
+                screen->width, screen->height, screen->x, screen->y);
+        kms_capture_close(source);
+        return NULL;
+    }
+    return source;
+}
+
+// Export a framebuffer's planes as DMA-BUF fds - the GEM handles GetFB2
+// opened are only needed for that
+static int export_fb(CaptureSource *source, uint32_t fb_id, const drmModeCrtc *crtc, KmsFb *fb) {
+    drmModeFB2 *info = drmModeGetFB2(source->fd, fb_id);
+    if (!info) {
+        fprintf(stderr, "KMS capture: cannot read framebuffer %u of %s: %s%s\n", fb_id, source->output,
+                strerror(errno), errno == EPERM || errno == EACCES ? " (needs CAP_SYS_ADMIN)" : "");
+        return -1;
+    }
+    
+    DmaBufFrame *f = &fb->frame;
+    memset(fb, 0, sizeof(*fb));
+    f->fb_id = fb_id;
+    f->fourcc = info->pixel_format;
+    f->modifier = (info->flags & DRM_MODE_FB_MODIFIERS) ? info->modifier : DRM_FORMAT_MOD_INVALID;
+    f->width = info->width;
+    f->height = info->height;
+    f->crop_x = (int)crtc->x;
+    f->crop_y = (int)crtc->y;
+    f->crop_width = crtc->width;
+    f->crop_height = crtc->height;
+    
+    int result = 0;
+    for (int i = 0; i < DMABUF_MAX_PLANES && info->handles[i]; i++) {
+        f->fds[i] = -1;
+        for (int j = 0; j < i; j++) {
+            if (info->handles[j] == info->handles[i]) f->fds[i] = f->fds[j];
+        }
+        if (f->fds[i] < 0 && drmPrimeHandleToFD(source->fd, info->handles[i], DRM_CLOEXEC, &f->fds[i]) != 0) {
+            perror("KMS capture: PRIME export");
+            f->fds[i] = -1;
+            result = -1;
+        }
+        f->offsets[i] = info->offsets[i];
+        f->pitches[i] = info->pitches[i];
+        f->plane_count = i + 1;
+    }
+    for (int i = 0; i < DMABUF_MAX_PLANES && info->handles[i]; i++) {
+        bool seen = false;
+        for (int j = 0; j < i; j++) seen |= info->handles[j] == info->handles[i];
+        if (!seen) drmCloseBufferHandle(source->fd, info->handles[i]);
+    }
+    drmModeFreeFB2(info);
+    fb->used = true;
+    if (result != 0 || f->plane_count == 0) {
+        release_fb(fb);
+        return -1;
+    }
+    return 0;
+}
+
+// The framebuffer on screen right now. Exports are cached per fb_id; the
+// pipeline is FIFO, so a frame in flight is one of the last PIPELINE_DEPTH
+// grabs and an entry none of them used is free to replace
+static int kms_capture_grab(CaptureSource *source, FrameDesc *frame) {
+    drmModeCrtc *crtc = drmModeGetCrtc(source->fd, source->crtc_id);
+    if (!crtc) {
+        perror("KMS capture: drmModeGetCrtc");
+        return -1;
+    }
+    uint32_t fb_id = crtc->mode_valid ? crtc->buffer_id : 0;
+    if (!fb_id) {
+        drmModeFreeCrtc(crtc);
+        return 1;                       // CRTC off - nothing to show
+    }
+    
+    KmsFb *fb = NULL;
+    KmsFb *victim = NULL;
+    for (int i = 0; i < KMS_FB_CACHE && !fb; i++) {
+        KmsFb *entry = &source->cache[i];
+        if (entry->used && entry->frame.fb_id == fb_id) fb = entry;
+        else if (!entry->used || entry->last_grab + PIPELINE_DEPTH <= source->grabs) victim = entry;
+    }
+    if (!fb) {
+        if (!victim) {
+            drmModeFreeCrtc(crtc);
+            return 1;
+        }
+        if (victim->used) release_fb(victim);
+        if (export_fb(source, fb_id, crtc, victim) != 0) {
+            drmModeFreeCrtc(crtc);
+            return -1;
+        }
+        fb = victim;
+    }
+    drmModeFreeCrtc(crtc);
+    
+    fb->last_grab = source->grabs++;
+    frame->stage_data[PIPE_CAPTURE] = &fb->frame;
+    frame->tile_count = 1;
+    frame->tiles[0].rect = (XRectangle){ 0, 0, (unsigned short)fb->frame.crop_width, (unsigned short)fb->frame.crop_height };
+    frame->tiles[0].data = NULL;        // No pixels in memory
+    frame->tiles[0].stride = 0;
+    return 0;
+}
+
+#else // !TABCASTER_WITH_KMS
+
+struct CaptureSource {
+    int unused;
+};
+
+// Let capture_open explain that the build lacks KMS
+static bool kms_capture_probe(const ScreenInfo *screen) {
+    (void)screen;
+    return true;
+}
+
+static CaptureSource* kms_capture_open(Display *display, const ScreenInfo *screen, bool use_damage) {
+    (void)display;
+    (void)screen;
+    (void)use_damage;
+    fprintf(stderr, "Built without KMS capture support (rebuild with make WITH_KMS=1)\n");
+    return NULL;
+}
+
+static int kms_capture_grab(CaptureSource *source, FrameDesc *frame) {
+    (void)source;
+    (void)frame;
+    return -1;
+}
+
+static void kms_capture_close(CaptureSource *source) {
+    free(source);
+}
+
+#endif // TABCASTER_WITH_KMS
+
+// Outputs and modes still go through RandR - the X server owns the CRTCs
+const DisplayBackend display_backend_kms = {
+    .name = "kms",
+    .gpu_frames = true,
+    .enumerate = dm_ensure_screens,
+    .provision = mode_provision,
+    .gc_modes = mode_gc,
+    .capture_probe = kms_capture_probe,
+    .capture_open = kms_capture_open,
+    .capture_grab = kms_capture_grab,
+    .capture_close = kms_capture_close,
+};
@@ -1,15 +1,43 @@
 #include "display_manager.h"
+#include "timing.h"
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Fetch screen resources using the configured enumeration path
+XRRScreenResources* dm_fetch_resources(DisplayManager *dm) {
+    uint64_t start = timing_now();
+    dm->probe_fallback = false;
+    
+    XRRScreenResources *resources;
+    if (dm->enum_mode == DM_ENUM_REPROBE) {
+        resources = XRRGetScreenResources(dm->display, dm->root);
+    } else {
+        resources = XRRGetScreenResourcesCurrent(dm->display, dm->root);
+        
+        // A server that has never been probed reports no outputs - probe once
+        if (resources && resources->noutput == 0) {
+            XRRFreeScreenResources(resources);
+            dm->probe_fallback = true;
+            resources = XRRGetScreenResources(dm->display, dm->root);
+        }
+    }
+    
+    timing_record(TIMING_RESOURCES, start);
+    return resources;
+}
+
 // Initialize display manager and connect to X11
-DisplayManager* dm_init(void) {
+// Screen resources and outputs are fetched lazily by the paths that need them
+DisplayManager* dm_init(DmEnumMode enum_mode) {
     DisplayManager *dm = calloc(1, sizeof(DisplayManager));
     if (!dm) return NULL;
     
     // Open X display, NULL means default display
+    uint64_t start = timing_now();
     dm->display = XOpenDisplay(NULL); 
+    timing_record(TIMING_CONNECT, start);
     if (!dm->display) {
         fprintf(stderr, "Cannot open X display\n");
         free(dm);
@@ -18,66 +46,116 @@ DisplayManager* dm_init(void) {
     
     dm->screen = DefaultScreen(dm->display);
     dm->root = RootWindow(dm->display, dm->screen); // Desktop background
+    dm->enum_mode = enum_mode;
+    dm->backend = DM_BACKEND_XCB;
     
-    // Get XRandR resources for monitor enumeration
-    dm->resources = XRRGetScreenResources(dm->display, dm->root);
-    if (!dm->resources) {
-        fprintf(stderr, "XRRGetScreenResources failed\n");
-        XCloseDisplay(dm->display);
-        free(dm);
-        return NULL;
+    return dm;
+}
+
+// Swap in freshly fetched resources
+static int replace_resources(DisplayManager *dm) {
+    XRRScreenResources *resources = dm_fetch_resources(dm);
+    if (!resources) {
+        fprintf(stderr, "Failed to get XRandR screen resources\n");
+        return -1;
     }
     
-    return dm;
+    if (dm->resources) XRRFreeScreenResources(dm->resources);
+    dm->resources = resources;
+    dm->resources_stale = false;
+    return 0;
 }
 
-// Extract geometry information from CRTC
-static void extract_geometry(DisplayManager *dm, ScreenInfo *screen, RRCrtc crtc) {
-    XRRCrtcInfo *crtc_info = XRRGetCrtcInfo(dm->display, dm->resources, crtc);
-    if (crtc_info) {
-        screen->x = crtc_info->x;
-        screen->y = crtc_info->y;
-        screen->width = crtc_info->width;
-        screen->height = crtc_info->height;
-        XRRFreeCrtcInfo(crtc_info);
+// Fetch XRandR resources on first use
+int dm_ensure_resources(DisplayManager *dm) {
+    if (!dm) return -1;
+    if (dm->resources) return 0;
+    
+    dm->resources = dm_fetch_resources(dm);
+    if (!dm->resources) {
+        fprintf(stderr, "Failed to get XRandR screen resources\n");
+        return -1;
     }
+    return 0;
 }
 
-// Check if output is the primary monitor
-static bool is_primary_output(DisplayManager *dm, RROutput output_id) {
-    RROutput primary = XRRGetOutputPrimary(dm->display, dm->root);
-    return (primary == output_id);
+// Enumerate outputs on first use - returns connected count, -1 on error
+int dm_ensure_screens(DisplayManager *dm) {
+    if (!dm) return -1;
+    if (dm->screens_valid) return dm_count_connected_screens(dm);
+    return dm_get_screens(dm);
+}
+
+// Record one CRTC reply in the snapshot table
+static void store_crtc_state(CrtcState *state, RRCrtc crtc, const XRRCrtcInfo *crtc_info) {
+    memset(state, 0, sizeof(*state));
+    state->id = crtc;
+    if (!crtc_info) return;
+    
+    state->x = crtc_info->x;
+    state->y = crtc_info->y;
+    state->width = crtc_info->width;
+    state->height = crtc_info->height;
+    state->mode = crtc_info->mode;
+    state->rotation = crtc_info->rotation;
+    state->noutput = crtc_info->noutput < DM_MAX_CRTC_OUTPUTS ? crtc_info->noutput : DM_MAX_CRTC_OUTPUTS;
+    memcpy(state->outputs, crtc_info->outputs, state->noutput * sizeof(RROutput));
 }
 
 // Populate a single ScreenInfo structure from XRROutputInfo
-static void populate_screen_info(DisplayManager *dm, ScreenInfo *screen, 
-                                RROutput output_id, XRROutputInfo *output_info) {
+// (geometry is filled in from the CRTC table by dm_topology_rebuild)
+static int populate_screen_info(ScreenInfo *screen, RROutput output_id,
+                                XRROutputInfo *output_info, RROutput primary) {
     // Basic information
     snprintf(screen->name, sizeof(screen->name), "%s", output_info->name);
     screen->output_id = output_id;
     screen->connected = (output_info->connection == RR_Connected);
     
-    // Only get geometry and primary status for connected monitors
+    // Mode and CRTC lists for the snapshot
+    if (dm_screen_alloc_lists(screen, output_info->nmode, output_info->ncrtc) != 0) return -1;
+    memcpy(screen->modes, output_info->modes, output_info->nmode * sizeof(RRMode));
+    memcpy(screen->possible_crtcs, output_info->crtcs, output_info->ncrtc * sizeof(RRCrtc));
+    screen->preferred_count = output_info->npreferred;
+    
+    // Only track CRTC and primary status for connected monitors
     if (screen->connected && output_info->crtc) {
         screen->crtc_id = output_info->crtc;
-        extract_geometry(dm, screen, output_info->crtc);
-        screen->primary = is_primary_output(dm, output_id);
+        screen->primary = (primary == output_id);
     } else {
-        // Initialize disconnected monitor fields
         screen->crtc_id = 0;
-        screen->x = screen->y = 0;
-        screen->width = screen->height = 0;
         screen->primary = false;
     }
+    return 0;
+}
+
+// Free per-output lists of the current screen array
+static void free_screen_array(DisplayManager *dm) {
+    for (int i = 0; dm->screens && i < dm->screen_count; i++) {
+        dm_screen_free_lists(&dm->screens[i]);
+    }
+    free(dm->screens);
+    dm->screens = NULL;
+    dm->screen_count = 0;
+    dm->screens_valid = false;
 }
 
-// Allocate screen array for all outputs
+// Allocate screen array for all outputs (and the CRTC table of the snapshot)
 static int allocate_screen_array(DisplayManager *dm) {
     int array_size = dm->resources->noutput;
     
+    // Drop any arrays left over from a previous enumeration
+    free_screen_array(dm);
+    free(dm->topology.crtcs);
+    dm->topology.crtcs = NULL;
+    dm->topology.crtc_count = 0;
+    
     if (array_size <= 0) return 0;
     
     dm->screens = calloc(array_size, sizeof(ScreenInfo));
+    if (dm->resources->ncrtc > 0) {
+        dm->topology.crtcs = calloc(dm->resources->ncrtc, sizeof(CrtcState));
+        if (!dm->topology.crtcs) return -1;
+    }
     return dm->screens ? array_size : -1;
 }
 
@@ -113,34 +191,378 @@ ScreenInfo* dm_get_primary_screen(DisplayManager *dm) {
     return NULL;
 }
 
-// Main function - enumerate and populate all screens
-int dm_get_screens(DisplayManager *dm) {
-    if (!dm || !dm->resources) return -1;
-    
-    // Allocate space for all outputs
-    int max_screens = allocate_screen_array(dm);
-    if (max_screens <= 0) return max_screens;
+// Describe which enumeration path produced the current resources
+const char* dm_enum_path_name(DisplayManager *dm) {
+    if (!dm) return "none";
+    if (dm->enum_mode == DM_ENUM_REPROBE) return "reprobe (XRRGetScreenResources)";
+    if (dm->probe_fallback) return "reprobe (fallback, server had no cached outputs)";
+    return "current (XRRGetScreenResourcesCurrent, no probe)";
+}
+
+// Xlib backend - one blocking request per output and per CRTC, plus primary.
+// Unless screens/crtcs is NULL, appends every output/CRTC of res to them
+int dm_xlib_query_topology(DisplayManager *dm, XRRScreenResources *res, ScreenInfo *screens, int *screen_count,
+                           CrtcState *crtcs, int *crtc_count, RROutput *primary) {
+    uint64_t start = timing_now();
+    *primary = XRRGetOutputPrimary(dm->display, dm->root);
+    timing_record(TIMING_PRIMARY, start);
     
-    dm->screen_count = 0;
+    // CRTC table first, geometry is resolved from it after indexing
+    for (int i = 0; crtcs && i < res->ncrtc; i++) {
+        RRCrtc crtc = res->crtcs[i];
+        start = timing_now();
+        XRRCrtcInfo *crtc_info = XRRGetCrtcInfo(dm->display, res, crtc);
+        timing_record(TIMING_CRTC_INFO, start);
+        store_crtc_state(&crtcs[(*crtc_count)++], crtc, crtc_info);
+        if (crtc_info) XRRFreeCrtcInfo(crtc_info);
+    }
     
     // Process each output
-    for (int i = 0; i < dm->resources->noutput; i++) {
-        XRROutputInfo *output_info = XRRGetOutputInfo(dm->display, 
-                                                      dm->resources, 
-                                                      dm->resources->outputs[i]);
+    for (int i = 0; screens && i < res->noutput; i++) {
+        start = timing_now();
+        XRROutputInfo *output_info = XRRGetOutputInfo(dm->display, res, res->outputs[i]);
+        timing_record(TIMING_OUTPUT_INFO, start);
         if (!output_info) continue;
         
-        ScreenInfo *screen = &dm->screens[dm->screen_count];
-        populate_screen_info(dm, screen, dm->resources->outputs[i], output_info);
+        ScreenInfo *screen = &screens[*screen_count];
+        int result = populate_screen_info(screen, res->outputs[i], output_info, *primary);
         
         XRRFreeOutputInfo(output_info);
-        dm->screen_count++;
+        if (result != 0) return -1;
+        (*screen_count)++;
     }
+    return 0;
+}
+
+int dm_xlib_populate_screens(DisplayManager *dm) {
+    RROutput primary;
+    return dm_xlib_query_topology(dm, dm->resources, dm->screens, &dm->screen_count,
+                                  dm->topology.crtcs, &dm->topology.crtc_count, &primary);
+}
+
+// Human readable backend name
+const char* dm_backend_name(DmBackend backend) {
+    return backend == DM_BACKEND_XCB ? "xcb" : "xlib";
+}
+
+// Main function - enumerate and populate all screens
+int dm_get_screens(DisplayManager *dm) {
+    if (dm_ensure_resources(dm) != 0) return -1;
+    
+    // Modes were created/destroyed since the fetch - the snapshot needs a fresh list
+    if (dm->resources_stale && replace_resources(dm) != 0) return -1;
+    
+    uint64_t start = timing_now();
+    
+    // Allocate space for all outputs
+    int max_screens = allocate_screen_array(dm);
+    if (max_screens < 0) return -1;
+    if (max_screens == 0) {
+        dm->screens_valid = true;
+        return 0;
+    }
+    
+    int result = (dm->backend == DM_BACKEND_XCB)
+        ? dm_xcb_populate_screens(dm)
+        : dm_xlib_populate_screens(dm);
+    if (result != 0) return -1;
+    
+    // Index the snapshot and resolve geometry from the CRTC table
+    if (dm_topology_rebuild(dm) != 0) {
+        fprintf(stderr, "Failed to index topology\n");
+        return -1;
+    }
+    dm->screens_valid = true;
+    timing_record(TIMING_ENUMERATE, start);
     
     // Return count of connected screens (calculated after population)
     return dm_count_connected_screens(dm);
 }
 
+// Re-fetch screen resources and rebuild dm->screens from scratch
+int dm_reload(DisplayManager *dm) {
+    if (!dm) return -1;
+    if (replace_resources(dm) != 0) return -1;
+    
+    // Mode list may have changed - rebuild the timing index on next use
+    mode_cache_free(dm->mode_cache);
+    dm->mode_cache = NULL;
+    
+    return dm_get_screens(dm);
+}
+
+// Error trap state - Xlib error handlers are process global, so one handler is
+// installed once and never swapped. It attributes each error by connection and
+// serial: to the dm trap, to a connection's watch, or else to the handler it replaced.
+#define DM_TRAP_MAX_ERRORS 256
+static pthread_once_t trap_handler_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t trap_lock = PTHREAD_MUTEX_INITIALIZER;
+static XErrorHandler previous_error_handler = NULL;
+static Display *trap_display = NULL;           // Connection trapped by dm_trap_errors, NULL = none
+static unsigned long trap_first_serial = 0;
+static int trapped_error_code = 0;
+static struct {
+    unsigned long serial;
+    int error_code;
+} trapped_errors[DM_TRAP_MAX_ERRORS];
+static int trapped_error_count = 0;
+static DmErrorWatch *error_watches = NULL;     // Active dm_watch_errors, one per connection at most
+
+// Record errors raised by trapped or watched requests, keyed by connection and request serial
+static int trap_error_handler(Display *display, XErrorEvent *error) {
+    pthread_mutex_lock(&trap_lock);
+    bool handled = false;
+    if (display == trap_display && error->serial >= trap_first_serial) {
+        if (trapped_error_code == 0) trapped_error_code = error->error_code;
+        if (trapped_error_count < DM_TRAP_MAX_ERRORS) {
+            trapped_errors[trapped_error_count].serial = error->serial;
+            trapped_errors[trapped_error_count].error_code = error->error_code;
+            trapped_error_count++;
+        }
+        handled = true;
+    }
+    for (DmErrorWatch *watch = error_watches; watch && !handled; watch = watch->next) {
+        if (watch->display != display || error->serial < watch->first_serial) continue;
+        if (watch->error_code == 0) watch->error_code = error->error_code;
+        handled = true;
+    }
+    XErrorHandler previous = previous_error_handler;
+    pthread_mutex_unlock(&trap_lock);
+    
+    // Not ours - behave as if we were never installed (Xlib's default exits)
+    if (!handled && previous) return previous(display, error);
+    return 0;
+}
+
+static void install_trap_handler(void) {
+    previous_error_handler = XSetErrorHandler(trap_error_handler);
+}
+
+// Start collecting errors - requests already in flight are not attributed to the trap
+void dm_trap_errors(DisplayManager *dm) {
+    if (!dm) return;
+    pthread_once(&trap_handler_once, install_trap_handler);
+    pthread_mutex_lock(&trap_lock);
+    trap_display = dm->display;
+    trap_first_serial = NextRequest(dm->display);
+    trapped_error_code = 0;
+    trapped_error_count = 0;
+    pthread_mutex_unlock(&trap_lock);
+}
+
+// Peek at the trapped error without syncing
+int dm_trapped_error(void) {
+    return trapped_error_code;
+}
+
+// First trapped error raised by a request with serial in [first_serial, end_serial)
+int dm_trapped_error_in(unsigned long first_serial, unsigned long end_serial) {
+    for (int i = 0; i < trapped_error_count; i++) {
+        if (trapped_errors[i].serial >= first_serial && trapped_errors[i].serial < end_serial) {
+            return trapped_errors[i].error_code;
+        }
+    }
+    return 0;
+}
+
+// Flush outstanding requests, stop attributing errors to the trap and report
+int dm_untrap_errors(DisplayManager *dm) {
+    if (!dm) return 0;
+    uint64_t start = timing_now();
+    XSync(dm->display, False);
+    timing_record(TIMING_SYNC, start);
+    pthread_mutex_lock(&trap_lock);
+    trap_display = NULL;
+    pthread_mutex_unlock(&trap_lock);
+    return trapped_error_code;
+}
+
+// Start collecting errors for requests the calling thread issues on display from now on
+void dm_watch_errors(DmErrorWatch *watch, Display *display) {
+    pthread_once(&trap_handler_once, install_trap_handler);
+    watch->display = display;
+    watch->first_serial = NextRequest(display);
+    watch->error_code = 0;
+    pthread_mutex_lock(&trap_lock);
+    watch->next = error_watches;
+    error_watches = watch;
+    pthread_mutex_unlock(&trap_lock);
+}
+
+// Sync the watched connection, then stop watching it
+int dm_unwatch_errors(DmErrorWatch *watch) {
+    XSync(watch->display, False);
+    pthread_mutex_lock(&trap_lock);
+    for (DmErrorWatch **link = &error_watches; *link; link = &(*link)->next) {
+        if (*link == watch) {
+            *link = watch->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&trap_lock);
+    return watch->error_code;
+}
+
+// XSync unless the caller batches requests and syncs once itself
+void dm_sync(DisplayManager *dm) {
+    if (!dm || dm->defer_sync) return;
+    uint64_t start = timing_now();
+    XSync(dm->display, False);
+    timing_record(TIMING_SYNC, start);
+}
+
+// Subscribe to the RandR notifications that can change our cached topology
+int dm_select_events(DisplayManager *dm) {
+    if (!dm) return -1;
+    if (dm->events_selected) return 0;
+    
+    if (!XRRQueryExtension(dm->display, &dm->rr_event_base, &dm->rr_error_base)) {
+        fprintf(stderr, "XRandR extension not available\n");
+        return -1;
+    }
+    
+    XRRSelectInput(dm->display, dm->root,
+                   RRScreenChangeNotifyMask | RROutputChangeNotifyMask | RRCrtcChangeNotifyMask);
+    XFlush(dm->display);
+    
+    dm->events_selected = true;
+    return 0;
+}
+
+// CRTC change events carry the full geometry, so no round trip is needed
+static int apply_crtc_change(DisplayManager *dm, const XRRCrtcChangeNotifyEvent *ev) {
+    CrtcState *crtc = dm_find_crtc(dm, ev->crtc);
+    if (!crtc) return 0;
+    
+    crtc->mode = ev->mode;
+    crtc->rotation = ev->rotation;
+    if (ev->mode == None) {
+        // CRTC was disabled - outputs keep their connection state but have no geometry
+        crtc->x = crtc->y = 0;
+        crtc->width = crtc->height = 0;
+    } else {
+        crtc->x = ev->x;
+        crtc->y = ev->y;
+        crtc->width = ev->width;
+        crtc->height = ev->height;
+    }
+    
+    for (int i = 0; i < crtc->noutput; i++) {
+        ScreenInfo *screen = dm_find_screen_by_output(dm, crtc->outputs[i]);
+        if (screen) dm_screen_sync_geometry(dm, screen);
+    }
+    return 1;
+}
+
+// Move an output from its old CRTC's output list to the new one
+static void rebind_output(DisplayManager *dm, ScreenInfo *screen, RRCrtc new_crtc) {
+    CrtcState *old_state = screen->crtc_id ? dm_find_crtc(dm, screen->crtc_id) : NULL;
+    if (old_state) {
+        for (int i = 0; i < old_state->noutput; i++) {
+            if (old_state->outputs[i] != screen->output_id) continue;
+            old_state->outputs[i] = old_state->outputs[--old_state->noutput];
+            break;
+        }
+    }
+    
+    CrtcState *new_state = new_crtc ? dm_find_crtc(dm, new_crtc) : NULL;
+    if (new_state && new_state->noutput < DM_MAX_CRTC_OUTPUTS) {
+        bool listed = false;
+        for (int i = 0; i < new_state->noutput; i++) {
+            if (new_state->outputs[i] == screen->output_id) listed = true;
+        }
+        if (!listed) new_state->outputs[new_state->noutput++] = screen->output_id;
+    }
+    screen->crtc_id = new_crtc;
+}
+
+// Output change events carry connection and CRTC; the mode list may have
+// changed too, so the output itself is re-read (one request per changed output)
+static int apply_output_change(DisplayManager *dm, const XRROutputChangeNotifyEvent *ev,
+                               bool *need_reload) {
+    ScreenInfo *screen = dm_find_screen_by_output(dm, ev->output);
+    if (!screen) {
+        // Output we have never seen (e.g. MST hotplug) - the output list itself changed
+        *need_reload = true;
+        return 0;
+    }
+    
+    screen->connected = (ev->connection == RR_Connected);
+    rebind_output(dm, screen, screen->connected ? ev->crtc : 0);
+    
+    uint64_t start = timing_now();
+    XRROutputInfo *output_info = XRRGetOutputInfo(dm->display, dm->resources, ev->output);
+    timing_record(TIMING_OUTPUT_INFO, start);
+    if (output_info) {
+        dm_screen_free_lists(screen);
+        if (dm_screen_alloc_lists(screen, output_info->nmode, output_info->ncrtc) == 0) {
+            memcpy(screen->modes, output_info->modes, output_info->nmode * sizeof(RRMode));
+            memcpy(screen->possible_crtcs, output_info->crtcs, output_info->ncrtc * sizeof(RRCrtc));
+            screen->preferred_count = output_info->npreferred;
+        }
+        XRRFreeOutputInfo(output_info);
+    }
+    
+    dm_screen_sync_geometry(dm, screen);
+    return 1;
+}
+
+// Primary output is not part of any notify event, so re-read it once per batch
+static void refresh_primary(DisplayManager *dm) {
+    uint64_t start = timing_now();
+    RROutput primary = XRRGetOutputPrimary(dm->display, dm->root);
+    timing_record(TIMING_PRIMARY, start);
+    
+    for (int i = 0; i < dm->screen_count; i++) {
+        ScreenInfo *screen = &dm->screens[i];
+        screen->primary = screen->connected && screen->crtc_id && screen->output_id == primary;
+    }
+}
+
+// Drain all queued X events and fold RandR changes into the cache
+int dm_process_events(DisplayManager *dm) {
+    if (!dm || !dm->events_selected) return -1;
+    
+    int changes = 0;
+    bool need_reload = false;
+    bool need_primary = false;
+    
+    while (XPending(dm->display) > 0) {
+        XEvent event;
+        XNextEvent(dm->display, &event);
+        
+        if (event.type == dm->rr_event_base + RRScreenChangeNotify) {
+            XRRScreenChangeNotifyEvent *ev = (XRRScreenChangeNotifyEvent *)&event;
+            XRRUpdateConfiguration(&event);
+            
+            // A new config timestamp means outputs, CRTCs or modes were added/removed
+            if (!dm->resources || ev->config_timestamp != dm->resources->configTimestamp) {
+                need_reload = true;
+            }
+            changes++;
+        } else if (event.type == dm->rr_event_base + RRNotify) {
+            XRRNotifyEvent *ev = (XRRNotifyEvent *)&event;
+            
+            if (ev->subtype == RRNotify_CrtcChange) {
+                changes += apply_crtc_change(dm, (XRRCrtcChangeNotifyEvent *)ev);
+            } else if (ev->subtype == RRNotify_OutputChange) {
+                changes += apply_output_change(dm, (XRROutputChangeNotifyEvent *)ev, &need_reload);
+                need_primary = true;
+            }
+        }
+    }
+    
+    // Re-read only what the new config timestamp says can differ
+    if (need_reload) {
+        if (dm_refresh(dm, NULL) < 0) return -1;
+        changes++;
+    } else if (need_primary) {
+        refresh_primary(dm);
+    }
+    
+    return changes;
+}
+
 // Print all outputs and their connection status
 void dm_print_screens(DisplayManager *dm) {
     if (!dm || !dm->screens) return;
@@ -163,7 +585,9 @@ void dm_print_screens(DisplayManager *dm) {
 void dm_cleanup(DisplayManager *dm) {
     if (!dm) return;
     
-    if (dm->screens) free(dm->screens);
+    free_screen_array(dm);
+    dm_topology_free(dm);
+    mode_cache_free(dm->mode_cache);
     if (dm->resources) XRRFreeScreenResources(dm->resources);
     if (dm->display) XCloseDisplay(dm->display);
     free(dm);
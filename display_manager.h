@@ -4,6 +4,10 @@
 #include <X11/Xlib.h>
 #include <X11/extensions/Xrandr.h>
 #include <stdbool.h>
+#include "mode_cache.h"
+#include "index_map.h"
+
+#define DM_MAX_CRTC_OUTPUTS 8   // Outputs tracked per CRTC (clone mode)
 
 // Information about a single monitor
 typedef struct {
@@ -16,27 +20,185 @@ typedef struct {
     bool primary;           // Is this the primary monitor?
     RROutput output_id;     // X11 output identifier
     RRCrtc crtc_id;        // X11 CRTC identifier
+    RRMode mode_id;         // Mode currently driving the CRTC (0 if none)
+    RRMode *modes;          // Modes available on this output (owned by DisplayManager)
+    int mode_count;
+    int preferred_count;    // The first preferred_count modes are preferred
+    RRCrtc *possible_crtcs; // CRTCs able to drive this output (owned by DisplayManager)
+    int possible_crtc_count;
 } ScreenInfo;
 
+// CRTC state captured during enumeration
+typedef struct {
+    RRCrtc id;
+    int x;
+    int y;
+    unsigned int width;
+    unsigned int height;
+    RRMode mode;            // None when the CRTC is disabled
+    Rotation rotation;
+    int noutput;
+    RROutput outputs[DM_MAX_CRTC_OUTPUTS];
+} CrtcState;
+
+// One XRandR mode known to the server
+typedef struct {
+    RRMode id;
+    char name[64];
+    unsigned int width;
+    unsigned int height;
+    unsigned long dot_clock;    // Hz
+    unsigned int h_total;
+    unsigned int v_total;
+    unsigned long flags;
+} ModeEntry;
+
+// Indexed snapshot of outputs (dm->screens), CRTCs and modes
+typedef struct {
+    CrtcState *crtcs;
+    int crtc_count;
+    ModeEntry *modes;
+    int mode_count;
+    int mode_capacity;
+    IndexMap output_by_name;    // name hash -> dm->screens index
+    IndexMap output_by_id;      // RROutput -> dm->screens index
+    IndexMap crtc_by_id;        // RRCrtc -> crtcs index
+    IndexMap mode_by_id;        // RRMode -> modes index
+    IndexMap mode_by_name;      // name hash -> modes index
+} Topology;
+
+// How screen resources are fetched from the server
+typedef enum {
+    DM_ENUM_CURRENT,    // XRRGetScreenResourcesCurrent - no hardware probe (fast)
+    DM_ENUM_REPROBE     // XRRGetScreenResources - server re-probes every connector (slow)
+} DmEnumMode;
+
+// Which protocol binding dm_get_screens uses to query outputs
+typedef enum {
+    DM_BACKEND_XCB,     // Pipelined xcb-randr requests, ~2 round trips total (default)
+    DM_BACKEND_XLIB     // Blocking Xlib calls, 2-3 round trips per output
+} DmBackend;
+
+// What dm_refresh found different about one output
+typedef enum {
+    DM_CHANGE_ADDED      = 1 << 0,  // New output (hotplug, MST) - all other flags clear
+    DM_CHANGE_REMOVED    = 1 << 1,  // Output is gone - name and ID are from the old snapshot
+    DM_CHANGE_CONNECTION = 1 << 2,  // Connected state flipped
+    DM_CHANGE_CRTC       = 1 << 3,  // Driven by another CRTC, or lit/unlit
+    DM_CHANGE_GEOMETRY   = 1 << 4,  // Position or size - capture must follow (capture_update_geometry)
+    DM_CHANGE_MODE       = 1 << 5,  // Scanout mode, and so refresh rate - frame pacing must follow
+    DM_CHANGE_MODE_LIST  = 1 << 6,  // Modes the output offers
+    DM_CHANGE_PRIMARY    = 1 << 7
+} DmChangeFlags;
+
+typedef struct {
+    RROutput output;
+    char name[32];
+    unsigned int flags;         // DmChangeFlags
+} DmOutputChange;
+
+// Result of one dm_refresh - reuse it across calls, dm_change_set_free when done
+typedef struct {
+    DmOutputChange *outputs;    // Changed outputs only, in snapshot order (removed ones last)
+    int count;
+    int capacity;
+    bool modes_changed;         // Server mode list changed - mode index and cache were rebuilt
+    int output_queries;         // Outputs re-read from the server (0 unless the config timestamp moved)
+} DmChangeSet;
+
 // Main structure for managing X11 display and monitors
 typedef struct {
     Display *display;              // Connection to X11 server
     Window root;                   // Root window (desktop)
     int screen;                    // Default screen number
-    XRRScreenResources *resources; // XRandR screen resources (outputs/monitors)
+    XRRScreenResources *resources; // XRandR screen resources (NULL until dm_ensure_resources)
+    bool resources_stale;          // Mode list changed by us before outputs were enumerated
+    DmEnumMode enum_mode;          // Requested enumeration path
+    DmBackend backend;             // Backend used by dm_get_screens and dm_refresh
+    bool probe_fallback;           // Did the last fetch have to fall back to a full probe?
     ScreenInfo *screens;           // Array of monitor info (all outputs)
     int screen_count;              // Total number of outputs (connected + disconnected)
+    bool screens_valid;            // Has dm->screens been populated (see dm_ensure_screens)?
+    Topology topology;             // Indexed snapshot built by dm_get_screens
+    int rr_event_base;             // First XRandR event code (set by dm_select_events)
+    int rr_error_base;             // First XRandR error code
+    bool events_selected;          // Are we subscribed to RandR change notifications?
+    ModeCache *mode_cache;         // Timing index of existing modes (built lazily, NULL until used)
+    bool force_new_modes;          // Skip mode deduplication in mode_create_cvt
+    bool defer_sync;               // Batch mode: mode operations skip their XSync, caller syncs once
+    struct ProfileRegistry *profiles; // Tablet profiles with prewarmed modes, exempt from GC (not owned, NULL = none)
 } DisplayManager;
 
+// Error watch on one connection other than dm->display (e.g. a capture thread's own)
+typedef struct DmErrorWatch {
+    Display *display;
+    unsigned long first_serial;    // Errors for requests from this serial on are caught
+    int error_code;                // First error caught (0 = none)
+    struct DmErrorWatch *next;
+} DmErrorWatch;
+
 // Core functions
-DisplayManager* dm_init(void);                    // Initialize display manager - returns NULL on failure
+DisplayManager* dm_init(DmEnumMode enum_mode);    // Connect to X (no resource fetch) - returns NULL on failure
+int dm_ensure_resources(DisplayManager *dm);      // Fetch XRandR resources if not done yet - returns 0 on success
+XRRScreenResources* dm_fetch_resources(DisplayManager *dm); // Fresh resources via the enumeration path, caller frees - NULL on failure
+int dm_ensure_screens(DisplayManager *dm);        // Enumerate outputs if not done yet - returns connected count, -1 on error
 int dm_get_screens(DisplayManager *dm);           // Get all screen info - returns number of connected monitors, -1 on error
 void dm_print_screens(DisplayManager *dm);        // Print monitor info to stdout
 void dm_cleanup(DisplayManager *dm);              // Clean up resources - safe to call with NULL
 
+// X error trapping - collects asynchronous errors instead of exiting
+void dm_trap_errors(DisplayManager *dm);          // Start collecting errors for requests issued from now on
+int dm_trapped_error(void);                       // First trapped error code so far (0 = none), no round trip
+int dm_trapped_error_in(unsigned long first_serial, unsigned long end_serial); // First error for serials in range (0 = none)
+int dm_untrap_errors(DisplayManager *dm);         // Sync, stop trapping - returns first error code (0 = none)
+void dm_watch_errors(DmErrorWatch *watch, Display *display); // Catch errors on display from now on, any thread, caller owns watch
+int dm_unwatch_errors(DmErrorWatch *watch);       // Sync, stop watching - returns first error code (0 = none)
+void dm_sync(DisplayManager *dm);                 // XSync unless dm->defer_sync is set
+
+// Topology cache maintenance (used by daemon mode)
+int dm_select_events(DisplayManager *dm);         // Subscribe to RandR screen/output/CRTC notifications - returns 0 on success
+int dm_process_events(DisplayManager *dm);        // Apply pending RandR events to dm->screens - returns number of changes, -1 on error
+int dm_reload(DisplayManager *dm);                // Re-fetch resources and re-enumerate all outputs - returns connected count, -1 on error
+int dm_refresh(DisplayManager *dm, DmChangeSet *changes); // Diff current resources against the snapshot, re-read only what moved - returns changed outputs, -1 on error
+const DmOutputChange* dm_change_find(const DmChangeSet *changes, RROutput output); // Change of one output (NULL = unchanged)
+void dm_change_set_free(DmChangeSet *changes);    // Safe on zeroed set
+
+// Snapshot lookups - O(1) hash lookups, no X round trips
+ScreenInfo* dm_find_screen(DisplayManager *dm, const char *name);          // Output by name (NULL if unknown)
+ScreenInfo* dm_find_screen_by_output(DisplayManager *dm, RROutput output); // Output by ID (NULL if unknown)
+CrtcState* dm_find_crtc(DisplayManager *dm, RRCrtc crtc);                  // CRTC by ID (NULL if unknown)
+ModeEntry* dm_find_mode(DisplayManager *dm, RRMode mode);                  // Mode by ID (NULL if unknown)
+ModeEntry* dm_find_mode_by_name(DisplayManager *dm, const char *name);     // Mode by name (NULL if unknown)
+bool dm_screen_has_mode(const ScreenInfo *screen, RRMode mode);            // Is mode in the output's mode list?
+double dm_mode_refresh(const ModeEntry *mode);                             // dotClock / (hTotal * vTotal) in Hz (0 if unknown)
+
+// Snapshot maintenance - keep the snapshot in step with requests we issue
+int dm_topology_rebuild(DisplayManager *dm);                               // Re-index after enumeration - returns 0 on success
+void dm_topology_free(DisplayManager *dm);                                 // Free snapshot storage and indexes
+int dm_topology_add_mode(DisplayManager *dm, const XRRModeInfo *info, RRMode mode); // Record a created mode
+void dm_topology_remove_mode(DisplayManager *dm, RRMode mode);             // Forget a destroyed mode everywhere
+int dm_screen_add_mode(ScreenInfo *screen, RRMode mode);                   // Append to output mode list
+void dm_screen_remove_mode(ScreenInfo *screen, RRMode mode);               // Drop from output mode list
+void dm_crtc_set_outputs(DisplayManager *dm, CrtcState *crtc,
+                         const RROutput *outputs, int noutput);            // Rebind CRTC and its outputs' crtc_id
+void dm_screen_sync_geometry(DisplayManager *dm, ScreenInfo *screen);     // Copy geometry from the screen's CRTC state
+int dm_screen_alloc_lists(ScreenInfo *screen, int mode_count, int crtc_count); // Backend helper - returns 0 on success
+void dm_screen_free_lists(ScreenInfo *screen);
+
+// Backend implementations - fill the preallocated dm->screens (names, connection,
+// crtc_id, primary, mode and CRTC lists) and dm->topology.crtcs, set counts
+int dm_xlib_populate_screens(DisplayManager *dm);  // Returns 0 on success, -1 on error
+int dm_xcb_populate_screens(DisplayManager *dm);   // Returns 0 on success, -1 on error
+int dm_xlib_query_topology(DisplayManager *dm, XRRScreenResources *res, ScreenInfo *screens, int *screen_count,
+                           CrtcState *crtcs, int *crtc_count, RROutput *primary); // Blocking, NULL screens/crtcs are skipped
+int dm_xcb_query_topology(DisplayManager *dm, XRRScreenResources *res, ScreenInfo *screens, int *screen_count,
+                          CrtcState *crtcs, int *crtc_count, RROutput *primary); // Pipelined, NULL screens/crtcs are skipped
+const char* dm_backend_name(DmBackend backend);
+
 // Utility functions for working with screen data
 int dm_count_connected_screens(DisplayManager *dm);     // Count currently connected screens
 int dm_count_disconnected_screens(DisplayManager *dm);  // Count currently disconnected screens
 ScreenInfo* dm_get_primary_screen(DisplayManager *dm);  // Get pointer to primary screen (NULL if none)
+const char* dm_enum_path_name(DisplayManager *dm);      // Describe which enumeration path produced dm->resources
 
 #endif
\ No newline at end of file
@@ -0,0 +1,307 @@
+#include "display_manager.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Incremental re-enumeration. The server keeps two stamps: configTimestamp
+// moves when outputs or CRTCs come or go, or an output's connection or mode
+// list changes; timestamp moves whenever a CRTC is set. dm_refresh fetches
+// the current resources, compares both with the snapshot's and re-reads only
+// what they say can differ, through dm->backend (one pipelined round trip with xcb):
+//   neither moved       primary output
+//   timestamp           primary + CRTC table (bindings come from the CRTCs)
+//   configTimestamp     primary + CRTC table + every output
+// Outputs whose mode and CRTC lists are unchanged keep their ScreenInfo and
+// allocations, and dm->screens itself is only replaced when outputs were
+// added or removed. The change set is the diff against the old snapshot.
+
+// Scalars the diff compares, saved before the snapshot is touched
+typedef struct {
+    RROutput output;
+    char name[32];
+    bool connected;
+    bool primary;
+    RRCrtc crtc_id;
+    RRMode mode_id;
+    int x;
+    int y;
+    unsigned int width;
+    unsigned int height;
+} OutputState;
+
+static bool same_ids(const XID *a, int a_count, const XID *b, int b_count) {
+    return a_count == b_count && (a_count == 0 || memcmp(a, b, a_count * sizeof(XID)) == 0);
+}
+
+static bool same_modes(const XRRScreenResources *a, const XRRScreenResources *b) {
+    if (a->nmode != b->nmode) return false;
+    for (int i = 0; i < a->nmode; i++) {
+        if (a->modes[i].id != b->modes[i].id) return false;
+    }
+    return true;
+}
+
+static bool same_lists(const ScreenInfo *a, const ScreenInfo *b) {
+    return a->preferred_count == b->preferred_count &&
+           same_ids(a->modes, a->mode_count, b->modes, b->mode_count) &&
+           same_ids(a->possible_crtcs, a->possible_crtc_count, b->possible_crtcs, b->possible_crtc_count);
+}
+
+// Hand from's mode and CRTC lists to an entry that has none
+static void move_lists(ScreenInfo *to, ScreenInfo *from) {
+    to->modes = from->modes;
+    to->mode_count = from->mode_count;
+    to->preferred_count = from->preferred_count;
+    to->possible_crtcs = from->possible_crtcs;
+    to->possible_crtc_count = from->possible_crtc_count;
+    from->modes = NULL;
+    from->possible_crtcs = NULL;
+    from->mode_count = from->possible_crtc_count = 0;
+}
+
+static void save_state(OutputState *state, const ScreenInfo *screen) {
+    state->output = screen->output_id;
+    snprintf(state->name, sizeof(state->name), "%s", screen->name);
+    state->connected = screen->connected;
+    state->primary = screen->primary;
+    state->crtc_id = screen->crtc_id;
+    state->mode_id = screen->mode_id;
+    state->x = screen->x;
+    state->y = screen->y;
+    state->width = screen->width;
+    state->height = screen->height;
+}
+
+static unsigned int diff_output(const OutputState *before, const ScreenInfo *after) {
+    unsigned int flags = 0;
+    if (before->connected != after->connected) flags |= DM_CHANGE_CONNECTION;
+    if (before->crtc_id != after->crtc_id) flags |= DM_CHANGE_CRTC;
+    if (before->x != after->x || before->y != after->y ||
+        before->width != after->width || before->height != after->height) flags |= DM_CHANGE_GEOMETRY;
+    if (before->mode_id != after->mode_id) flags |= DM_CHANGE_MODE;
+    if (before->primary != after->primary) flags |= DM_CHANGE_PRIMARY;
+    return flags;
+}
+
+static int add_change(DmChangeSet *changes, RROutput output, const char *name, unsigned int flags) {
+    if (!changes) return 0;
+    if (changes->count == changes->capacity) {
+        int capacity = changes->capacity ? changes->capacity * 2 : 8;
+        DmOutputChange *grown = realloc(changes->outputs, capacity * sizeof(DmOutputChange));
+        if (!grown) return -1;
+        changes->outputs = grown;
+        changes->capacity = capacity;
+    }
+    DmOutputChange *change = &changes->outputs[changes->count++];
+    change->output = output;
+    snprintf(change->name, sizeof(change->name), "%s", name);
+    change->flags = flags;
+    return 0;
+}
+
+// Fold re-read outputs into the snapshot (takes fresh). Entries whose lists did
+// not change keep their allocations; list_changed marks the ones that got new lists
+static void merge_outputs(DisplayManager *dm, ScreenInfo *fresh, int fresh_count, bool *kept, bool *list_changed) {
+    bool in_place = fresh_count == dm->screen_count;
+    for (int i = 0; in_place && i < fresh_count; i++) {
+        if (fresh[i].output_id != dm->screens[i].output_id) in_place = false;
+    }
+    
+    // Same outputs in the same order - update entries where they are
+    if (in_place) {
+        for (int i = 0; i < fresh_count; i++) {
+            ScreenInfo *screen = &dm->screens[i];
+            if (same_lists(screen, &fresh[i])) {
+                dm_screen_free_lists(&fresh[i]);
+                move_lists(&fresh[i], screen);
+            } else {
+                dm_screen_free_lists(screen);
+                list_changed[i] = true;
+            }
+            *screen = fresh[i];
+        }
+        free(fresh);
+        return;
+    }
+    
+    for (int i = 0; i < fresh_count; i++) {
+        ScreenInfo *old = dm_find_screen_by_output(dm, fresh[i].output_id);
+        if (old && same_lists(old, &fresh[i])) {
+            dm_screen_free_lists(&fresh[i]);
+            move_lists(&fresh[i], old);
+            kept[old - dm->screens] = true;
+        } else {
+            list_changed[i] = old != NULL;  // New outputs are reported as added instead
+        }
+    }
+    for (int i = 0; i < dm->screen_count; i++) {
+        if (!kept[i]) dm_screen_free_lists(&dm->screens[i]);
+    }
+    free(dm->screens);
+    dm->screens = fresh;
+    dm->screen_count = fresh_count;
+}
+
+// Without re-read outputs, an output's CRTC is the one listing it
+static void bind_from_crtcs(DisplayManager *dm) {
+    for (int i = 0; i < dm->screen_count; i++) {
+        ScreenInfo *screen = &dm->screens[i];
+        screen->crtc_id = 0;
+        for (int c = 0; screen->connected && c < dm->topology.crtc_count; c++) {
+            const CrtcState *crtc = &dm->topology.crtcs[c];
+            for (int o = 0; o < crtc->noutput; o++) {
+                if (crtc->outputs[o] == screen->output_id) screen->crtc_id = crtc->id;
+            }
+        }
+    }
+}
+
+// First refresh - nothing to diff against, every output is new
+static int refresh_full(DisplayManager *dm, DmChangeSet *changes) {
+    if (dm_reload(dm) < 0) return -1;
+    for (int i = 0; i < dm->screen_count; i++) {
+        if (add_change(changes, dm->screens[i].output_id, dm->screens[i].name, DM_CHANGE_ADDED) != 0) return -1;
+    }
+    if (changes) {
+        changes->modes_changed = true;
+        changes->output_queries = dm->screen_count;
+    }
+    return dm->screen_count;
+}
+
+int dm_refresh(DisplayManager *dm, DmChangeSet *changes) {
+    if (!dm) return -1;
+    if (changes) {
+        changes->count = 0;
+        changes->modes_changed = false;
+        changes->output_queries = 0;
+    }
+    if (!dm->screens_valid || !dm->resources) return refresh_full(dm, changes);
+    
+    uint64_t start = timing_now();
+    XRRScreenResources *res = dm_fetch_resources(dm);
+    if (!res) {
+        fprintf(stderr, "Failed to get XRandR screen resources\n");
+        return -1;
+    }
+    
+    XRRScreenResources *old = dm->resources;
+    bool outputs_moved = res->configTimestamp != old->configTimestamp ||
+                         !same_ids(old->outputs, old->noutput, res->outputs, res->noutput) ||
+                         !same_ids(old->crtcs, old->ncrtc, res->crtcs, res->ncrtc);
+    bool crtcs_moved = outputs_moved || res->timestamp != old->timestamp;
+    bool modes_moved = dm->resources_stale || !same_modes(old, res);
+    
+    // Everything that can fail is allocated before the snapshot is touched
+    int before_count = dm->screen_count;
+    int after_max = res->noutput > before_count ? res->noutput : before_count;
+    OutputState *before = calloc(before_count > 0 ? before_count : 1, sizeof(OutputState));
+    bool *seen = calloc(before_count > 0 ? before_count : 1, sizeof(bool));
+    bool *list_changed = calloc(after_max > 0 ? after_max : 1, sizeof(bool));
+    CrtcState *crtcs = crtcs_moved ? calloc(res->ncrtc > 0 ? res->ncrtc : 1, sizeof(CrtcState)) : NULL;
+    ScreenInfo *fresh = outputs_moved ? calloc(res->noutput > 0 ? res->noutput : 1, sizeof(ScreenInfo)) : NULL;
+    IndexMap previous = { 0 };
+    int fresh_count = 0;
+    int crtc_count = 0;
+    RROutput primary = 0;
+    int result = -1;
+    if (!before || !seen || !list_changed || (crtcs_moved && !crtcs) || (outputs_moved && !fresh) ||
+        index_map_init(&previous, before_count) != 0) {
+        goto fail;
+    }
+    for (int i = 0; i < before_count; i++) {
+        save_state(&before[i], &dm->screens[i]);
+        if (index_map_put(&previous, dm->screens[i].output_id, i) != 0) goto fail;
+    }
+    int queried = (dm->backend == DM_BACKEND_XCB)
+        ? dm_xcb_query_topology(dm, res, fresh, &fresh_count, crtcs, &crtc_count, &primary)
+        : dm_xlib_query_topology(dm, res, fresh, &fresh_count, crtcs, &crtc_count, &primary);
+    if (queried != 0) goto fail;
+    
+    // Apply: outputs first (merge looks old entries up by ID), then CRTCs, then resources
+    if (fresh) {
+        merge_outputs(dm, fresh, fresh_count, seen, list_changed);
+        fresh = NULL;
+        memset(seen, 0, (before_count > 0 ? before_count : 1) * sizeof(bool));
+    }
+    if (crtcs) {
+        free(dm->topology.crtcs);
+        dm->topology.crtcs = crtcs;
+        dm->topology.crtc_count = crtc_count;
+        crtcs = NULL;
+        if (!outputs_moved) bind_from_crtcs(dm);
+    }
+    for (int i = 0; i < dm->screen_count; i++) {
+        ScreenInfo *screen = &dm->screens[i];
+        screen->primary = screen->connected && screen->crtc_id && screen->output_id == primary;
+    }
+    XRRFreeScreenResources(old);
+    dm->resources = res;
+    dm->resources_stale = false;
+    res = NULL;
+    if (modes_moved) {
+        mode_cache_free(dm->mode_cache);
+        dm->mode_cache = NULL;
+    }
+    if ((outputs_moved || crtcs_moved || modes_moved) && dm_topology_rebuild(dm) != 0) {
+        fprintf(stderr, "Failed to index topology\n");
+        dm->screens_valid = false;      // Next dm_ensure_screens enumerates from scratch
+        goto fail;
+    }
+    
+    // Diff against the saved state
+    result = 0;
+    for (int i = 0; i < dm->screen_count; i++) {
+        const ScreenInfo *screen = &dm->screens[i];
+        int index = index_map_find(&previous, screen->output_id, NULL, NULL);
+        unsigned int flags = DM_CHANGE_ADDED;
+        if (index >= 0) {
+            seen[index] = true;
+            flags = diff_output(&before[index], screen) | (list_changed[i] ? DM_CHANGE_MODE_LIST : 0);
+        }
+        if (!flags) continue;
+        if (add_change(changes, screen->output_id, screen->name, flags) != 0) {
+            result = -1;
+            break;
+        }
+        result++;
+    }
+    for (int i = 0; result >= 0 && i < before_count; i++) {
+        if (seen[i]) continue;
+        if (add_change(changes, before[i].output, before[i].name, DM_CHANGE_REMOVED) != 0) {
+            result = -1;
+            break;
+        }
+        result++;
+    }
+    if (changes) {
+        changes->modes_changed = modes_moved;
+        changes->output_queries = outputs_moved ? fresh_count : 0;
+    }
+    timing_record(TIMING_REFRESH, start);
+    
+fail:
+    for (int i = 0; fresh && i < fresh_count; i++) dm_screen_free_lists(&fresh[i]);
+    free(fresh);
+    free(crtcs);
+    if (res) XRRFreeScreenResources(res);
+    index_map_free(&previous);
+    free(list_changed);
+    free(seen);
+    free(before);
+    return result;
+}
+
+const DmOutputChange* dm_change_find(const DmChangeSet *changes, RROutput output) {
+    for (int i = 0; changes && i < changes->count; i++) {
+        if (changes->outputs[i].output == output) return &changes->outputs[i];
+    }
+    return NULL;
+}
+
+void dm_change_set_free(DmChangeSet *changes) {
+    if (!changes) return;
+    free(changes->outputs);
+    memset(changes, 0, sizeof(*changes));
+}
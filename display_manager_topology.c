@@ -0,0 +1,311 @@
+#include "display_manager.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Indexed topology snapshot: hash lookups for outputs, CRTCs and modes so that
+// command handling never scans arrays or asks the server again.
+
+// Match callbacks used to reject string hash collisions
+typedef struct {
+    DisplayManager *dm;
+    const char *name;
+} NameMatch;
+
+static bool screen_name_matches(int index, const void *ctx) {
+    const NameMatch *m = ctx;
+    return strcmp(m->dm->screens[index].name, m->name) == 0;
+}
+
+static bool mode_name_matches(int index, const void *ctx) {
+    const NameMatch *m = ctx;
+    return strcmp(m->dm->topology.modes[index].name, m->name) == 0;
+}
+
+// Grow the mode table to hold at least one more entry
+static int reserve_mode(Topology *topo) {
+    if (topo->mode_count < topo->mode_capacity) return 0;
+    
+    int capacity = topo->mode_capacity ? topo->mode_capacity * 2 : 64;
+    ModeEntry *grown = realloc(topo->modes, capacity * sizeof(ModeEntry));
+    if (!grown) return -1;
+    
+    topo->modes = grown;
+    topo->mode_capacity = capacity;
+    return 0;
+}
+
+// Append a mode entry and index it
+static int append_mode(Topology *topo, const XRRModeInfo *info, RRMode mode) {
+    if (reserve_mode(topo) != 0) return -1;
+    
+    int index = topo->mode_count++;
+    ModeEntry *entry = &topo->modes[index];
+    entry->id = mode;
+    snprintf(entry->name, sizeof(entry->name), "%.*s", (int)info->nameLength, info->name);
+    entry->width = info->width;
+    entry->height = info->height;
+    entry->dot_clock = info->dotClock;
+    entry->h_total = info->hTotal;
+    entry->v_total = info->vTotal;
+    entry->flags = info->modeFlags;
+    
+    if (index_map_put(&topo->mode_by_id, mode, index) != 0 ||
+        index_map_put(&topo->mode_by_name, index_map_hash_string(entry->name), index) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Copy geometry of the screen's CRTC from the snapshot
+void dm_screen_sync_geometry(DisplayManager *dm, ScreenInfo *screen) {
+    CrtcState *crtc = screen->crtc_id ? dm_find_crtc(dm, screen->crtc_id) : NULL;
+    
+    if (screen->connected && crtc && crtc->mode != None) {
+        screen->x = crtc->x;
+        screen->y = crtc->y;
+        screen->width = crtc->width;
+        screen->height = crtc->height;
+        screen->mode_id = crtc->mode;
+    } else {
+        screen->x = screen->y = 0;
+        screen->width = screen->height = 0;
+        screen->mode_id = 0;
+        if (!screen->connected) screen->primary = false;
+    }
+}
+
+// Rebuild every index after the backend filled screens and CRTCs
+int dm_topology_rebuild(DisplayManager *dm) {
+    Topology *topo = &dm->topology;
+    
+    index_map_free(&topo->output_by_name);
+    index_map_free(&topo->output_by_id);
+    index_map_free(&topo->crtc_by_id);
+    index_map_free(&topo->mode_by_id);
+    index_map_free(&topo->mode_by_name);
+    
+    int nmode = dm->resources ? dm->resources->nmode : 0;
+    if (index_map_init(&topo->output_by_name, dm->screen_count) != 0 ||
+        index_map_init(&topo->output_by_id, dm->screen_count) != 0 ||
+        index_map_init(&topo->crtc_by_id, topo->crtc_count) != 0 ||
+        index_map_init(&topo->mode_by_id, nmode) != 0 ||
+        index_map_init(&topo->mode_by_name, nmode) != 0) {
+        return -1;
+    }
+    
+    for (int i = 0; i < topo->crtc_count; i++) {
+        if (index_map_put(&topo->crtc_by_id, topo->crtcs[i].id, i) != 0) return -1;
+    }
+    
+    topo->mode_count = 0;
+    for (int i = 0; i < nmode; i++) {
+        if (append_mode(topo, &dm->resources->modes[i], dm->resources->modes[i].id) != 0) return -1;
+    }
+    
+    for (int i = 0; i < dm->screen_count; i++) {
+        ScreenInfo *screen = &dm->screens[i];
+        if (index_map_put(&topo->output_by_name, index_map_hash_string(screen->name), i) != 0 ||
+            index_map_put(&topo->output_by_id, screen->output_id, i) != 0) {
+            return -1;
+        }
+        dm_screen_sync_geometry(dm, screen);
+    }
+    return 0;
+}
+
+// Release snapshot storage
+void dm_topology_free(DisplayManager *dm) {
+    Topology *topo = &dm->topology;
+    
+    free(topo->crtcs);
+    free(topo->modes);
+    index_map_free(&topo->output_by_name);
+    index_map_free(&topo->output_by_id);
+    index_map_free(&topo->crtc_by_id);
+    index_map_free(&topo->mode_by_id);
+    index_map_free(&topo->mode_by_name);
+    memset(topo, 0, sizeof(*topo));
+}
+
+// Output by name
+ScreenInfo* dm_find_screen(DisplayManager *dm, const char *name) {
+    if (!dm || !name) return NULL;
+    
+    NameMatch match = { dm, name };
+    int index = index_map_find(&dm->topology.output_by_name, index_map_hash_string(name),
+                               screen_name_matches, &match);
+    return index >= 0 ? &dm->screens[index] : NULL;
+}
+
+// Output by RROutput
+ScreenInfo* dm_find_screen_by_output(DisplayManager *dm, RROutput output) {
+    if (!dm) return NULL;
+    
+    int index = index_map_find(&dm->topology.output_by_id, output, NULL, NULL);
+    return index >= 0 ? &dm->screens[index] : NULL;
+}
+
+// CRTC by RRCrtc
+CrtcState* dm_find_crtc(DisplayManager *dm, RRCrtc crtc) {
+    if (!dm) return NULL;
+    
+    int index = index_map_find(&dm->topology.crtc_by_id, crtc, NULL, NULL);
+    return index >= 0 ? &dm->topology.crtcs[index] : NULL;
+}
+
+// Mode by RRMode
+ModeEntry* dm_find_mode(DisplayManager *dm, RRMode mode) {
+    if (!dm) return NULL;
+    
+    int index = index_map_find(&dm->topology.mode_by_id, mode, NULL, NULL);
+    return index >= 0 ? &dm->topology.modes[index] : NULL;
+}
+
+// Mode by name
+ModeEntry* dm_find_mode_by_name(DisplayManager *dm, const char *name) {
+    if (!dm || !name) return NULL;
+    
+    NameMatch match = { dm, name };
+    int index = index_map_find(&dm->topology.mode_by_name, index_map_hash_string(name),
+                               mode_name_matches, &match);
+    return index >= 0 ? &dm->topology.modes[index] : NULL;
+}
+
+// Vertical refresh in Hz from the mode's timings (what the CRTC really scans at)
+double dm_mode_refresh(const ModeEntry *mode) {
+    if (!mode || mode->h_total == 0 || mode->v_total == 0) return 0.0;
+    
+    double v_total = mode->v_total;
+    if (mode->flags & RR_DoubleScan) v_total *= 2;
+    if (mode->flags & RR_Interlace) v_total /= 2;
+    return mode->dot_clock / ((double)mode->h_total * v_total);
+}
+
+// Is mode listed for the output? Lists are short, a scan is fine
+bool dm_screen_has_mode(const ScreenInfo *screen, RRMode mode) {
+    for (int i = 0; screen && i < screen->mode_count; i++) {
+        if (screen->modes[i] == mode) return true;
+    }
+    return false;
+}
+
+// Record a mode we just created
+int dm_topology_add_mode(DisplayManager *dm, const XRRModeInfo *info, RRMode mode) {
+    if (!dm || !info || mode == 0) return -1;
+    
+    // No snapshot yet - it will be built from resources fetched after this change
+    if (!dm->screens_valid) {
+        dm->resources_stale = true;
+        return 0;
+    }
+    if (dm_find_mode(dm, mode)) return 0;
+    return append_mode(&dm->topology, info, mode);
+}
+
+// Forget a destroyed mode - swap the last entry into its slot
+void dm_topology_remove_mode(DisplayManager *dm, RRMode mode) {
+    if (!dm) return;
+    if (!dm->screens_valid) {
+        dm->resources_stale = dm->resources != NULL;
+        return;
+    }
+    Topology *topo = &dm->topology;
+    
+    int index = index_map_find(&topo->mode_by_id, mode, NULL, NULL);
+    if (index < 0) return;
+    
+    index_map_remove(&topo->mode_by_id, mode, index);
+    index_map_remove(&topo->mode_by_name, index_map_hash_string(topo->modes[index].name), index);
+    
+    int last = topo->mode_count - 1;
+    if (index != last) {
+        ModeEntry *moved = &topo->modes[last];
+        index_map_remove(&topo->mode_by_id, moved->id, last);
+        index_map_remove(&topo->mode_by_name, index_map_hash_string(moved->name), last);
+        topo->modes[index] = *moved;
+        index_map_put(&topo->mode_by_id, moved->id, index);
+        index_map_put(&topo->mode_by_name, index_map_hash_string(topo->modes[index].name), index);
+    }
+    topo->mode_count--;
+    
+    for (int i = 0; i < dm->screen_count; i++) {
+        dm_screen_remove_mode(&dm->screens[i], mode);
+    }
+}
+
+// Append a mode to an output's list (no-op if already present)
+int dm_screen_add_mode(ScreenInfo *screen, RRMode mode) {
+    if (!screen || dm_screen_has_mode(screen, mode)) return 0;
+    
+    RRMode *grown = realloc(screen->modes, (screen->mode_count + 1) * sizeof(RRMode));
+    if (!grown) return -1;
+    
+    screen->modes = grown;
+    screen->modes[screen->mode_count++] = mode;
+    return 0;
+}
+
+// Remove a mode from an output's list, keeping order
+void dm_screen_remove_mode(ScreenInfo *screen, RRMode mode) {
+    if (!screen) return;
+    
+    for (int i = 0; i < screen->mode_count; i++) {
+        if (screen->modes[i] != mode) continue;
+        
+        memmove(&screen->modes[i], &screen->modes[i + 1],
+                (screen->mode_count - i - 1) * sizeof(RRMode));
+        screen->mode_count--;
+        if (i < screen->preferred_count) screen->preferred_count--;
+        return;
+    }
+}
+
+// Rebind a CRTC to a new set of outputs and refresh their geometry
+void dm_crtc_set_outputs(DisplayManager *dm, CrtcState *crtc, const RROutput *outputs, int noutput) {
+    if (!dm || !crtc) return;
+    
+    // Outputs dropped from this CRTC lose their geometry
+    for (int i = 0; i < crtc->noutput; i++) {
+        ScreenInfo *screen = dm_find_screen_by_output(dm, crtc->outputs[i]);
+        if (screen && screen->crtc_id == crtc->id) {
+            screen->crtc_id = 0;
+            dm_screen_sync_geometry(dm, screen);
+        }
+    }
+    
+    crtc->noutput = noutput < DM_MAX_CRTC_OUTPUTS ? noutput : DM_MAX_CRTC_OUTPUTS;
+    for (int i = 0; i < crtc->noutput; i++) {
+        crtc->outputs[i] = outputs[i];
+        
+        ScreenInfo *screen = dm_find_screen_by_output(dm, outputs[i]);
+        if (screen) {
+            screen->crtc_id = crtc->id;
+            dm_screen_sync_geometry(dm, screen);
+        }
+    }
+}
+
+// Allocate per-output lists (backends fill them)
+int dm_screen_alloc_lists(ScreenInfo *screen, int mode_count, int crtc_count) {
+    screen->modes = mode_count > 0 ? calloc(mode_count, sizeof(RRMode)) : NULL;
+    screen->possible_crtcs = crtc_count > 0 ? calloc(crtc_count, sizeof(RRCrtc)) : NULL;
+    if ((mode_count > 0 && !screen->modes) || (crtc_count > 0 && !screen->possible_crtcs)) {
+        dm_screen_free_lists(screen);
+        return -1;
+    }
+    screen->mode_count = mode_count;
+    screen->possible_crtc_count = crtc_count;
+    return 0;
+}
+
+// Free per-output lists
+void dm_screen_free_lists(ScreenInfo *screen) {
+    free(screen->modes);
+    free(screen->possible_crtcs);
+    screen->modes = NULL;
+    screen->possible_crtcs = NULL;
+    screen->mode_count = 0;
+    screen->preferred_count = 0;
+    screen->possible_crtc_count = 0;
+}
@@ -0,0 +1,149 @@
+#include "display_manager.h"
+#include "timing.h"
+#include <X11/Xlib-xcb.h>
+#include <xcb/randr.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// XCB backend for dm_get_screens and dm_refresh: every GetOutputInfo,
+// GetCrtcInfo and the GetOutputPrimary request are sent before the first reply
+// is read, so the whole enumeration costs a single round trip on top of the
+// resource fetch.
+
+// Record one CRTC reply in the snapshot table
+static void store_crtc_reply(CrtcState *state, RRCrtc crtc, xcb_randr_get_crtc_info_reply_t *crtc_info) {
+    memset(state, 0, sizeof(*state));
+    state->id = crtc;
+    if (!crtc_info) return;
+    
+    state->x = crtc_info->x;
+    state->y = crtc_info->y;
+    state->width = crtc_info->width;
+    state->height = crtc_info->height;
+    state->mode = crtc_info->mode;
+    state->rotation = crtc_info->rotation;
+    
+    int noutput = xcb_randr_get_crtc_info_outputs_length(crtc_info);
+    xcb_randr_output_t *outputs = xcb_randr_get_crtc_info_outputs(crtc_info);
+    state->noutput = noutput < DM_MAX_CRTC_OUTPUTS ? noutput : DM_MAX_CRTC_OUTPUTS;
+    for (int i = 0; i < state->noutput; i++) {
+        state->outputs[i] = outputs[i];
+    }
+}
+
+// Fill one ScreenInfo from its output reply (geometry comes from the CRTC table)
+static int populate_from_reply(ScreenInfo *screen, RROutput output_id,
+                               xcb_randr_get_output_info_reply_t *output_info,
+                               RROutput primary) {
+    snprintf(screen->name, sizeof(screen->name), "%.*s",
+             xcb_randr_get_output_info_name_length(output_info),
+             (const char *)xcb_randr_get_output_info_name(output_info));
+    screen->output_id = output_id;
+    screen->connected = (output_info->connection == XCB_RANDR_CONNECTION_CONNECTED);
+    
+    // XCB IDs are 32-bit, RandR XIDs are unsigned long - copy element-wise
+    int nmode = xcb_randr_get_output_info_modes_length(output_info);
+    int ncrtc = xcb_randr_get_output_info_crtcs_length(output_info);
+    if (dm_screen_alloc_lists(screen, nmode, ncrtc) != 0) return -1;
+    
+    xcb_randr_mode_t *modes = xcb_randr_get_output_info_modes(output_info);
+    xcb_randr_crtc_t *crtcs = xcb_randr_get_output_info_crtcs(output_info);
+    for (int i = 0; i < nmode; i++) screen->modes[i] = modes[i];
+    for (int i = 0; i < ncrtc; i++) screen->possible_crtcs[i] = crtcs[i];
+    screen->preferred_count = output_info->num_preferred;
+    
+    // Only track CRTC and primary status for connected monitors
+    if (screen->connected && output_info->crtc) {
+        screen->crtc_id = output_info->crtc;
+        screen->primary = (primary == output_id);
+    } else {
+        screen->crtc_id = 0;
+        screen->primary = false;
+    }
+    return 0;
+}
+
+// Pipelined query of the primary output and, unless screens/crtcs is NULL,
+// every output/CRTC of res - appends to screens/crtcs and their counts
+int dm_xcb_query_topology(DisplayManager *dm, XRRScreenResources *res, ScreenInfo *screens, int *screen_count,
+                          CrtcState *crtcs, int *crtc_count, RROutput *primary) {
+    xcb_connection_t *conn = XGetXCBConnection(dm->display);
+    if (!conn) {
+        fprintf(stderr, "No XCB connection behind Xlib display\n");
+        return -1;
+    }
+    
+    xcb_timestamp_t config_ts = (xcb_timestamp_t)res->configTimestamp;
+    int noutput = screens ? res->noutput : 0;
+    int ncrtc = crtcs ? res->ncrtc : 0;
+    
+    xcb_randr_get_output_info_cookie_t *output_cookies = calloc(noutput > 0 ? noutput : 1, sizeof(*output_cookies));
+    xcb_randr_get_crtc_info_cookie_t *crtc_cookies = calloc(ncrtc > 0 ? ncrtc : 1, sizeof(*crtc_cookies));
+    if (!output_cookies || !crtc_cookies) {
+        free(output_cookies);
+        free(crtc_cookies);
+        return -1;
+    }
+    
+    // Send everything first - CRTC count is small, so query all of them
+    // up front instead of waiting to learn which ones are in use
+    xcb_randr_get_output_primary_cookie_t primary_cookie =
+        xcb_randr_get_output_primary(conn, (xcb_window_t)dm->root);
+    for (int i = 0; i < noutput; i++) {
+        output_cookies[i] = xcb_randr_get_output_info(conn, (xcb_randr_output_t)res->outputs[i], config_ts);
+    }
+    for (int i = 0; i < ncrtc; i++) {
+        crtc_cookies[i] = xcb_randr_get_crtc_info(conn, (xcb_randr_crtc_t)res->crtcs[i], config_ts);
+    }
+    
+    // Collect replies - the first one flushes the request buffer, so the
+    // primary wait carries the round trip and the rest should be near zero
+    *primary = 0;
+    uint64_t start = timing_now();
+    xcb_randr_get_output_primary_reply_t *primary_reply =
+        xcb_randr_get_output_primary_reply(conn, primary_cookie, NULL);
+    timing_record(TIMING_PRIMARY, start);
+    if (primary_reply) {
+        *primary = primary_reply->output;
+        free(primary_reply);
+    }
+    
+    for (int i = 0; i < ncrtc; i++) {
+        start = timing_now();
+        xcb_randr_get_crtc_info_reply_t *crtc_info =
+            xcb_randr_get_crtc_info_reply(conn, crtc_cookies[i], NULL);
+        timing_record(TIMING_CRTC_INFO, start);
+        store_crtc_reply(&crtcs[(*crtc_count)++], res->crtcs[i], crtc_info);
+        free(crtc_info);
+    }
+    
+    int result = 0;
+    for (int i = 0; i < noutput; i++) {
+        start = timing_now();
+        xcb_randr_get_output_info_reply_t *output_info =
+            xcb_randr_get_output_info_reply(conn, output_cookies[i], NULL);
+        timing_record(TIMING_OUTPUT_INFO, start);
+        if (!output_info) continue;
+        
+        // Keep draining replies after a failure so none are left queued
+        ScreenInfo *screen = &screens[*screen_count];
+        if (result == 0 && populate_from_reply(screen, res->outputs[i], output_info, *primary) == 0) {
+            (*screen_count)++;
+        } else {
+            result = -1;
+        }
+        free(output_info);
+    }
+    
+    free(crtc_cookies);
+    free(output_cookies);
+    return result;
+}
+
+// Pipelined enumeration of all outputs through xcb-randr
+int dm_xcb_populate_screens(DisplayManager *dm) {
+    RROutput primary;
+    return dm_xcb_query_topology(dm, dm->resources, dm->screens, &dm->screen_count,
+                                 dm->topology.crtcs, &dm->topology.crtc_count, &primary);
+}
@@ -0,0 +1,551 @@
+#include "encoder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef TABCASTER_WITH_FFMPEG
+#include <libavcodec/avcodec.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/opt.h>
+#ifdef TABCASTER_WITH_KMS
+#include <libavutil/hwcontext_vaapi.h>
+#include <unistd.h>
+#include <va/va_drmcommon.h>
+#include <va/va_vpp.h>
+#endif
+#endif
+
+static const char *backend_names[ENC_BACKEND_COUNT] = {
+    [ENC_BACKEND_NVENC]    = "nvenc",
+    [ENC_BACKEND_VAAPI]    = "vaapi",
+    [ENC_BACKEND_X264]     = "x264",
+    [ENC_BACKEND_OPENH264] = "openh264",
+};
+
+// Fill an encoder config from a mode specification
+void encoder_config_from_spec(const ModeSpec *spec, EncoderConfig *config) {
+    if (!spec || !config) return;
+    memset(config, 0, sizeof(*config));
+    config->width = spec->width;
+    config->height = spec->height;
+    config->refresh_rate = spec->refresh_rate;
+    config->bitrate_kbps = ENCODER_DEFAULT_BITRATE_KBPS;
+}
+
+const char* encoder_backend_name(EncoderBackend backend) {
+    if (backend == ENC_BACKEND_AUTO) return "auto";
+    return (backend >= 0 && backend < ENC_BACKEND_COUNT) ? backend_names[backend] : "none";
+}
+
+// Parse a backend name from the command line
+int encoder_backend_from_name(const char *name, EncoderBackend *backend) {
+    if (!name || !backend) return -1;
+    if (strcmp(name, "auto") == 0) {
+        *backend = ENC_BACKEND_AUTO;
+        return 0;
+    }
+    for (int i = 0; i < ENC_BACKEND_COUNT; i++) {
+        if (strcmp(name, backend_names[i]) == 0) {
+            *backend = (EncoderBackend)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+#ifdef TABCASTER_WITH_FFMPEG
+
+struct Encoder {
+    EncoderBackend backend;
+    CsFormat input_format;
+    AVCodecContext *ctx;
+    AVBufferRef *hw_device;     // VAAPI only
+    AVFrame *frame;             // Wraps the caller's YuvImage, no copy
+    AVFrame *hw_frame;          // VAAPI upload target
+#ifdef TABCASTER_WITH_KMS
+    VADisplay va_display;       // DMA-BUF input: video processing converts imports into hw_frame
+    VAConfigID vpp_config;
+    VAContextID vpp_context;    // VA_INVALID_ID without DMA-BUF input
+#endif
+    AVPacket *packet;
+    int64_t pts;
+};
+
+static const char *codec_names[ENC_BACKEND_COUNT] = {
+    [ENC_BACKEND_NVENC]    = "h264_nvenc",
+    [ENC_BACKEND_VAAPI]    = "h264_vaapi",
+    [ENC_BACKEND_X264]     = "libx264",
+    [ENC_BACKEND_OPENH264] = "libopenh264",
+};
+
+// Backend specific low-latency options - unknown options are ignored by libavcodec
+static void set_low_latency_options(Encoder *enc) {
+    void *priv = enc->ctx->priv_data;
+    
+    switch (enc->backend) {
+    case ENC_BACKEND_NVENC:
+        av_opt_set(priv, "preset", "p1", 0);
+        av_opt_set(priv, "tune", "ull", 0);
+        av_opt_set(priv, "rc", "cbr", 0);
+        av_opt_set_int(priv, "zerolatency", 1, 0);
+        av_opt_set_int(priv, "delay", 0, 0);
+        av_opt_set_int(priv, "intra-refresh", 1, 0);
+        break;
+    case ENC_BACKEND_VAAPI:
+        // No intra refresh through VAAPI - keyframes stay periodic
+        av_opt_set(priv, "rc_mode", "CBR", 0);
+        av_opt_set_int(priv, "async_depth", 1, 0);
+        break;
+    case ENC_BACKEND_X264:
+        av_opt_set(priv, "preset", "ultrafast", 0);
+        av_opt_set(priv, "tune", "zerolatency", 0);
+        av_opt_set_int(priv, "intra-refresh", 1, 0);
+        break;
+    case ENC_BACKEND_OPENH264:
+        av_opt_set_int(priv, "allow_skip_frames", 1, 0);
+        break;
+    default:
+        break;
+    }
+}
+
+// VAAPI device and NV12 surface pool - returns 0 on success
+static int setup_vaapi(Encoder *enc, const EncoderConfig *config) {
+    if (av_hwdevice_ctx_create(&enc->hw_device, AV_HWDEVICE_TYPE_VAAPI, config->vaapi_device, NULL, 0) < 0) {
+        return -1;
+    }
+    
+    AVBufferRef *frames_ref = av_hwframe_ctx_alloc(enc->hw_device);
+    if (!frames_ref) return -1;
+    
+    AVHWFramesContext *frames = (AVHWFramesContext *)frames_ref->data;
+    frames->format = AV_PIX_FMT_VAAPI;
+    frames->sw_format = AV_PIX_FMT_NV12;
+    frames->width = (int)config->width;
+    frames->height = (int)config->height;
+    frames->initial_pool_size = PIPELINE_DEPTH;
+    if (av_hwframe_ctx_init(frames_ref) < 0) {
+        av_buffer_unref(&frames_ref);
+        return -1;
+    }
+    
+    enc->ctx->hw_frames_ctx = frames_ref;
+    enc->hw_frame = av_frame_alloc();
+    return enc->hw_frame ? 0 : -1;
+}
+
+#ifdef TABCASTER_WITH_KMS
+// Video processing context on the encoder's VA display - returns 0 on success
+static int setup_vpp(Encoder *enc, const EncoderConfig *config) {
+    AVHWDeviceContext *device = (AVHWDeviceContext *)enc->hw_device->data;
+    AVVAAPIDeviceContext *hwctx = device->hwctx;
+    enc->va_display = hwctx->display;
+    
+    if (vaCreateConfig(enc->va_display, VAProfileNone, VAEntrypointVideoProc, NULL, 0,
+                       &enc->vpp_config) != VA_STATUS_SUCCESS) {
+        enc->vpp_config = VA_INVALID_ID;
+        return -1;
+    }
+    if (vaCreateContext(enc->va_display, enc->vpp_config, (int)config->width, (int)config->height,
+                        VA_PROGRESSIVE, NULL, 0, &enc->vpp_context) != VA_STATUS_SUCCESS) {
+        enc->vpp_context = VA_INVALID_ID;
+        return -1;
+    }
+    return 0;
+}
+#else
+// Only KMS capture produces DMA-BUF frames, and libva is linked with it
+static int setup_vpp(Encoder *enc, const EncoderConfig *config) {
+    (void)enc;
+    (void)config;
+    fprintf(stderr, "VAAPI: built without DMA-BUF input (rebuild with make WITH_KMS=1)\n");
+    return -1;
+}
+#endif
+
+// Open one specific backend
+static Encoder* open_backend(EncoderBackend backend, const EncoderConfig *config) {
+    if (config->dmabuf_input && backend != ENC_BACKEND_VAAPI) return NULL;
+    const AVCodec *codec = avcodec_find_encoder_by_name(codec_names[backend]);
+    if (!codec) return NULL;
+    
+    Encoder *enc = calloc(1, sizeof(Encoder));
+    if (!enc) return NULL;
+    enc->backend = backend;
+#ifdef TABCASTER_WITH_KMS
+    enc->vpp_config = VA_INVALID_ID;
+    enc->vpp_context = VA_INVALID_ID;
+#endif
+    enc->input_format = backend == ENC_BACKEND_OPENH264 ? CS_FORMAT_I420 : CS_FORMAT_NV12;
+    
+    enc->ctx = avcodec_alloc_context3(codec);
+    enc->frame = av_frame_alloc();
+    enc->packet = av_packet_alloc();
+    if (!enc->ctx || !enc->frame || !enc->packet) {
+        encoder_close(enc);
+        return NULL;
+    }
+    
+    double refresh = config->refresh_rate > 0 ? config->refresh_rate : 60.0;
+    int rate_milli = (int)(refresh * 1000 + 0.5);
+    int mb_rows = (int)((config->height + 15) / 16);
+    int64_t bitrate = (int64_t)(config->bitrate_kbps ? config->bitrate_kbps : ENCODER_DEFAULT_BITRATE_KBPS) * 1000;
+    
+    AVCodecContext *ctx = enc->ctx;
+    ctx->width = (int)config->width;
+    ctx->height = (int)config->height;
+    ctx->time_base = (AVRational){ 1000, rate_milli };
+    ctx->framerate = (AVRational){ rate_milli, 1000 };
+    ctx->pix_fmt = backend == ENC_BACKEND_VAAPI ? AV_PIX_FMT_VAAPI
+                 : backend == ENC_BACKEND_OPENH264 ? AV_PIX_FMT_YUV420P : AV_PIX_FMT_NV12;
+    ctx->max_b_frames = 0;
+    ctx->gop_size = (int)(refresh * 2);                  // Intra refresh period where supported
+    ctx->slices = mb_rows / ENCODER_SLICE_MB_ROWS > 0 ? mb_rows / ENCODER_SLICE_MB_ROWS : 1;
+    ctx->bit_rate = bitrate;
+    ctx->rc_max_rate = bitrate;
+    ctx->rc_buffer_size = (int)(bitrate / refresh);      // One frame of VBV - no bursts to queue
+    ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    ctx->thread_type = FF_THREAD_SLICE;                  // Frame threads would add a frame of delay each
+    set_low_latency_options(enc);
+    
+    if ((backend == ENC_BACKEND_VAAPI && setup_vaapi(enc, config) != 0) ||
+        avcodec_open2(ctx, codec, NULL) < 0 || (config->dmabuf_input && setup_vpp(enc, config) != 0)) {
+        encoder_close(enc);
+        return NULL;
+    }
+    return enc;
+}
+
+// Open the requested backend, or the fastest one that works
+Encoder* encoder_open(EncoderBackend backend, const EncoderConfig *config) {
+    if (!config || config->width == 0 || config->height == 0) return NULL;
+    if (backend != ENC_BACKEND_AUTO) {
+        if (backend < 0 || backend >= ENC_BACKEND_COUNT) return NULL;
+        return open_backend(backend, config);
+    }
+    
+    // Missing GPUs and drivers are expected here - keep libav quiet while trying
+    int level = av_log_get_level();
+    av_log_set_level(AV_LOG_QUIET);
+    Encoder *enc = NULL;
+    for (int i = 0; i < ENC_BACKEND_COUNT && !enc; i++) {
+        enc = open_backend((EncoderBackend)i, config);
+    }
+    av_log_set_level(level);
+    return enc;
+}
+
+EncoderBackend encoder_backend(const Encoder *encoder) {
+    return encoder ? encoder->backend : ENC_BACKEND_COUNT;
+}
+
+CsFormat encoder_input_format(const Encoder *encoder) {
+    return encoder ? encoder->input_format : CS_FORMAT_NV12;
+}
+
+// The YuvImage outlives the encode call and zero-delay encoders do not keep frames
+static void release_nothing(void *opaque, uint8_t *data) {
+    (void)opaque;
+    (void)data;
+}
+
+// Hand a frame to the codec and pick up its packet, if one is ready
+static int submit_frame(Encoder *encoder, AVFrame *send, EncodedPacket *packet) {
+    int err = avcodec_send_frame(encoder->ctx, send);
+    if (err < 0) {
+        fprintf(stderr, "%s: failed to submit frame\n", encoder_backend_name(encoder->backend));
+        return -1;
+    }
+    
+    av_packet_unref(encoder->packet);
+    err = avcodec_receive_packet(encoder->ctx, encoder->packet);
+    if (err == AVERROR(EAGAIN)) return 0;
+    if (err < 0) {
+        fprintf(stderr, "%s: encode failed\n", encoder_backend_name(encoder->backend));
+        return -1;
+    }
+    
+    packet->data = encoder->packet->data;
+    packet->size = (size_t)encoder->packet->size;
+    packet->keyframe = (encoder->packet->flags & AV_PKT_FLAG_KEY) != 0;
+    packet->pts = encoder->packet->pts;
+    return 0;
+}
+
+// Encode one frame
+int encoder_encode(Encoder *encoder, const YuvImage *image, EncodedPacket *packet) {
+    if (!encoder || !image || !packet) return -1;
+    memset(packet, 0, sizeof(*packet));
+    
+    AVFrame *frame = encoder->frame;
+    frame->format = image->format == CS_FORMAT_NV12 ? AV_PIX_FMT_NV12 : AV_PIX_FMT_YUV420P;
+    frame->width = (int)image->width;
+    frame->height = (int)image->height;
+    for (int i = 0; i < 3; i++) {
+        frame->data[i] = image->planes[i];
+        frame->linesize[i] = image->strides[i];
+    }
+    frame->buf[0] = av_buffer_create(image->storage, 1, release_nothing, NULL, AV_BUFFER_FLAG_READONLY);
+    frame->pts = encoder->pts++;
+    
+    AVFrame *send = frame;
+    if (encoder->backend == ENC_BACKEND_VAAPI) {
+        av_frame_unref(encoder->hw_frame);
+        if (av_hwframe_get_buffer(encoder->ctx->hw_frames_ctx, encoder->hw_frame, 0) < 0 ||
+            av_hwframe_transfer_data(encoder->hw_frame, frame, 0) < 0) {
+            av_frame_unref(frame);
+            fprintf(stderr, "VAAPI upload failed\n");
+            return -1;
+        }
+        encoder->hw_frame->pts = frame->pts;
+        send = encoder->hw_frame;
+    }
+    
+    int result = submit_frame(encoder, send, packet);
+    av_frame_unref(frame);
+    return result;
+}
+
+#ifdef TABCASTER_WITH_KMS
+// VA fourcc for the 32-bit RGB layouts scanout buffers use (DRM and VA
+// fourccs are packed alike)
+static uint32_t va_rgb_fourcc(uint32_t drm_fourcc) {
+    switch (drm_fourcc) {
+    case VA_FOURCC('X', 'R', '2', '4'): return VA_FOURCC_BGRX;     // DRM_FORMAT_XRGB8888
+    case VA_FOURCC('A', 'R', '2', '4'): return VA_FOURCC_BGRA;
+    case VA_FOURCC('X', 'B', '2', '4'): return VA_FOURCC_RGBX;
+    case VA_FOURCC('A', 'B', '2', '4'): return VA_FOURCC_RGBA;
+    default:                            return 0;
+    }
+}
+
+// Wrap a framebuffer in a VA surface - no copy, the driver maps the DMA-BUF
+static int import_surface(Encoder *encoder, const DmaBufFrame *frame, VASurfaceID *surface) {
+    uint32_t fourcc = va_rgb_fourcc(frame->fourcc);
+    if (!fourcc) {
+        fprintf(stderr, "VAAPI: framebuffer format %.4s is not supported\n", (const char *)&frame->fourcc);
+        return -1;
+    }
+    
+    VADRMPRIMESurfaceDescriptor desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.fourcc = fourcc;
+    desc.width = frame->width;
+    desc.height = frame->height;
+    desc.num_layers = 1;
+    desc.layers[0].drm_format = frame->fourcc;
+    desc.layers[0].num_planes = (uint32_t)frame->plane_count;
+    for (int i = 0; i < frame->plane_count; i++) {
+        // Planes sharing a buffer share one object
+        uint32_t object = desc.num_objects;
+        for (uint32_t o = 0; o < desc.num_objects; o++) {
+            if (desc.objects[o].fd == frame->fds[i]) object = o;
+        }
+        if (object == desc.num_objects) {
+            desc.objects[object].fd = frame->fds[i];
+            desc.objects[object].size = (uint32_t)lseek(frame->fds[i], 0, SEEK_END);
+            desc.objects[object].drm_format_modifier = frame->modifier;
+            desc.num_objects++;
+        }
+        desc.layers[0].object_index[i] = object;
+        desc.layers[0].offset[i] = frame->offsets[i];
+        desc.layers[0].pitch[i] = frame->pitches[i];
+    }
+    
+    VASurfaceAttrib attribs[2] = {
+        { .type = VASurfaceAttribMemoryType, .flags = VA_SURFACE_ATTRIB_SETTABLE,
+          .value = { .type = VAGenericValueTypeInteger, .value.i = VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2 } },
+        { .type = VASurfaceAttribExternalBufferDescriptor, .flags = VA_SURFACE_ATTRIB_SETTABLE,
+          .value = { .type = VAGenericValueTypePointer, .value.p = &desc } },
+    };
+    if (vaCreateSurfaces(encoder->va_display, VA_RT_FORMAT_RGB32, frame->width, frame->height,
+                         surface, 1, attribs, 2) != VA_STATUS_SUCCESS) {
+        fprintf(stderr, "VAAPI: cannot import framebuffer %u\n", frame->fb_id);
+        return -1;
+    }
+    return 0;
+}
+
+// Crop the output's rectangle out of the framebuffer and convert it to the
+// encoder's NV12 surface (BT.601 limited range, as the CPU path)
+static int convert_surface(Encoder *encoder, VASurfaceID source, VASurfaceID target, const DmaBufFrame *frame) {
+    VARectangle region = { (int16_t)frame->crop_x, (int16_t)frame->crop_y,
+                           (uint16_t)frame->crop_width, (uint16_t)frame->crop_height };
+    VAProcPipelineParameterBuffer params;
+    memset(&params, 0, sizeof(params));
+    params.surface = source;
+    params.surface_region = &region;
+    params.surface_color_standard = VAProcColorStandardBT601;
+    params.output_color_standard = VAProcColorStandardBT601;
+    params.output_background_color = 0xff000000;
+    
+    VABufferID buffer;
+    if (vaCreateBuffer(encoder->va_display, encoder->vpp_context, VAProcPipelineParameterBufferType,
+                       sizeof(params), 1, &params, &buffer) != VA_STATUS_SUCCESS) return -1;
+    VAStatus status = vaBeginPicture(encoder->va_display, encoder->vpp_context, target);
+    if (status == VA_STATUS_SUCCESS) {
+        status = vaRenderPicture(encoder->va_display, encoder->vpp_context, &buffer, 1);
+        VAStatus ended = vaEndPicture(encoder->va_display, encoder->vpp_context);
+        if (status == VA_STATUS_SUCCESS) status = ended;
+    }
+    // The import is destroyed right after - it must not be read any more
+    if (status == VA_STATUS_SUCCESS) status = vaSyncSurface(encoder->va_display, target);
+    vaDestroyBuffer(encoder->va_display, buffer);
+    return status == VA_STATUS_SUCCESS ? 0 : -1;
+}
+
+// Encode one GPU frame: import, convert into a pool surface, submit
+int encoder_encode_dmabuf(Encoder *encoder, const DmaBufFrame *frame, EncodedPacket *packet) {
+    if (!encoder || !frame || !packet) return -1;
+    memset(packet, 0, sizeof(*packet));
+    if (encoder->vpp_context == VA_INVALID_ID) {
+        fprintf(stderr, "%s: not opened for DMA-BUF input\n", encoder_backend_name(encoder->backend));
+        return -1;
+    }
+    
+    VASurfaceID source;
+    if (import_surface(encoder, frame, &source) != 0) return -1;
+    av_frame_unref(encoder->hw_frame);
+    int result = -1;
+    if (av_hwframe_get_buffer(encoder->ctx->hw_frames_ctx, encoder->hw_frame, 0) >= 0) {
+        VASurfaceID target = (VASurfaceID)(uintptr_t)encoder->hw_frame->data[3];
+        result = convert_surface(encoder, source, target, frame);
+    }
+    vaDestroySurfaces(encoder->va_display, &source, 1);
+    if (result != 0) {
+        fprintf(stderr, "VAAPI: framebuffer conversion failed\n");
+        return -1;
+    }
+    
+    encoder->hw_frame->pts = encoder->pts++;
+    return submit_frame(encoder, encoder->hw_frame, packet);
+}
+#else
+int encoder_encode_dmabuf(Encoder *encoder, const DmaBufFrame *frame, EncodedPacket *packet) {
+    (void)encoder;
+    (void)frame;
+    (void)packet;
+    return -1;
+}
+#endif // TABCASTER_WITH_KMS
+
+// Free the codec context and everything attached to it
+void encoder_close(Encoder *encoder) {
+    if (!encoder) return;
+    avcodec_free_context(&encoder->ctx);
+    av_frame_free(&encoder->frame);
+    av_frame_free(&encoder->hw_frame);
+    av_packet_free(&encoder->packet);
+#ifdef TABCASTER_WITH_KMS
+    if (encoder->vpp_context != VA_INVALID_ID) vaDestroyContext(encoder->va_display, encoder->vpp_context);
+    if (encoder->vpp_config != VA_INVALID_ID) vaDestroyConfig(encoder->va_display, encoder->vpp_config);
+#endif
+    av_buffer_unref(&encoder->hw_device);
+    free(encoder);
+}
+
+#else // !TABCASTER_WITH_FFMPEG
+
+struct Encoder {
+    EncoderBackend backend;
+};
+
+Encoder* encoder_open(EncoderBackend backend, const EncoderConfig *config) {
+    (void)backend;
+    (void)config;
+    fprintf(stderr, "Built without encoder support (rebuild with make WITH_FFMPEG=1)\n");
+    return NULL;
+}
+
+EncoderBackend encoder_backend(const Encoder *encoder) {
+    return encoder ? encoder->backend : ENC_BACKEND_COUNT;
+}
+
+CsFormat encoder_input_format(const Encoder *encoder) {
+    (void)encoder;
+    return CS_FORMAT_NV12;
+}
+
+int encoder_encode(Encoder *encoder, const YuvImage *image, EncodedPacket *packet) {
+    (void)encoder;
+    (void)image;
+    (void)packet;
+    return -1;
+}
+
+int encoder_encode_dmabuf(Encoder *encoder, const DmaBufFrame *frame, EncodedPacket *packet) {
+    (void)encoder;
+    (void)frame;
+    (void)packet;
+    return -1;
+}
+
+void encoder_close(Encoder *encoder) {
+    free(encoder);
+}
+
+#endif // TABCASTER_WITH_FFMPEG
+
+// Open and immediately close each backend until one works
+EncoderBackend encoder_probe(const EncoderConfig *config) {
+#ifdef TABCASTER_WITH_FFMPEG
+    Encoder *enc = encoder_open(ENC_BACKEND_AUTO, config);
+    EncoderBackend backend = encoder_backend(enc);
+    encoder_close(enc);
+    return backend;
+#else
+    (void)config;
+    return ENC_BACKEND_COUNT;
+#endif
+}
+
+// Per-slot copies of the encoded output, so send can read while encode moves on
+struct EncoderStage {
+    Encoder *encoder;
+    uint8_t *buffers[PIPELINE_DEPTH];
+    size_t capacities[PIPELINE_DEPTH];
+    EncodedPacket packets[PIPELINE_DEPTH];
+};
+
+EncoderStage* encoder_stage_create(Encoder *encoder) {
+    if (!encoder) return NULL;
+    EncoderStage *stage = calloc(1, sizeof(EncoderStage));
+    if (stage) stage->encoder = encoder;
+    return stage;
+}
+
+// Encode the converted image of a frame
+int encoder_stage_process(void *ctx, FrameDesc *frame) {
+    EncoderStage *stage = ctx;
+    if (!stage || !frame || frame->slot < 0 || frame->slot >= PIPELINE_DEPTH) return -1;
+    
+    const YuvImage *image = frame->stage_data[PIPE_CONVERT];
+    const DmaBufFrame *dmabuf = frame->stage_data[PIPE_CAPTURE];
+    if (!image && !dmabuf) return 1;
+    
+    EncodedPacket packet;
+    int result = image ? encoder_encode(stage->encoder, image, &packet)
+                       : encoder_encode_dmabuf(stage->encoder, dmabuf, &packet);
+    if (result != 0) return -1;
+    if (packet.size == 0) return 1;     // Encoder is still filling up - nothing to send
+    
+    int slot = frame->slot;
+    if (packet.size > stage->capacities[slot]) {
+        uint8_t *grown = realloc(stage->buffers[slot], packet.size);
+        if (!grown) return -1;
+        stage->buffers[slot] = grown;
+        stage->capacities[slot] = packet.size;
+    }
+    memcpy(stage->buffers[slot], packet.data, packet.size);
+    
+    stage->packets[slot] = packet;
+    stage->packets[slot].data = stage->buffers[slot];
+    frame->stage_data[PIPE_ENCODE] = &stage->packets[slot];
+    return 0;
+}
+
+void encoder_stage_destroy(EncoderStage *stage) {
+    if (!stage) return;
+    for (int i = 0; i < PIPELINE_DEPTH; i++) free(stage->buffers[i]);
+    free(stage);
+}
@@ -0,0 +1,74 @@
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "colorspace.h"
+#include "display_backend.h"
+#include "mode_manager.h"
+#include "pipeline.h"
+
+// H.264 encoder abstraction over libavcodec: NVENC and VAAPI in hardware,
+// x264 and OpenH264 in software. Every backend is set up for latency rather
+// than compression - no B-frames, periodic intra refresh instead of IDR spikes
+// where the backend supports it, a one-frame rate control buffer and one slice
+// per ENCODER_SLICE_MB_ROWS macroblock rows so the client can decode slices as
+// they arrive. An encoder opened for DMA-BUF input (VAAPI only) imports KMS
+// framebuffers as VA surfaces and converts them to NV12 with VA video
+// processing, so GPU frames never pass through memory. Built only with
+// `make WITH_FFMPEG=1`; otherwise no backend opens.
+
+#define ENCODER_SLICE_MB_ROWS 4              // Macroblock rows per slice
+#define ENCODER_DEFAULT_BITRATE_KBPS 12000
+
+typedef enum {
+    ENC_BACKEND_AUTO = -1,      // Fastest backend that opens
+    ENC_BACKEND_NVENC,          // In order of preference
+    ENC_BACKEND_VAAPI,
+    ENC_BACKEND_X264,
+    ENC_BACKEND_OPENH264,
+    ENC_BACKEND_COUNT
+} EncoderBackend;
+
+typedef struct {
+    unsigned int width;
+    unsigned int height;
+    double refresh_rate;
+    unsigned int bitrate_kbps;
+    const char *vaapi_device;       // DRM render node (NULL = libva default)
+    bool dmabuf_input;              // Frames come as DmaBufFrame, not YuvImage (VAAPI only)
+} EncoderConfig;
+
+// One encoded access unit - data is owned by whoever produced it
+typedef struct {
+    const uint8_t *data;
+    size_t size;                    // 0 while the encoder has no output yet
+    bool keyframe;
+    int64_t pts;                    // Frame number at the configured refresh
+} EncodedPacket;
+
+typedef struct Encoder Encoder;
+
+void encoder_config_from_spec(const ModeSpec *spec, EncoderConfig *config);      // Size and rate from a mode, default bitrate
+Encoder* encoder_open(EncoderBackend backend, const EncoderConfig *config);     // NULL if the backend is unavailable
+EncoderBackend encoder_probe(const EncoderConfig *config);                      // Fastest backend that opens (ENC_BACKEND_COUNT if none)
+EncoderBackend encoder_backend(const Encoder *encoder);
+CsFormat encoder_input_format(const Encoder *encoder);                          // Layout the convert stage must produce
+int encoder_encode(Encoder *encoder, const YuvImage *image, EncodedPacket *packet); // packet valid until the next call - returns 0 on success, -1 on error
+int encoder_encode_dmabuf(Encoder *encoder, const DmaBufFrame *frame,
+                          EncodedPacket *packet);                      // Same for a GPU frame, needs dmabuf_input
+const char* encoder_backend_name(EncoderBackend backend);
+int encoder_backend_from_name(const char *name, EncoderBackend *backend);       // "nvenc", "vaapi", "x264", "openh264", "auto" - returns 0 on success
+void encoder_close(Encoder *encoder);                                           // Safe to call with NULL
+
+// Pipeline encode stage - encodes stage_data[PIPE_CONVERT] (or the DmaBufFrame
+// in stage_data[PIPE_CAPTURE] without a convert stage) and leaves an
+// EncodedPacket (in a per-slot buffer) in stage_data[PIPE_ENCODE]
+typedef struct EncoderStage EncoderStage;
+
+EncoderStage* encoder_stage_create(Encoder *encoder);           // Borrows encoder - NULL on failure
+int encoder_stage_process(void *stage, FrameDesc *frame);       // PipelineStageFn
+void encoder_stage_destroy(EncoderStage *stage);                // Safe to call with NULL
+
+#endif
@@ -0,0 +1,96 @@
+#include "frame_clock.h"
+#include "timing.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+// Absolute CLOCK_MONOTONIC timespec for a nanosecond timestamp
+static struct timespec to_timespec(uint64_t ns) {
+    struct timespec ts = { (time_t)(ns / 1000000000ull), (long)(ns % 1000000000ull) };
+    return ts;
+}
+
+// Create a clock whose first tick is one period from now
+FrameClock* frame_clock_create(double refresh_hz) {
+    if (refresh_hz <= 0) refresh_hz = FRAME_CLOCK_DEFAULT_HZ;
+    
+    FrameClock *clock = calloc(1, sizeof(FrameClock));
+    if (!clock) return NULL;
+    
+    clock->period_ns = (uint64_t)(1e9 / refresh_hz + 0.5);
+    clock->epoch_ns = timing_now() + clock->period_ns;
+    clock->deadline_ns = clock->epoch_ns;
+    
+    // timerfd keeps the door open for poll()-driven loops; nanosleep is the fallback
+    clock->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (clock->timer_fd < 0) perror("timerfd_create");
+    return clock;
+}
+
+// Sleep until the absolute deadline
+static int sleep_until(FrameClock *clock, uint64_t deadline) {
+    struct timespec when = to_timespec(deadline);
+    
+    if (clock->timer_fd >= 0) {
+        struct itimerspec spec = { { 0, 0 }, when };
+        if (timerfd_settime(clock->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) != 0) return -1;
+        
+        uint64_t expirations;
+        while (read(clock->timer_fd, &expirations, sizeof(expirations)) < 0) {
+            if (errno != EINTR) return -1;
+        }
+        return 0;
+    }
+    
+    int err;
+    while ((err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &when, NULL)) == EINTR) {}
+    return err == 0 ? 0 : -1;
+}
+
+// Advance to the next tick that is still in the future and wait for it
+int frame_clock_wait(FrameClock *clock) {
+    if (!clock) return -1;
+    
+    uint64_t now = timing_now();
+    uint64_t next = clock->frames == 0 ? 0 : clock->tick + 1;
+    uint64_t deadline = clock->epoch_ns + next * clock->period_ns;
+    
+    // Behind schedule - skip to the slot we can still make instead of replaying old ones
+    int dropped = 0;
+    if (now >= deadline) {
+        uint64_t behind = (now - deadline) / clock->period_ns + 1;
+        next += behind;
+        deadline += behind * clock->period_ns;
+        dropped = (int)behind;
+        clock->dropped += behind;
+    }
+    
+    if (sleep_until(clock, deadline) != 0) {
+        perror("frame clock");
+        return -1;
+    }
+    
+    clock->tick = next;
+    clock->deadline_ns = deadline + clock->period_ns;
+    clock->frames++;
+    return dropped;
+}
+
+// Work for this frame ran past its slot - sending it now would only add latency
+bool frame_clock_late(const FrameClock *clock) {
+    return clock && timing_now() > clock->deadline_ns;
+}
+
+double frame_clock_hz(const FrameClock *clock) {
+    return clock && clock->period_ns ? 1e9 / clock->period_ns : 0.0;
+}
+
+// Close the timer
+void frame_clock_destroy(FrameClock *clock) {
+    if (!clock) return;
+    if (clock->timer_fd >= 0) close(clock->timer_fd);
+    free(clock);
+}
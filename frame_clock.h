@@ -0,0 +1,30 @@
+#ifndef FRAME_CLOCK_H
+#define FRAME_CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Frame clock locked to an output's refresh rate. Deadlines are absolute
+// (epoch + n * period on CLOCK_MONOTONIC) so timer latency never accumulates
+// into drift, and a caller that falls behind skips the missed ticks instead of
+// working off a backlog - latency stays bounded at one frame.
+
+#define FRAME_CLOCK_DEFAULT_HZ 60.0    // Used when the output's mode timings are unknown
+
+typedef struct {
+    int timer_fd;               // timerfd armed with TFD_TIMER_ABSTIME (-1 = clock_nanosleep)
+    uint64_t period_ns;
+    uint64_t epoch_ns;          // Deadline of tick 0
+    uint64_t tick;              // Index of the current frame
+    uint64_t deadline_ns;       // End of the current frame's slot
+    unsigned long frames;       // Ticks delivered
+    unsigned long dropped;      // Ticks skipped because the caller was late
+} FrameClock;
+
+FrameClock* frame_clock_create(double refresh_hz);  // NULL on failure (refresh_hz <= 0 uses the default)
+int frame_clock_wait(FrameClock *clock);            // Sleep until the next tick - returns ticks dropped, -1 on error
+bool frame_clock_late(const FrameClock *clock);     // Has the current frame overrun its slot? (drop it)
+double frame_clock_hz(const FrameClock *clock);
+void frame_clock_destroy(FrameClock *clock);        // Safe to call with NULL
+
+#endif
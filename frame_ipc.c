@@ -0,0 +1,284 @@
+#define _GNU_SOURCE     // memfd_create, accept4
+#include "frame_ipc.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+struct FrameIpc {
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    FramePool *pool;                    // Convert stage's shared pool (borrowed)
+    int listen_fd;
+    int conn_fd;                        // Connected consumer (-1 = none)
+    int ring_fd;                        // memfd behind header
+    int event_fd;
+    FrameIpcHeader *header;
+    size_t header_size;
+    uint32_t generation;
+    bool rehello;                       // Pool may have been rebuilt - send the fds again before publishing
+    uint64_t head;                      // Our copy of header->head
+    uint64_t released;                  // Frames whose buffers we gave back
+    FrameBuffer *held[FRAME_IPC_RING];  // Reference per published, unreleased frame
+    
+    unsigned long published;
+    unsigned long consumers;            // Connections accepted
+    unsigned long full;                 // Frames dropped with the consumer FRAME_IPC_RING behind
+    unsigned long unconnected;          // Frames dropped with nobody to take them
+    unsigned long reclaimed;            // Frames taken back without the consumer releasing them
+};
+
+static uint64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+// Give back what the consumer released - a tail past head is clamped, never trusted
+static void reclaim(FrameIpc *ipc) {
+    uint64_t tail = atomic_load_explicit(&ipc->header->tail, memory_order_acquire);
+    if (tail > ipc->head) tail = ipc->head;
+    while (ipc->released < tail) {
+        FrameBuffer **held = &ipc->held[ipc->released % FRAME_IPC_RING];
+        frame_buffer_unref(*held);
+        *held = NULL;
+        ipc->released++;
+    }
+}
+
+// Take every frame back whatever the consumer is doing with it, and start the ring over
+static void reset_ring(FrameIpc *ipc) {
+    for (; ipc->released < ipc->head; ipc->released++) {
+        FrameBuffer **held = &ipc->held[ipc->released % FRAME_IPC_RING];
+        frame_buffer_unref(*held);
+        *held = NULL;
+        ipc->reclaimed++;
+    }
+    ipc->head = 0;
+    ipc->released = 0;
+    FrameIpcHeader *h = ipc->header;
+    atomic_store_explicit(&h->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->tail, 0, memory_order_relaxed);
+    for (int i = 0; i < FRAME_IPC_RING; i++) atomic_store_explicit(&h->slots[i].seq, 0, memory_order_relaxed);
+    h->generation = ++ipc->generation;
+    atomic_thread_fence(memory_order_release);
+}
+
+static void drop_consumer(FrameIpc *ipc) {
+    if (ipc->conn_fd < 0) return;
+    close(ipc->conn_fd);
+    ipc->conn_fd = -1;
+    reset_ring(ipc);
+    fprintf(stderr, "IPC: consumer on %s went away\n", ipc->path);
+}
+
+// New generation, and the fds that go with it
+static int send_hello(FrameIpc *ipc) {
+    reset_ring(ipc);
+    FrameIpcHello hello = {
+        .magic = FRAME_IPC_MAGIC,
+        .version = FRAME_IPC_VERSION,
+        .generation = ipc->generation,
+        .header_size = (uint32_t)ipc->header_size,
+        .arena_size = frame_pool_arena_size(ipc->pool),
+    };
+    int fds[3] = { ipc->ring_fd, frame_pool_fd(ipc->pool), ipc->event_fd };
+    union {
+        char buffer[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+    
+    struct iovec iov = { &hello, sizeof(hello) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buffer,
+        .msg_controllen = sizeof(control.buffer),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    
+    if (sendmsg(ipc->conn_fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)sizeof(hello)) {
+        perror("IPC: sending the frame memfds");
+        drop_consumer(ipc);
+        return -1;
+    }
+    ipc->rehello = false;
+    return 0;
+}
+
+// Accept a consumer if none is connected, notice if the one we have hung up.
+// Returns true with a consumer ready for frames
+static bool check_consumer(FrameIpc *ipc) {
+    if (ipc->conn_fd >= 0) {
+        char byte;
+        ssize_t n = recv(ipc->conn_fd, &byte, 1, MSG_DONTWAIT);     // Consumers send nothing, reading only detects the hangup
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) drop_consumer(ipc);
+    }
+    if (ipc->conn_fd < 0) {
+        ipc->conn_fd = accept4(ipc->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (ipc->conn_fd < 0) return false;
+        ipc->consumers++;
+        ipc->rehello = true;
+        printf("IPC: consumer connected on %s\n", ipc->path);
+    }
+    return !ipc->rehello || send_hello(ipc) == 0;
+}
+
+// The ring memfd: one header, sealed at its size
+static int create_ring(FrameIpc *ipc) {
+    ipc->header_size = (sizeof(FrameIpcHeader) + 4095) & ~(size_t)4095;
+    ipc->ring_fd = memfd_create("tabcaster-ipc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (ipc->ring_fd < 0 || ftruncate(ipc->ring_fd, (off_t)ipc->header_size) != 0) {
+        perror("IPC: ring memfd");
+        return -1;
+    }
+    fcntl(ipc->ring_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+    
+    void *header = mmap(NULL, ipc->header_size, PROT_READ | PROT_WRITE, MAP_SHARED, ipc->ring_fd, 0);
+    if (header == MAP_FAILED) {
+        perror("IPC: ring mmap");
+        return -1;
+    }
+    ipc->header = header;
+    ipc->header->magic = FRAME_IPC_MAGIC;
+    ipc->header->version = FRAME_IPC_VERSION;
+    ipc->header->ring = FRAME_IPC_RING;
+    return 0;
+}
+
+FrameIpc* frame_ipc_open(const char *path, ColorspaceStage *convert) {
+    FramePool *pool = colorspace_stage_pool(convert);
+    if (!path || !pool) return NULL;
+    if (frame_pool_fd(pool) < 0) {
+        fprintf(stderr, "IPC: the convert stage's pool is not shared\n");
+        return NULL;
+    }
+    
+    FrameIpc *ipc = calloc(1, sizeof(FrameIpc));
+    if (!ipc) return NULL;
+    ipc->pool = pool;
+    ipc->listen_fd = ipc->conn_fd = ipc->ring_fd = ipc->event_fd = -1;
+    if (snprintf(ipc->path, sizeof(ipc->path), "%s", path) >= (int)sizeof(ipc->path)) {
+        fprintf(stderr, "IPC: socket path %s is too long\n", path);
+        free(ipc);
+        return NULL;
+    }
+    
+    if (create_ring(ipc) != 0) {
+        frame_ipc_close(ipc);
+        return NULL;
+    }
+    ipc->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    ipc->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (ipc->event_fd < 0 || ipc->listen_fd < 0) {
+        perror("IPC: socket");
+        frame_ipc_close(ipc);
+        return NULL;
+    }
+    
+    // A socket file left by an earlier run would make bind fail
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    memcpy(addr.sun_path, ipc->path, sizeof(ipc->path));
+    unlink(ipc->path);
+    if (bind(ipc->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(ipc->listen_fd, 1) != 0) {
+        fprintf(stderr, "IPC: cannot listen on %s: %s\n", ipc->path, strerror(errno));
+        ipc->path[0] = '\0';                // Not ours to unlink
+        frame_ipc_close(ipc);
+        return NULL;
+    }
+    return ipc;
+}
+
+// Descriptor into the slot under its seqlock, then the buffer reference, then head
+int frame_ipc_stage_process(void *ctx, FrameDesc *frame) {
+    FrameIpc *ipc = ctx;
+    if (!ipc || !frame) return -1;
+    const YuvImage *image = frame->stage_data[PIPE_CONVERT];
+    FrameBuffer *buffer = frame->buffers[PIPE_CONVERT];
+    if (!image || !buffer) return -1;
+    
+    if (!check_consumer(ipc)) {
+        ipc->unconnected++;
+        return 1;
+    }
+    reclaim(ipc);
+    if (ipc->head - ipc->released >= FRAME_IPC_RING) {
+        ipc->full++;
+        return 1;
+    }
+    
+    uint64_t n = ipc->head;
+    FrameIpcSlot *slot = &ipc->header->slots[n % FRAME_IPC_RING];
+    atomic_store_explicit(&slot->seq, (uint32_t)(2 * n + 1), memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->buffer = (uint32_t)buffer->index;
+    slot->frame = n;
+    slot->captured_ns = frame->captured_ns;
+    slot->offset = frame_buffer_offset(buffer);
+    slot->size = (uint32_t)frame_pool_buffer_size(ipc->pool);
+    slot->format = image->format;
+    slot->width = image->width;
+    slot->height = image->height;
+    for (int i = 0; i < 3; i++) {
+        bool used = image->planes[i] && (i < 2 || image->format == CS_FORMAT_I420);
+        slot->planes[i] = used ? (uint32_t)(image->planes[i] - buffer->data) : 0;
+        slot->strides[i] = used ? (uint32_t)image->strides[i] : 0;
+    }
+    atomic_store_explicit(&slot->seq, (uint32_t)(2 * (n + 1)), memory_order_release);
+    
+    ipc->held[n % FRAME_IPC_RING] = frame_buffer_ref(buffer);
+    ipc->head = n + 1;
+    atomic_store_explicit(&ipc->header->head, ipc->head, memory_order_release);
+    uint64_t one = 1;
+    if (write(ipc->event_fd, &one, sizeof(one)) < 0) {
+        // Counter saturated - the consumer has wakeups pending regardless
+    }
+    ipc->published++;
+    frame->stage_data[PIPE_ENCODE] = NULL;
+    return 0;
+}
+
+// Give the consumer a moment to finish what it holds - the pool can only be
+// rebuilt once every buffer is back, and it is rewritten as soon as it is
+void frame_ipc_release(FrameIpc *ipc) {
+    if (!ipc) return;
+    
+    uint64_t deadline = monotonic_ms() + FRAME_IPC_DRAIN_MS;
+    while (ipc->conn_fd >= 0) {
+        reclaim(ipc);
+        if (ipc->released == ipc->head || monotonic_ms() >= deadline) break;
+        nanosleep(&(struct timespec){ 0, 1000000 }, NULL);
+    }
+    reset_ring(ipc);
+    ipc->rehello = true;
+}
+
+void frame_ipc_print_stats(const FrameIpc *ipc, FILE *out) {
+    if (!ipc) return;
+    fprintf(out, "IPC (%s): %lu frames published to %lu consumer(s), %lu dropped with the ring full, %lu with no consumer\n",
+            ipc->path, ipc->published, ipc->consumers, ipc->full, ipc->unconnected);
+    if (ipc->reclaimed) fprintf(out, "  %lu frames taken back unreleased\n", ipc->reclaimed);
+}
+
+void frame_ipc_close(FrameIpc *ipc) {
+    if (!ipc) return;
+    if (ipc->header) reset_ring(ipc);
+    if (ipc->conn_fd >= 0) close(ipc->conn_fd);
+    if (ipc->listen_fd >= 0) close(ipc->listen_fd);
+    if (ipc->path[0] && ipc->listen_fd >= 0) unlink(ipc->path);
+    if (ipc->event_fd >= 0) close(ipc->event_fd);
+    if (ipc->header) munmap(ipc->header, ipc->header_size);
+    if (ipc->ring_fd >= 0) close(ipc->ring_fd);
+    free(ipc);
+}
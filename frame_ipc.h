@@ -0,0 +1,78 @@
+#ifndef FRAME_IPC_H
+#define FRAME_IPC_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "colorspace.h"
+#include "pipeline.h"
+
+// Zero-copy frame handoff to an encoder in another process. Replaces the
+// in-process encode stage: converted frames stay in the convert stage's frame
+// pool, whose arena is a memfd, and only their descriptors are published to
+// the consumer through a ring in a second, small memfd. Both memfds and an
+// eventfd go to the consumer over a UNIX SOCK_SEQPACKET socket with
+// SCM_RIGHTS, so it maps the very pages the convert stage wrote.
+//
+// Protocol (host byte order, both ends on one machine):
+//   connect         -> FrameIpcHello + fds [ring memfd, arena memfd, eventfd]
+//   per frame       producer fills slot head % FRAME_IPC_RING, bumps head and
+//                   signals the eventfd
+//   consumer        reads slots tail .. head - 1, then stores tail past every
+//                   frame it is done with - the buffer is reused after that
+//   pool rebuilt    (mode change) another FrameIpcHello with a new generation
+//                   and arena memfd; head and tail restart from 0
+// Each slot is a seqlock: seq is odd while the producer rewrites it and
+// 2 * (frame + 1) once it holds frame number frame, so a reader can check it
+// copied a whole descriptor of the frame it expected. A consumer that falls
+// FRAME_IPC_RING frames behind makes the producer drop frames, never wait.
+
+#define FRAME_IPC_MAGIC 0x54434649      // "TCFI"
+#define FRAME_IPC_VERSION 1
+#define FRAME_IPC_RING 4                // Frames the consumer may hold (extra pool buffers)
+#define FRAME_IPC_DRAIN_MS 200          // Wait for the consumer to hand frames back before a pool rebuild
+
+typedef struct {
+    _Atomic uint32_t seq;               // Seqlock, see above
+    uint32_t buffer;                    // Pool buffer index, for consumers that track buffers
+    uint64_t frame;                     // Frames published before this one in this generation
+    uint64_t captured_ns;               // CLOCK_MONOTONIC capture start
+    uint64_t offset;                    // Frame start in the arena memfd
+    uint32_t size;                      // Bytes the frame spans
+    uint32_t format;                    // CsFormat
+    uint32_t width;
+    uint32_t height;
+    uint32_t planes[3];                 // Plane offsets from offset (planes[2] unused for NV12)
+    uint32_t strides[3];
+} FrameIpcSlot;
+
+// Start of the ring memfd
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t generation;                // Matches the FrameIpcHello the fds came with
+    uint32_t ring;                      // FRAME_IPC_RING
+    _Atomic uint64_t head;              // Frames published (producer)
+    _Atomic uint64_t tail;              // Frames released (consumer)
+    FrameIpcSlot slots[FRAME_IPC_RING];
+} FrameIpcHeader;
+
+// Socket message, sent with the three fds
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t generation;
+    uint32_t header_size;               // Bytes to map of the ring memfd
+    uint64_t arena_size;                // Bytes to map of the arena memfd
+} FrameIpcHello;
+
+typedef struct FrameIpc FrameIpc;
+
+FrameIpc* frame_ipc_open(const char *path, ColorspaceStage *convert); // Listen at path for one consumer of convert's frames - NULL on failure
+void frame_ipc_release(FrameIpc *ipc);                                // Pipeline stopped - take every frame back, waiting up to FRAME_IPC_DRAIN_MS
+void frame_ipc_print_stats(const FrameIpc *ipc, FILE *out);
+void frame_ipc_close(FrameIpc *ipc);                                  // Removes the socket - safe to call with NULL
+
+int frame_ipc_stage_process(void *ipc, FrameDesc *frame);             // PipelineStageFn - publishes stage_data[PIPE_CONVERT]
+
+#endif
@@ -0,0 +1,270 @@
+#define _GNU_SOURCE     // memfd_create
+#include "frame_pool.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+struct FramePool {
+    pthread_mutex_t lock;           // Guards the free list
+    int capacity;
+    size_t buffer_size;             // Size callers asked for
+    size_t slot_size;               // buffer_size rounded up to FRAME_POOL_ALIGN
+    uint8_t *arena;
+    size_t arena_size;
+    FramePoolPages pages;
+    bool shared;                    // Arena lives in a memfd another process can map
+    int fd;                         // The memfd (-1 when private)
+    FrameBuffer *buffers;
+    int *free_list;                 // Stack of free buffer indices
+    int free_count;
+};
+
+static size_t round_up(size_t n, size_t to) {
+    return (n + to - 1) / to * to;
+}
+
+// Back a shared arena with a memfd, hugetlbfs first. Size is sealed so a
+// consumer that mapped it can trust it never shrinks under its mapping
+static int map_shared_arena(FramePool *pool, size_t size) {
+    size_t mapped = 0;
+    int fd = -1;
+    pool->pages = FRAME_POOL_PAGES_NORMAL;
+    
+#ifdef MFD_HUGETLB
+    if (size >= FRAME_POOL_HUGE_PAGE) {
+        mapped = round_up(size, FRAME_POOL_HUGE_PAGE);
+        fd = memfd_create("tabcaster-frames", MFD_CLOEXEC | MFD_ALLOW_SEALING | MFD_HUGETLB);
+        if (fd >= 0 && ftruncate(fd, (off_t)mapped) != 0) {
+            close(fd);
+            fd = -1;
+        }
+        if (fd >= 0) pool->pages = FRAME_POOL_PAGES_HUGETLB;
+    }
+#endif
+    if (fd < 0) {
+        mapped = round_up(size, (size_t)sysconf(_SC_PAGESIZE));
+        fd = memfd_create("tabcaster-frames", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (fd < 0 || ftruncate(fd, (off_t)mapped) != 0) {
+            perror("Frame pool memfd");
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+    }
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+    
+    void *arena = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (arena == MAP_FAILED) {
+        perror("Frame pool mmap");
+        close(fd);
+        return -1;
+    }
+    pool->arena = arena;
+    pool->arena_size = mapped;
+    pool->fd = fd;
+    return 0;
+}
+
+// Map the arena, best page size first, and fault it in now rather than on
+// the first frames
+static int map_arena(FramePool *pool, size_t size) {
+    if (pool->shared) return map_shared_arena(pool, size);
+    
+    void *arena = MAP_FAILED;
+    size_t mapped = 0;
+    pool->pages = FRAME_POOL_PAGES_NORMAL;
+    
+#ifdef MAP_HUGETLB
+    if (size >= FRAME_POOL_HUGE_PAGE) {
+        mapped = round_up(size, FRAME_POOL_HUGE_PAGE);
+        arena = mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        if (arena != MAP_FAILED) pool->pages = FRAME_POOL_PAGES_HUGETLB;
+    }
+#endif
+    
+    if (arena == MAP_FAILED) {
+        mapped = round_up(size, (size_t)sysconf(_SC_PAGESIZE));
+        arena = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (arena == MAP_FAILED) {
+            perror("Frame pool mmap");
+            return -1;
+        }
+        
+#ifdef MADV_HUGEPAGE
+        // Advice must come before the pages are touched
+        if (size >= FRAME_POOL_HUGE_PAGE && madvise(arena, mapped, MADV_HUGEPAGE) == 0) {
+            pool->pages = FRAME_POOL_PAGES_THP;
+        }
+#endif
+        for (size_t off = 0; off < mapped; off += 4096) ((volatile uint8_t *)arena)[off] = 0;
+    }
+    
+    pool->arena = arena;
+    pool->arena_size = mapped;
+    return 0;
+}
+
+static void unmap_arena(FramePool *pool) {
+    if (pool->arena) munmap(pool->arena, pool->arena_size);
+    if (pool->fd >= 0) close(pool->fd);
+    pool->fd = -1;
+    pool->arena = NULL;
+    pool->arena_size = 0;
+}
+
+// Map an arena for buffer_size and put every buffer on the free list
+static int build_arena(FramePool *pool, size_t buffer_size) {
+    pool->buffer_size = buffer_size;
+    pool->slot_size = round_up(buffer_size, FRAME_POOL_ALIGN);
+    if (map_arena(pool, pool->slot_size * (size_t)pool->capacity) != 0) return -1;
+    
+    for (int i = 0; i < pool->capacity; i++) {
+        FrameBuffer *b = &pool->buffers[i];
+        b->pool = pool;
+        b->data = pool->arena + pool->slot_size * (size_t)i;
+        b->index = i;
+        atomic_store(&b->refs, 0);
+        pool->free_list[i] = pool->capacity - 1 - i;    // Hand out buffer 0 first
+    }
+    pool->free_count = pool->capacity;
+    return 0;
+}
+
+// Allocate the bookkeeping and the first arena
+static FramePool* pool_create(int capacity, size_t buffer_size, bool shared) {
+    if (capacity <= 0 || buffer_size == 0) return NULL;
+    
+    FramePool *pool = calloc(1, sizeof(FramePool));
+    if (!pool) return NULL;
+    pool->capacity = capacity;
+    pool->shared = shared;
+    pool->fd = -1;
+    pool->buffers = calloc(capacity, sizeof(FrameBuffer));
+    pool->free_list = calloc(capacity, sizeof(int));
+    if (!pool->buffers || !pool->free_list || pthread_mutex_init(&pool->lock, NULL) != 0) {
+        free(pool->buffers);
+        free(pool->free_list);
+        free(pool);
+        return NULL;
+    }
+    
+    if (build_arena(pool, buffer_size) != 0) {
+        frame_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+FramePool* frame_pool_create(int capacity, size_t buffer_size) {
+    return pool_create(capacity, buffer_size, false);
+}
+
+FramePool* frame_pool_create_shared(int capacity, size_t buffer_size) {
+    return pool_create(capacity, buffer_size, true);
+}
+
+// New mode, new frame size - only possible once every buffer is back
+int frame_pool_resize(FramePool *pool, size_t buffer_size) {
+    if (!pool || buffer_size == 0) return -1;
+    
+    pthread_mutex_lock(&pool->lock);
+    int result = 0;
+    if (pool->free_count != pool->capacity) {
+        fprintf(stderr, "Frame pool: cannot resize with %d buffers in use\n", pool->capacity - pool->free_count);
+        result = -1;
+    } else if (round_up(buffer_size, FRAME_POOL_ALIGN) != pool->slot_size) {
+        unmap_arena(pool);
+        result = build_arena(pool, buffer_size);
+    } else {
+        pool->buffer_size = buffer_size;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return result;
+}
+
+// Take a free buffer with its first reference
+FrameBuffer* frame_pool_acquire(FramePool *pool) {
+    if (!pool) return NULL;
+    
+    FrameBuffer *buffer = NULL;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->arena && pool->free_count > 0) {
+        buffer = &pool->buffers[pool->free_list[--pool->free_count]];
+        atomic_store_explicit(&buffer->refs, 1, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return buffer;
+}
+
+FrameBuffer* frame_buffer_ref(FrameBuffer *buffer) {
+    if (buffer) atomic_fetch_add_explicit(&buffer->refs, 1, memory_order_relaxed);
+    return buffer;
+}
+
+// The last holder's writes happen-before the next acquirer's through the lock
+void frame_buffer_unref(FrameBuffer *buffer) {
+    if (!buffer) return;
+    if (atomic_fetch_sub_explicit(&buffer->refs, 1, memory_order_acq_rel) != 1) return;
+    
+    FramePool *pool = buffer->pool;
+    pthread_mutex_lock(&pool->lock);
+    pool->free_list[pool->free_count++] = buffer->index;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+size_t frame_pool_buffer_size(const FramePool *pool) {
+    return pool ? pool->buffer_size : 0;
+}
+
+int frame_pool_fd(const FramePool *pool) {
+    return pool ? pool->fd : -1;
+}
+
+size_t frame_pool_arena_size(const FramePool *pool) {
+    return pool ? pool->arena_size : 0;
+}
+
+size_t frame_buffer_offset(const FrameBuffer *buffer) {
+    return buffer ? (size_t)(buffer->data - buffer->pool->arena) : 0;
+}
+
+int frame_pool_capacity(const FramePool *pool) {
+    return pool ? pool->capacity : 0;
+}
+
+int frame_pool_available(FramePool *pool) {
+    if (!pool) return 0;
+    
+    pthread_mutex_lock(&pool->lock);
+    int available = pool->free_count;
+    pthread_mutex_unlock(&pool->lock);
+    return available;
+}
+
+FramePoolPages frame_pool_pages(const FramePool *pool) {
+    return pool ? pool->pages : FRAME_POOL_PAGES_NORMAL;
+}
+
+const char* frame_pool_pages_name(FramePoolPages pages) {
+    switch (pages) {
+    case FRAME_POOL_PAGES_HUGETLB: return "hugetlb";
+    case FRAME_POOL_PAGES_THP:     return "transparent huge pages";
+    default:                       return "normal pages";
+    }
+}
+
+void frame_pool_destroy(FramePool *pool) {
+    if (!pool) return;
+    
+    if (pool->free_count != pool->capacity) {
+        fprintf(stderr, "Frame pool: destroyed with %d buffers in use\n", pool->capacity - pool->free_count);
+    }
+    unmap_arena(pool);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->buffers);
+    free(pool->free_list);
+    free(pool);
+}
@@ -0,0 +1,53 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed set of equally sized frame buffers carved out of one arena, so the
+// streaming path never touches the heap per frame. Buffers start on 64-byte
+// boundaries and are refcounted: a stage that wants to keep a frame past its
+// hand-off takes a reference, and the buffer goes back to the pool when the
+// last one is dropped. The arena comes from explicit huge pages when the
+// system has them reserved, else from transparent huge pages, else plain
+// pages. It is sized once for an output's mode and only rebuilt when the
+// mode changes. A shared pool keeps its arena in a sealed memfd instead, so
+// another process can map the very same buffers; a rebuild gives it a new fd.
+
+#define FRAME_POOL_ALIGN 64
+#define FRAME_POOL_HUGE_PAGE (2u << 20)     // Arena is rounded to this when asking for huge pages
+
+typedef enum {
+    FRAME_POOL_PAGES_NORMAL,
+    FRAME_POOL_PAGES_THP,                   // madvise(MADV_HUGEPAGE), kernel may still back it with small pages
+    FRAME_POOL_PAGES_HUGETLB                // MAP_HUGETLB, reserved huge pages
+} FramePoolPages;
+
+typedef struct FramePool FramePool;
+
+typedef struct {
+    FramePool *pool;
+    uint8_t *data;                          // FRAME_POOL_ALIGN aligned, frame_pool_buffer_size() bytes
+    int index;
+    _Atomic int refs;
+} FrameBuffer;
+
+FramePool* frame_pool_create(int capacity, size_t buffer_size);    // NULL on failure
+FramePool* frame_pool_create_shared(int capacity, size_t buffer_size); // Arena in a memfd - NULL on failure
+int frame_pool_resize(FramePool *pool, size_t buffer_size);         // Rebuild the arena - -1 while buffers are out
+FrameBuffer* frame_pool_acquire(FramePool *pool);                   // One reference held - NULL when all are out
+FrameBuffer* frame_buffer_ref(FrameBuffer *buffer);                 // Returns buffer - safe to call with NULL
+void frame_buffer_unref(FrameBuffer *buffer);                       // Back to the pool on the last unref - safe to call with NULL
+size_t frame_pool_buffer_size(const FramePool *pool);
+int frame_pool_fd(const FramePool *pool);                           // Shared arena's memfd, owned by the pool (-1 when private)
+size_t frame_pool_arena_size(const FramePool *pool);                // Mapped bytes, what a consumer maps of the memfd
+size_t frame_buffer_offset(const FrameBuffer *buffer);              // Buffer start within the arena
+int frame_pool_capacity(const FramePool *pool);
+int frame_pool_available(FramePool *pool);                          // Buffers not handed out right now
+FramePoolPages frame_pool_pages(const FramePool *pool);
+const char* frame_pool_pages_name(FramePoolPages pages);
+void frame_pool_destroy(FramePool *pool);                           // Every buffer must be back - safe to call with NULL
+
+#endif
@@ -0,0 +1,164 @@
+#include "index_map.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SLOT_EMPTY   0
+#define SLOT_USED    1
+#define SLOT_DELETED 2
+
+// Mix key bits so sequential XIDs spread over the table (splitmix64 finalizer)
+static uint32_t hash_slot(uint64_t key, int capacity) {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return (uint32_t)key & (uint32_t)(capacity - 1);
+}
+
+// Allocate empty slot arrays of the given capacity
+static int alloc_slots(IndexMap *map, int capacity) {
+    map->keys = calloc(capacity, sizeof(uint64_t));
+    map->values = calloc(capacity, sizeof(int));
+    map->states = calloc(capacity, sizeof(uint8_t));
+    if (!map->keys || !map->values || !map->states) {
+        free(map->keys);
+        free(map->values);
+        free(map->states);
+        map->keys = NULL;
+        map->values = NULL;
+        map->states = NULL;
+        return -1;
+    }
+    map->capacity = capacity;
+    map->used = 0;
+    map->occupied = 0;
+    return 0;
+}
+
+// Insert into a slot without growth checks
+static void insert_slot(IndexMap *map, uint64_t key, int value) {
+    uint32_t mask = (uint32_t)map->capacity - 1;
+    uint32_t index = hash_slot(key, map->capacity);
+    
+    while (map->states[index] == SLOT_USED) {
+        index = (index + 1) & mask;
+    }
+    
+    if (map->states[index] == SLOT_EMPTY) map->occupied++;
+    map->keys[index] = key;
+    map->values[index] = value;
+    map->states[index] = SLOT_USED;
+    map->used++;
+}
+
+// Rehash into a larger (or tombstone-free) table
+static int rehash(IndexMap *map, int capacity) {
+    IndexMap old = *map;
+    
+    if (alloc_slots(map, capacity) != 0) {
+        *map = old;
+        return -1;
+    }
+    
+    for (int i = 0; i < old.capacity; i++) {
+        if (old.states[i] == SLOT_USED) {
+            insert_slot(map, old.keys[i], old.values[i]);
+        }
+    }
+    index_map_free(&old);
+    return 0;
+}
+
+// Size the table for the expected number of entries at <50% load
+int index_map_init(IndexMap *map, int expected) {
+    memset(map, 0, sizeof(*map));
+    
+    int capacity = 16;
+    while (capacity < expected * 2) capacity *= 2;
+    return alloc_slots(map, capacity);
+}
+
+// Forget all entries
+void index_map_clear(IndexMap *map) {
+    if (!map->states) return;
+    memset(map->states, 0, map->capacity * sizeof(uint8_t));
+    map->used = 0;
+    map->occupied = 0;
+}
+
+// Release slot storage
+void index_map_free(IndexMap *map) {
+    free(map->keys);
+    free(map->values);
+    free(map->states);
+    memset(map, 0, sizeof(*map));
+}
+
+// Add a key/value pair, growing at 70% occupancy
+int index_map_put(IndexMap *map, uint64_t key, int value) {
+    if (!map->states && index_map_init(map, 8) != 0) return -1;
+    
+    if ((map->occupied + 1) * 10 > map->capacity * 7) {
+        int capacity = (map->used + 1) * 10 > map->capacity * 5 ? map->capacity * 2 : map->capacity;
+        if (rehash(map, capacity) != 0) return -1;
+    }
+    insert_slot(map, key, value);
+    return 0;
+}
+
+// Probe the chain for key, letting the caller reject hash collisions
+int index_map_find(const IndexMap *map, uint64_t key, IndexMatchFn match, const void *ctx) {
+    if (!map->states) return -1;
+    
+    uint32_t mask = (uint32_t)map->capacity - 1;
+    uint32_t index = hash_slot(key, map->capacity);
+    
+    for (int probes = 0; probes < map->capacity && map->states[index] != SLOT_EMPTY; probes++) {
+        if (map->states[index] == SLOT_USED && map->keys[index] == key &&
+            (!match || match(map->values[index], ctx))) {
+            return map->values[index];
+        }
+        index = (index + 1) & mask;
+    }
+    return -1;
+}
+
+// Remove the entry holding exactly this key and value
+void index_map_remove(IndexMap *map, uint64_t key, int value) {
+    if (!map->states) return;
+    
+    uint32_t mask = (uint32_t)map->capacity - 1;
+    uint32_t index = hash_slot(key, map->capacity);
+    
+    for (int probes = 0; probes < map->capacity && map->states[index] != SLOT_EMPTY; probes++) {
+        if (map->states[index] == SLOT_USED && map->keys[index] == key &&
+            map->values[index] == value) {
+            map->states[index] = SLOT_DELETED;
+            map->used--;
+            return;
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+// FNV-1a 64-bit
+uint64_t index_map_hash_string(const char *str) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (; *str; str++) {
+        hash ^= (unsigned char)*str;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// FNV-1a 64-bit over raw bytes - zero struct padding before hashing
+uint64_t index_map_hash_bytes(const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
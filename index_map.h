@@ -0,0 +1,33 @@
+#ifndef INDEX_MAP_H
+#define INDEX_MAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Open-addressing hash map from a 64-bit key (XID, string or struct hash) to an
+// array index. Duplicate keys are allowed so string hashes can collide;
+// callers disambiguate through the match callback.
+
+typedef struct {
+    uint64_t *keys;
+    int *values;
+    uint8_t *states;    // 0 = empty, 1 = used, 2 = deleted
+    int capacity;       // power of two
+    int used;
+    int occupied;       // used + deleted, governs growth
+} IndexMap;
+
+typedef bool (*IndexMatchFn)(int value, const void *ctx);
+
+int index_map_init(IndexMap *map, int expected);                  // Returns 0 on success, -1 on allocation failure
+void index_map_clear(IndexMap *map);                              // Drop all entries, keep capacity
+void index_map_free(IndexMap *map);                               // Safe on zeroed map
+int index_map_put(IndexMap *map, uint64_t key, int value);        // Returns 0 on success, -1 on allocation failure
+int index_map_find(const IndexMap *map, uint64_t key,
+                   IndexMatchFn match, const void *ctx);          // First value for key accepted by match (NULL = any), -1 if none
+void index_map_remove(IndexMap *map, uint64_t key, int value);    // Remove one key/value pair
+uint64_t index_map_hash_string(const char *str);                  // FNV-1a 64-bit string hash
+uint64_t index_map_hash_bytes(const void *data, size_t length);   // FNV-1a 64-bit hash of a fixed-size key
+
+#endif
@@ -0,0 +1,458 @@
+#define _GNU_SOURCE     // recvmmsg
+#include "input.h"
+#include "timing.h"
+#include <X11/extensions/XTest.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define INPUT_PACKET_MAX (sizeof(InputPacketHeader) + INPUT_MAX_EVENTS * sizeof(InputEvent))
+
+// Tablet to root coordinates: root = origin + (v * scale + 2^31) >> 32
+typedef struct {
+    int x0;
+    int y0;
+    uint64_t sx;
+    uint64_t sy;
+    bool active;                        // An output to inject into
+} InputTransform;
+
+struct InputInjector {
+    Display *display;                   // Daemon connection (borrowed)
+    int screen;                         // X screen XTest motion is relative to
+    int fd;
+    struct in6_addr peers[INPUT_MAX_PEERS]; // Allowed sources, IPv4 as v4-mapped
+    int peer_count;                     // 0 = any source
+    uint8_t token[INPUT_TOKEN_SIZE];
+    bool have_token;
+    InputTransform transform;
+    char output[32];                    // Output the transform maps onto, for messages
+    uint32_t sequence;                  // Newest datagram seen
+    bool have_sequence;
+    int last_x;                         // Last injected root position (-1 = none yet)
+    int last_y;
+    unsigned int held;                  // Bit b set = we pressed button b and owe a release
+    
+    struct mmsghdr msgs[INPUT_BATCH];
+    struct iovec iov[INPUT_BATCH];
+    struct sockaddr_storage sources[INPUT_BATCH];
+    uint8_t packets[INPUT_BATCH][INPUT_PACKET_MAX];
+    char control[INPUT_BATCH][CMSG_SPACE(sizeof(struct timespec))];
+    
+    unsigned long datagrams;
+    unsigned long malformed;            // Bad magic/version/length, truncated or unknown events
+    unsigned long rejected;             // Wrong source address or pairing token
+    unsigned long stale;                // Arrived after a newer datagram - motion skipped
+    unsigned long unrouted;             // Arrived with no active output
+    unsigned long events;               // Events in valid datagrams
+    unsigned long coalesced;            // Motion events folded into a later one
+    unsigned long injected;             // XTest requests sent
+    unsigned long flushes;
+};
+
+static int64_t timespec_ns(const struct timespec *ts) {
+    return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+// Map one tablet coordinate pair through the precomputed transform
+static void map_point(const InputTransform *t, uint16_t x, uint16_t y, int *root_x, int *root_y) {
+    *root_x = t->x0 + (int)(((uint64_t)x * t->sx + (1ULL << 31)) >> 32);
+    *root_y = t->y0 + (int)(((uint64_t)y * t->sy + (1ULL << 31)) >> 32);
+}
+
+// Move the pointer unless it is already there
+static int inject_motion(InputInjector *input, int x, int y) {
+    if (x == input->last_x && y == input->last_y) return 0;
+    XTestFakeMotionEvent(input->display, input->screen, x, y, CurrentTime);
+    input->last_x = x;
+    input->last_y = y;
+    input->injected++;
+    return 1;
+}
+
+// Release every button we still hold, e.g. when the output goes away mid-stroke
+static void release_buttons(InputInjector *input) {
+    if (!input->held) return;
+    for (unsigned int b = 1; b <= INPUT_MAX_BUTTON; b++) {
+        if (input->held & (1u << b)) XTestFakeButtonEvent(input->display, b, False, CurrentTime);
+    }
+    input->held = 0;
+    XFlush(input->display);
+}
+
+// Any address as an in6_addr, IPv4 mapped to ::ffff:a.b.c.d - returns -1 for other families
+static int normalize_address(const struct sockaddr *sa, struct in6_addr *out) {
+    if (sa->sa_family == AF_INET6) {
+        *out = ((const struct sockaddr_in6 *)sa)->sin6_addr;
+        return 0;
+    }
+    if (sa->sa_family == AF_INET) {
+        memset(out, 0, sizeof(*out));
+        out->s6_addr[10] = 0xff;
+        out->s6_addr[11] = 0xff;
+        memcpy(&out->s6_addr[12], &((const struct sockaddr_in *)sa)->sin_addr, 4);
+        return 0;
+    }
+    return -1;
+}
+
+static bool is_loopback(const struct in6_addr *addr) {
+    return IN6_IS_ADDR_LOOPBACK(addr) || (IN6_IS_ADDR_V4MAPPED(addr) && addr->s6_addr[12] == 127);
+}
+
+// Only the configured peer's addresses - any source when none is set
+static bool source_allowed(const InputInjector *input, const struct sockaddr_storage *source, socklen_t length) {
+    if (input->peer_count == 0) return true;
+    struct in6_addr addr;
+    if (length == 0 || normalize_address((const struct sockaddr *)source, &addr) != 0) return false;
+    for (int i = 0; i < input->peer_count; i++) {
+        if (memcmp(&addr, &input->peers[i], sizeof(addr)) == 0) return true;
+    }
+    return false;
+}
+
+// Constant time, so how long a rejection takes says nothing about how much matched
+static bool token_matches(const InputInjector *input, const uint8_t *token) {
+    uint8_t diff = 0;
+    for (int i = 0; i < INPUT_TOKEN_SIZE; i++) diff |= token[i] ^ input->token[i];
+    return diff == 0;
+}
+
+// Inject one datagram - returns X requests queued (not yet flushed)
+static int handle_packet(InputInjector *input, const uint8_t *data, size_t length) {
+    InputPacketHeader h;
+    if (length < INPUT_HEADER_V1_SIZE) {
+        input->malformed++;
+        return 0;
+    }
+    memcpy(&h, data, INPUT_HEADER_V1_SIZE);
+    size_t header = h.version == INPUT_VERSION_V1 ? INPUT_HEADER_V1_SIZE : sizeof(h);
+    if (ntohs(h.magic) != INPUT_MAGIC || (h.version != INPUT_VERSION && h.version != INPUT_VERSION_V1) ||
+        h.count > INPUT_MAX_EVENTS || length < header + h.count * sizeof(InputEvent)) {
+        input->malformed++;
+        return 0;
+    }
+    if (input->have_token) {
+        if (h.version == INPUT_VERSION_V1) {
+            input->rejected++;
+            return 0;
+        }
+        memcpy(h.token, data + INPUT_HEADER_V1_SIZE, sizeof(h.token));
+        if (!token_matches(input, h.token)) {
+            input->rejected++;
+            return 0;
+        }
+    }
+    
+    uint32_t sequence = ntohl(h.sequence);
+    bool stale = input->have_sequence && (int32_t)(sequence - input->sequence) <= 0;
+    if (stale) {
+        input->stale++;
+    } else {
+        input->sequence = sequence;
+        input->have_sequence = true;
+    }
+    if (!input->transform.active) {
+        input->unrouted++;
+        return 0;
+    }
+    input->events += h.count;
+    
+    int injected = 0;
+    bool pending = false;            // Motion waiting for the next button event or the end
+    int pending_x = 0, pending_y = 0;
+    for (int i = 0; i < h.count; i++) {
+        InputEvent ev;
+        memcpy(&ev, data + header + i * sizeof(InputEvent), sizeof(ev));
+        int x, y;
+        map_point(&input->transform, ntohs(ev.x), ntohs(ev.y), &x, &y);
+        
+        switch (ev.type) {
+        case INPUT_MOTION:
+            if (stale) break;
+            if (pending) input->coalesced++;
+            pending = true;
+            pending_x = x;
+            pending_y = y;
+            break;
+        case INPUT_BUTTON_DOWN:
+        case INPUT_BUTTON_UP: {
+            if (ev.button < 1 || ev.button > INPUT_MAX_BUTTON) {
+                input->malformed++;
+                break;
+            }
+            // The press or release lands where the client saw it, not at the last motion
+            if (pending) input->coalesced++;
+            pending = false;
+            injected += inject_motion(input, x, y);
+                
+            bool press = ev.type == INPUT_BUTTON_DOWN;
+            unsigned int bit = 1u << ev.button;
+            if (press == ((input->held & bit) != 0)) break;    // Repeated by the client
+            XTestFakeButtonEvent(input->display, ev.button, press, CurrentTime);
+            input->held = press ? input->held | bit : input->held & ~bit;
+            input->injected++;
+            injected++;
+            break;
+        }
+        default:
+            input->malformed++;
+            break;
+        }
+    }
+    if (pending) injected += inject_motion(input, pending_x, pending_y);
+    return injected;
+}
+
+// Parse 16 hex digits into the pairing token
+static int parse_token(const char *text, uint8_t *token) {
+    if (strlen(text) != INPUT_TOKEN_SIZE * 2) return -1;
+    for (int i = 0; i < INPUT_TOKEN_SIZE * 2; i++) {
+        char c = text[i];
+        int v = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 :
+                c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (v < 0) return -1;
+        token[i / 2] = (uint8_t)(i % 2 ? token[i / 2] | v : v << 4);
+    }
+    return 0;
+}
+
+// Resolve the peer host into the allowed source list
+static int resolve_peer(InputInjector *input, const char *host) {
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_DGRAM };
+    struct addrinfo *found;
+    int err = getaddrinfo(host, NULL, &hints, &found);
+    if (err != 0) {
+        fprintf(stderr, "Input: cannot resolve peer %s: %s\n", host, gai_strerror(err));
+        return -1;
+    }
+    for (struct addrinfo *ai = found; ai && input->peer_count < INPUT_MAX_PEERS; ai = ai->ai_next) {
+        struct in6_addr addr;
+        if (normalize_address(ai->ai_addr, &addr) != 0) continue;
+        bool seen = false;
+        for (int i = 0; i < input->peer_count; i++) seen |= memcmp(&addr, &input->peers[i], sizeof(addr)) == 0;
+        if (!seen) input->peers[input->peer_count++] = addr;
+    }
+    freeaddrinfo(found);
+    if (input->peer_count == 0) {
+        fprintf(stderr, "Input: peer %s has no IPv4 or IPv6 address\n", host);
+        return -1;
+    }
+    return 0;
+}
+
+// Bind the numeric address (dual-stack for ::) - returns the socket or -1
+static int bind_socket(const char *address, int port, bool *loopback) {
+    char service[8];
+    snprintf(service, sizeof(service), "%d", port);
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_DGRAM,
+                              .ai_flags = AI_PASSIVE | AI_NUMERICHOST };
+    struct addrinfo *found;
+    int err = getaddrinfo(address, service, &hints, &found);
+    if (err != 0) {
+        fprintf(stderr, "Input: bad bind address %s: %s\n", address, gai_strerror(err));
+        return -1;
+    }
+    
+    int fd = -1;
+    for (struct addrinfo *ai = found; ai && fd < 0; ai = ai->ai_next) {
+        struct in6_addr addr;
+        if (normalize_address(ai->ai_addr, &addr) != 0) continue;
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (ai->ai_family == AF_INET6 && IN6_IS_ADDR_UNSPECIFIED(&addr)) {
+            int off = 0;
+            setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+        }
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            perror("Input: bind");
+            close(fd);
+            fd = -1;
+            continue;
+        }
+        *loopback = is_loopback(&addr);
+    }
+    freeaddrinfo(found);
+    return fd;
+}
+
+// Open the listening socket on the daemon's connection
+InputInjector* input_open(Display *display, const InputConfig *config) {
+    if (!display || !config || config->port <= 0 || config->port > 65535) return NULL;
+    
+    int event_base, error_base, major, minor;
+    if (!XTestQueryExtension(display, &event_base, &error_base, &major, &minor)) {
+        fprintf(stderr, "XTest is not available\n");
+        return NULL;
+    }
+    
+    InputInjector *input = calloc(1, sizeof(InputInjector));
+    if (!input) return NULL;
+    input->display = display;
+    input->screen = DefaultScreen(display);
+    input->fd = -1;
+    input->last_x = -1;
+    input->last_y = -1;
+    
+    if (config->token) {
+        if (parse_token(config->token, input->token) != 0) {
+            fprintf(stderr, "Input: pairing token must be %d hex digits\n", INPUT_TOKEN_SIZE * 2);
+            input_close(input);
+            return NULL;
+        }
+        input->have_token = true;
+    }
+    if (config->peer && resolve_peer(input, config->peer) != 0) {
+        input_close(input);
+        return NULL;
+    }
+    
+    const char *address = config->bind ? config->bind : INPUT_DEFAULT_BIND;
+    bool loopback = false;
+    input->fd = bind_socket(address, config->port, &loopback);
+    if (input->fd < 0) {
+        input_close(input);
+        return NULL;
+    }
+    // Off loopback anyone on the network could otherwise drive the pointer
+    if (!loopback && input->peer_count == 0 && !input->have_token) {
+        fprintf(stderr, "Input: listening on %s needs a peer address or a pairing token\n", address);
+        input_close(input);
+        return NULL;
+    }
+    
+    // Kernel receive timestamps - the latency we want includes time spent queued in the socket
+    int on = 1;
+    if (setsockopt(input->fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) != 0) {
+        perror("Input: SO_TIMESTAMPNS");
+    }
+    
+    for (int i = 0; i < INPUT_BATCH; i++) {
+        input->iov[i].iov_base = input->packets[i];
+        input->iov[i].iov_len = sizeof(input->packets[i]);
+        input->msgs[i].msg_hdr.msg_iov = &input->iov[i];
+        input->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    return input;
+}
+
+// Precompute the tablet-to-root transform for the output now under the pen
+int input_set_output(InputInjector *input, const ScreenInfo *screen) {
+    if (!input) return -1;
+    
+    if (!screen || !screen->crtc_id || screen->width == 0 || screen->height == 0) {
+        if (input->transform.active && screen) printf("Input: %s is inactive, dropping input\n", screen->name);
+        release_buttons(input);
+        input->transform.active = false;
+        return 0;
+    }
+    
+    // 0 maps onto the first pixel and INPUT_COORD_MAX onto the last
+    input->transform = (InputTransform){
+        .x0 = screen->x,
+        .y0 = screen->y,
+        .sx = ((uint64_t)(screen->width - 1) << 32) / INPUT_COORD_MAX,
+        .sy = ((uint64_t)(screen->height - 1) << 32) / INPUT_COORD_MAX,
+        .active = true,
+    };
+    snprintf(input->output, sizeof(input->output), "%s", screen->name);
+    input->last_x = -1;
+    input->last_y = -1;
+    return 0;
+}
+
+int input_fd(const InputInjector *input) {
+    return input ? input->fd : -1;
+}
+
+// Drain the socket a batch at a time, one flush per batch
+int input_process(InputInjector *input) {
+    if (!input) return -1;
+    
+    int total = 0;
+    for (;;) {
+        for (int i = 0; i < INPUT_BATCH; i++) {
+            input->msgs[i].msg_hdr.msg_control = input->control[i];
+            input->msgs[i].msg_hdr.msg_controllen = sizeof(input->control[i]);
+            input->msgs[i].msg_hdr.msg_name = &input->sources[i];
+            input->msgs[i].msg_hdr.msg_namelen = sizeof(input->sources[i]);
+            input->msgs[i].msg_hdr.msg_flags = 0;
+        }
+        int n = recvmmsg(input->fd, input->msgs, INPUT_BATCH, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR) continue;
+            perror("Input: recvmmsg");
+            return -1;
+        }
+        
+        int64_t received[INPUT_BATCH];     // CLOCK_REALTIME receive time of datagrams that injected anything (0 = none)
+        int batch = 0;
+        for (int i = 0; i < n; i++) {
+            struct msghdr *msg = &input->msgs[i].msg_hdr;
+            input->datagrams++;
+            received[i] = 0;
+            if (msg->msg_flags & MSG_TRUNC) {
+                input->malformed++;
+                continue;
+            }
+            if (!source_allowed(input, &input->sources[i], msg->msg_namelen)) {
+                input->rejected++;
+                continue;
+            }
+            int injected = handle_packet(input, input->packets[i], input->msgs[i].msg_len);
+            if (injected == 0) continue;
+            batch += injected;
+            
+            for (struct cmsghdr *c = CMSG_FIRSTHDR(msg); c; c = CMSG_NXTHDR(msg, c)) {
+                if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+                    struct timespec ts;
+                    memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+                    received[i] = timespec_ns(&ts);
+                }
+            }
+        }
+        
+        if (batch > 0) {
+            XFlush(input->display);
+            input->flushes++;
+            total += batch;
+            
+            // The receive stamps are wall-clock, timing runs on the monotonic clock
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            int64_t realtime = timespec_ns(&now);
+            uint64_t monotonic = timing_now();
+            for (int i = 0; i < n; i++) {
+                if (received[i] <= 0 || received[i] > realtime) continue;
+                uint64_t age = (uint64_t)(realtime - received[i]);
+                if (age < monotonic) timing_record(TIMING_INPUT, monotonic - age);
+            }
+        }
+        if (n < INPUT_BATCH) break;
+    }
+    return total;
+}
+
+void input_print_stats(const InputInjector *input, FILE *out) {
+    if (!input) return;
+    fprintf(out, "Input (%s): %lu datagrams, %lu events, %lu motion coalesced, %lu injected in %lu flushes\n",
+            input->transform.active ? input->output : "no output", input->datagrams, input->events,
+            input->coalesced, input->injected, input->flushes);
+    fprintf(out, "  %lu malformed, %lu rejected, %lu stale, %lu without an output\n",
+            input->malformed, input->rejected, input->stale, input->unrouted);
+}
+
+void input_close(InputInjector *input) {
+    if (!input) return;
+    release_buttons(input);
+    if (input->fd >= 0) close(input->fd);
+    free(input);
+}
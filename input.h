@@ -0,0 +1,80 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <X11/Xlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "display_manager.h"
+
+// Pen and touch input from the tablet client, injected with XTest on the
+// daemon's X connection. The client sends UDP datagrams of InputEvent records
+// in tablet coordinates (0 .. INPUT_COORD_MAX across the output); a fixed-point
+// transform precomputed from the output's x/y/width/height maps them to root
+// coordinates. Within a datagram consecutive motion collapses to its last
+// position, and each recvmmsg batch of datagrams ends in a single XFlush.
+// Packet receive (kernel timestamp) to flush is recorded as TIMING_INPUT.
+//
+// Wire format (network byte order):
+//   datagram = InputPacketHeader + count InputEvent records
+// Datagrams older than the newest sequence seen lose their motion but keep
+// their button events, so a reordered release is never dropped.
+//
+// The socket binds loopback unless told otherwise. Any other bind address needs
+// a peer, a pairing token or both: datagrams from another source address, or
+// without the token, are counted and dropped before they are parsed further.
+// Version 1 headers carry no token and are only accepted when none is set.
+
+#define INPUT_MAGIC 0x5449              // "TI"
+#define INPUT_VERSION 2
+#define INPUT_VERSION_V1 1              // No token field - header is 8 bytes
+#define INPUT_DEFAULT_PORT 47001
+#define INPUT_DEFAULT_BIND "127.0.0.1"
+#define INPUT_TOKEN_SIZE 8              // Pairing token bytes, given as 16 hex digits
+#define INPUT_MAX_PEERS 4               // Addresses kept from resolving the peer host
+#define INPUT_COORD_MAX 65535           // Tablet coordinate of the output's last pixel
+#define INPUT_MAX_EVENTS 64             // Per datagram
+#define INPUT_BATCH 16                  // Datagrams per recvmmsg (one flush each)
+#define INPUT_MAX_BUTTON 7              // X buttons 1-3 plus the 4-7 scroll buttons
+
+enum {
+    INPUT_MOTION = 1,
+    INPUT_BUTTON_DOWN = 2,
+    INPUT_BUTTON_UP = 3,
+};
+
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t count;                      // InputEvent records that follow
+    uint32_t sequence;                  // Datagrams sent before this one
+    uint8_t token[INPUT_TOKEN_SIZE];    // Pairing token (all zero when none is configured)
+} InputPacketHeader;
+
+#define INPUT_HEADER_V1_SIZE offsetof(InputPacketHeader, token)
+
+// Listener settings
+typedef struct {
+    int port;                           // UDP port
+    const char *bind;                   // Numeric address to bind (NULL = INPUT_DEFAULT_BIND)
+    const char *peer;                   // Accept only datagrams from this host (NULL = any source)
+    const char *token;                  // Pairing token as 16 hex digits (NULL = none)
+} InputConfig;
+
+typedef struct __attribute__((packed)) {
+    uint8_t type;                       // INPUT_MOTION / _BUTTON_DOWN / _BUTTON_UP
+    uint8_t button;                     // X button (1 = pen tip / touch, 2, 3 = barrel buttons)
+    uint16_t x;                         // Tablet coordinates, also for button events
+    uint16_t y;
+} InputEvent;
+
+typedef struct InputInjector InputInjector;
+
+InputInjector* input_open(Display *display, const InputConfig *config); // Listen on the configured address - NULL without XTest, on failure or unauthenticated non-loopback bind
+int input_set_output(InputInjector *input, const ScreenInfo *screen); // Retarget the transform - NULL or inactive drops input, returns 0 on success
+int input_fd(const InputInjector *input);                           // Socket to poll for POLLIN
+int input_process(InputInjector *input);                            // Drain pending datagrams - returns X events injected, -1 on error
+void input_print_stats(const InputInjector *input, FILE *out);
+void input_close(InputInjector *input);                             // Releases held buttons - safe to call with NULL
+
+#endif
@@ -0,0 +1,235 @@
+#include "latency_probe.h"
+#include "frame_clock.h"
+#include "timing.h"
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// What the send stage knew about a frame, until its echo
+typedef struct {
+    bool valid;
+    uint32_t frame;
+    uint64_t captured_ns;
+    uint64_t encoded_ns;                // 0 = no encode stage (external encoder)
+    uint64_t sent_ns;
+} ProbeFrame;
+
+// Latest samples of one segment, in microseconds
+typedef struct {
+    uint32_t samples[LATENCY_PROBE_SAMPLES];
+    unsigned long count;                // Recorded so far - the window holds the last LATENCY_PROBE_SAMPLES
+} ProbeWindow;
+
+struct LatencyProbe {
+    pthread_mutex_t lock;
+    ProbeFrame frames[LATENCY_PROBE_RING];
+    ProbeWindow windows[PROBE_SEGMENT_COUNT];
+    unsigned long sent;
+    unsigned long echoes;
+    unsigned long stale;                // Echoes for frames no longer (or never) in the ring
+    unsigned long bogus;                // Echoes claiming display before the frame was sent
+};
+
+static const TimingStage segment_timers[PROBE_SEGMENT_COUNT] = {
+    [PROBE_ENCODE]  = TIMING_PROBE_ENCODE,
+    [PROBE_SEND]    = TIMING_PROBE_SEND,
+    [PROBE_DISPLAY] = TIMING_PROBE_DISPLAY,
+    [PROBE_TOTAL]   = TIMING_PROBE_TOTAL,
+};
+
+static const char *segment_names[PROBE_SEGMENT_COUNT] = {
+    [PROBE_ENCODE]  = "capture -> encode",
+    [PROBE_SEND]    = "encode -> send",
+    [PROBE_DISPLAY] = "send -> display",
+    [PROBE_TOTAL]   = "capture -> display",
+};
+
+LatencyProbe* latency_probe_create(void) {
+    LatencyProbe *probe = calloc(1, sizeof(LatencyProbe));
+    if (!probe) return NULL;
+    pthread_mutex_init(&probe->lock, NULL);
+    return probe;
+}
+
+static void record(LatencyProbe *probe, ProbeSegment segment, uint64_t elapsed_ns) {
+    ProbeWindow *window = &probe->windows[segment];
+    uint64_t us = elapsed_ns / 1000;
+    window->samples[window->count % LATENCY_PROBE_SAMPLES] = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+    window->count++;
+    timing_record_elapsed(segment_timers[segment], elapsed_ns);
+}
+
+void latency_probe_sent(LatencyProbe *probe, uint32_t frame, uint64_t captured_ns,
+                        uint64_t encoded_ns, uint64_t sent_ns) {
+    if (!probe) return;
+    
+    pthread_mutex_lock(&probe->lock);
+    probe->frames[frame % LATENCY_PROBE_RING] = (ProbeFrame){ true, frame, captured_ns, encoded_ns, sent_ns };
+    probe->sent++;
+    pthread_mutex_unlock(&probe->lock);
+}
+
+// The echoed stamp must match too - frame numbers restart with every transport
+void latency_probe_echo(LatencyProbe *probe, uint32_t frame, uint32_t timestamp_us,
+                        uint32_t hold_us, uint64_t received_ns) {
+    if (!probe) return;
+    
+    pthread_mutex_lock(&probe->lock);
+    ProbeFrame *f = &probe->frames[frame % LATENCY_PROBE_RING];
+    uint64_t displayed_ns = received_ns - (uint64_t)hold_us * 1000;
+    if (!f->valid || f->frame != frame || (uint32_t)(f->captured_ns / 1000) != timestamp_us) {
+        probe->stale++;
+    } else if ((uint64_t)hold_us * 1000 > received_ns || displayed_ns < f->sent_ns) {
+        probe->bogus++;
+        f->valid = false;
+    } else {
+        if (f->encoded_ns) {
+            record(probe, PROBE_ENCODE, f->encoded_ns - f->captured_ns);
+            record(probe, PROBE_SEND, f->sent_ns - f->encoded_ns);
+        }
+        record(probe, PROBE_DISPLAY, displayed_ns - f->sent_ns);
+        record(probe, PROBE_TOTAL, displayed_ns - f->captured_ns);
+        probe->echoes++;
+        f->valid = false;               // A duplicated echo counts once
+    }
+    pthread_mutex_unlock(&probe->lock);
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of the sorted samples
+static double percentile_ms(const uint32_t *sorted, size_t count, double p) {
+    size_t rank = (size_t)(p * (double)count + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+    return sorted[rank - 1] / 1000.0;
+}
+
+void latency_probe_print(LatencyProbe *probe, FILE *out) {
+    if (!probe) return;
+    
+    pthread_mutex_lock(&probe->lock);
+    fprintf(out, "Latency probe: %lu frames sent, %lu echoed (%lu stale, %lu inconsistent)\n",
+            probe->sent, probe->echoes, probe->stale, probe->bogus);
+    uint32_t *sorted = malloc(sizeof(uint32_t) * LATENCY_PROBE_SAMPLES);
+    for (int i = 0; sorted && i < PROBE_SEGMENT_COUNT; i++) {
+        const ProbeWindow *window = &probe->windows[i];
+        size_t count = window->count < LATENCY_PROBE_SAMPLES ? window->count : LATENCY_PROBE_SAMPLES;
+        if (count == 0) continue;
+        memcpy(sorted, window->samples, count * sizeof(uint32_t));
+        qsort(sorted, count, sizeof(uint32_t), compare_u32);
+        fprintf(out, "  %-20s p50 %7.2f ms  p99 %7.2f ms  max %7.2f ms  (last %zu)\n", segment_names[i],
+                percentile_ms(sorted, count, 0.50), percentile_ms(sorted, count, 0.99),
+                sorted[count - 1] / 1000.0, count);
+    }
+    free(sorted);
+    pthread_mutex_unlock(&probe->lock);
+}
+
+void latency_probe_destroy(LatencyProbe *probe) {
+    if (!probe) return;
+    pthread_mutex_destroy(&probe->lock);
+    free(probe);
+}
+
+struct ProbePattern {
+    pthread_t thread;
+    bool thread_started;
+    _Atomic bool stop;
+    Display *display;
+    Window window;
+    GC gc;
+    unsigned long black;
+    unsigned long white;
+    unsigned int width;
+    double refresh_hz;
+};
+
+// One redraw: counter blocks split the strip's width evenly
+static void draw_pattern(ProbePattern *pattern, uint32_t counter) {
+    XRectangle ones[LATENCY_PATTERN_BITS];
+    XRectangle zeros[LATENCY_PATTERN_BITS];
+    int one_count = 0;
+    int zero_count = 0;
+    for (int bit = 0; bit < LATENCY_PATTERN_BITS; bit++) {
+        int x0 = (int)(pattern->width * (unsigned)bit / LATENCY_PATTERN_BITS);
+        int x1 = (int)(pattern->width * (unsigned)(bit + 1) / LATENCY_PATTERN_BITS);
+        XRectangle rect = { (short)x0, 0, (unsigned short)(x1 - x0), LATENCY_PATTERN_HEIGHT };
+        if (counter & (1u << (LATENCY_PATTERN_BITS - 1 - bit))) ones[one_count++] = rect;
+        else zeros[zero_count++] = rect;
+    }
+    XSetForeground(pattern->display, pattern->gc, pattern->white);
+    XFillRectangles(pattern->display, pattern->window, pattern->gc, ones, one_count);
+    XSetForeground(pattern->display, pattern->gc, pattern->black);
+    XFillRectangles(pattern->display, pattern->window, pattern->gc, zeros, zero_count);
+    XFlush(pattern->display);
+}
+
+static void* pattern_thread(void *arg) {
+    ProbePattern *pattern = arg;
+    FrameClock *clock = frame_clock_create(pattern->refresh_hz);
+    if (!clock) return NULL;
+    
+    while (!atomic_load(&pattern->stop)) {
+        if (frame_clock_wait(clock) < 0) break;
+        draw_pattern(pattern, (uint32_t)(timing_now() / 1000000));
+    }
+    frame_clock_destroy(clock);
+    return NULL;
+}
+
+ProbePattern* probe_pattern_start(const char *display_name, const ScreenInfo *screen, double refresh_hz) {
+    if (!screen || !screen->width) return NULL;
+    
+    ProbePattern *pattern = calloc(1, sizeof(ProbePattern));
+    if (!pattern) return NULL;
+    pattern->refresh_hz = refresh_hz;
+    pattern->width = screen->width;
+    pattern->display = XOpenDisplay(display_name);
+    if (!pattern->display) {
+        fprintf(stderr, "Probe pattern: cannot open X connection\n");
+        free(pattern);
+        return NULL;
+    }
+    
+    // Override-redirect: the window manager neither decorates nor moves it
+    Display *display = pattern->display;
+    int screen_number = DefaultScreen(display);
+    pattern->black = BlackPixel(display, screen_number);
+    pattern->white = WhitePixel(display, screen_number);
+    XSetWindowAttributes attributes = { .override_redirect = True, .background_pixel = pattern->black };
+    pattern->window = XCreateWindow(display, DefaultRootWindow(display), screen->x, screen->y,
+                                    screen->width, LATENCY_PATTERN_HEIGHT, 0, CopyFromParent, InputOutput,
+                                    CopyFromParent, CWOverrideRedirect | CWBackPixel, &attributes);
+    pattern->gc = XCreateGC(display, pattern->window, 0, NULL);
+    XMapRaised(display, pattern->window);
+    XSync(display, False);
+    
+    if (pthread_create(&pattern->thread, NULL, pattern_thread, pattern) != 0) {
+        fprintf(stderr, "Probe pattern: cannot start drawing thread\n");
+        probe_pattern_stop(pattern);
+        return NULL;
+    }
+    pattern->thread_started = true;
+    printf("Drawing latency test pattern over %s (%d-bit millisecond counter, top %d rows)\n", screen->name,
+           LATENCY_PATTERN_BITS, LATENCY_PATTERN_HEIGHT);
+    return pattern;
+}
+
+void probe_pattern_stop(ProbePattern *pattern) {
+    if (!pattern) return;
+    atomic_store(&pattern->stop, true);
+    if (pattern->thread_started) pthread_join(pattern->thread, NULL);
+    XFreeGC(pattern->display, pattern->gc);
+    XDestroyWindow(pattern->display, pattern->window);
+    XCloseDisplay(pattern->display);
+    free(pattern);
+}
@@ -0,0 +1,56 @@
+#ifndef LATENCY_PROBE_H
+#define LATENCY_PROBE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "display_manager.h"
+
+// Frame-to-photon latency probe. In probe mode every frame datagram carries
+// TRANSPORT_FLAG_PROBE, and the client answers each frame it puts on screen
+// with a TransportProbe echo: the frame number and capture stamp from the
+// header, plus how long it held the echo after the frame was displayed. The
+// send stage remembers when each frame was captured, left the encoder and
+// left the socket, so the echo's kernel receive time splits capture -> display
+// into capture -> encode -> send -> display. The clocks are never compared:
+// display time is the echo's arrival minus the hold, so it includes the echo's
+// one-way trip back over the tablet link (well under a millisecond on a LAN).
+//
+// Samples go to the TIMING_PROBE_* stages (timing command, --timing) and to a
+// window of the last LATENCY_PROBE_SAMPLES per segment for exact p50/p99/max.
+//
+// The optional test pattern is an override-redirect strip across the top of
+// the output, redrawn every refresh on its own X connection: LATENCY_PATTERN_BITS
+// blocks, white = 1, most significant first, holding the CLOCK_MONOTONIC
+// milliseconds of the draw. The client can decode it from the picture and
+// compare it with the frame's capture stamp (draw -> capture), and a camera
+// filming both screens reads the same counter off the monitor and the tablet.
+
+#define LATENCY_PROBE_RING 256          // Frames remembered until their echo (several seconds at 60 Hz)
+#define LATENCY_PROBE_SAMPLES 4096      // Most recent samples kept per segment
+#define LATENCY_PATTERN_BITS 24         // Counter blocks in the test pattern (wraps every ~4.6 hours)
+#define LATENCY_PATTERN_HEIGHT 48       // Strip height in pixels
+
+typedef enum {
+    PROBE_ENCODE,                       // Capture start -> encoder done
+    PROBE_SEND,                         // Encoder done -> last datagram sent
+    PROBE_DISPLAY,                      // Sent -> displayed
+    PROBE_TOTAL,                        // Capture start -> displayed
+    PROBE_SEGMENT_COUNT
+} ProbeSegment;
+
+typedef struct LatencyProbe LatencyProbe;
+typedef struct ProbePattern ProbePattern;
+
+LatencyProbe* latency_probe_create(void);                      // NULL on failure
+void latency_probe_sent(LatencyProbe *probe, uint32_t frame, uint64_t captured_ns,
+                        uint64_t encoded_ns, uint64_t sent_ns); // Send stage: frame left the socket
+void latency_probe_echo(LatencyProbe *probe, uint32_t frame, uint32_t timestamp_us,
+                        uint32_t hold_us, uint64_t received_ns); // Echo arrived at received_ns (CLOCK_MONOTONIC)
+void latency_probe_print(LatencyProbe *probe, FILE *out);      // p50/p99/max per segment and echo counts
+void latency_probe_destroy(LatencyProbe *probe);               // Safe to call with NULL
+
+ProbePattern* probe_pattern_start(const char *display_name, const ScreenInfo *screen,
+                                  double refresh_hz);          // Draw the test pattern over screen - NULL on failure
+void probe_pattern_stop(ProbePattern *pattern);                // Joins and removes the window - safe to call with NULL
+
+#endif
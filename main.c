@@ -1,8 +1,19 @@
+#include <X11/Xlib.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "display_backend.h"
 #include "display_manager.h"
 #include "mode_manager.h"
+#include "daemon.h"
+#include "batch.h"
+#include "timing.h"
+#include "capture.h"
+#include "damage.h"
+#include "frame_clock.h"
+#include "encoder.h"
+#include "input.h"
+#include "session.h"
 
 // Print usage information
 void print_usage(const char *program_name) {
@@ -13,38 +24,159 @@ void print_usage(const char *program_name) {
     printf("  --add-mode OUTPUT ID      Add existing mode (by ID) to output\n");
     printf("  --remove-mode OUTPUT ID   Remove mode (by ID) from output\n");
     printf("  --delete-mode ID          Delete mode (by ID) from XRandR entirely\n");
+    printf("  --provision OUTPUT WxH@R  Create mode, add it to OUTPUT and enable it in one step\n");
+    printf("  --right-of OUTPUT         Place provisioned output right of OUTPUT (with --provision)\n");
+    printf("  --batch FILE              Run create/add/remove/delete lines from FILE (- for stdin) with one sync\n");
+    printf("  --force-new               Always create a new mode, even if identical timings exist\n");
     printf("  --reduced-blanking        Use reduced blanking for CVT (with --create-mode)\n");
+    printf("  --backend xcb|xlib        Output query backend (default: xcb, pipelined)\n");
+    printf("  --reprobe                 Force a hardware re-probe of all outputs (slow)\n");
+    printf("  --gc-modes                Delete TabCaster-created modes that no CRTC is using, also attached ones\n");
+    printf("  --daemon                  Stay running, track RandR changes and read commands from stdin\n");
+    printf("  --gc-interval SECONDS     Orphaned mode GC interval in daemon mode (default: %d, 0 = off)\n",
+           DAEMON_DEFAULT_GC_INTERVAL);
+    printf("                            only modes in no output's list, so --add-mode'd modes are kept\n");
+    printf("  --control PATH            In daemon mode, also serve JSON/binary requests on UNIX socket PATH\n");
+    printf("  --profiles FILE           In daemon mode, load tablet profiles and create their modes at startup\n");
+    printf("  --input OUTPUT            In daemon mode, inject tablet pen/touch input into OUTPUT with XTest\n");
+    printf("  --input-port PORT         UDP port tablet input arrives on (default: %d)\n", INPUT_DEFAULT_PORT);
+    printf("  --input-bind ADDRESS      Address the input port listens on (default: %s)\n", INPUT_DEFAULT_BIND);
+    printf("  --input-peer HOST         Only accept tablet input sent from HOST\n");
+    printf("  --input-token HEX         Only accept tablet input carrying this 16 hex digit pairing token\n");
+    printf("  --capture OUTPUT          Capture OUTPUT's CRTC region (MIT-SHM) and report throughput\n");
+    printf("  --stream OUTPUT           Run the threaded capture/convert/encode/send pipeline on OUTPUT\n");
+    printf("  --display-backend x11|kms Frame source for --stream: MIT-SHM, or KMS DMA-BUFs straight to VAAPI (default: x11)\n");
+    printf("                            outputs without a KMS CRTC (VIRTUAL heads) fall back to x11\n");
+    printf("  --frames N                Frames to grab with --capture/--stream (default: 60, 0 = forever with --stream)\n");
+    printf("  --session SPEC            Stream one of several tablets at once (repeatable, up to %d), SPEC is\n", SESSION_MAX);
+    printf("                            output=NAME[,mode=WxH@R][,send=HOST:PORT|,ipc=PATH][,cpus=LIST|any]\n");
+    printf("  --send HOST:PORT          With --stream, send encoded frames to the tablet client over UDP\n");
+    printf("  --ipc PATH                With --stream, hand frames to an external encoder on UNIX socket PATH\n");
+    printf("  --fec                     With --send, add one XOR parity packet per 8 data packets\n");
+    printf("  --cursor                  With --send, send the cursor separately for the client to draw\n");
+    printf("  --probe                   With --send, have the client echo displayed frames and report latency percentiles\n");
+    printf("  --probe-pattern           With --stream, draw a millisecond counter strip over the output for calibration\n");
+    printf("  --adaptive MBITS          With --stream, step through a 100/75/50%% x full/half rate mode ladder to fit\n");
+    printf("                            the link and encoder (MBITS = link budget, 0 = react to loss and backlog only)\n");
+    printf("  --tile-diff               With --stream, hash 64x64 tiles and pass on only those that changed\n");
+    printf("  --encoder NAME            Encoder for --stream: auto|nvenc|vaapi|x264|openh264 (default: auto)\n");
+    printf("  --damage                  With --capture/--stream, read only XDamage dirty rectangles, skip idle frames\n");
+    printf("  --timing                  Print how long each X stage took (stages not needed are skipped)\n");
     printf("  --help                    Show this help\n");
     printf("\nExamples:\n");
     printf("  %s --create-mode 2336x1080@60\n", program_name);
     printf("  %s --add-mode HDMI1 123456789\n", program_name);
     printf("  %s --remove-mode HDMI1 2336x1080_60.00\n", program_name);
+    printf("  %s --provision VIRTUAL1 2336x1080@60 --right-of eDP-1\n", program_name);
+    printf("  printf 'create 2336x1080@60\\nadd VIRTUAL1 $1\\n' | %s --batch -\n", program_name);
+    printf("  echo list | %s --daemon\n", program_name);
+    printf("  %s --session output=VIRTUAL1,send=10.0.0.11:47000 --session output=VIRTUAL2,send=10.0.0.12:47000\n",
+           program_name);
 }
 
-// Parse mode specification (WxH@R format)
-int parse_mode_spec(const char *spec, unsigned int *width, unsigned int *height, double *refresh) {
-    if (!spec || !width || !height || !refresh) return -1;
-    
-    // Format: WIDTHxHEIGHT@REFRESH (e.g., "2336x1080@60" or "1920x1080@59.93")
-    int parsed = sscanf(spec, "%ux%u@%lf", width, height, refresh);
-    if (parsed != 3) {
-        fprintf(stderr, "Invalid mode specification: %s\n", spec);
-        fprintf(stderr, "Expected format: WIDTHxHEIGHT@REFRESH (e.g., 2336x1080@60)\n");
+// Grab frames from an output's CRTC region, paced to its mode's refresh rate
+// With damage tracking only dirty rectangles are read
+static int run_capture(DisplayManager *dm, const char *output_name, int frames, bool use_damage) {
+    if (dm_ensure_screens(dm) < 0) return -1;
+    
+    ScreenInfo *screen = dm_find_screen(dm, output_name);
+    if (!screen) {
+        fprintf(stderr, "Unknown output: %s\n", output_name);
         return -1;
     }
     
-    // Basic validation
-    if (*width < 1 || *width > 32767 || *height < 1 || *height > 32767) {
-        fprintf(stderr, "Invalid resolution: %ux%u\n", *width, *height);
-        return -1;
+    Capture *cap = capture_create(dm->display, dm->root, screen);
+    if (!cap) return -1;
+    
+    DamageTracker *tracker = NULL;
+    if (use_damage) {
+        tracker = damage_create(dm->display, dm->root, cap);
+        if (!tracker) {
+            capture_destroy(cap);
+            return -1;
+        }
     }
     
-    if (*refresh <= 0 || *refresh > 240) {
-        fprintf(stderr, "Invalid refresh rate: %.2f\n", *refresh);
+    // Pace to what the CRTC actually scans out, not the rate that was asked for
+    FrameClock *clock = frame_clock_create(dm_mode_refresh(dm_find_mode(dm, screen->mode_id)));
+    if (!clock) {
+        damage_destroy(tracker);
+        capture_destroy(cap);
         return -1;
     }
     
-    return 0;
+    printf("Capturing %s: %ux%u+%d+%d @ %.3f Hz (%s%s)\n", cap->output, cap->width, cap->height,
+           cap->x, cap->y, frame_clock_hz(clock), cap->use_shm ? "MIT-SHM" : "XGetSubImage",
+           tracker ? ", damage only" : "");
+    
+    uint64_t start = timing_now();
+    double bytes = 0;
+    unsigned long late = 0;
+    int result = 0;
+    for (int i = 0; i < frames && result == 0; i++) {
+        if (frame_clock_wait(clock) < 0) {
+            result = -1;
+            break;
+        }
+        
+        double frame_bytes = 0;
+        if (!tracker) {
+            result = capture_frame(cap);
+            frame_bytes = (double)cap->image->bytes_per_line * cap->height;
+        } else {
+            int count = damage_collect(tracker);
+            if (count <= 0) {
+                result = count;
+                continue;
+            }
+            
+            CaptureTile tiles[DAMAGE_MAX_RECTS];
+            result = capture_rects(cap, tracker->rects, count, tiles);
+            for (int t = 0; t < count; t++) frame_bytes += (double)tiles[t].stride * tiles[t].rect.height;
+        }
+        
+        // Overran the slot - a stale frame is dropped, not queued behind the next one
+        if (frame_clock_late(clock)) {
+            late++;
+            continue;
+        }
+        bytes += frame_bytes;
+    }
+    double seconds = (timing_now() - start) / 1e9;
+    
+    if (seconds > 0) {
+        printf("Captured %lu frame%s in %.3f s: %.1f fps, %.1f MB/s\n",
+               cap->frames, cap->frames == 1 ? "" : "s", seconds,
+               cap->frames / seconds, bytes / 1e6 / seconds);
+        printf("Pacing: %lu late frame%s dropped, %lu tick%s skipped\n",
+               late, late == 1 ? "" : "s", clock->dropped, clock->dropped == 1 ? "" : "s");
+    }
+    if (tracker) {
+        printf("Damage: %lu frame%s sent, %lu skipped (no change)\n",
+               tracker->frames_collected, tracker->frames_collected == 1 ? "" : "s",
+               tracker->frames_skipped);
+    }
+    frame_clock_destroy(clock);
+    damage_destroy(tracker);
+    capture_destroy(cap);
+    return result;
+}
+
+// Report the encoder --stream would pick, probed at the primary output's size
+static void print_encoder_info(DisplayManager *dm) {
+    ScreenInfo *screen = dm_get_primary_screen(dm);
+    ModeSpec spec = { 1920, 1080, 60.0, false };
+    if (screen && screen->width && screen->height) {
+        spec.width = screen->width;
+        spec.height = screen->height;
+        double refresh = dm_mode_refresh(dm_find_mode(dm, screen->mode_id));
+        if (refresh > 0) spec.refresh_rate = refresh;
+    }
+    
+    EncoderConfig config;
+    encoder_config_from_spec(&spec, &config);
+    EncoderBackend backend = encoder_probe(&config);
+    printf("Encoder: %s\n", backend < ENC_BACKEND_COUNT ? encoder_backend_name(backend) : "none available");
 }
 
 // Main entry point with command line argument parsing
@@ -57,10 +189,37 @@ int main(int argc, char *argv[]) {
     bool add_mode = false;
     bool remove_mode = false;
     bool delete_mode = false;
+    bool provision_mode = false;
     bool reduced_blanking = false;
+    bool daemon_mode = false;
+    bool reprobe = false;
+    bool force_new = false;
+    bool gc_modes = false;
+    bool show_timing = false;
+    int capture_frames = 60;
+    bool use_damage = false;
+    bool tile_diff = false;
+    bool use_fec = false;
+    bool send_cursor = false;
+    bool probe = false;
+    bool probe_pattern = false;
+    double adaptive_mbps = -1;
+    char *send_address = NULL;
+    char *ipc_path = NULL;
+    EncoderBackend encoder = ENC_BACKEND_AUTO;
+    DaemonConfig daemon_config = { .gc_interval = DAEMON_DEFAULT_GC_INTERVAL, .input_port = INPUT_DEFAULT_PORT };
+    DmBackend backend = DM_BACKEND_XCB;
+    DisplayBackendKind display_kind = DISPLAY_BACKEND_X11;
     
     char *mode_spec = NULL;
     char *output_name = NULL;
+    char *provision_output = NULL;
+    char *right_of = NULL;
+    char *batch_file = NULL;
+    char *capture_output = NULL;
+    char *stream_output = NULL;
+    SessionSpec sessions[SESSION_MAX];
+    int session_count = 0;
     RRMode mode_id = 0;
     
     // Simple argument parsing
@@ -81,8 +240,96 @@ int main(int argc, char *argv[]) {
         } else if (strcmp(argv[i], "--delete-mode") == 0 && i + 1 < argc) {
             delete_mode = true;
             mode_id = (RRMode)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--provision") == 0 && i + 2 < argc) {
+            provision_mode = true;
+            provision_output = argv[++i];
+            mode_spec = argv[++i];
+        } else if (strcmp(argv[i], "--right-of") == 0 && i + 1 < argc) {
+            right_of = argv[++i];
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch_file = argv[++i];
+        } else if (strcmp(argv[i], "--force-new") == 0) {
+            force_new = true;
         } else if (strcmp(argv[i], "--reduced-blanking") == 0) {
             reduced_blanking = true;
+        } else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            if (strcmp(name, "xcb") == 0) {
+                backend = DM_BACKEND_XCB;
+            } else if (strcmp(name, "xlib") == 0) {
+                backend = DM_BACKEND_XLIB;
+            } else {
+                fprintf(stderr, "Unknown backend: %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--display-backend") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            if (display_backend_from_name(name, &display_kind) != 0) {
+                fprintf(stderr, "Unknown display backend: %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--reprobe") == 0) {
+            reprobe = true;
+        } else if (strcmp(argv[i], "--gc-modes") == 0) {
+            gc_modes = true;
+        } else if (strcmp(argv[i], "--gc-interval") == 0 && i + 1 < argc) {
+            daemon_config.gc_interval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--daemon") == 0) {
+            daemon_mode = true;
+        } else if (strcmp(argv[i], "--control") == 0 && i + 1 < argc) {
+            daemon_config.control_path = argv[++i];
+        } else if (strcmp(argv[i], "--profiles") == 0 && i + 1 < argc) {
+            daemon_config.profiles_path = argv[++i];
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            daemon_config.input_output = argv[++i];
+        } else if (strcmp(argv[i], "--input-port") == 0 && i + 1 < argc) {
+            daemon_config.input_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--input-bind") == 0 && i + 1 < argc) {
+            daemon_config.input_bind = argv[++i];
+        } else if (strcmp(argv[i], "--input-peer") == 0 && i + 1 < argc) {
+            daemon_config.input_peer = argv[++i];
+        } else if (strcmp(argv[i], "--input-token") == 0 && i + 1 < argc) {
+            daemon_config.input_token = argv[++i];
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            capture_output = argv[++i];
+        } else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+            stream_output = argv[++i];
+        } else if (strcmp(argv[i], "--session") == 0 && i + 1 < argc) {
+            if (session_count == SESSION_MAX) {
+                fprintf(stderr, "At most %d sessions are supported\n", SESSION_MAX);
+                return 1;
+            }
+            if (session_parse_spec(argv[++i], &sessions[session_count]) != 0) return 1;
+            session_count++;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            capture_frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--damage") == 0) {
+            use_damage = true;
+        } else if (strcmp(argv[i], "--send") == 0 && i + 1 < argc) {
+            send_address = argv[++i];
+        } else if (strcmp(argv[i], "--ipc") == 0 && i + 1 < argc) {
+            ipc_path = argv[++i];
+        } else if (strcmp(argv[i], "--fec") == 0) {
+            use_fec = true;
+        } else if (strcmp(argv[i], "--cursor") == 0) {
+            send_cursor = true;
+        } else if (strcmp(argv[i], "--probe") == 0) {
+            probe = true;
+        } else if (strcmp(argv[i], "--probe-pattern") == 0) {
+            probe_pattern = true;
+        } else if (strcmp(argv[i], "--adaptive") == 0 && i + 1 < argc) {
+            adaptive_mbps = atof(argv[++i]);
+            if (adaptive_mbps < 0) adaptive_mbps = 0;
+        } else if (strcmp(argv[i], "--tile-diff") == 0) {
+            tile_diff = true;
+        } else if (strcmp(argv[i], "--encoder") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            if (encoder_backend_from_name(name, &encoder) != 0) {
+                fprintf(stderr, "Unknown encoder: %s\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--timing") == 0) {
+            show_timing = true;
         } else if (strcmp(argv[i], "--help") == 0) {
             print_usage(argv[0]);
             return 0;
@@ -98,28 +345,47 @@ int main(int argc, char *argv[]) {
         list_mode = true;
     }
     
-    // Initialize display manager
-    DisplayManager *dm = dm_init();
-    if (!dm) {
-        fprintf(stderr, "Failed to initialize display manager\n");
+    if (stream_output && session_count > 0) {
+        fprintf(stderr, "--stream and --session cannot be combined\n");
+        return 1;
+    }
+    if (send_address && ipc_path) {
+        fprintf(stderr, "--ipc hands frames to an external encoder, it cannot be combined with --send\n");
         return 1;
     }
     
-    // Get monitor information
-    int connected_count = dm_get_screens(dm);
-    if (connected_count < 0) {
-        fprintf(stderr, "Failed to get screen information\n");
-        dm_cleanup(dm);
+    // Every stream, a single --stream too, runs through session_run: its capture
+    // thread opens its own X connection while this thread keeps using dm's
+    if (stream_output || session_count > 0) XInitThreads();
+    
+    // Initialize display manager - resources and outputs are fetched on first use
+    // The daemon always keeps latency histograms, they are cheap
+    timing_enable(show_timing || daemon_mode);
+    const DisplayBackend *display = display_backend_get(display_kind);
+    DisplayManager *dm = dm_init(reprobe ? DM_ENUM_REPROBE : DM_ENUM_CURRENT);
+    if (!dm) {
+        fprintf(stderr, "Failed to initialize display manager\n");
         return 1;
     }
+    dm->backend = backend;
+    dm->force_new_modes = force_new;
     
     // Execute requested operations
     if (list_mode) {
+        int connected_count = display->enumerate(dm);
+        if (connected_count < 0) {
+            fprintf(stderr, "Failed to get screen information\n");
+            dm_cleanup(dm);
+            return 1;
+        }
+        
+        printf("Enumeration: %s, backend: %s\n", dm_enum_path_name(dm), dm_backend_name(dm->backend));
         printf("Found %d total output%s, %d connected\n", 
                dm->screen_count, 
                dm->screen_count == 1 ? "" : "s",
                connected_count);
         dm_print_screens(dm);
+        print_encoder_info(dm);
     }
     
     if (create_mode) {
@@ -144,6 +410,17 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    if (provision_mode) {
+        ModeSpec spec = { .reduced_blanking = reduced_blanking };
+        
+        if (parse_mode_spec(mode_spec, &spec.width, &spec.height, &spec.refresh_rate) == 0) {
+            RRMode new_mode_id = display->provision(dm, provision_output, &spec, right_of);
+            if (new_mode_id == 0) {
+                fprintf(stderr, "Failed to provision output\n");
+            }
+        }
+    }
+    
     if (add_mode) {
         if (mode_add_to_output(dm, output_name, mode_id) != 0) {
             fprintf(stderr, "Failed to add mode to output\n");
@@ -162,7 +439,63 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    int exit_code = 0;
+    if (gc_modes) {
+        if (display->gc_modes(dm) < 0) {
+            fprintf(stderr, "Stale mode garbage collection failed\n");
+            exit_code = 1;
+        }
+    }
+    
+    if (batch_file) {
+        FILE *input = strcmp(batch_file, "-") == 0 ? stdin : fopen(batch_file, "r");
+        if (!input) {
+            perror(batch_file);
+            exit_code = 1;
+        } else {
+            int failed = batch_run(dm, input);
+            if (failed != 0) {
+                fprintf(stderr, "Batch finished with %d failed line%s\n",
+                        failed, failed == 1 ? "" : "s");
+                exit_code = 1;
+            }
+            if (input != stdin) fclose(input);
+        }
+    }
+    
+    if (capture_output) {
+        if (run_capture(dm, capture_output, capture_frames, use_damage) != 0) exit_code = 1;
+    }
+    
+    if (stream_output || session_count > 0) {
+        StreamOptions stream_options = { capture_frames, use_damage, tile_diff, encoder, use_fec,
+                                         send_cursor, adaptive_mbps, display, probe, probe_pattern };
+        if (stream_output) {
+            // A single unpinned session
+            memset(&sessions[0], 0, sizeof(sessions[0]));
+            snprintf(sessions[0].output, sizeof(sessions[0].output), "%s", stream_output);
+            if (send_address) snprintf(sessions[0].send, sizeof(sessions[0].send), "%s", send_address);
+            if (ipc_path) snprintf(sessions[0].ipc, sizeof(sessions[0].ipc), "%s", ipc_path);
+            session_count = 1;
+        } else {
+            session_assign_cpus(sessions, session_count);
+        }
+        if (session_run(dm, sessions, session_count, &stream_options) != 0) exit_code = 1;
+    }
+    
+    if (daemon_mode) {
+        if (daemon_run(dm, &daemon_config) != 0) {
+            fprintf(stderr, "Daemon terminated with an error\n");
+            exit_code = 1;
+        }
+    }
+    
+    if (show_timing) {
+        timing_print(stderr);
+        if (daemon_mode) timing_print_histograms(stderr);
+    }
+    
     // Clean up
     dm_cleanup(dm);
-    return 0;
+    return exit_code;
 }
\ No newline at end of file
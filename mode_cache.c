@@ -0,0 +1,160 @@
+#include "mode_cache.h"
+#include "index_map.h"
+#include "mode_manager.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Timing fields that define a mode (name and ID excluded)
+typedef struct {
+    unsigned int width, height;
+    unsigned long dot_clock;
+    unsigned int h_sync_start, h_sync_end, h_total, h_skew;
+    unsigned int v_sync_start, v_sync_end, v_total;
+    unsigned long flags;
+} ModeKey;
+
+typedef struct {
+    ModeKey key;
+    RRMode mode_id;
+} CacheEntry;
+
+// Dense entry array indexed by an IndexMap keyed by the timing hash; the
+// map's match callback compares full keys, so hash collisions are harmless
+struct ModeCache {
+    CacheEntry *entries;
+    int count;
+    int capacity;
+    IndexMap by_timing;     // hash_key -> entries index
+};
+
+// Extract the lookup key from an XRRModeInfo
+static void make_key(const XRRModeInfo *mode, ModeKey *key) {
+    memset(key, 0, sizeof(*key));   // padding must hash and compare equal
+    key->width = mode->width;
+    key->height = mode->height;
+    key->dot_clock = mode->dotClock;
+    key->h_sync_start = mode->hSyncStart;
+    key->h_sync_end = mode->hSyncEnd;
+    key->h_total = mode->hTotal;
+    key->h_skew = mode->hSkew;
+    key->v_sync_start = mode->vSyncStart;
+    key->v_sync_end = mode->vSyncEnd;
+    key->v_total = mode->vTotal;
+    key->flags = mode->modeFlags;
+}
+
+static uint64_t hash_key(const ModeKey *key) {
+    return index_map_hash_bytes(key, sizeof(*key));
+}
+
+typedef struct {
+    const ModeCache *cache;
+    const ModeKey *key;
+} KeyMatch;
+
+// Reject entries whose timings only share the hash
+static bool key_matches(int index, const void *ctx) {
+    const KeyMatch *match = ctx;
+    return memcmp(&match->cache->entries[index].key, match->key, sizeof(*match->key)) == 0;
+}
+
+static int find_entry(const ModeCache *cache, const ModeKey *key) {
+    KeyMatch match = { cache, key };
+    return index_map_find(&cache->by_timing, hash_key(key), key_matches, &match);
+}
+
+// Append an entry unless these timings are indexed already - keeps the first (oldest) mode
+static int add_entry(ModeCache *cache, const ModeKey *key, RRMode mode_id) {
+    if (find_entry(cache, key) >= 0) return 0;
+    
+    if (cache->count == cache->capacity) {
+        int capacity = cache->capacity ? cache->capacity * 2 : 16;
+        CacheEntry *entries = realloc(cache->entries, (size_t)capacity * sizeof(CacheEntry));
+        if (!entries) return -1;
+        cache->entries = entries;
+        cache->capacity = capacity;
+    }
+    if (index_map_put(&cache->by_timing, hash_key(key), cache->count) != 0) return -1;
+    cache->entries[cache->count].key = *key;
+    cache->entries[cache->count].mode_id = mode_id;
+    cache->count++;
+    return 0;
+}
+
+// Build an index of every mode the server knows about
+ModeCache* mode_cache_build(const XRRScreenResources *resources) {
+    ModeCache *cache = calloc(1, sizeof(ModeCache));
+    if (!cache) return NULL;
+    
+    if (index_map_init(&cache->by_timing, resources ? resources->nmode : 0) != 0) {
+        free(cache);
+        return NULL;
+    }
+    
+    // A session's pinned modes are its own, never a match for someone else
+    size_t pinned_length = strlen(MODE_PINNED_PREFIX);
+    for (int i = 0; resources && i < resources->nmode; i++) {
+        const XRRModeInfo *mode = &resources->modes[i];
+        if (mode->nameLength >= pinned_length && strncmp(mode->name, MODE_PINNED_PREFIX, pinned_length) == 0) continue;
+        ModeKey key;
+        make_key(mode, &key);
+        if (add_entry(cache, &key, mode->id) != 0) {
+            mode_cache_free(cache);
+            return NULL;
+        }
+    }
+    return cache;
+}
+
+// Find a mode with identical timings
+RRMode mode_cache_find(const ModeCache *cache, const XRRModeInfo *timings) {
+    if (!cache || !timings) return 0;
+    
+    ModeKey key;
+    make_key(timings, &key);
+    int index = find_entry(cache, &key);
+    return index >= 0 ? cache->entries[index].mode_id : 0;
+}
+
+// Index a newly created mode
+int mode_cache_insert(ModeCache *cache, const XRRModeInfo *timings, RRMode mode_id) {
+    if (!cache || !timings || mode_id == 0) return -1;
+    
+    ModeKey key;
+    make_key(timings, &key);
+    return add_entry(cache, &key, mode_id);
+}
+
+// Remove a mode by ID - the last entry moves into its place to keep the array dense
+void mode_cache_remove(ModeCache *cache, RRMode mode_id) {
+    if (!cache || mode_id == 0) return;
+    
+    for (int i = 0; i < cache->count; i++) {
+        if (cache->entries[i].mode_id != mode_id) continue;
+        
+        int last = cache->count - 1;
+        index_map_remove(&cache->by_timing, hash_key(&cache->entries[i].key), i);
+        if (i != last) {
+            uint64_t hash = hash_key(&cache->entries[last].key);
+            index_map_remove(&cache->by_timing, hash, last);
+            cache->entries[i] = cache->entries[last];
+            index_map_put(&cache->by_timing, hash, i);   // On failure the mode is only missed, recreated on demand
+        }
+        cache->count--;
+        return;
+    }
+}
+
+// Number of indexed modes
+int mode_cache_count(const ModeCache *cache) {
+    return cache ? cache->count : 0;
+}
+
+// Free the index
+void mode_cache_free(ModeCache *cache) {
+    if (!cache) return;
+    index_map_free(&cache->by_timing);
+    free(cache->entries);
+    free(cache);
+}
@@ -0,0 +1,19 @@
+#ifndef MODE_CACHE_H
+#define MODE_CACHE_H
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+
+// Hash index of existing XRandR modes keyed by their timings, so identical
+// modes can be found without downloading and scanning the whole mode list.
+
+typedef struct ModeCache ModeCache;
+
+ModeCache* mode_cache_build(const XRRScreenResources *resources);     // Index all modes in resources - NULL on failure
+RRMode mode_cache_find(const ModeCache *cache, const XRRModeInfo *timings); // Mode with identical timings (0 if none)
+int mode_cache_insert(ModeCache *cache, const XRRModeInfo *timings, RRMode mode_id); // Returns 0 on success, -1 on error
+void mode_cache_remove(ModeCache *cache, RRMode mode_id);            // Forget a destroyed mode
+int mode_cache_count(const ModeCache *cache);                         // Number of indexed modes
+void mode_cache_free(ModeCache *cache);                               // Safe to call with NULL
+
+#endif
@@ -1,8 +1,36 @@
 #include "mode_manager.h"
+#include "profile.h"
+#include "timing.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Parse mode specification (WxH@R format)
+int parse_mode_spec(const char *spec, unsigned int *width, unsigned int *height, double *refresh) {
+    if (!spec || !width || !height || !refresh) return -1;
+    
+    // Format: WIDTHxHEIGHT@REFRESH (e.g., "2336x1080@60" or "1920x1080@59.93")
+    int parsed = sscanf(spec, "%ux%u@%lf", width, height, refresh);
+    if (parsed != 3) {
+        fprintf(stderr, "Invalid mode specification: %s\n", spec);
+        fprintf(stderr, "Expected format: WIDTHxHEIGHT@REFRESH (e.g., 2336x1080@60)\n");
+        return -1;
+    }
+    
+    // Basic validation
+    if (*width < 1 || *width > 32767 || *height < 1 || *height > 32767) {
+        fprintf(stderr, "Invalid resolution: %ux%u\n", *width, *height);
+        return -1;
+    }
+    
+    if (*refresh <= 0 || *refresh > 240) {
+        fprintf(stderr, "Invalid refresh rate: %.2f\n", *refresh);
+        return -1;
+    }
+    
+    return 0;
+}
+
 // Convert libxcvt_mode_info to XRRModeInfo
 static void convert_libxcvt_to_xrr(const struct libxcvt_mode_info *cvt_mode, XRRModeInfo *xrr_mode, const char *mode_name) {
     memset(xrr_mode, 0, sizeof(XRRModeInfo));
@@ -41,27 +69,52 @@ static void convert_libxcvt_to_xrr(const struct libxcvt_mode_info *cvt_mode, XRR
     xrr_mode->nameLength = strlen(mode_name);
 }
 
-// Create CVT mode using libxcvt and convert to XRandR
-RRMode mode_create_cvt(DisplayManager *dm, unsigned int width, unsigned int height, 
-                      double refresh_rate, bool reduced_blanking) {
-    if (!dm) return 0;
+// Timing index of existing modes, built from the screen resources on first use
+static ModeCache* ensure_mode_cache(DisplayManager *dm) {
+    if (!dm->mode_cache && dm_ensure_resources(dm) == 0) {
+        dm->mode_cache = mode_cache_build(dm->resources);
+    }
+    return dm->mode_cache;
+}
+
+// Create (or reuse) a CVT mode - *reused tells whether the ID already existed.
+// Pinned modes are only reused by name, never as some other mode with equal timings
+static RRMode create_cvt_mode(DisplayManager *dm, const char *prefix, unsigned int width, unsigned int height,
+                              double refresh_rate, bool reduced_blanking, bool *reused) {
+    *reused = false;
+    bool pinned = strcmp(prefix, MODE_PINNED_PREFIX) == 0;
     
     // Use libxcvt to calculate CVT timing
+    uint64_t start = timing_now();
     struct libxcvt_mode_info *cvt_mode = libxcvt_gen_mode_info(width, height, refresh_rate, 
                                                                reduced_blanking, false);
+    timing_record(TIMING_CVT_GENERATE, start);
     if (!cvt_mode) {
         fprintf(stderr, "libxcvt failed to generate mode for %dx%d@%.2f\n", 
                 width, height, refresh_rate);
         return 0;
     }
     
+    // Prefixed name marks the mode as ours for garbage collection
+    char mode_name[64];
+    snprintf(mode_name, sizeof(mode_name), "%s%ux%u_%.2f%s",
+             prefix, width, height, refresh_rate, reduced_blanking ? "R" : "");
+    if (pinned) {
+        RRMode named = mode_find_by_name(dm, mode_name);
+        if (named) {
+            free(cvt_mode);
+            *reused = true;
+            return named;
+        }
+    }
+    
     // Print the calculated mode info (using libxcvt structure)
     printf("Generated CVT mode:\n");
     printf("# %dx%d %.2f Hz (CVT) hsync: %.2f kHz; pclk: %.3f MHz\n",
            cvt_mode->hdisplay, cvt_mode->vdisplay, refresh_rate,
            cvt_mode->dot_clock / (double)cvt_mode->htotal, cvt_mode->dot_clock / 1000.0);
-    printf("Modeline \"%dx%d_%.2f\" %.3f %d %d %d %d %d %d %d %d %shsync %svsync\n",
-           width, height, refresh_rate, cvt_mode->dot_clock / 1000.0,
+    printf("Modeline \"%s\" %.3f %d %d %d %d %d %d %d %d %shsync %svsync\n",
+           mode_name, cvt_mode->dot_clock / 1000.0,
            cvt_mode->hdisplay, cvt_mode->hsync_start, cvt_mode->hsync_end, cvt_mode->htotal,
            cvt_mode->vdisplay, cvt_mode->vsync_start, cvt_mode->vsync_end, cvt_mode->vtotal,
            (cvt_mode->mode_flags & LIBXCVT_MODE_FLAG_HSYNC_POSITIVE) ? "+" : "-",
@@ -69,12 +122,22 @@ RRMode mode_create_cvt(DisplayManager *dm, unsigned int width, unsigned int heig
     
     // Convert to XRRModeInfo
     XRRModeInfo xrr_mode;
-    char mode_name[64];
-    snprintf(mode_name, sizeof(mode_name), "%dx%d_%.2f", width, height, refresh_rate);
     convert_libxcvt_to_xrr(cvt_mode, &xrr_mode, mode_name);
     
+    // Reuse a mode with identical timings instead of piling up duplicates
+    ModeCache *cache = dm->force_new_modes || pinned ? NULL : ensure_mode_cache(dm);
+    RRMode existing_id = mode_cache_find(cache, &xrr_mode);
+    if (existing_id != 0) {
+        free(cvt_mode);
+        *reused = true;
+        printf("Reusing existing mode with ID: %lu\n", existing_id);
+        return existing_id;
+    }
+    
     // Create the mode in XRandR
+    start = timing_now();
     RRMode new_mode_id = XRRCreateMode(dm->display, dm->root, &xrr_mode);
+    timing_record(TIMING_CREATE_MODE, start);
     
     // Clean up libxcvt resources
     free(cvt_mode);
@@ -84,31 +147,47 @@ RRMode mode_create_cvt(DisplayManager *dm, unsigned int width, unsigned int heig
         return 0;
     }
     
+    if (!pinned) mode_cache_insert(dm->mode_cache, &xrr_mode, new_mode_id);
+    dm_topology_add_mode(dm, &xrr_mode, new_mode_id);
+    
     printf("Created mode with ID: %lu\n", new_mode_id);
     return new_mode_id;
 }
 
+// Create CVT mode using libxcvt and convert to XRandR
+RRMode mode_create_cvt(DisplayManager *dm, unsigned int width, unsigned int height, 
+                      double refresh_rate, bool reduced_blanking) {
+    if (!dm) return 0;
+    
+    bool reused;
+    return create_cvt_mode(dm, MODE_NAME_PREFIX, width, height, refresh_rate, reduced_blanking, &reused);
+}
+
+// A mode for a live session to keep attached - see MODE_PINNED_PREFIX
+RRMode mode_create_cvt_pinned(DisplayManager *dm, unsigned int width, unsigned int height,
+                              double refresh_rate, bool reduced_blanking) {
+    if (!dm) return 0;
+    
+    bool reused;
+    return create_cvt_mode(dm, MODE_PINNED_PREFIX, width, height, refresh_rate, reduced_blanking, &reused);
+}
+
 // Add mode to a specific output using RRMode ID
 int mode_add_to_output(DisplayManager *dm, const char *output_name, RRMode mode_id) {
     if (!dm || !output_name || mode_id == 0) return -1;
+    if (dm_ensure_screens(dm) < 0) return -1;
     
     // Find the output by name
-    RROutput target_output = 0;
-    for (int i = 0; i < dm->screen_count; i++) {
-        if (strcmp(dm->screens[i].name, output_name) == 0) {
-            target_output = dm->screens[i].output_id;
-            break;
-        }
-    }
-    
-    if (target_output == 0) {
+    ScreenInfo *target = dm_find_screen(dm, output_name);
+    if (!target) {
         fprintf(stderr, "Output '%s' not found\n", output_name);
         return -1;
     }
     
     // Add the mode to the output
-    XRRAddOutputMode(dm->display, target_output, mode_id);
-    XSync(dm->display, False);
+    XRRAddOutputMode(dm->display, target->output_id, mode_id);
+    dm_screen_add_mode(target, mode_id);
+    dm_sync(dm);
     
     printf("Added mode ID %lu to output '%s'\n", mode_id, output_name);
     return 0;
@@ -117,24 +196,19 @@ int mode_add_to_output(DisplayManager *dm, const char *output_name, RRMode mode_
 // Remove mode from a specific output using RRMode ID
 int mode_remove_from_output(DisplayManager *dm, const char *output_name, RRMode mode_id) {
     if (!dm || !output_name || mode_id == 0) return -1;
+    if (dm_ensure_screens(dm) < 0) return -1;
     
     // Find the output by name
-    RROutput target_output = 0;
-    for (int i = 0; i < dm->screen_count; i++) {
-        if (strcmp(dm->screens[i].name, output_name) == 0) {
-            target_output = dm->screens[i].output_id;
-            break;
-        }
-    }
-    
-    if (target_output == 0) {
+    ScreenInfo *target = dm_find_screen(dm, output_name);
+    if (!target) {
         fprintf(stderr, "Output '%s' not found\n", output_name);
         return -1;
     }
     
     // Remove the mode from the output
-    XRRDeleteOutputMode(dm->display, target_output, mode_id);
-    XSync(dm->display, False);
+    XRRDeleteOutputMode(dm->display, target->output_id, mode_id);
+    dm_screen_remove_mode(target, mode_id);
+    dm_sync(dm);
     
     printf("Removed mode ID %lu from output '%s'\n", mode_id, output_name);
     return 0;
@@ -146,12 +220,317 @@ int mode_delete_from_xrandr(DisplayManager *dm, RRMode mode_id) {
     
     // Delete the mode from XRandR
     XRRDestroyMode(dm->display, mode_id);
-    XSync(dm->display, False);
+    mode_cache_remove(dm->mode_cache, mode_id);
+    dm_topology_remove_mode(dm, mode_id);
+    dm_sync(dm);
     
     printf("Deleted mode ID %lu from XRandR\n", mode_id);
     return 0;
 }
 
+// Pick the CRTC to drive an output: keep its current one, otherwise the first idle CRTC it supports
+static RRCrtc pick_crtc(DisplayManager *dm, const ScreenInfo *screen) {
+    if (screen->crtc_id) return screen->crtc_id;
+    
+    for (int i = 0; i < screen->possible_crtc_count; i++) {
+        CrtcState *crtc = dm_find_crtc(dm, screen->possible_crtcs[i]);
+        if (crtc && crtc->noutput == 0 && crtc->mode == None) {
+            return crtc->id;
+        }
+    }
+    return 0;
+}
+
+// Place new output right of the anchor, or right of everything currently lit
+static void compute_placement(DisplayManager *dm, const ScreenInfo *target,
+                              const ScreenInfo *anchor, int *x, int *y) {
+    if (anchor) {
+        *x = anchor->x + (int)anchor->width;
+        *y = anchor->y;
+        return;
+    }
+    
+    *x = 0;
+    *y = 0;
+    for (int i = 0; i < dm->screen_count; i++) {
+        const ScreenInfo *s = &dm->screens[i];
+        if (s == target || !s->crtc_id || s->width == 0) continue;
+        
+        int right_edge = s->x + (int)s->width;
+        if (right_edge > *x) *x = right_edge;
+    }
+}
+
+// Provision a virtual display in a single server grab - with an existing mode
+// (spec NULL) there is no CVT generation or mode creation, only the CRTC set
+static RRMode provision(DisplayManager *dm, const char *output_name, const ModeSpec *spec,
+                        RRMode existing, Rotation rotation, const char *right_of) {
+    if (dm_ensure_screens(dm) < 0) return 0;
+    
+    unsigned int width, height;
+    if (spec) {
+        width = spec->width;
+        height = spec->height;
+    } else {
+        ModeEntry *mode = dm_find_mode(dm, existing);
+        if (!mode) {
+            fprintf(stderr, "Mode ID %lu not found\n", existing);
+            return 0;
+        }
+        width = mode->width;
+        height = mode->height;
+    }
+    // The CRTC covers the rotated size on the desktop
+    if (rotation & (RR_Rotate_90 | RR_Rotate_270)) {
+        unsigned int swap = width;
+        width = height;
+        height = swap;
+    }
+    
+    ScreenInfo *target = dm_find_screen(dm, output_name);
+    if (!target) {
+        fprintf(stderr, "Output '%s' not found\n", output_name);
+        return 0;
+    }
+    
+    ScreenInfo *anchor = NULL;
+    if (right_of) {
+        anchor = dm_find_screen(dm, right_of);
+        if (!anchor || !anchor->crtc_id) {
+            fprintf(stderr, "Anchor output '%s' not found or not active\n", right_of);
+            return 0;
+        }
+    }
+    
+    int x, y;
+    compute_placement(dm, target, anchor, &x, &y);
+    
+    // Current screen size - grow it if the new output does not fit
+    int old_width = DisplayWidth(dm->display, dm->screen);
+    int old_height = DisplayHeight(dm->display, dm->screen);
+    int old_mm_width = DisplayWidthMM(dm->display, dm->screen);
+    int old_mm_height = DisplayHeightMM(dm->display, dm->screen);
+    int new_width = x + (int)width > old_width ? x + (int)width : old_width;
+    int new_height = y + (int)height > old_height ? y + (int)height : old_height;
+    bool need_resize = (new_width != old_width || new_height != old_height);
+    
+    RRMode mode_id = 0;
+    RRCrtc crtc = 0;
+    CrtcState previous_crtc;
+    bool had_previous_crtc = false;
+    bool mode_reused = false;
+    bool mode_added = false;
+    bool resized = false;
+    bool crtc_set = false;
+    const char *failed_step = NULL;
+    
+    dm_trap_errors(dm);
+    XGrabServer(dm->display);
+    
+    do {
+        if (spec) {
+            mode_id = create_cvt_mode(dm, MODE_NAME_PREFIX, spec->width, spec->height, spec->refresh_rate,
+                                      spec->reduced_blanking, &mode_reused);
+            if (mode_id == 0) { failed_step = "create mode"; break; }
+        } else {
+            mode_id = existing;
+            mode_reused = true;
+        }
+        
+        // Only undo the attachment if the output did not list the mode already
+        mode_added = !dm_screen_has_mode(target, mode_id);
+        XRRAddOutputMode(dm->display, target->output_id, mode_id);
+        
+        crtc = pick_crtc(dm, target);
+        if (crtc == 0) { failed_step = "find free CRTC"; break; }
+        
+        CrtcState *crtc_state = dm_find_crtc(dm, crtc);
+        if (target->crtc_id && crtc_state) {
+            previous_crtc = *crtc_state;
+            had_previous_crtc = true;
+        }
+        
+        if (need_resize) {
+            int min_w, min_h, max_w, max_h;
+            if (XRRGetScreenSizeRange(dm->display, dm->root, &min_w, &min_h, &max_w, &max_h) &&
+                (new_width > max_w || new_height > max_h)) {
+                failed_step = "resize screen (exceeds maximum)";
+                break;
+            }
+            
+            // Keep the physical DPI of the existing screen
+            int mm_width = old_width > 0 ? (int)((double)new_width * old_mm_width / old_width) : 0;
+            int mm_height = old_height > 0 ? (int)((double)new_height * old_mm_height / old_height) : 0;
+            XRRSetScreenSize(dm->display, dm->root, new_width, new_height, mm_width, mm_height);
+            resized = true;
+        }
+        
+        RROutput output = target->output_id;
+        Status status = XRRSetCrtcConfig(dm->display, dm->resources, crtc, CurrentTime,
+                                         x, y, mode_id, rotation, &output, 1);
+        if (status != RRSetConfigSuccess) { failed_step = "set CRTC config"; break; }
+        crtc_set = true;
+        
+        // Errors from the fire-and-forget requests arrive ahead of the replies above
+        if (dm_trapped_error() != 0) { failed_step = "X request"; break; }
+    } while (0);
+    
+    // The only explicit sync of the whole operation
+    int error_code = dm_untrap_errors(dm);
+    if (!failed_step && error_code != 0) failed_step = "X request";
+    
+    if (failed_step) {
+        fprintf(stderr, "Provisioning '%s' failed at step: %s", output_name, failed_step);
+        if (error_code != 0) fprintf(stderr, " (X error %d)", error_code);
+        fprintf(stderr, ", rolling back\n");
+        
+        // Undo in reverse order, ignoring errors from already-failed steps
+        dm_trap_errors(dm);
+        if (crtc_set) {
+            if (had_previous_crtc) {
+                XRRSetCrtcConfig(dm->display, dm->resources, crtc, CurrentTime,
+                                 previous_crtc.x, previous_crtc.y, previous_crtc.mode,
+                                 previous_crtc.rotation, previous_crtc.outputs,
+                                 previous_crtc.noutput);
+            } else {
+                XRRSetCrtcConfig(dm->display, dm->resources, crtc, CurrentTime,
+                                 0, 0, None, RR_Rotate_0, NULL, 0);
+            }
+        }
+        if (resized) {
+            XRRSetScreenSize(dm->display, dm->root, old_width, old_height,
+                             old_mm_width, old_mm_height);
+        }
+        if (mode_added) XRRDeleteOutputMode(dm->display, target->output_id, mode_id);
+        if (mode_id && !mode_reused) {
+            XRRDestroyMode(dm->display, mode_id);
+            mode_cache_remove(dm->mode_cache, mode_id);
+            dm_topology_remove_mode(dm, mode_id);
+        }
+        dm_untrap_errors(dm);
+        mode_id = 0;
+    } else {
+        // Keep the snapshot in step without waiting for notify events
+        dm_screen_add_mode(target, mode_id);
+        CrtcState *crtc_state = dm_find_crtc(dm, crtc);
+        if (crtc_state) {
+            RROutput output = target->output_id;
+            crtc_state->x = x;
+            crtc_state->y = y;
+            crtc_state->width = width;
+            crtc_state->height = height;
+            crtc_state->mode = mode_id;
+            crtc_state->rotation = rotation;
+            dm_crtc_set_outputs(dm, crtc_state, &output, 1);
+        }
+        printf("Provisioned '%s': %ux%u+%d+%d with mode ID %lu on CRTC %lu\n",
+               output_name, width, height, x, y, mode_id, crtc);
+    }
+    
+    XUngrabServer(dm->display);
+    XFlush(dm->display);
+    
+    return mode_id;
+}
+
+RRMode mode_provision(DisplayManager *dm, const char *output_name, const ModeSpec *spec,
+                      const char *right_of) {
+    if (!dm || !output_name || !spec) return 0;
+    return provision(dm, output_name, spec, 0, RR_Rotate_0, right_of);
+}
+
+RRMode mode_provision_existing(DisplayManager *dm, const char *output_name, RRMode mode_id,
+                               Rotation rotation, const char *right_of) {
+    if (!dm || !output_name || mode_id == 0) return 0;
+    return provision(dm, output_name, NULL, mode_id, rotation, right_of);
+}
+
+// Is the mode currently driving any CRTC?
+static bool mode_is_active(DisplayManager *dm, RRMode mode_id) {
+    for (int i = 0; i < dm->topology.crtc_count; i++) {
+        if (dm->topology.crtcs[i].mode == mode_id) return true;
+    }
+    return false;
+}
+
+// Is the mode still in some output's list, i.e. one xrandr could switch to?
+static bool mode_is_attached(DisplayManager *dm, RRMode mode_id) {
+    for (int i = 0; i < dm->screen_count; i++) {
+        if (dm_screen_has_mode(&dm->screens[i], mode_id)) return true;
+    }
+    return false;
+}
+
+// Collect TabCaster-created modes that no CRTC is using and no profile prewarmed
+int mode_find_stale(DisplayManager *dm, RRMode *stale, int max_stale, bool orphans_only) {
+    if (!dm || !stale) return 0;
+    if (dm_ensure_screens(dm) < 0) return 0;
+    
+    size_t prefix_length = strlen(MODE_NAME_PREFIX);
+    size_t pinned_length = strlen(MODE_PINNED_PREFIX);
+    int count = 0;
+    
+    for (int i = 0; i < dm->topology.mode_count && count < max_stale; i++) {
+        const ModeEntry *mode = &dm->topology.modes[i];
+        bool pinned = strncmp(mode->name, MODE_PINNED_PREFIX, pinned_length) == 0;
+        if (!pinned && strncmp(mode->name, MODE_NAME_PREFIX, prefix_length) != 0) continue;
+        if (mode_is_active(dm, mode->id)) continue;
+        if ((orphans_only || pinned) && mode_is_attached(dm, mode->id)) continue;
+        if (profile_pins_mode(dm->profiles, mode->id)) continue;
+        
+        stale[count++] = mode->id;
+    }
+    return count;
+}
+
+// Detach modes from every output listing them and destroy them, syncing once
+int mode_gc_delete(DisplayManager *dm, const RRMode *modes, int count) {
+    if (!dm || !modes || count <= 0) return 0;
+    
+    // Reuse the regular remove/destroy path with the per-call syncs deferred
+    bool previous_defer = dm->defer_sync;
+    dm->defer_sync = true;
+    dm_trap_errors(dm);
+    
+    int failures = 0;
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < dm->screen_count; j++) {
+            ScreenInfo *screen = &dm->screens[j];
+            if (dm_screen_has_mode(screen, modes[i]) &&
+                mode_remove_from_output(dm, screen->name, modes[i]) != 0) {
+                failures++;
+            }
+        }
+        if (mode_delete_from_xrandr(dm, modes[i]) != 0) failures++;
+    }
+    
+    if (dm_untrap_errors(dm) != 0) {
+        fprintf(stderr, "Some stale modes could not be removed (still in use by another client?)\n");
+        failures++;
+    }
+    dm->defer_sync = previous_defer;
+    return failures;
+}
+
+// One-shot garbage collection of stale TabCaster modes - asked for explicitly,
+// so attached but unused modes go too
+int mode_gc(DisplayManager *dm) {
+    if (!dm) return -1;
+    if (dm_ensure_screens(dm) < 0) return -1;
+    if (dm->topology.mode_count == 0) return 0;
+    
+    RRMode *stale = calloc(dm->topology.mode_count, sizeof(RRMode));
+    if (!stale) return -1;
+    
+    int count = mode_find_stale(dm, stale, dm->topology.mode_count, false);
+    int failures = mode_gc_delete(dm, stale, count);
+    
+    printf("Garbage collected %d stale mode%s%s\n", count, count == 1 ? "" : "s",
+           failures ? " (with errors)" : "");
+    free(stale);
+    return failures ? -1 : count;
+}
+
 // Print libxcvt mode info in readable format
 void mode_print_libxcvt_info(const struct libxcvt_mode_info *cvt_mode, double refresh_rate) {
     if (!cvt_mode) return;
@@ -167,27 +546,11 @@ void mode_print_libxcvt_info(const struct libxcvt_mode_info *cvt_mode, double re
            (cvt_mode->mode_flags & LIBXCVT_MODE_FLAG_VSYNC_POSITIVE) ? "+" : "-");
 }
 
-// Find mode ID by name in current XRandR configuration
+// Find mode ID by name in the topology snapshot
 RRMode mode_find_by_name(DisplayManager *dm, const char *mode_name) {
     if (!dm || !mode_name) return 0;
+    if (dm_ensure_screens(dm) < 0) return 0;
     
-    // Get current screen resources
-    XRRScreenResources *current_resources = XRRGetScreenResources(dm->display, dm->root);
-    if (!current_resources) return 0;
-    
-    // Search through all modes
-    for (int i = 0; i < current_resources->nmode; i++) {
-        XRRModeInfo *mode_info = &current_resources->modes[i];
-        
-        // Compare mode names
-        if (strlen(mode_name) == mode_info->nameLength && 
-            strncmp(mode_name, mode_info->name, mode_info->nameLength) == 0) {
-            RRMode found_id = mode_info->id;
-            XRRFreeScreenResources(current_resources);
-            return found_id;
-        }
-    }
-    
-    XRRFreeScreenResources(current_resources);
-    return 0; // Mode not found
-}
\ No newline at end of file
+    ModeEntry *mode = dm_find_mode_by_name(dm, mode_name);
+    return mode ? mode->id : 0;
+}
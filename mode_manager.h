@@ -6,6 +6,12 @@
 #include <X11/extensions/Xrandr.h>
 #include <stdbool.h>
 
+// Modes created by TabCaster carry this name prefix so stale ones can be found later
+#define MODE_NAME_PREFIX "tc_"
+// Modes a running session keeps attached without using them (the adaptive ladder):
+// collected only once attached to no output, even by an explicit --gc-modes
+#define MODE_PINNED_PREFIX "tcpin_"
+
 // Simple mode specification for input
 typedef struct {
     unsigned int width;
@@ -17,11 +23,30 @@ typedef struct {
 // Core mode management functions 
 RRMode mode_create_cvt(DisplayManager *dm, unsigned int width, unsigned int height, 
                       double refresh_rate, bool reduced_blanking);
+RRMode mode_create_cvt_pinned(DisplayManager *dm, unsigned int width, unsigned int height,
+                              double refresh_rate, bool reduced_blanking); // MODE_PINNED_PREFIX name, reused only by name - 0 on failure
 int mode_add_to_output(DisplayManager *dm, const char *output_name, RRMode mode_id);
 int mode_remove_from_output(DisplayManager *dm, const char *output_name, RRMode mode_id);
 int mode_delete_from_xrandr(DisplayManager *dm, RRMode mode_id);
 
+// Create mode, attach it to output and light it up in one grabbed, single-sync step.
+// Placed right of 'right_of' when given, otherwise right of the current desktop.
+// Rolls back every step on failure - returns new mode ID, 0 on failure
+RRMode mode_provision(DisplayManager *dm, const char *output_name, const ModeSpec *spec,
+                      const char *right_of);
+RRMode mode_provision_existing(DisplayManager *dm, const char *output_name, RRMode mode_id,
+                               Rotation rotation, const char *right_of); // Same with a mode that exists already - just the CRTC set
+
+// Stale mode garbage collection - TabCaster modes (MODE_NAME_PREFIX, or orphaned MODE_PINNED_PREFIX) not driving any CRTC
+// and not prewarmed by a profile (see profile.h). Orphans are also attached to no output:
+// a mode someone added with --add-mode and selects with xrandr later is not an orphan
+int mode_find_stale(DisplayManager *dm, RRMode *stale, int max_stale,
+                    bool orphans_only);                                    // Fill stale IDs - returns count
+int mode_gc_delete(DisplayManager *dm, const RRMode *modes, int count);    // Detach and destroy in one sync - returns failures
+int mode_gc(DisplayManager *dm);                                           // Find and delete all stale modes - returns deleted count, -1 on error
+
 // Utility functions
+int parse_mode_spec(const char *spec, unsigned int *width, unsigned int *height, double *refresh);
 void mode_print_libxcvt_info(const struct libxcvt_mode_info *cvt_mode, double refresh_rate);
 RRMode mode_find_by_name(DisplayManager *dm, const char *mode_name);
 
@@ -0,0 +1,385 @@
+#define _GNU_SOURCE     // pthread_attr_setaffinity_np
+#include "pipeline.h"
+#include "cursor.h"
+#include "display_backend.h"
+#include "frame_clock.h"
+#include "spsc_ring.h"
+#include "tile_diff.h"
+#include "timing.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define IDLE_SPINS 64               // Empty-ring polls before sleeping
+#define IDLE_SLEEP_NS 100000        // Sleep between polls once idle (bounds wake-up latency)
+
+static const char *stage_names[PIPE_STAGE_COUNT] = {
+    [PIPE_CAPTURE] = "capture",
+    [PIPE_CONVERT] = "convert",
+    [PIPE_ENCODE]  = "encode",
+    [PIPE_SEND]    = "send",
+};
+
+static const TimingStage stage_timers[PIPE_STAGE_COUNT] = {
+    [PIPE_CAPTURE] = TIMING_CAPTURE,
+    [PIPE_CONVERT] = TIMING_PIPE_CONVERT,
+    [PIPE_ENCODE]  = TIMING_PIPE_ENCODE,
+    [PIPE_SEND]    = TIMING_PIPE_SEND,
+};
+
+// Per-stage thread state and counters
+typedef struct {
+    Pipeline *pipeline;
+    PipelineStage stage;
+    pthread_t thread;
+    bool started;
+    _Atomic bool done;              // Thread exited, its output ring will not grow
+    _Atomic unsigned long frames;   // Frames handled
+    _Atomic unsigned long dropped;  // Frames this stage dropped (late or by its hook)
+} StageThread;
+
+struct Pipeline {
+    PipelineConfig config;
+    SpscRing rings[PIPE_STAGE_COUNT];   // rings[i] feeds stage i; rings[PIPE_CAPTURE] returns free frames
+    FrameDesc frames[PIPELINE_DEPTH];
+    StageThread threads[PIPE_STAGE_COUNT];
+    _Atomic bool stop;
+    _Atomic bool failed;
+    _Atomic unsigned long no_buffer;    // Ticks dropped because every frame was in flight
+    _Atomic unsigned long idle;         // Ticks skipped because damage reported nothing
+    _Atomic unsigned long unchanged;    // Ticks skipped because no tile hash changed
+    _Atomic unsigned long late_ticks;   // Ticks the frame clock skipped
+    _Atomic unsigned long delivered;    // Frames sent intact
+    _Atomic uint64_t latency_ns;        // ... their summed capture-to-send latency
+    _Atomic uint64_t latency_max_ns;
+    Display *capture_display;           // Capture thread's private connection
+    const DisplayBackend *backend;
+    CaptureSource *source;              // Capture buffers on capture_display, freed after every stage let go
+    CursorTracker *cursor;              // Lives on capture_display, kept for its stats
+};
+
+// Back off on an empty ring - spin briefly, then sleep in short steps
+static void idle_wait(int *spins) {
+    if (++*spins < IDLE_SPINS) return;
+    struct timespec pause = { 0, IDLE_SLEEP_NS };
+    nanosleep(&pause, NULL);
+}
+
+// Drop the pool buffers a recycled frame still references
+static void release_buffers(FrameDesc *frame) {
+    for (int i = 0; i < PIPE_STAGE_COUNT; i++) {
+        frame_buffer_unref(frame->buffers[i]);
+        frame->buffers[i] = NULL;
+    }
+}
+
+// Capture thread - private X connection, frame clock, capture source
+static void* capture_thread(void *arg) {
+    StageThread *self = arg;
+    Pipeline *p = self->pipeline;
+    const PipelineConfig *cfg = &p->config;
+    
+    // Kept open until pipeline_destroy - the capture buffers' SHM segments are attached through it
+    Display *display = XOpenDisplay(cfg->display_name);
+    p->capture_display = display;
+    FrameClock *clock = NULL;
+    FrameDesc *pending = NULL;      // Free frame held back after an idle tick
+    
+    if (!display) {
+        fprintf(stderr, "Pipeline: cannot open capture connection\n");
+        goto fail;
+    }
+    Window root = DefaultRootWindow(display);
+    
+    p->source = p->backend->capture_open(display, &cfg->screen, cfg->use_damage);
+    if (!p->source) goto fail;
+    if (cfg->sideband) {
+        p->cursor = cursor_create(display, root, &cfg->screen, cfg->sideband);
+        if (!p->cursor) goto fail;
+    }
+    clock = frame_clock_create(cfg->refresh_hz);
+    if (!clock) goto fail;
+    
+    uint64_t sequence = 0;
+    uint64_t budget = (uint64_t)(PIPE_STAGE_COUNT * 1e9 / frame_clock_hz(clock));
+    
+    while (!atomic_load(&p->stop) && (cfg->max_frames == 0 || clock->frames < cfg->max_frames)) {
+        int skipped = frame_clock_wait(clock);
+        if (skipped < 0) goto fail;
+        atomic_fetch_add(&p->late_ticks, (unsigned long)skipped);
+        
+        // Every tick, even idle ones - pointer motion alone never makes a frame
+        if (p->cursor) {
+            uint64_t polled = timing_now();
+            int result = cursor_update(p->cursor);
+            timing_record(TIMING_CURSOR, polled);
+            if (result != 0) goto fail;
+        }
+        
+        FrameDesc *frame = pending;
+        pending = NULL;
+        if (!frame) {
+            frame = spsc_ring_pop(&p->rings[PIPE_CAPTURE]);
+            if (!frame) {
+                atomic_fetch_add(&p->no_buffer, 1);
+                continue;
+            }
+            // Its changes never made it out - damage already collected and hashes that
+            // saw them would hide them for good
+            if (frame->dropped) {
+                tile_diff_invalidate(cfg->tile_diff);
+                if (p->backend->capture_invalidate) p->backend->capture_invalidate(p->source);
+            }
+            release_buffers(frame);
+        }
+        
+        uint64_t start = timing_now();
+        memset(frame->stage_data, 0, sizeof(frame->stage_data));
+        int result = p->backend->capture_grab(p->source, frame);
+        if (result < 0) goto fail;
+        if (result > 0) {
+            pending = frame;
+            atomic_fetch_add(&p->idle, 1);
+            continue;
+        }
+        
+        if (cfg->tile_diff) {
+            uint64_t hashed = timing_now();
+            int count = tile_diff_apply(cfg->tile_diff, frame->tiles, &frame->tile_count);
+            timing_record(TIMING_TILE_DIFF, hashed);
+            if (count < 0) goto fail;
+            if (count == 0) {
+                pending = frame;
+                atomic_fetch_add(&p->unchanged, 1);
+                continue;
+            }
+        }
+        
+        frame->sequence = sequence++;
+        frame->captured_ns = start;
+        frame->deadline_ns = start + budget;
+        frame->dropped = false;
+        memset(frame->done_ns, 0, sizeof(frame->done_ns));
+        frame->done_ns[PIPE_CAPTURE] = timing_now();
+        
+        // Ring capacity covers every frame, so this cannot fail
+        spsc_ring_push(&p->rings[PIPE_CONVERT], frame);
+        atomic_fetch_add(&self->frames, 1);
+    }
+    goto done;
+    
+fail:
+    atomic_store(&p->failed, true);
+done:
+    // Capture buffers are freed in pipeline_destroy, after every stage let go of them
+    atomic_store(&self->done, true);
+    frame_clock_destroy(clock);
+    
+    return NULL;
+}
+
+// Convert/encode/send thread - run the hook on each frame and pass it on
+static void* stage_thread(void *arg) {
+    StageThread *self = arg;
+    Pipeline *p = self->pipeline;
+    PipelineStage stage = self->stage;
+    PipelineStageFn fn = p->config.stages[stage];
+    void *ctx = p->config.stage_ctx[stage];
+    SpscRing *in = &p->rings[stage];
+    SpscRing *out = &p->rings[(stage + 1) % PIPE_STAGE_COUNT];  // send feeds the free ring
+    StageThread *upstream = &p->threads[stage - 1];
+    
+    int spins = 0;
+    for (;;) {
+        FrameDesc *frame = spsc_ring_pop(in);
+        if (!frame) {
+            if (atomic_load(&upstream->done) && spsc_ring_depth(in) == 0) break;
+            idle_wait(&spins);
+            continue;
+        }
+        spins = 0;
+        
+        // Once encoded, a frame is a reference for the next ones - skipping its
+        // send would corrupt the client's picture until the next intra refresh
+        if (!frame->dropped && stage <= PIPE_ENCODE && timing_now() > frame->deadline_ns) {
+            frame->dropped = true;      // Too old to be worth showing
+            atomic_fetch_add(&self->dropped, 1);
+        }
+        
+        if (!frame->dropped && fn) {
+            uint64_t start = timing_now();
+            int result = fn(ctx, frame);
+            frame->done_ns[stage] = timing_now();
+            timing_record_elapsed(stage_timers[stage], frame->done_ns[stage] - start);
+            if (result < 0) {
+                atomic_store(&p->failed, true);
+                atomic_store(&p->stop, true);
+                frame->dropped = true;
+            } else if (result > 0) {
+                frame->dropped = true;
+                atomic_fetch_add(&self->dropped, 1);
+            }
+        }
+        
+        if (stage == PIPE_SEND && !frame->dropped) {
+            timing_record(TIMING_PIPE_LATENCY, frame->captured_ns);
+            uint64_t latency = timing_now() - frame->captured_ns;
+            atomic_fetch_add(&p->delivered, 1);
+            atomic_fetch_add(&p->latency_ns, latency);
+            if (latency > atomic_load(&p->latency_max_ns)) atomic_store(&p->latency_max_ns, latency);
+        }
+        atomic_fetch_add(&self->frames, 1);
+        spsc_ring_push(out, frame);
+    }
+    
+    atomic_store(&self->done, true);
+    return NULL;
+}
+
+// Allocate rings and descriptors and start every stage thread
+Pipeline* pipeline_start(const PipelineConfig *config) {
+    if (!config) return NULL;
+    
+    Pipeline *p = calloc(1, sizeof(Pipeline));
+    if (!p) return NULL;
+    p->config = *config;
+    p->backend = config->backend ? config->backend : &display_backend_x11;
+    
+    for (int i = 0; i < PIPE_STAGE_COUNT; i++) {
+        if (spsc_ring_init(&p->rings[i], PIPELINE_DEPTH) != 0) {
+            pipeline_destroy(p);
+            return NULL;
+        }
+    }
+    for (int i = 0; i < PIPELINE_DEPTH; i++) {
+        p->frames[i].slot = i;
+        spsc_ring_push(&p->rings[PIPE_CAPTURE], &p->frames[i]);
+    }
+    
+    // Every stage shares the CPU set and the scheduler spreads them over it
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (config->cpu_mask) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (int cpu = 0; cpu < 64; cpu++) {
+            if (config->cpu_mask & (1ULL << cpu)) CPU_SET(cpu, &cpus);
+        }
+        pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+    }
+    
+    for (int i = 0; i < PIPE_STAGE_COUNT; i++) {
+        StageThread *t = &p->threads[i];
+        t->pipeline = p;
+        t->stage = (PipelineStage)i;
+        if (pthread_create(&t->thread, &attr, i == PIPE_CAPTURE ? capture_thread : stage_thread, t) != 0) {
+            fprintf(stderr, "Pipeline: cannot start %s thread%s\n", stage_names[i],
+                    config->cpu_mask ? " (are the pinned CPUs online?)" : "");
+            atomic_store(&p->stop, true);    // Threads already running are all upstream and drain on their own
+            pthread_attr_destroy(&attr);
+            pipeline_destroy(p);
+            return NULL;
+        }
+        t->started = true;
+    }
+    pthread_attr_destroy(&attr);
+    return p;
+}
+
+// Ask the capture thread to stop - downstream stages exit once drained
+void pipeline_stop(Pipeline *pipeline) {
+    if (pipeline) atomic_store(&pipeline->stop, true);
+}
+
+// Send exits last, once everything upstream has drained
+bool pipeline_finished(Pipeline *pipeline) {
+    return !pipeline || atomic_load(&pipeline->threads[PIPE_SEND].done);
+}
+
+// Join every stage thread, in pipeline order
+int pipeline_join(Pipeline *pipeline) {
+    if (!pipeline) return -1;
+    
+    for (int i = 0; i < PIPE_STAGE_COUNT; i++) {
+        StageThread *t = &pipeline->threads[i];
+        if (!t->started) continue;
+        
+        pthread_join(t->thread, NULL);
+        t->started = false;
+    }
+    return atomic_load(&pipeline->failed) ? -1 : 0;
+}
+
+size_t pipeline_queue_depth(Pipeline *pipeline, PipelineStage stage) {
+    if (!pipeline || (unsigned)stage >= PIPE_STAGE_COUNT) return 0;
+    return spsc_ring_depth(&pipeline->rings[stage]);
+}
+
+unsigned long pipeline_stage_dropped(Pipeline *pipeline, PipelineStage stage) {
+    if (!pipeline || (unsigned)stage >= PIPE_STAGE_COUNT) return 0;
+    return atomic_load(&pipeline->threads[stage].dropped);
+}
+
+const char* pipeline_stage_name(PipelineStage stage) {
+    return (unsigned)stage < PIPE_STAGE_COUNT ? stage_names[stage] : "unknown";
+}
+
+void pipeline_get_stats(Pipeline *pipeline, PipelineStats *stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (!pipeline) return;
+    
+    for (int i = 0; i < PIPE_STAGE_COUNT; i++) {
+        stats->frames[i] = atomic_load(&pipeline->threads[i].frames);
+        stats->dropped[i] = atomic_load(&pipeline->threads[i].dropped);
+    }
+    stats->delivered = atomic_load(&pipeline->delivered);
+    stats->latency_ns = atomic_load(&pipeline->latency_ns);
+    stats->latency_max_ns = atomic_load(&pipeline->latency_max_ns);
+    stats->no_buffer = atomic_load(&pipeline->no_buffer);
+    stats->idle = atomic_load(&pipeline->idle);
+    stats->unchanged = atomic_load(&pipeline->unchanged);
+    stats->late_ticks = atomic_load(&pipeline->late_ticks);
+}
+
+// Print ring depths and per-stage frame counts (latency histograms live in timing)
+void pipeline_print_stats(Pipeline *pipeline, FILE *out) {
+    if (!pipeline) return;
+    
+    fprintf(out, "Pipeline:\n");
+    for (int i = 0; i < PIPE_STAGE_COUNT; i++) {
+        StageThread *t = &pipeline->threads[i];
+        SpscRing *ring = &pipeline->rings[i];
+        fprintf(out, "  %-8s %6lu frames, %4lu dropped, %s queue %zu/%zu (max %zu)\n",
+                stage_names[i], atomic_load(&t->frames), atomic_load(&t->dropped), i == PIPE_CAPTURE ? "free" : "in",
+                spsc_ring_depth(ring), spsc_ring_capacity(ring), atomic_load(&ring->max_depth));
+    }
+    fprintf(out, "  ticks: %lu without a free frame, %lu idle (no damage), %lu unchanged (tile diff), %lu skipped late\n",
+            atomic_load(&pipeline->no_buffer), atomic_load(&pipeline->idle), atomic_load(&pipeline->unchanged),
+            atomic_load(&pipeline->late_ticks));
+    unsigned long delivered = atomic_load(&pipeline->delivered);
+    if (delivered) {
+        fprintf(out, "  delivered: %lu frames, latency %.2f ms avg, %.2f ms max\n", delivered,
+                atomic_load(&pipeline->latency_ns) / 1e6 / delivered, atomic_load(&pipeline->latency_max_ns) / 1e6);
+    }
+    if (pipeline->config.tile_diff && pipeline_finished(pipeline)) tile_diff_print_stats(pipeline->config.tile_diff, out);
+    if (pipeline_finished(pipeline)) cursor_print_stats(pipeline->cursor, out);
+}
+
+// Stop, join and free everything, capture buffers before their connection
+void pipeline_destroy(Pipeline *pipeline) {
+    if (!pipeline) return;
+    
+    pipeline_stop(pipeline);
+    pipeline_join(pipeline);
+    
+    for (int i = 0; i < PIPELINE_DEPTH; i++) release_buffers(&pipeline->frames[i]);
+    pipeline->backend->capture_close(pipeline->source);
+    cursor_destroy(pipeline->cursor);
+    if (pipeline->capture_display) XCloseDisplay(pipeline->capture_display);
+    for (int i = 0; i < PIPE_STAGE_COUNT; i++) spsc_ring_free(&pipeline->rings[i]);
+    free(pipeline);
+}
@@ -0,0 +1,87 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "capture.h"
+#include "damage.h"
+#include "frame_pool.h"
+
+// Streaming pipeline: capture -> convert -> encode -> send, one thread per
+// stage, joined by SPSC rings of frame descriptors. The capture thread owns a
+// private X connection, so nothing contends with the DisplayManager's, and
+// grabs frames through the display backend's capture source. Frames
+// circulate: the send thread hands finished descriptors back to capture
+// through a return ring, and when none is free at a tick the tick is dropped -
+// backpressure ends at the frame clock instead of queueing.
+
+#define PIPELINE_DEPTH 4            // Frames in flight (capture buffers)
+
+typedef enum {
+    PIPE_CAPTURE,
+    PIPE_CONVERT,
+    PIPE_ENCODE,
+    PIPE_SEND,
+    PIPE_STAGE_COUNT
+} PipelineStage;
+
+// One frame moving through the pipeline
+typedef struct {
+    int slot;                           // Index of this descriptor, 0 .. PIPELINE_DEPTH - 1
+    uint64_t sequence;
+    uint64_t captured_ns;               // Capture start
+    uint64_t deadline_ns;               // Past this the frame is stale and skipped - up to the encoder, never after
+    uint64_t done_ns[PIPE_STAGE_COUNT]; // When each stage finished with it (0 = not yet, or passed through)
+    Capture *capture;                   // Buffer the pixels live in (X11 capture, one per descriptor)
+    int tile_count;                     // Dirty rectangles in tiles
+    CaptureTile tiles[DAMAGE_MAX_RECTS];
+    bool dropped;                       // A stage gave up on it - later stages pass it through
+    void *stage_data[PIPE_STAGE_COUNT]; // Per-stage output (DMA-BUF, converted planes, bitstream, ...)
+    FrameBuffer *buffers[PIPE_STAGE_COUNT]; // Pool buffers behind stage_data - unreferenced when the frame is recycled
+} FrameDesc;
+
+// Stage hook - returns 0 to pass the frame on, 1 to drop it, -1 on fatal error
+typedef int (*PipelineStageFn)(void *ctx, FrameDesc *frame);
+
+typedef struct {
+    const char *display_name;           // X display for the capture connection (NULL = $DISPLAY)
+    ScreenInfo screen;                  // Output to capture (geometry copied, lists unused)
+    const struct DisplayBackend *backend; // Capture source (NULL = X11)
+    double refresh_hz;                  // Frame clock rate (0 = default)
+    bool use_damage;                    // Capture XDamage rectangles only
+    struct TileDiff *tile_diff;         // Pass on only the changed tiles of whole frames (NULL = off, used by the capture thread only)
+    struct Transport *sideband;         // Send the cursor shape/position here every tick (NULL = off)
+    unsigned long max_frames;           // Stop after this many ticks (0 = until pipeline_stop)
+    uint64_t cpu_mask;                  // Pin every stage thread to these CPUs, bit n = CPU n (0 = unpinned)
+    PipelineStageFn stages[PIPE_STAGE_COUNT]; // Convert/encode/send hooks, NULL passes through (capture is built in)
+    void *stage_ctx[PIPE_STAGE_COUNT];
+} PipelineConfig;
+
+// Totals of one pipeline run, for comparing sessions
+typedef struct {
+    unsigned long frames[PIPE_STAGE_COUNT];  // Handled per stage
+    unsigned long dropped[PIPE_STAGE_COUNT]; // Dropped per stage
+    unsigned long delivered;            // Frames that left the send stage intact
+    uint64_t latency_ns;                // Capture start to send done, summed over delivered frames
+    uint64_t latency_max_ns;
+    unsigned long no_buffer;            // Ticks without a free frame
+    unsigned long idle;                 // Ticks with no damage
+    unsigned long unchanged;            // Ticks with no tile change
+    unsigned long late_ticks;           // Ticks the frame clock skipped
+} PipelineStats;
+
+typedef struct Pipeline Pipeline;
+
+Pipeline* pipeline_start(const PipelineConfig *config);    // Spawn stage threads - NULL on failure
+void pipeline_stop(Pipeline *pipeline);                     // Ask capture to stop, in-flight frames still drain
+bool pipeline_finished(Pipeline *pipeline);                 // Every stage has exited - pipeline_join will not block
+int pipeline_join(Pipeline *pipeline);                      // Wait for all threads - returns 0, or -1 if a stage failed
+size_t pipeline_queue_depth(Pipeline *pipeline, PipelineStage stage); // Frames waiting in front of stage right now
+unsigned long pipeline_stage_dropped(Pipeline *pipeline, PipelineStage stage); // Frames stage has dropped so far
+const char* pipeline_stage_name(PipelineStage stage);
+void pipeline_get_stats(Pipeline *pipeline, PipelineStats *stats); // Totals so far, safe while running (zeroes for NULL)
+void pipeline_print_stats(Pipeline *pipeline, FILE *out);   // Queue depths, frame counts and drops
+void pipeline_destroy(Pipeline *pipeline);                  // Stops and joins if still running - safe to call with NULL
+
+#endif
@@ -0,0 +1,157 @@
+#include "profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROFILE_LINE_MAX 256
+
+static const struct {
+    const char *name;
+    Rotation rotation;
+} rotations[] = {
+    { "normal", RR_Rotate_0 },
+    { "left", RR_Rotate_90 },
+    { "inverted", RR_Rotate_180 },
+    { "right", RR_Rotate_270 },
+};
+
+const char* profile_rotation_name(Rotation rotation) {
+    for (size_t i = 0; i < sizeof(rotations) / sizeof(rotations[0]); i++) {
+        if (rotations[i].rotation == rotation) return rotations[i].name;
+    }
+    return "normal";
+}
+
+// Parse "DEVICE WxH@R [rb] [ORIENTATION]" (modified in place by strtok_r)
+static int parse_profile(char *line, Profile *profile) {
+    memset(profile, 0, sizeof(*profile));
+    profile->rotation = RR_Rotate_0;
+    
+    char *saveptr = NULL;
+    char *device = strtok_r(line, " \t\r\n", &saveptr);
+    char *mode = strtok_r(NULL, " \t\r\n", &saveptr);
+    if (!device || !mode) return -1;
+    if (snprintf(profile->device, sizeof(profile->device), "%s", device) >= (int)sizeof(profile->device)) return -1;
+    if (parse_mode_spec(mode, &profile->spec.width, &profile->spec.height, &profile->spec.refresh_rate) != 0) return -1;
+    
+    char *option;
+    while ((option = strtok_r(NULL, " \t\r\n", &saveptr)) != NULL) {
+        if (option[0] == '#') break;
+        if (strcmp(option, "rb") == 0) {
+            profile->spec.reduced_blanking = true;
+            continue;
+        }
+        size_t i = 0;
+        while (i < sizeof(rotations) / sizeof(rotations[0]) && strcmp(option, rotations[i].name) != 0) i++;
+        if (i == sizeof(rotations) / sizeof(rotations[0])) return -1;
+        profile->rotation = rotations[i].rotation;
+    }
+    return 0;
+}
+
+int profile_load(const char *path, ProfileRegistry *registry) {
+    if (!path || !registry) return -1;
+    memset(registry, 0, sizeof(*registry));
+    
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+    
+    char line[PROFILE_LINE_MAX];
+    int capacity = 0;
+    int number = 0;
+    int result = 0;
+    while (fgets(line, sizeof(line), file)) {
+        number++;
+        char *start = line + strspn(line, " \t\r\n");
+        if (*start == '\0' || *start == '#') continue;
+        
+        Profile profile;
+        if (parse_profile(start, &profile) != 0) {
+            fprintf(stderr, "%s:%d: expected DEVICE WxH@R [rb] [normal|left|inverted|right]\n", path, number);
+            result = -1;
+            break;
+        }
+        if (profile_find(registry, profile.device)) {
+            fprintf(stderr, "%s:%d: duplicate profile %s\n", path, number, profile.device);
+            result = -1;
+            break;
+        }
+        if (registry->count == capacity) {
+            int new_capacity = capacity ? capacity * 2 : 8;
+            Profile *grown = realloc(registry->profiles, new_capacity * sizeof(Profile));
+            if (!grown) {
+                result = -1;
+                break;
+            }
+            registry->profiles = grown;
+            capacity = new_capacity;
+        }
+        registry->profiles[registry->count++] = profile;
+    }
+    fclose(file);
+    
+    if (result != 0) profile_free(registry);
+    return result;
+}
+
+// Profiles with identical specs end up on one mode through the mode cache
+int profile_prewarm(DisplayManager *dm, ProfileRegistry *registry) {
+    if (!dm || !registry) return -1;
+    
+    int failures = 0;
+    for (int i = 0; i < registry->count; i++) {
+        Profile *profile = &registry->profiles[i];
+        profile->mode_id = mode_create_cvt(dm, profile->spec.width, profile->spec.height,
+                                           profile->spec.refresh_rate, profile->spec.reduced_blanking);
+        if (profile->mode_id == 0) {
+            fprintf(stderr, "Profile %s: cannot create its mode\n", profile->device);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+const Profile* profile_find(const ProfileRegistry *registry, const char *device) {
+    if (!registry || !device) return NULL;
+    for (int i = 0; i < registry->count; i++) {
+        if (strcmp(registry->profiles[i].device, device) == 0) return &registry->profiles[i];
+    }
+    return NULL;
+}
+
+bool profile_pins_mode(const ProfileRegistry *registry, RRMode mode) {
+    if (!registry || mode == 0) return false;
+    for (int i = 0; i < registry->count; i++) {
+        if (registry->profiles[i].mode_id == mode) return true;
+    }
+    return false;
+}
+
+// Recreates the mode first if someone deleted it since the prewarm
+RRMode profile_connect(DisplayManager *dm, ProfileRegistry *registry, const char *device,
+                       const char *output_name, const char *right_of) {
+    if (!dm || !output_name) return 0;
+    Profile *profile = (Profile *)profile_find(registry, device);
+    if (!profile) {
+        fprintf(stderr, "No profile for device '%s'\n", device ? device : "");
+        return 0;
+    }
+    if (dm_ensure_screens(dm) < 0) return 0;
+    
+    if (!profile->mode_id || !dm_find_mode(dm, profile->mode_id)) {
+        profile->mode_id = mode_create_cvt(dm, profile->spec.width, profile->spec.height,
+                                           profile->spec.refresh_rate, profile->spec.reduced_blanking);
+        if (profile->mode_id == 0) return 0;
+    }
+    return mode_provision_existing(dm, output_name, profile->mode_id, profile->rotation, right_of);
+}
+
+void profile_free(ProfileRegistry *registry) {
+    if (!registry) return;
+    free(registry->profiles);
+    registry->profiles = NULL;
+    registry->count = 0;
+}
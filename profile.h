@@ -0,0 +1,43 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include "display_manager.h"
+#include "mode_manager.h"
+
+// Tablet profiles: the mode and orientation each known tablet model wants,
+// so nobody retypes specs. The daemon loads them from a file at startup and
+// creates every profile's mode ahead of time (profile_prewarm); connecting a
+// known tablet is then a single CRTC set with no CVT generation or
+// XRRCreateMode. Prewarmed modes are exempt from stale mode GC while the
+// registry is attached to the DisplayManager (dm->profiles).
+//
+// File format, one profile per line, '#' starts a comment:
+//   DEVICE WxH@R [rb] [normal|left|inverted|right]
+// e.g. "galaxy-tab-s8 2560x1600@60 rb left". Orientations are xrandr's
+// --rotate names.
+
+#define PROFILE_DEVICE_MAX 32
+
+typedef struct {
+    char device[PROFILE_DEVICE_MAX];    // Tablet model ID, as the client reports it
+    ModeSpec spec;
+    Rotation rotation;                  // RR_Rotate_*
+    RRMode mode_id;                     // Prewarmed mode (0 until profile_prewarm)
+} Profile;
+
+typedef struct ProfileRegistry {
+    Profile *profiles;
+    int count;
+} ProfileRegistry;
+
+int profile_load(const char *path, ProfileRegistry *registry);   // Returns 0 on success, -1 on error (line reported)
+int profile_prewarm(DisplayManager *dm, ProfileRegistry *registry); // Create every profile's mode - returns failures
+const Profile* profile_find(const ProfileRegistry *registry, const char *device); // NULL if unknown
+bool profile_pins_mode(const ProfileRegistry *registry, RRMode mode); // Is mode some profile's prewarmed mode?
+RRMode profile_connect(DisplayManager *dm, ProfileRegistry *registry, const char *device,
+                       const char *output_name, const char *right_of); // Provision output for device - mode ID, 0 on failure
+void profile_free(ProfileRegistry *registry);
+const char* profile_rotation_name(Rotation rotation);
+
+#endif
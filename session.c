@@ -0,0 +1,555 @@
+#define _GNU_SOURCE     // sched_getaffinity
+#include "session.h"
+#include "adaptive.h"
+#include "colorspace.h"
+#include "frame_ipc.h"
+#include "latency_probe.h"
+#include "pipeline.h"
+#include "tile_diff.h"
+#include "timing.h"
+#include "transport.h"
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+// One running tablet session and everything its pipeline borrows
+typedef struct {
+    SessionSpec spec;
+    const StreamOptions *options;
+    PipelineConfig config;
+    CsKernel kernel;
+    CsFormat format;
+    EncoderBackend backend;             // Reopened as the same backend after a mode change
+    Encoder *encoder;
+    EncoderStage *encode;
+    ColorspaceStage *convert;
+    TileDiff *tiles;
+    Transport *transport;
+    FrameIpc *ipc;                      // External encoder instead of encoder/encode
+    AdaptiveController *adaptive;
+    LatencyProbe *probe;                // Kept across restarts, like the transport
+    const DisplayBackend *display;      // options->display, or X11 if that cannot capture this output
+    ProbePattern *pattern;              // Redrawn at the run's size, NULL between runs
+    Pipeline *pipeline;                 // NULL between runs
+    bool restart;                       // Output changed, start again once the pipeline drained
+    bool done;
+    bool failed;
+    
+    double queue_sum[PIPE_STAGE_COUNT]; // Ring depth samples since the last report
+    int queue_samples;
+    PipelineStats last;                 // Totals at the last report (zero when a run starts)
+    TransportStats last_transport;
+} Session;
+
+// Does a RandR change to the output invalidate the running pipeline?
+static bool geometry_changed(const ScreenInfo *before, const ScreenInfo *after) {
+    return !after || after->crtc_id != before->crtc_id || after->mode_id != before->mode_id ||
+           after->width != before->width || after->height != before->height ||
+           after->x != before->x || after->y != before->y;
+}
+
+// Open the encoder and its stage for the output's current mode
+static int open_encoder(EncoderBackend backend, const ScreenInfo *screen, double refresh, bool dmabuf,
+                        Encoder **encoder, EncoderStage **stage) {
+    ModeSpec spec = { screen->width, screen->height, refresh, false };
+    EncoderConfig config;
+    encoder_config_from_spec(&spec, &config);
+    config.dmabuf_input = dmabuf;
+    
+    *encoder = encoder_open(backend, &config);
+    *stage = NULL;
+    if (!*encoder) {
+        if (dmabuf) {
+            fprintf(stderr, "GPU frames need the VAAPI encoder, which is not available\n");
+            return -1;
+        }
+        if (backend == ENC_BACKEND_AUTO) return 0;      // Stream without encoding
+        fprintf(stderr, "Encoder %s is not available\n", encoder_backend_name(backend));
+        return -1;
+    }
+    *stage = encoder_stage_create(*encoder);
+    return *stage ? 0 : -1;
+}
+
+// "0-3,6" for a mask
+static void format_cpus(uint64_t mask, char *out, size_t size) {
+    size_t used = 0;
+    out[0] = '\0';
+    for (int cpu = 0; cpu < 64 && used < size; cpu++) {
+        if (!(mask & (1ULL << cpu))) continue;
+        int last = cpu;
+        while (last + 1 < 64 && (mask & (1ULL << (last + 1)))) last++;
+        int n = last > cpu ? snprintf(out + used, size - used, "%s%d-%d", used ? "," : "", cpu, last)
+                           : snprintf(out + used, size - used, "%s%d", used ? "," : "", cpu);
+        if (n < 0) break;
+        used += (size_t)n;
+        cpu = last;
+    }
+    if (!mask) snprintf(out, size, "any");
+}
+
+int session_parse_cpus(const char *text, uint64_t *mask) {
+    if (!text || !mask) return -1;
+    *mask = 0;
+    if (strcmp(text, "any") == 0) return 0;
+    
+    const char *p = text;
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p) return -1;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p) return -1;
+        }
+        if (first < 0 || last < first || last >= 64) {
+            fprintf(stderr, "CPU range %ld-%ld is outside 0-63\n", first, last);
+            return -1;
+        }
+        for (long cpu = first; cpu <= last; cpu++) *mask |= 1ULL << cpu;
+        if (*end == ',') end++;
+        else if (*end) return -1;
+        p = end;
+    }
+    return *mask ? 0 : -1;
+}
+
+// Comma-separated key=value pairs - a bare item continues the cpus= list before it
+int session_parse_spec(const char *text, SessionSpec *spec) {
+    if (!text || !spec) return -1;
+    memset(spec, 0, sizeof(*spec));
+    
+    char buffer[256];
+    char cpus[128] = "";
+    if (snprintf(buffer, sizeof(buffer), "%s", text) >= (int)sizeof(buffer)) return -1;
+    bool in_cpus = false;
+    for (char *item = strtok(buffer, ","); item; item = strtok(NULL, ",")) {
+        char *value = strchr(item, '=');
+        if (!value && in_cpus) {
+            size_t len = strlen(cpus);
+            snprintf(cpus + len, sizeof(cpus) - len, ",%s", item);
+            continue;
+        }
+        if (!value) {
+            fprintf(stderr, "Session: expected key=value, got '%s'\n", item);
+            return -1;
+        }
+        *value++ = '\0';
+        in_cpus = false;
+        
+        if (strcmp(item, "output") == 0) {
+            snprintf(spec->output, sizeof(spec->output), "%s", value);
+        } else if (strcmp(item, "mode") == 0) {
+            if (parse_mode_spec(value, &spec->mode.width, &spec->mode.height, &spec->mode.refresh_rate) != 0) return -1;
+        } else if (strcmp(item, "send") == 0) {
+            snprintf(spec->send, sizeof(spec->send), "%s", value);
+        } else if (strcmp(item, "ipc") == 0) {
+            snprintf(spec->ipc, sizeof(spec->ipc), "%s", value);
+        } else if (strcmp(item, "cpus") == 0) {
+            snprintf(cpus, sizeof(cpus), "%s", value);
+            in_cpus = true;
+        } else {
+            fprintf(stderr, "Session: unknown key '%s'\n", item);
+            return -1;
+        }
+    }
+    
+    if (!spec->output[0]) {
+        fprintf(stderr, "Session: output= is required\n");
+        return -1;
+    }
+    if (spec->ipc[0] && spec->send[0]) {
+        fprintf(stderr, "Session: ipc= hands frames to an external encoder, it cannot be combined with send=\n");
+        return -1;
+    }
+    if (cpus[0]) {
+        if (session_parse_cpus(cpus, &spec->cpu_mask) != 0) {
+            fprintf(stderr, "Session: bad CPU list '%s'\n", cpus);
+            return -1;
+        }
+        spec->cpus_given = true;
+    }
+    return 0;
+}
+
+// CPUs this process may run on that no explicit session claimed, dealt out in equal blocks
+void session_assign_cpus(SessionSpec *specs, int count) {
+    if (!specs || count <= 1) return;
+    
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+    uint64_t free_mask = 0;
+    for (int cpu = 0; cpu < 64; cpu++) {
+        if (CPU_ISSET(cpu, &allowed)) free_mask |= 1ULL << cpu;
+    }
+    int automatic = 0;
+    for (int i = 0; i < count; i++) {
+        if (specs[i].cpus_given) free_mask &= ~specs[i].cpu_mask;
+        else automatic++;
+    }
+    if (automatic == 0) return;
+    
+    int per = __builtin_popcountll(free_mask) / automatic;
+    if (per == 0) {
+        fprintf(stderr, "Sessions: fewer free CPUs than sessions, leaving them unpinned\n");
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        if (specs[i].cpus_given) continue;
+        uint64_t mask = 0;
+        for (int n = 0; n < per; n++) {
+            uint64_t lowest = free_mask & -free_mask;
+            mask |= lowest;
+            free_mask &= ~lowest;
+        }
+        specs[i].cpu_mask = mask;
+    }
+}
+
+// Build every stage for the output's current mode (the pipeline starts separately)
+static int session_open(DisplayManager *dm, Session *s) {
+    const StreamOptions *options = s->options;
+    ScreenInfo *screen = dm_find_screen(dm, s->spec.output);
+    if (!screen) {
+        fprintf(stderr, "Unknown output: %s\n", s->spec.output);
+        return -1;
+    }
+    
+    // No KMS CRTC for the output (e.g. a VIRTUAL head) - MIT-SHM still reaches it
+    s->display = options->display;
+    if (s->display->capture_probe && !s->display->capture_probe(screen)) {
+        printf("%s: no %s scanout for this output, falling back to x11 capture\n", s->spec.output, s->display->name);
+        s->display = &display_backend_x11;
+    }
+    
+    s->config = (PipelineConfig){
+        .display_name = DisplayString(dm->display),
+        .screen = *screen,
+        .refresh_hz = dm_mode_refresh(dm_find_mode(dm, screen->mode_id)),
+        .use_damage = options->use_damage,
+        .max_frames = options->frames > 0 ? (unsigned long)options->frames : 0,
+        .cpu_mask = s->spec.cpu_mask,
+        .backend = s->display,
+    };
+    
+    // GPU frames go straight to the encoder - nothing on the CPU ever sees their pixels
+    bool gpu = s->display->gpu_frames;
+    if (gpu && (s->spec.ipc[0] || options->tile_diff || options->use_damage)) {
+        fprintf(stderr, "%s capture hands frames to the GPU encoder, it cannot be combined with %s\n",
+                s->display->name, s->spec.ipc[0] ? "ipc=" : options->tile_diff ? "--tile-diff" : "--damage");
+        return -1;
+    }
+    
+    // Encoder first - it decides which layout the convert stage produces. An
+    // external one gets NV12 straight out of a shared pool
+    if (!s->spec.ipc[0] &&
+        open_encoder(options->encoder, screen, s->config.refresh_hz, gpu, &s->encoder, &s->encode) != 0) return -1;
+    s->backend = encoder_backend(s->encoder);
+    s->format = encoder_input_format(s->encoder);
+    
+    s->kernel = colorspace_detect();
+    if (!gpu) {
+        s->convert = s->spec.ipc[0] ? colorspace_stage_create_shared(s->kernel, s->format, screen->width,
+                                                                     screen->height, FRAME_IPC_RING)
+                                    : colorspace_stage_create(s->kernel, s->format, screen->width, screen->height);
+        if (!s->convert) return -1;
+        s->config.stages[PIPE_CONVERT] = colorspace_stage_process;
+        s->config.stage_ctx[PIPE_CONVERT] = s->convert;
+    }
+    if (s->spec.ipc[0]) {
+        s->ipc = frame_ipc_open(s->spec.ipc, s->convert);
+        if (!s->ipc) return -1;
+        printf("Publishing %s frames to an external encoder on %s\n", s->spec.output, s->spec.ipc);
+    }
+    if (options->tile_diff) {
+        s->tiles = tile_diff_create(s->kernel, screen->width, screen->height);
+        if (!s->tiles) return -1;
+        s->config.tile_diff = s->tiles;
+    }
+    if (s->spec.send[0]) {
+        if (!s->encoder) {
+            fprintf(stderr, "--send needs an encoder\n");
+            return -1;
+        }
+        if (options->probe) {
+            s->probe = latency_probe_create();
+            if (!s->probe) return -1;
+        }
+        TransportConfig transport_config = { s->spec.send, s->config.refresh_hz, options->fec, s->probe };
+        s->transport = transport_open(&transport_config);
+        if (!s->transport) return -1;
+        s->config.stages[PIPE_SEND] = transport_stage_process;
+        s->config.stage_ctx[PIPE_SEND] = s->transport;
+        printf("Sending %s to %s over UDP%s%s\n", s->spec.output, s->spec.send, options->fec ? " with FEC" : "",
+               options->cursor ? ", cursor as sideband" : "");
+        if (options->cursor) s->config.sideband = s->transport;
+    } else if (options->cursor || options->probe) {
+        fprintf(stderr, "%s needs --send\n", options->cursor ? "--cursor" : "--probe");
+        return -1;
+    }
+    
+    if (options->adaptive_mbps >= 0) {
+        // Every rung is created and attached here, never while streaming
+        s->adaptive = adaptive_create(dm, s->spec.output, options->adaptive_mbps);
+        if (!s->adaptive) return -1;
+        adaptive_print_ladder(s->adaptive, stdout);
+    }
+    return 0;
+}
+
+// Start a pipeline run on the current configuration
+static int session_start(Session *s) {
+    if (s->ipc) {
+        s->config.stages[PIPE_ENCODE] = frame_ipc_stage_process;
+        s->config.stage_ctx[PIPE_ENCODE] = s->ipc;
+    } else {
+        s->config.stages[PIPE_ENCODE] = s->encode ? encoder_stage_process : NULL;
+        s->config.stage_ctx[PIPE_ENCODE] = s->encode;
+    }
+    FramePool *pool = colorspace_stage_pool(s->convert);
+    char cpus[64];
+    format_cpus(s->config.cpu_mask, cpus, sizeof(cpus));
+    printf("Streaming %s: %ux%u, %s capture, convert %s -> %s, encode %s, CPUs %s\n", s->config.screen.name,
+           s->config.screen.width, s->config.screen.height, s->display->name,
+           s->convert ? colorspace_kernel_name(s->kernel) : "GPU", s->format == CS_FORMAT_NV12 ? "NV12" : "I420",
+           s->ipc ? "external" : s->encoder ? encoder_backend_name(encoder_backend(s->encoder)) : "off (no encoder available)",
+           cpus);
+    if (pool) {
+        printf("Frame pool: %d x %zu KiB, %s\n", frame_pool_capacity(pool), frame_pool_buffer_size(pool) / 1024,
+               frame_pool_pages_name(frame_pool_pages(pool)));
+    }
+    
+    // Pattern first, so the very first frame already shows it
+    if (s->options->probe_pattern) {
+        s->pattern = probe_pattern_start(s->config.display_name, &s->config.screen, s->config.refresh_hz);
+        if (!s->pattern) return -1;
+    }
+    s->pipeline = pipeline_start(&s->config);
+    if (!s->pipeline) return -1;
+    adaptive_begin(s->adaptive, s->pipeline, s->transport);
+    memset(&s->last, 0, sizeof(s->last));
+    memset(s->queue_sum, 0, sizeof(s->queue_sum));
+    s->queue_samples = 0;
+    return 0;
+}
+
+// Join a stopped or finished run and print its stats - returns 0, or -1 if a stage failed
+static int session_finish(Session *s, bool several) {
+    int joined = pipeline_join(s->pipeline);
+    if (several) printf("Session %s:\n", s->spec.output);
+    pipeline_print_stats(s->pipeline, stdout);
+    transport_print_stats(s->transport, stdout);
+    latency_probe_print(s->probe, stdout);
+    frame_ipc_print_stats(s->ipc, stdout);
+    adaptive_print_stats(s->adaptive, stdout);
+    pipeline_destroy(s->pipeline);
+    s->pipeline = NULL;
+    probe_pattern_stop(s->pattern);
+    s->pattern = NULL;
+    return joined;
+}
+
+// Rebuild for the output's new mode - every frame is back in the pool now.
+// Returns 0 if running again, 1 if the output is gone, -1 on error
+static int session_restart(DisplayManager *dm, Session *s) {
+    ScreenInfo *screen = dm_find_screen(dm, s->spec.output);
+    if (!screen || !screen->crtc_id || !screen->width || !screen->height) {
+        printf("%s is no longer active, stopping\n", s->spec.output);
+        return 1;
+    }
+    s->config.screen = *screen;
+    s->config.refresh_hz = dm_mode_refresh(dm_find_mode(dm, screen->mode_id));
+    printf("%s changed to %ux%u+%d+%d, restarting\n", screen->name, screen->width, screen->height,
+           screen->x, screen->y);
+    
+    frame_ipc_release(s->ipc);
+    if (s->convert && colorspace_stage_resize(s->convert, screen->width, screen->height) != 0) return -1;
+    if (s->tiles && tile_diff_resize(s->tiles, screen->width, screen->height) != 0) return -1;
+    transport_set_refresh(s->transport, s->config.refresh_hz);
+    if (s->encoder) {
+        encoder_stage_destroy(s->encode);
+        encoder_close(s->encoder);
+        if (open_encoder(s->backend, screen, s->config.refresh_hz, s->display->gpu_frames,
+                         &s->encoder, &s->encode) != 0) return -1;
+    }
+    return session_start(s);
+}
+
+static void session_close(Session *s) {
+    if (s->pipeline) {
+        pipeline_stop(s->pipeline);
+        session_finish(s, false);
+    }
+    adaptive_destroy(s->adaptive);
+    encoder_stage_destroy(s->encode);
+    encoder_close(s->encoder);
+    tile_diff_destroy(s->tiles);
+    transport_close(s->transport);
+    latency_probe_destroy(s->probe);
+    probe_pattern_stop(s->pattern);
+    frame_ipc_close(s->ipc);
+    colorspace_stage_destroy(s->convert);
+}
+
+// The stage that most likely holds this session back, from the period's counters
+static const char* session_limit(const Session *s, const PipelineStats *now, const TransportStats *link) {
+    // Frames piling up in front of a stage, or dropped by it for being late
+    int worst = -1;
+    double worst_queue = 1.0;
+    for (int i = PIPE_CONVERT; i < PIPE_STAGE_COUNT && s->queue_samples; i++) {
+        double queue = s->queue_sum[i] / s->queue_samples;
+        if (queue >= worst_queue) {
+            worst = i;
+            worst_queue = queue;
+        }
+    }
+    unsigned long worst_drops = 0;
+    for (int i = PIPE_CONVERT; worst < 0 && i < PIPE_STAGE_COUNT; i++) {
+        unsigned long drops = now->dropped[i] - s->last.dropped[i];
+        if (drops > worst_drops) {
+            worst = i;
+            worst_drops = drops;
+        }
+    }
+    if (worst >= 0) return pipeline_stage_name(worst);
+    if (link->send_errors != s->last_transport.send_errors || link->nacks != s->last_transport.nacks) return "network";
+    if (now->no_buffer != s->last.no_buffer) return "pipeline full";
+    return "-";
+}
+
+// One line per session for the period since the last report
+static void print_report(Session *sessions, int count, double seconds, FILE *out) {
+    fprintf(out, "Sessions (last %.1f s):\n", seconds);
+    for (int i = 0; i < count; i++) {
+        Session *s = &sessions[i];
+        if (!s->pipeline) {
+            fprintf(out, "  %-10s %s\n", s->spec.output, s->failed ? "failed" : "stopped");
+            continue;
+        }
+        
+        PipelineStats now;
+        TransportStats link;
+        pipeline_get_stats(s->pipeline, &now);
+        transport_get_stats(s->transport, &link);
+        unsigned long delivered = now.delivered - s->last.delivered;
+        double latency = delivered ? (now.latency_ns - s->last.latency_ns) / 1e6 / delivered : 0;
+        int samples = s->queue_samples ? s->queue_samples : 1;
+        char cpus[64];
+        format_cpus(s->config.cpu_mask, cpus, sizeof(cpus));
+        
+        fprintf(out, "  %-10s %4ux%-4u CPUs %-8s %6.1f fps %7.2f Mbit/s %6.1f ms  queue %.1f/%.1f/%.1f  "
+                "drops %lu/%lu/%lu  limit: %s\n",
+                s->spec.output, s->config.screen.width, s->config.screen.height, cpus,
+                delivered / seconds, (link.bytes - s->last_transport.bytes) * 8 / seconds / 1e6, latency,
+                s->queue_sum[PIPE_CONVERT] / samples, s->queue_sum[PIPE_ENCODE] / samples,
+                s->queue_sum[PIPE_SEND] / samples,
+                now.dropped[PIPE_CONVERT] - s->last.dropped[PIPE_CONVERT],
+                now.dropped[PIPE_ENCODE] - s->last.dropped[PIPE_ENCODE],
+                now.dropped[PIPE_SEND] - s->last.dropped[PIPE_SEND], session_limit(s, &now, &link));
+        
+        s->last = now;
+        s->last_transport = link;
+        memset(s->queue_sum, 0, sizeof(s->queue_sum));
+        s->queue_samples = 0;
+    }
+}
+
+// Watch one session for a tick - returns false once it has ended
+static bool session_tick(DisplayManager *dm, Session *s, bool topology_changed, bool several) {
+    for (int i = 0; i < PIPE_STAGE_COUNT; i++) s->queue_sum[i] += (double)pipeline_queue_depth(s->pipeline, i);
+    s->queue_samples++;
+    
+    if (s->adaptive && adaptive_sample(s->adaptive) < 0) {
+        s->failed = true;
+        pipeline_stop(s->pipeline);
+    }
+    if (topology_changed && !s->restart &&
+        geometry_changed(&s->config.screen, dm_find_screen(dm, s->spec.output))) {
+        s->restart = true;
+        pipeline_stop(s->pipeline);
+    }
+    if (!pipeline_finished(s->pipeline)) return true;
+    
+    if (session_finish(s, several) != 0) s->failed = true;
+    if (s->failed || !s->restart) return false;
+    
+    s->restart = false;
+    int restarted = session_restart(dm, s);
+    if (restarted < 0) s->failed = true;
+    return restarted == 0;
+}
+
+// Provision, open and start every session, then follow them all from this thread
+int session_run(DisplayManager *dm, SessionSpec *specs, int count, const StreamOptions *options) {
+    if (!dm || !specs || count <= 0 || count > SESSION_MAX || !options) return -1;
+    
+    // Select before the snapshot so no mode change slips in between
+    if (dm_select_events(dm) != 0) return -1;
+    if (options->display->enumerate(dm) < 0) return -1;
+    
+    Session *sessions = calloc(count, sizeof(Session));
+    if (!sessions) return -1;
+    int result = 0;
+    int running = 0;
+    
+    // Every mode first, so no session starts on a layout that is still changing
+    for (int i = 0; i < count; i++) {
+        sessions[i].spec = specs[i];
+        sessions[i].options = options;
+        if (specs[i].mode.width == 0) continue;
+        if (options->display->provision(dm, specs[i].output, &specs[i].mode, NULL) == 0) sessions[i].failed = true;
+    }
+    
+    // A tablet that cannot start is left out - the others still stream
+    for (int i = 0; i < count; i++) {
+        Session *s = &sessions[i];
+        if (s->failed || session_open(dm, s) != 0 || session_start(s) != 0) {
+            fprintf(stderr, "Session %s failed to start%s\n", s->spec.output, count > 1 ? ", skipping it" : "");
+            s->failed = true;
+            s->done = true;
+            continue;
+        }
+        running++;
+    }
+    if (running == 0) result = -1;
+    
+    bool several = count > 1;
+    uint64_t report_start = timing_now();
+    while (result == 0 && running > 0) {
+        struct pollfd fd = { ConnectionNumber(dm->display), POLLIN, 0 };
+        if (poll(&fd, 1, SESSION_WATCH_MS) < 0 && errno != EINTR) {
+            result = -1;
+            break;
+        }
+        int changes = dm_process_events(dm);
+        if (changes < 0) {
+            result = -1;
+            break;
+        }
+        
+        for (int i = 0; i < count; i++) {
+            Session *s = &sessions[i];
+            if (s->done) continue;
+            if (session_tick(dm, s, changes > 0, several)) continue;
+            s->done = true;
+            running--;
+            if (s->failed) {
+                fprintf(stderr, "Session %s failed%s\n", s->spec.output, running ? ", the others keep running" : "");
+            }
+        }
+        
+        uint64_t now = timing_now();
+        if (several && SESSION_REPORT_MS > 0 && now - report_start >= (uint64_t)SESSION_REPORT_MS * 1000000) {
+            print_report(sessions, count, (now - report_start) / 1e9, stdout);
+            report_start = now;
+        }
+    }
+    
+    for (int i = 0; i < count; i++) session_close(&sessions[i]);
+    free(sessions);
+    return result;
+}
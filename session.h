@@ -0,0 +1,53 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "display_backend.h"
+#include "display_manager.h"
+#include "encoder.h"
+#include "mode_manager.h"
+
+// Streaming sessions: one tablet = one output = one pipeline with its own
+// convert stage, encoder, tile diff, transport and adaptive ladder. Any
+// number of sessions run side by side, each pipeline pinned to its own CPUs,
+// while the main thread follows RandR changes for all of them on the one
+// shared DisplayManager and restarts only the session whose output changed.
+// --stream is simply a run with a single, unpinned session.
+
+#define SESSION_MAX 8
+#define SESSION_WATCH_MS 100            // RandR poll and per-session sampling interval
+#define SESSION_REPORT_MS 10000         // Per-session summary interval with several sessions (0 = off)
+
+// Settings shared by every session of a run
+typedef struct {
+    int frames;                         // Ticks per pipeline run (0 = until the output goes away)
+    bool use_damage;
+    bool tile_diff;
+    EncoderBackend encoder;
+    bool fec;
+    bool cursor;                        // Cursor sideband on the transport
+    double adaptive_mbps;               // Adaptive mode ladder with this link budget (0 = none, <0 = ladder off)
+    const DisplayBackend *display;      // Enumeration, modes and capture
+    bool probe;                         // Latency probe echoes on the transport (see latency_probe.h)
+    bool probe_pattern;                 // Draw the latency test pattern over each streamed output
+} StreamOptions;
+
+// One session from the command line
+typedef struct {
+    char output[32];
+    ModeSpec mode;                      // Provision the output with this mode first (width 0 = use it as it is)
+    char send[128];                     // UDP destination "host:port" (empty = encode only)
+    char ipc[108];                      // UNIX socket for an external encoder, instead of encoding here (empty = none)
+    uint64_t cpu_mask;                  // CPUs for its pipeline threads (0 = unpinned)
+    bool cpus_given;                    // cpu_mask came from the spec, not the automatic split
+} SessionSpec;
+
+int session_parse_spec(const char *text, SessionSpec *spec);   // "output=NAME[,mode=WxH@R][,send=HOST:PORT|,ipc=PATH][,cpus=LIST]" - returns 0 on success
+int session_parse_cpus(const char *text, uint64_t *mask);      // "2-3,6" or "any" (mask 0) - returns 0 on success
+void session_assign_cpus(SessionSpec *specs, int count);       // Split the online CPUs evenly among specs without cpus=
+int session_run(DisplayManager *dm, SessionSpec *specs, int count,
+                const StreamOptions *options);                 // Provision, start and follow every session until all end - a failing session is logged and the others keep going, returns -1 only if none started
+
+#endif
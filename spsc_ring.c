@@ -0,0 +1,70 @@
+#include "spsc_ring.h"
+#include <stdlib.h>
+
+// Allocate the slot array
+int spsc_ring_init(SpscRing *ring, size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) size <<= 1;
+    
+    ring->slots = calloc(size, sizeof(void *));
+    if (!ring->slots) return -1;
+    
+    ring->mask = size - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->max_depth, 0);
+    ring->cached_tail = 0;
+    ring->cached_head = 0;
+    return 0;
+}
+
+// Publish one item - the release store makes the slot contents visible first
+bool spsc_ring_push(SpscRing *ring, void *item) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    
+    if (head - ring->cached_tail > ring->mask) {
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head - ring->cached_tail > ring->mask) return false;
+    }
+    
+    ring->slots[head & ring->mask] = item;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    
+    size_t depth = head + 1 - ring->cached_tail;
+    if (depth > atomic_load_explicit(&ring->max_depth, memory_order_relaxed)) {
+        atomic_store_explicit(&ring->max_depth, depth, memory_order_relaxed);
+    }
+    return true;
+}
+
+// Take the oldest item
+void* spsc_ring_pop(SpscRing *ring) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    
+    if (tail == ring->cached_head) {
+        ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (tail == ring->cached_head) return NULL;
+    }
+    
+    void *item = ring->slots[tail & ring->mask];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return item;
+}
+
+// Snapshot of the queue depth
+size_t spsc_ring_depth(SpscRing *ring) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    return head - tail;
+}
+
+size_t spsc_ring_capacity(const SpscRing *ring) {
+    return ring->mask + 1;
+}
+
+// Release the slot array
+void spsc_ring_free(SpscRing *ring) {
+    if (!ring) return;
+    free(ring->slots);
+    ring->slots = NULL;
+}
@@ -0,0 +1,32 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Bounded lock-free single-producer/single-consumer ring of pointers. Head and
+// tail sit on separate cache lines so producer and consumer never bounce the
+// same line; each side keeps a cached copy of the other's index and only
+// reloads it when the ring looks full (or empty).
+
+#define SPSC_CACHE_LINE 64
+
+typedef struct {
+    void **slots;
+    size_t mask;                                        // capacity - 1 (capacity is a power of two)
+    _Alignas(SPSC_CACHE_LINE) _Atomic size_t head;      // Next slot to write (producer)
+    size_t cached_tail;                                 // Producer's view of tail
+    _Alignas(SPSC_CACHE_LINE) _Atomic size_t tail;      // Next slot to read (consumer)
+    size_t cached_head;                                 // Consumer's view of head
+    _Alignas(SPSC_CACHE_LINE) _Atomic size_t max_depth; // High-water mark, for stats
+} SpscRing;
+
+int spsc_ring_init(SpscRing *ring, size_t capacity);    // Capacity rounded up to a power of two - returns 0 on success
+bool spsc_ring_push(SpscRing *ring, void *item);        // Producer only - false if full
+void* spsc_ring_pop(SpscRing *ring);                    // Consumer only - NULL if empty
+size_t spsc_ring_depth(SpscRing *ring);                 // Items queued right now (approximate from a third thread)
+size_t spsc_ring_capacity(const SpscRing *ring);
+void spsc_ring_free(SpscRing *ring);                    // Safe on zeroed ring
+
+#endif
@@ -0,0 +1,401 @@
+#include "tile_diff.h"
+#include "damage.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TD_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#define TD_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+// xxh3-style accumulate: each row is read in 64-byte stripes of eight 64-bit
+// lanes. Lane i adds lo32 * hi32 of (data ^ key), lane i ^ 1 adds the raw
+// data, and every row ends in a scramble (xorshift, key, multiply) so rows
+// cannot trade places without changing the hash. Stripes use their own keys
+// by position in the row. A short last stripe is zero padded.
+
+#define STRIPE 64
+#define STRIPE_KEYS 4               // TILE_DIFF_SIZE * 4 bytes / STRIPE - key sets per row
+#define SCRAMBLE_KEY (STRIPE_KEYS * 8)
+#define PRIME32_1 0x9E3779B1u
+#define PRIME64_1 0x9E3779B185EBCA87ull
+#define PRIME64_2 0xC2B2AE3D27D4EB4Full
+
+typedef void (*BlockFn)(uint64_t acc[8], const uint8_t *pixels, int stride, int row_bytes, int rows);
+
+static const uint64_t keys[SCRAMBLE_KEY + 8] = {
+    0xe220a8397b1dcdafull, 0x6e789e6aa1b965f4ull, 0x06c45d188009454full, 0xf88bb8a8724c81ecull,
+    0x1b39896a51a8749bull, 0x53cb9f0c747ea2eaull, 0x2c829abe1f4532e1ull, 0xc584133ac916ab3cull,
+    0x3ee5789041c98ac3ull, 0xf3b8488c368cb0a6ull, 0x657eecdd3cb13d09ull, 0xc2d326e0055bdef6ull,
+    0x8621a03fe0bbdb7bull, 0x8e1f7555983aa92full, 0xb54e0f1600cc4d19ull, 0x84bb3f97971d80abull,
+    0x7d29825c75521255ull, 0xc3cf17102b7f7f86ull, 0x3466e9a083914f64ull, 0xd81a8d2b5a4485acull,
+    0xdb01602b100b9ed7ull, 0xa9038a921825f10dull, 0xedf5f1d90dca2f6aull, 0x54496ad67bd2634cull,
+    0xdd7c01d4f5407269ull, 0x935e82f1db4c4f7bull, 0x69b82ebc92233300ull, 0x40d29eb57de1d510ull,
+    0xa2f09dabb45c6316ull, 0xee521d7a0f4d3872ull, 0xf16952ee72f3454full, 0x377d35dea8e40225ull,
+    0x0c7de8064963bab0ull, 0x05582d37111ac529ull, 0xd254741f599dc6f7ull, 0x69630f7593d108c3ull,
+    0x417ef96181daa383ull, 0x3c3c41a3b43343a1ull, 0x6e19905dcbe531dfull, 0x4fa9fa7324851729ull,
+};
+
+// Stripe at offset off of a row, copied into pad when fewer than STRIPE bytes are left
+static inline const uint8_t* stripe_at(const uint8_t *row, int off, int row_bytes, uint8_t *pad) {
+    if (row_bytes - off >= STRIPE) return row + off;
+    memset(pad, 0, STRIPE);
+    memcpy(pad, row + off, (size_t)(row_bytes - off));
+    return pad;
+}
+
+static inline const uint64_t* stripe_keys(int off) {
+    return keys + ((off / STRIPE) % STRIPE_KEYS) * 8;
+}
+
+// Reference kernel
+static void block_scalar(uint64_t acc[8], const uint8_t *pixels, int stride, int row_bytes, int rows) {
+    uint8_t pad[STRIPE];
+    
+    for (int y = 0; y < rows; y++) {
+        const uint8_t *row = pixels + (size_t)y * stride;
+        for (int off = 0; off < row_bytes; off += STRIPE) {
+            const uint8_t *p = stripe_at(row, off, row_bytes, pad);
+            const uint64_t *key = stripe_keys(off);
+            for (int i = 0; i < 8; i++) {
+                uint64_t d;
+                memcpy(&d, p + 8 * i, sizeof(d));
+                uint64_t k = d ^ key[i];
+                acc[i ^ 1] += d;
+                acc[i] += (k & 0xffffffffu) * (k >> 32);
+            }
+        }
+        for (int i = 0; i < 8; i++) {
+            uint64_t a = acc[i];
+            a ^= a >> 47;
+            a ^= keys[SCRAMBLE_KEY + i];
+            acc[i] = a * PRIME32_1;
+        }
+    }
+}
+
+#ifdef TD_HAVE_X86
+
+__attribute__((target("sse4.1")))
+static inline __m128i accumulate_sse41(__m128i acc, __m128i d, __m128i k) {
+    __m128i dk = _mm_xor_si128(d, k);
+    __m128i product = _mm_mul_epu32(dk, _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1)));
+    __m128i swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+    return _mm_add_epi64(_mm_add_epi64(acc, swapped), product);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i scramble_sse41(__m128i acc, __m128i k) {
+    const __m128i prime = _mm_set1_epi32((int)PRIME32_1);
+    acc = _mm_xor_si128(_mm_xor_si128(acc, _mm_srli_epi64(acc, 47)), k);
+    __m128i lo = _mm_mul_epu32(acc, prime);
+    __m128i hi = _mm_mul_epu32(_mm_srli_epi64(acc, 32), prime);
+    return _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+}
+
+// Four 2-lane accumulators per stripe
+__attribute__((target("sse4.1")))
+static void block_sse41(uint64_t acc[8], const uint8_t *pixels, int stride, int row_bytes, int rows) {
+    uint8_t pad[STRIPE];
+    __m128i a[4];
+    for (int i = 0; i < 4; i++) a[i] = _mm_loadu_si128((const __m128i *)(acc + 2 * i));
+    
+    for (int y = 0; y < rows; y++) {
+        const uint8_t *row = pixels + (size_t)y * stride;
+        for (int off = 0; off < row_bytes; off += STRIPE) {
+            const uint8_t *p = stripe_at(row, off, row_bytes, pad);
+            const uint64_t *key = stripe_keys(off);
+            for (int i = 0; i < 4; i++) {
+                a[i] = accumulate_sse41(a[i], _mm_loadu_si128((const __m128i *)(p + 16 * i)),
+                                        _mm_loadu_si128((const __m128i *)(key + 2 * i)));
+            }
+        }
+        for (int i = 0; i < 4; i++) {
+            a[i] = scramble_sse41(a[i], _mm_loadu_si128((const __m128i *)(keys + SCRAMBLE_KEY + 2 * i)));
+        }
+    }
+    for (int i = 0; i < 4; i++) _mm_storeu_si128((__m128i *)(acc + 2 * i), a[i]);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i accumulate_avx2(__m256i acc, __m256i d, __m256i k) {
+    __m256i dk = _mm256_xor_si256(d, k);
+    __m256i product = _mm256_mul_epu32(dk, _mm256_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1)));
+    __m256i swapped = _mm256_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+    return _mm256_add_epi64(_mm256_add_epi64(acc, swapped), product);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i scramble_avx2(__m256i acc, __m256i k) {
+    const __m256i prime = _mm256_set1_epi32((int)PRIME32_1);
+    acc = _mm256_xor_si256(_mm256_xor_si256(acc, _mm256_srli_epi64(acc, 47)), k);
+    __m256i lo = _mm256_mul_epu32(acc, prime);
+    __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(acc, 32), prime);
+    return _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+}
+
+// Two 4-lane accumulators per stripe
+__attribute__((target("avx2")))
+static void block_avx2(uint64_t acc[8], const uint8_t *pixels, int stride, int row_bytes, int rows) {
+    uint8_t pad[STRIPE];
+    __m256i a0 = _mm256_loadu_si256((const __m256i *)acc);
+    __m256i a1 = _mm256_loadu_si256((const __m256i *)(acc + 4));
+    const __m256i s0 = _mm256_loadu_si256((const __m256i *)(keys + SCRAMBLE_KEY));
+    const __m256i s1 = _mm256_loadu_si256((const __m256i *)(keys + SCRAMBLE_KEY + 4));
+    
+    for (int y = 0; y < rows; y++) {
+        const uint8_t *row = pixels + (size_t)y * stride;
+        for (int off = 0; off < row_bytes; off += STRIPE) {
+            const uint8_t *p = stripe_at(row, off, row_bytes, pad);
+            const uint64_t *key = stripe_keys(off);
+            a0 = accumulate_avx2(a0, _mm256_loadu_si256((const __m256i *)p),
+                                 _mm256_loadu_si256((const __m256i *)key));
+            a1 = accumulate_avx2(a1, _mm256_loadu_si256((const __m256i *)(p + 32)),
+                                 _mm256_loadu_si256((const __m256i *)(key + 4)));
+        }
+        a0 = scramble_avx2(a0, s0);
+        a1 = scramble_avx2(a1, s1);
+    }
+    _mm256_storeu_si256((__m256i *)acc, a0);
+    _mm256_storeu_si256((__m256i *)(acc + 4), a1);
+}
+
+#endif // TD_HAVE_X86
+
+#ifdef TD_HAVE_NEON
+
+static inline uint64x2_t accumulate_neon(uint64x2_t acc, uint64x2_t d, uint64x2_t k) {
+    uint64x2_t dk = veorq_u64(d, k);
+    uint64x2_t product = vmull_u32(vmovn_u64(dk), vshrn_n_u64(dk, 32));
+    return vaddq_u64(vaddq_u64(acc, vextq_u64(d, d, 1)), product);
+}
+
+static inline uint64x2_t scramble_neon(uint64x2_t acc, uint64x2_t k) {
+    const uint32x2_t prime = vdup_n_u32(PRIME32_1);
+    acc = veorq_u64(veorq_u64(acc, vshrq_n_u64(acc, 47)), k);
+    uint64x2_t lo = vmull_u32(vmovn_u64(acc), prime);
+    uint64x2_t hi = vmull_u32(vshrn_n_u64(acc, 32), prime);
+    return vaddq_u64(lo, vshlq_n_u64(hi, 32));
+}
+
+// Four 2-lane accumulators per stripe
+static void block_neon(uint64_t acc[8], const uint8_t *pixels, int stride, int row_bytes, int rows) {
+    uint8_t pad[STRIPE];
+    uint64x2_t a[4];
+    for (int i = 0; i < 4; i++) a[i] = vld1q_u64(acc + 2 * i);
+    
+    for (int y = 0; y < rows; y++) {
+        const uint8_t *row = pixels + (size_t)y * stride;
+        for (int off = 0; off < row_bytes; off += STRIPE) {
+            const uint8_t *p = stripe_at(row, off, row_bytes, pad);
+            const uint64_t *key = stripe_keys(off);
+            for (int i = 0; i < 4; i++) {
+                a[i] = accumulate_neon(a[i], vreinterpretq_u64_u8(vld1q_u8(p + 16 * i)), vld1q_u64(key + 2 * i));
+            }
+        }
+        for (int i = 0; i < 4; i++) a[i] = scramble_neon(a[i], vld1q_u64(keys + SCRAMBLE_KEY + 2 * i));
+    }
+    for (int i = 0; i < 4; i++) vst1q_u64(acc + 2 * i, a[i]);
+}
+
+#endif // TD_HAVE_NEON
+
+// Block function of a kernel (scalar when not built in)
+static BlockFn kernel_fn(CsKernel kernel) {
+    switch (kernel) {
+#ifdef TD_HAVE_X86
+    case CS_KERNEL_SSE41: return block_sse41;
+    case CS_KERNEL_AVX2:  return block_avx2;
+#endif
+#ifdef TD_HAVE_NEON
+    case CS_KERNEL_NEON:  return block_neon;
+#endif
+    default:              return block_scalar;
+    }
+}
+
+// Fold the lanes into one value and avalanche it
+static uint64_t finalize(const uint64_t acc[8], uint64_t length) {
+    uint64_t h = length * PRIME64_1;
+    for (int i = 0; i < 8; i++) {
+        h ^= acc[i];
+        h = ((h << 31) | (h >> 33)) * PRIME64_1;
+    }
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    return h;
+}
+
+static uint64_t hash_block(BlockFn fn, const uint8_t *pixels, int stride, int width, int height) {
+    uint64_t acc[8];
+    for (int i = 0; i < 8; i++) acc[i] = keys[SCRAMBLE_KEY + i] ^ PRIME64_2;
+    fn(acc, pixels, stride, width * 4, height);
+    return finalize(acc, ((uint64_t)width << 32) | (uint32_t)height);
+}
+
+uint64_t tile_diff_hash(CsKernel kernel, const uint8_t *pixels, int stride, int width, int height) {
+    if (!pixels || width <= 0 || height <= 0) return 0;
+    return hash_block(kernel_fn(kernel), pixels, stride, width, height);
+}
+
+TileDiff* tile_diff_create(CsKernel kernel, unsigned int width, unsigned int height) {
+    TileDiff *diff = calloc(1, sizeof(TileDiff));
+    if (!diff) return NULL;
+    diff->kernel = colorspace_kernel_supported(kernel) ? kernel : CS_KERNEL_SCALAR;
+    
+    if (tile_diff_resize(diff, width, height) != 0) {
+        tile_diff_destroy(diff);
+        return NULL;
+    }
+    return diff;
+}
+
+// Reallocate the hash grid for a new frame size - the next frame is all new
+int tile_diff_resize(TileDiff *diff, unsigned int width, unsigned int height) {
+    if (!diff || width == 0 || height == 0 || width > 0xffff || height > 0xffff) return -1;
+    
+    int cols = (int)((width + TILE_DIFF_SIZE - 1) / TILE_DIFF_SIZE);
+    int rows = (int)((height + TILE_DIFF_SIZE - 1) / TILE_DIFF_SIZE);
+    uint64_t *hashes = calloc((size_t)cols * rows, sizeof(uint64_t));
+    bool *changed = calloc(cols, sizeof(bool));
+    XRectangle *spans = calloc((size_t)cols * rows, sizeof(XRectangle));
+    if (!hashes || !changed || !spans) {
+        free(hashes);
+        free(changed);
+        free(spans);
+        return -1;
+    }
+    
+    free(diff->hashes);
+    free(diff->changed);
+    free(diff->spans);
+    diff->hashes = hashes;
+    diff->changed = changed;
+    diff->spans = spans;
+    diff->width = width;
+    diff->height = height;
+    diff->cols = cols;
+    diff->rows = rows;
+    diff->valid = false;
+    return 0;
+}
+
+void tile_diff_invalidate(TileDiff *diff) {
+    if (diff) diff->valid = false;
+}
+
+// Hash every tile, then turn the changed ones into rectangles: runs along a
+// tile row, stacked with an identical run in the row above. More than
+// DAMAGE_MAX_RECTS rectangles collapse into their bounding box
+int tile_diff_apply(TileDiff *diff, CaptureTile *tiles, int *count) {
+    if (!diff || !tiles || !count) return -1;
+    
+    // Only whole frames are diffed - damage rectangles are already the changed part
+    const XRectangle *whole = &tiles[0].rect;
+    if (*count != 1 || whole->x != 0 || whole->y != 0 ||
+        whole->width != diff->width || whole->height != diff->height) {
+        return *count;
+    }
+    
+    const uint8_t *base = (const uint8_t *)tiles[0].data;
+    int stride = tiles[0].stride;
+    BlockFn fn = kernel_fn(diff->kernel);
+    int spans = 0;
+    int changed_tiles = 0;
+    
+    for (int r = 0; r < diff->rows; r++) {
+        int y = r * TILE_DIFF_SIZE;
+        int h = (int)diff->height - y < TILE_DIFF_SIZE ? (int)diff->height - y : TILE_DIFF_SIZE;
+        
+        for (int c = 0; c < diff->cols; c++) {
+            int x = c * TILE_DIFF_SIZE;
+            int w = (int)diff->width - x < TILE_DIFF_SIZE ? (int)diff->width - x : TILE_DIFF_SIZE;
+            uint64_t hash = hash_block(fn, base + (size_t)y * stride + (size_t)x * 4, stride, w, h);
+            
+            uint64_t *slot = &diff->hashes[r * diff->cols + c];
+            diff->changed[c] = !diff->valid || *slot != hash;
+            *slot = hash;
+            if (diff->changed[c]) changed_tiles++;
+        }
+        
+        for (int c = 0; c < diff->cols; ) {
+            if (!diff->changed[c]) {
+                c++;
+                continue;
+            }
+            int start = c;
+            while (c < diff->cols && diff->changed[c]) c++;
+            
+            int x = start * TILE_DIFF_SIZE;
+            int w = (c == diff->cols ? (int)diff->width : c * TILE_DIFF_SIZE) - x;
+            XRectangle *above = NULL;
+            for (int i = spans - 1; i >= 0 && !above; i--) {
+                XRectangle *s = &diff->spans[i];
+                if (s->y + s->height == y && s->x == x && s->width == w) above = s;
+            }
+            if (above) {
+                above->height += h;
+            } else {
+                diff->spans[spans++] = (XRectangle){ (short)x, (short)y, (unsigned short)w, (unsigned short)h };
+            }
+        }
+    }
+    
+    int total = diff->cols * diff->rows;
+    diff->valid = true;
+    diff->frames++;
+    diff->tiles += total;
+    diff->skipped += total - changed_tiles;
+    if (changed_tiles == 0) {
+        diff->unchanged++;
+        *count = 0;
+        return 0;
+    }
+    
+    if (spans > DAMAGE_MAX_RECTS) {
+        int x0 = diff->spans[0].x, y0 = diff->spans[0].y;
+        int x1 = x0 + diff->spans[0].width, y1 = y0 + diff->spans[0].height;
+        for (int i = 1; i < spans; i++) {
+            const XRectangle *s = &diff->spans[i];
+            if (s->x < x0) x0 = s->x;
+            if (s->y < y0) y0 = s->y;
+            if (s->x + s->width > x1) x1 = s->x + s->width;
+            if (s->y + s->height > y1) y1 = s->y + s->height;
+        }
+        diff->spans[0] = (XRectangle){ (short)x0, (short)y0, (unsigned short)(x1 - x0), (unsigned short)(y1 - y0) };
+        spans = 1;
+    }
+    
+    for (int i = 0; i < spans; i++) {
+        const XRectangle *s = &diff->spans[i];
+        tiles[i].rect = *s;
+        tiles[i].data = (char *)base + (size_t)s->y * stride + (size_t)s->x * 4;
+        tiles[i].stride = stride;
+    }
+    *count = spans;
+    return spans;
+}
+
+void tile_diff_print_stats(const TileDiff *diff, FILE *out) {
+    if (!diff) return;
+    
+    fprintf(out, "Tile diff (%s, %dx%d tiles of %d px): %llu of %llu tiles unchanged (%.1f%%), %lu of %lu frames unchanged\n",
+            colorspace_kernel_name(diff->kernel), diff->cols, diff->rows, TILE_DIFF_SIZE,
+            diff->skipped, diff->tiles, diff->tiles ? 100.0 * diff->skipped / diff->tiles : 0.0,
+            diff->unchanged, diff->frames);
+}
+
+void tile_diff_destroy(TileDiff *diff) {
+    if (!diff) return;
+    free(diff->hashes);
+    free(diff->changed);
+    free(diff->spans);
+    free(diff);
+}
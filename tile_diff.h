@@ -0,0 +1,45 @@
+#ifndef TILE_DIFF_H
+#define TILE_DIFF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "capture.h"
+#include "colorspace.h"
+
+// Finds the parts of a whole captured frame that actually changed, for
+// compositors and GL clients that damage the full screen every frame. The
+// frame is split into TILE_DIFF_SIZE square tiles, each tile is hashed with an
+// xxh3-style multiply-accumulate hash (AVX2, SSE4.1 and NEON kernels, all
+// matching the scalar one), and only tiles whose hash moved since the
+// previous frame are handed on - merged into at most DAMAGE_MAX_RECTS
+// rectangles that point into the captured image.
+
+#define TILE_DIFF_SIZE 64           // Tile edge in pixels (even, so tiles stay chroma aligned)
+
+typedef struct TileDiff {
+    unsigned int width;             // Frame being diffed
+    unsigned int height;
+    int cols;
+    int rows;
+    CsKernel kernel;
+    uint64_t *hashes;               // Previous frame's hash per tile, row-major
+    bool valid;                     // hashes hold a frame (false forces every tile to count as changed)
+    bool *changed;                  // Scratch: changed flags of one tile row
+    XRectangle *spans;              // Scratch: merged changed spans before the DAMAGE_MAX_RECTS cap
+    unsigned long frames;           // Frames diffed
+    unsigned long unchanged;        // ... of which nothing changed
+    unsigned long long tiles;       // Tiles hashed
+    unsigned long long skipped;     // ... of which had not changed
+} TileDiff;
+
+TileDiff* tile_diff_create(CsKernel kernel, unsigned int width, unsigned int height); // NULL on failure
+int tile_diff_apply(TileDiff *diff, CaptureTile *tiles, int *count);  // Replace one whole-frame tile with the changed parts - returns tiles left (0 = frame unchanged), -1 on error
+void tile_diff_invalidate(TileDiff *diff);                           // Next frame counts as fully changed (a frame was lost downstream)
+int tile_diff_resize(TileDiff *diff, unsigned int width, unsigned int height); // New mode - returns 0 on success
+uint64_t tile_diff_hash(CsKernel kernel, const uint8_t *pixels, int stride,
+                        int width, int height);                      // Hash of a width x height BGRX block
+void tile_diff_print_stats(const TileDiff *diff, FILE *out);
+void tile_diff_destroy(TileDiff *diff);                              // Safe to call with NULL
+
+#endif
@@ -0,0 +1,142 @@
+#include "timing.h"
+#include <pthread.h>
+#include <time.h>
+
+// Accumulated cost of one stage
+typedef struct {
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    unsigned int count;
+    unsigned int histogram[TIMING_HISTOGRAM_BUCKETS];
+} StageTotals;
+
+static bool timing_on = false;
+static uint64_t enabled_at = 0;
+static StageTotals totals[TIMING_STAGE_COUNT];
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *stage_names[TIMING_STAGE_COUNT] = {
+    [TIMING_CONNECT]      = "connect",
+    [TIMING_RESOURCES]    = "screen resources",
+    [TIMING_ENUMERATE]    = "output enumeration",
+    [TIMING_REFRESH]      = "incremental refresh",
+    [TIMING_PRIMARY]      = "  primary output",
+    [TIMING_OUTPUT_INFO]  = "  output info",
+    [TIMING_CRTC_INFO]    = "  crtc info",
+    [TIMING_CVT_GENERATE] = "cvt generation",
+    [TIMING_CREATE_MODE]  = "create mode",
+    [TIMING_SYNC]         = "xsync",
+    [TIMING_EVENTS]       = "event processing",
+    [TIMING_COMMAND]      = "command",
+    [TIMING_INPUT]        = "input injection",
+    [TIMING_CAPTURE]      = "capture",
+    [TIMING_DAMAGE]       = "damage fetch",
+    [TIMING_TILE_DIFF]    = "tile diff",
+    [TIMING_CURSOR]       = "cursor",
+    [TIMING_PIPE_CONVERT] = "pipeline convert",
+    [TIMING_PIPE_ENCODE]  = "pipeline encode",
+    [TIMING_PIPE_SEND]    = "pipeline send",
+    [TIMING_PIPE_LATENCY] = "pipeline latency",
+    [TIMING_PROBE_ENCODE] = "probe capture-encode",
+    [TIMING_PROBE_SEND]   = "probe encode-send",
+    [TIMING_PROBE_DISPLAY] = "probe send-display",
+    [TIMING_PROBE_TOTAL]  = "probe glass-to-glass",
+};
+
+void timing_enable(bool enabled) {
+    timing_on = enabled;
+    if (enabled) enabled_at = timing_now();
+}
+
+bool timing_enabled(void) {
+    return timing_on;
+}
+
+// Monotonic clock in nanoseconds
+uint64_t timing_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Histogram bucket for a sample - smallest i with elapsed < 2^i microseconds
+static int histogram_bucket(uint64_t elapsed_ns) {
+    uint64_t us = elapsed_ns / 1000;
+    int bucket = 0;
+    while (bucket < TIMING_HISTOGRAM_BUCKETS - 1 && us >= (1ull << bucket)) bucket++;
+    return bucket;
+}
+
+// Accumulate elapsed time since start
+void timing_record(TimingStage stage, uint64_t start) {
+    if (!timing_on || stage >= TIMING_STAGE_COUNT) return;
+    timing_record_elapsed(stage, timing_now() - start);
+}
+
+// Accumulate a duration whose end is not now (echoed or kernel-stamped)
+void timing_record_elapsed(TimingStage stage, uint64_t elapsed) {
+    if (!timing_on || stage >= TIMING_STAGE_COUNT) return;
+    
+    pthread_mutex_lock(&totals_lock);
+    StageTotals *t = &totals[stage];
+    if (t->count == 0 || elapsed < t->min_ns) t->min_ns = elapsed;
+    if (elapsed > t->max_ns) t->max_ns = elapsed;
+    t->total_ns += elapsed;
+    t->count++;
+    t->histogram[histogram_bucket(elapsed)]++;
+    pthread_mutex_unlock(&totals_lock);
+}
+
+// Print the per-stage breakdown; stages that never ran are reported as skipped
+// Indented stages are part of the one above, so only wall time is summed
+void timing_print(FILE *out) {
+    if (!timing_on) return;
+    
+    pthread_mutex_lock(&totals_lock);
+    fprintf(out, "Timing:\n");
+    for (int i = 0; i < TIMING_STAGE_COUNT; i++) {
+        const StageTotals *t = &totals[i];
+        if (t->count == 0) {
+            fprintf(out, "  %-22s skipped (not needed)\n", stage_names[i]);
+            continue;
+        }
+        fprintf(out, "  %-22s %10.3f ms  (%u call%s, max %.3f ms)\n", stage_names[i],
+                t->total_ns / 1e6, t->count, t->count == 1 ? "" : "s", t->max_ns / 1e6);
+    }
+    fprintf(out, "  %-22s %10.3f ms\n", "wall clock", (timing_now() - enabled_at) / 1e6);
+    pthread_mutex_unlock(&totals_lock);
+}
+
+// Print a row per non-empty bucket for every stage that has samples
+void timing_print_histograms(FILE *out) {
+    if (!timing_on) return;
+    
+    pthread_mutex_lock(&totals_lock);
+    fprintf(out, "Latency histograms:\n");
+    for (int i = 0; i < TIMING_STAGE_COUNT; i++) {
+        const StageTotals *t = &totals[i];
+        if (t->count == 0) continue;
+        
+        fprintf(out, "  %s: %u sample%s, min %.3f ms, avg %.3f ms, max %.3f ms\n",
+                stage_names[i] + (stage_names[i][0] == ' ' ? 2 : 0),
+                t->count, t->count == 1 ? "" : "s",
+                t->min_ns / 1e6, t->total_ns / 1e6 / t->count, t->max_ns / 1e6);
+        
+        for (int b = 0; b < TIMING_HISTOGRAM_BUCKETS; b++) {
+            if (t->histogram[b] == 0) continue;
+            
+            // Bar scaled to the stage's own sample count, 40 columns wide
+            int width = (int)((uint64_t)t->histogram[b] * 40 / t->count);
+            if (width == 0) width = 1;
+            if (b == TIMING_HISTOGRAM_BUCKETS - 1) {
+                fprintf(out, "    >= %9llu us  ", 1ull << (b - 1));
+            } else {
+                fprintf(out, "    <  %9llu us  ", 1ull << b);
+            }
+            fprintf(out, "%-40.*s %u\n", width,
+                    "########################################", t->histogram[b]);
+        }
+    }
+    pthread_mutex_unlock(&totals_lock);
+}
@@ -0,0 +1,53 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Lightweight stage timer - monotonic timestamps accumulated per stage and
+// printed with --timing. Every sample also lands in a log2 latency histogram
+// so a long-running daemon can show the shape of its round trips, not just
+// the average. Recording is a no-op until timing_enable(true). Safe to record
+// from pipeline threads; enable/disable only from the main thread.
+
+#define TIMING_HISTOGRAM_BUCKETS 24     // Bucket i holds samples below 2^i microseconds, last one is open-ended
+
+typedef enum {
+    TIMING_CONNECT,         // XOpenDisplay
+    TIMING_RESOURCES,       // XRRGetScreenResources[Current]
+    TIMING_ENUMERATE,       // dm_get_screens (output/CRTC queries + indexing)
+    TIMING_REFRESH,         // dm_refresh (resource fetch, queries and diff)
+    TIMING_PRIMARY,         // XRRGetOutputPrimary (xcb: wait for the first reply)
+    TIMING_OUTPUT_INFO,     // XRRGetOutputInfo (xcb: wait for one pipelined reply)
+    TIMING_CRTC_INFO,       // XRRGetCrtcInfo (xcb: wait for one pipelined reply)
+    TIMING_CVT_GENERATE,    // libxcvt_gen_mode_info
+    TIMING_CREATE_MODE,     // XRRCreateMode
+    TIMING_SYNC,            // XSync (dm_sync / dm_untrap_errors)
+    TIMING_EVENTS,          // Daemon: folding a batch of RandR events into the cache
+    TIMING_COMMAND,         // Daemon: executing one command line
+    TIMING_INPUT,           // Daemon: tablet input datagram received to XTest flush
+    TIMING_CAPTURE,         // XShmGetImage / XGetSubImage of one frame or dirty rectangle
+    TIMING_DAMAGE,          // XDamageSubtract + XFixesFetchRegion
+    TIMING_TILE_DIFF,       // Hashing one whole frame's tiles
+    TIMING_CURSOR,          // Cursor sideband: pointer query, shape fetch and sends
+    TIMING_PIPE_CONVERT,    // Pipeline: colorspace conversion of one frame
+    TIMING_PIPE_ENCODE,     // Pipeline: encoding one frame
+    TIMING_PIPE_SEND,       // Pipeline: sending one frame
+    TIMING_PIPE_LATENCY,    // Pipeline: capture start to send done
+    TIMING_PROBE_ENCODE,    // Latency probe: capture start to encoder done
+    TIMING_PROBE_SEND,      // Latency probe: encoder done to last datagram sent
+    TIMING_PROBE_DISPLAY,   // Latency probe: sent to displayed on the client (echo)
+    TIMING_PROBE_TOTAL,     // Latency probe: capture start to displayed
+    TIMING_STAGE_COUNT
+} TimingStage;
+
+void timing_enable(bool enabled);
+bool timing_enabled(void);
+uint64_t timing_now(void);                              // CLOCK_MONOTONIC in nanoseconds
+void timing_record(TimingStage stage, uint64_t start);  // Add (now - start) to stage and its histogram
+void timing_record_elapsed(TimingStage stage, uint64_t elapsed_ns); // Add a duration measured elsewhere
+void timing_print(FILE *out);                           // Per-stage breakdown, skipped stages included
+void timing_print_histograms(FILE *out);                // Latency distribution of every stage that ran
+
+#endif
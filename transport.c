@@ -0,0 +1,539 @@
+#define _GNU_SOURCE     // sendmmsg
+#include "transport.h"
+#include "encoder.h"
+#include "frame_clock.h"
+#include "latency_probe.h"
+#include "timing.h"
+#include <arpa/inet.h>
+#include <endian.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/errqueue.h>
+
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define TRANSPORT_HAVE_ZEROCOPY 1
+#define ZEROCOPY_FLAG MSG_ZEROCOPY
+#else
+#define ZEROCOPY_FLAG 0
+#endif
+
+#define TRANSPORT_SNDBUF (2 << 20)      // Room for a paced keyframe without blocking
+#define TRANSPORT_TOS 0x88              // DSCP AF41 - WMM maps it to the video access category
+
+_Static_assert(sizeof(TransportHeader) == 24, "wire header layout");
+_Static_assert(sizeof(TransportNack) == 20, "wire NACK layout");
+_Static_assert(sizeof(TransportProbe) == 16, "wire probe echo layout");
+_Static_assert(TRANSPORT_PAYLOAD % 8 == 0, "parity XOR works in 64-bit words");
+
+// One frame's datagrams, laid out TRANSPORT_MTU apart
+typedef struct {
+    uint8_t *packets;
+    uint16_t lengths[TRANSPORT_MAX_PACKETS];    // Datagram sizes, header included
+    int count;
+    bool zc_pending;                            // Zerocopy sends from this buffer not yet completed
+    uint32_t zc_last;                           // Notification id of its last zerocopy send
+} Staging;
+
+struct Transport {
+    int fd;
+    uint64_t period_ns;
+    bool fec;
+    LatencyProbe *probe;                // NULL = no probe echoes
+    bool zerocopy;                      // Socket accepted SO_ZEROCOPY and the kernel has not copied yet
+    uint32_t zc_next;                   // Notification id of the next zerocopy send
+    uint32_t zc_done;                   // Every id below this has completed
+    Staging staging[TRANSPORT_STAGING];
+    int next_staging;
+    uint32_t next_frame;
+    
+    Staging keyframe;                   // Last keyframe, kept for NACKed resends
+    uint32_t keyframe_id;
+    bool keyframe_valid;
+    
+    // Atomic where transport_get_stats reads them from another thread
+    _Atomic unsigned long frames;
+    unsigned long packets;
+    unsigned long parity;
+    _Atomic unsigned long long bytes;
+    _Atomic unsigned long nacks;
+    unsigned long nacks_ignored;        // For frames other than the kept keyframe
+    unsigned long resent;
+    _Atomic unsigned long oversize;     // Frames beyond TRANSPORT_MAX_PACKETS
+    _Atomic unsigned long send_errors;  // Datagrams the kernel refused (ENOBUFS, ECONNREFUSED, ...)
+    unsigned long zc_sends;
+    
+    _Atomic uint32_t cursor_request;    // Serial of the last shape request, taken by the capture thread
+    _Atomic unsigned long sideband;     // Cursor packets sent
+    _Atomic unsigned long sideband_errors;
+};
+
+// Split "host:port" / "[host]:port" in place
+static int split_address(char *spec, char **host, char **port) {
+    char *colon;
+    if (spec[0] == '[') {
+        char *end = strchr(spec, ']');
+        if (!end || end[1] != ':') return -1;
+        *end = '\0';
+        *host = spec + 1;
+        colon = end + 1;
+    } else {
+        colon = strrchr(spec, ':');
+        if (!colon) return -1;
+        *colon = '\0';
+        *host = spec;
+    }
+    *port = colon + 1;
+    return **host && **port ? 0 : -1;
+}
+
+// Resolve and connect, so send needs no address and recv only sees the client
+static int connect_socket(const char *address) {
+    char spec[256];
+    snprintf(spec, sizeof(spec), "%s", address);
+    char *host, *port;
+    if (split_address(spec, &host, &port) != 0) {
+        fprintf(stderr, "Transport: address must be host:port, got %s\n", address);
+        return -1;
+    }
+    
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_DGRAM };
+    struct addrinfo *found;
+    int err = getaddrinfo(host, port, &hints, &found);
+    if (err != 0) {
+        fprintf(stderr, "Transport: cannot resolve %s: %s\n", address, gai_strerror(err));
+        return -1;
+    }
+    
+    int fd = -1;
+    for (struct addrinfo *ai = found; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+            continue;
+        }
+        
+        int tos = TRANSPORT_TOS;
+        if (ai->ai_family == AF_INET6) {
+            setsockopt(fd, IPPROTO_IPV6, IPV6_TCLASS, &tos, sizeof(tos));
+        } else {
+            setsockopt(fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+        }
+    }
+    freeaddrinfo(found);
+    if (fd < 0) fprintf(stderr, "Transport: cannot connect to %s: %s\n", address, strerror(errno));
+    return fd;
+}
+
+Transport* transport_open(const TransportConfig *config) {
+    if (!config || !config->address) return NULL;
+    
+    Transport *t = calloc(1, sizeof(Transport));
+    if (!t) return NULL;
+    t->fd = -1;
+    t->fec = config->fec;
+    t->probe = config->probe;
+    transport_set_refresh(t, config->refresh_hz);
+    
+    bool ok = true;
+    for (int i = 0; ok && i < TRANSPORT_STAGING; i++) {
+        t->staging[i].packets = malloc((size_t)TRANSPORT_MAX_PACKETS * TRANSPORT_MTU);
+        ok = t->staging[i].packets != NULL;
+    }
+    t->keyframe.packets = ok ? malloc((size_t)TRANSPORT_MAX_PACKETS * TRANSPORT_MTU) : NULL;
+    if (!t->keyframe.packets || (t->fd = connect_socket(config->address)) < 0) {
+        transport_close(t);
+        return NULL;
+    }
+    
+    int sndbuf = TRANSPORT_SNDBUF;
+    setsockopt(t->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+#ifdef TRANSPORT_HAVE_ZEROCOPY
+    int one = 1;
+    t->zerocopy = setsockopt(t->fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+#endif
+    // Feedback is only read once per frame - echoes need their arrival time from the kernel
+    int on = 1;
+    if (t->probe && setsockopt(t->fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) != 0) {
+        perror("Transport: SO_TIMESTAMPNS");
+    }
+    return t;
+}
+
+void transport_set_refresh(Transport *transport, double refresh_hz) {
+    if (!transport) return;
+    if (refresh_hz <= 0) refresh_hz = FRAME_CLOCK_DEFAULT_HZ;
+    transport->period_ns = (uint64_t)(1e9 / refresh_hz);
+}
+
+// Fold finished zerocopy notifications into zc_done, and stop using
+// zerocopy once the kernel says it had to copy anyway
+static void reap_zerocopy(Transport *t) {
+#ifdef TRANSPORT_HAVE_ZEROCOPY
+    for (;;) {
+        char control[128];
+        struct msghdr msg = { .msg_control = control, .msg_controllen = sizeof(control) };
+        if (recvmsg(t->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+        
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            bool recverr = (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                           (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+            if (!recverr) continue;
+            
+            struct sock_extended_err err;
+            memcpy(&err, CMSG_DATA(cm), sizeof(err));
+            if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+            if ((int32_t)(err.ee_data + 1 - t->zc_done) > 0) t->zc_done = err.ee_data + 1;
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) t->zerocopy = false;
+        }
+    }
+    
+    for (int i = 0; i < TRANSPORT_STAGING; i++) {
+        Staging *s = &t->staging[i];
+        if (s->zc_pending && (int32_t)(t->zc_done - s->zc_last) > 0) s->zc_pending = false;
+    }
+#else
+    (void)t;
+#endif
+}
+
+// sendmmsg the listed packets of a staging buffer
+static int send_batch(Transport *t, const Staging *s, const int *indices, int count, int flags) {
+    struct mmsghdr msgs[TRANSPORT_BATCH];
+    struct iovec iovs[TRANSPORT_BATCH];
+    memset(msgs, 0, sizeof(msgs));
+    
+    for (int i = 0; i < count; i++) {
+        iovs[i].iov_base = s->packets + (size_t)indices[i] * TRANSPORT_MTU;
+        iovs[i].iov_len = s->lengths[indices[i]];
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    
+    int done = 0;
+    while (done < count) {
+        int n = sendmmsg(t->fd, msgs + done, (unsigned int)(count - done), flags);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            // Transient (no buffer space, client not listening yet) - lose the datagram, keep streaming
+            if (errno == ENOBUFS || errno == EAGAIN || errno == ECONNREFUSED || errno == EHOSTUNREACH ||
+                errno == ENETUNREACH) {
+                t->send_errors++;
+                done++;
+                continue;
+            }
+            perror("Transport: sendmmsg");
+            return -1;
+        }
+        
+        size_t sent = 0;
+        for (int i = done; i < done + n; i++) sent += iovs[i].iov_len;
+        t->bytes += sent;
+        if (flags & ZEROCOPY_FLAG) t->zc_sends += n;
+        done += n;
+    }
+    return 0;
+}
+
+// Header + payload of one datagram
+static uint8_t* write_header(Staging *s, int index, uint8_t flags, uint32_t frame, int data_count,
+                             int parity_count, int length, size_t frame_bytes, uint32_t timestamp_us) {
+    uint8_t *packet = s->packets + (size_t)index * TRANSPORT_MTU;
+    TransportHeader h = {
+        .magic = htons(TRANSPORT_MAGIC),
+        .version = TRANSPORT_VERSION,
+        .flags = flags,
+        .frame = htonl(frame),
+        .index = htons((uint16_t)index),
+        .data_count = htons((uint16_t)data_count),
+        .parity_count = htons((uint16_t)parity_count),
+        .length = htons((uint16_t)length),
+        .frame_bytes = htonl((uint32_t)frame_bytes),
+        .timestamp_us = htonl(timestamp_us),
+    };
+    memcpy(packet, &h, sizeof(h));
+    s->lengths[index] = (uint16_t)(sizeof(h) + length);
+    return packet + sizeof(h);
+}
+
+// XOR src into dst - payloads start 8-byte aligned within the staging buffer
+static void xor_payload(uint8_t *dst, const uint8_t *src, int length) {
+    int words = length / 8;
+    uint64_t *d = (uint64_t *)dst;
+    const uint64_t *w = (const uint64_t *)src;
+    for (int i = 0; i < words; i++) d[i] ^= w[i];
+    for (int i = words * 8; i < length; i++) dst[i] ^= src[i];
+}
+
+// Cut a frame into data packets plus one parity packet per FEC group
+static int packetize(Transport *t, Staging *s, uint32_t frame, const uint8_t *data, size_t size,
+                     bool keyframe, uint32_t timestamp_us) {
+    int data_count = (int)((size + TRANSPORT_PAYLOAD - 1) / TRANSPORT_PAYLOAD);
+    int parity_count = t->fec ? (data_count + TRANSPORT_FEC_GROUP - 1) / TRANSPORT_FEC_GROUP : 0;
+    if (data_count + parity_count > TRANSPORT_MAX_PACKETS) return -1;
+    uint8_t flags = (keyframe ? TRANSPORT_FLAG_KEYFRAME : 0) | (t->probe ? TRANSPORT_FLAG_PROBE : 0);
+    
+    for (int i = 0; i < data_count; i++) {
+        size_t offset = (size_t)i * TRANSPORT_PAYLOAD;
+        int length = size - offset < (size_t)TRANSPORT_PAYLOAD ? (int)(size - offset) : TRANSPORT_PAYLOAD;
+        uint8_t *payload = write_header(s, i, flags, frame, data_count, parity_count, length, size, timestamp_us);
+        memcpy(payload, data + offset, (size_t)length);
+    }
+    
+    for (int g = 0; g < parity_count; g++) {
+        int first = g * TRANSPORT_FEC_GROUP;
+        int last = first + TRANSPORT_FEC_GROUP < data_count ? first + TRANSPORT_FEC_GROUP : data_count;
+        int length = (int)s->lengths[first] - (int)sizeof(TransportHeader);    // First of a group is the longest
+        
+        uint8_t *parity = write_header(s, data_count + g, flags | TRANSPORT_FLAG_PARITY, frame, data_count,
+                                       parity_count, length, size, timestamp_us);
+        memset(parity, 0, (size_t)length);
+        for (int i = first; i < last; i++) {
+            const uint8_t *payload = s->packets + (size_t)i * TRANSPORT_MTU + sizeof(TransportHeader);
+            xor_payload(parity, payload, (int)s->lengths[i] - (int)sizeof(TransportHeader));
+        }
+    }
+    
+    s->count = data_count + parity_count;
+    t->parity += parity_count;
+    return 0;
+}
+
+static void sleep_until(uint64_t ns) {
+    struct timespec when = { (time_t)(ns / 1000000000ull), (long)(ns % 1000000000ull) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &when, NULL) == EINTR) {}
+}
+
+// Interleave parity with its group, so a burst loss costs each group one packet
+static int send_order(const Staging *s, int data_count, int *order) {
+    int n = 0;
+    int parity_count = s->count - data_count;
+    for (int g = 0; g * TRANSPORT_FEC_GROUP < data_count || g < parity_count; g++) {
+        for (int i = g * TRANSPORT_FEC_GROUP; i < (g + 1) * TRANSPORT_FEC_GROUP && i < data_count; i++) order[n++] = i;
+        if (g < parity_count) order[n++] = data_count + g;
+    }
+    return n;
+}
+
+// Packetize, then send in batches spread over TRANSPORT_PACE_SHARE of a frame period
+int transport_send_frame(Transport *t, const uint8_t *data, size_t size, bool keyframe, uint64_t captured_ns) {
+    if (!t || !data || size == 0) return -1;
+    
+    reap_zerocopy(t);
+    Staging *s = &t->staging[t->next_staging];
+    t->next_staging = (t->next_staging + 1) % TRANSPORT_STAGING;
+    
+    // Never rewrite memory the kernel may still be reading - but do not wait for it either
+    if (s->zc_pending) {
+        for (int i = 0; i < TRANSPORT_STAGING && s->zc_pending; i++) {
+            s = &t->staging[(t->next_staging + i) % TRANSPORT_STAGING];
+        }
+        if (s->zc_pending) return 1;
+    }
+    
+    uint32_t frame = t->next_frame++;
+    if (packetize(t, s, frame, data, size, keyframe, (uint32_t)(captured_ns / 1000)) != 0) {
+        if (t->oversize++ == 0) fprintf(stderr, "Transport: %zu byte frame exceeds %d packets, dropping\n", size, TRANSPORT_MAX_PACKETS);
+        return 1;
+    }
+    
+    int order[TRANSPORT_MAX_PACKETS];
+    int data_count = (int)((size + TRANSPORT_PAYLOAD - 1) / TRANSPORT_PAYLOAD);
+    int total = send_order(s, data_count, order);
+    int flags = t->zerocopy ? ZEROCOPY_FLAG : 0;
+    unsigned long zc_before = t->zc_sends;
+    
+    uint64_t start = timing_now();
+    uint64_t window = (uint64_t)(t->period_ns * TRANSPORT_PACE_SHARE);
+    for (int sent = 0; sent < total; ) {
+        int n = total - sent < TRANSPORT_BATCH ? total - sent : TRANSPORT_BATCH;
+        if (send_batch(t, s, order + sent, n, flags) != 0) return -1;
+        sent += n;
+        if (sent < total) sleep_until(start + window * (uint64_t)sent / (uint64_t)total);
+    }
+    
+    if (flags) {
+        uint32_t zc_count = (uint32_t)(t->zc_sends - zc_before);
+        t->zc_next += zc_count;
+        s->zc_pending = zc_count > 0;
+        s->zc_last = t->zc_next - 1;
+    }
+    if (keyframe) {
+        memcpy(t->keyframe.packets, s->packets, (size_t)s->count * TRANSPORT_MTU);
+        memcpy(t->keyframe.lengths, s->lengths, sizeof(s->lengths[0]) * (size_t)s->count);
+        t->keyframe.count = s->count;
+        t->keyframe_id = frame;
+        t->keyframe_valid = true;
+    }
+    
+    t->frames++;
+    t->packets += total;
+    return 0;
+}
+
+// Kernel receive stamp of a datagram on the monotonic clock, now if there is none
+static uint64_t receive_time(struct msghdr *msg) {
+    uint64_t monotonic = timing_now();
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(msg); c; c = CMSG_NXTHDR(msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_TIMESTAMPNS) continue;
+        struct timespec stamp, now;
+        memcpy(&stamp, CMSG_DATA(c), sizeof(stamp));
+        clock_gettime(CLOCK_REALTIME, &now);
+        int64_t age = ((int64_t)now.tv_sec - stamp.tv_sec) * 1000000000ll + (now.tv_nsec - stamp.tv_nsec);
+        if (age >= 0 && (uint64_t)age < monotonic) return monotonic - (uint64_t)age;
+    }
+    return monotonic;
+}
+
+// Resend the NACKed packets of the kept keyframe, ignore NACKs for anything else
+int transport_poll_feedback(Transport *t) {
+    if (!t) return -1;
+    
+    int resent = 0;
+    for (;;) {
+        union {
+            TransportNack nack;
+            TransportProbe probe;
+        } packet;
+        char control[CMSG_SPACE(sizeof(struct timespec))];
+        struct iovec iov = { .iov_base = &packet, .iov_len = sizeof(packet) };
+        struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control) };
+        ssize_t n = recvmsg(t->fd, &msg, MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR || errno == ECONNREFUSED) continue;
+            perror("Transport: recv");
+            return -1;
+        }
+        TransportNack nack = packet.nack;
+        if (n < (ssize_t)sizeof(TransportProbe) || ntohs(nack.magic) != TRANSPORT_MAGIC ||
+            nack.version != TRANSPORT_VERSION) {
+            continue;
+        }
+        if (nack.type == TRANSPORT_FEEDBACK_PROBE) {
+            if (n == (ssize_t)sizeof(TransportProbe)) {
+                latency_probe_echo(t->probe, ntohl(packet.probe.frame), ntohl(packet.probe.timestamp_us),
+                                   ntohl(packet.probe.hold_us), receive_time(&msg));
+            }
+            continue;
+        }
+        if (n != (ssize_t)sizeof(nack) ||
+            (nack.type != TRANSPORT_FEEDBACK_NACK && nack.type != TRANSPORT_FEEDBACK_CURSOR)) {
+            continue;
+        }
+        
+        if (nack.type == TRANSPORT_FEEDBACK_CURSOR) {
+            atomic_store(&t->cursor_request, ntohl(nack.frame));
+            continue;
+        }
+        t->nacks++;
+        if (!t->keyframe_valid || ntohl(nack.frame) != t->keyframe_id) {
+            t->nacks_ignored++;
+            continue;
+        }
+        
+        uint64_t mask = be64toh(nack.mask);
+        int base = ntohs(nack.base);
+        int indices[TRANSPORT_BATCH];
+        int count = 0;
+        for (int bit = 0; bit < 64; bit++) {
+            int index = base + bit;
+            if (!(mask & (1ull << bit)) || index >= t->keyframe.count) continue;
+            
+            t->keyframe.packets[(size_t)index * TRANSPORT_MTU + offsetof(TransportHeader, flags)] |= TRANSPORT_FLAG_RETRANSMIT;
+            indices[count++] = index;
+            if (count == TRANSPORT_BATCH) {
+                if (send_batch(t, &t->keyframe, indices, count, 0) != 0) return -1;
+                resent += count;
+                count = 0;
+            }
+        }
+        if (count > 0) {
+            if (send_batch(t, &t->keyframe, indices, count, 0) != 0) return -1;
+            resent += count;
+        }
+    }
+    
+    t->resent += resent;
+    return resent;
+}
+
+// Plain send() touches only the socket, so the capture thread can use it while
+// the send stage is mid-frame. A full socket buffer loses the packet instead of blocking capture
+int transport_send_sideband(Transport *t, const void *packet, size_t size) {
+    if (!t || !packet || size > TRANSPORT_MTU) return -1;
+    
+    if (send(t->fd, packet, size, MSG_DONTWAIT) < 0) {
+        if (errno == EAGAIN || errno == ENOBUFS || errno == ECONNREFUSED || errno == EINTR ||
+            errno == EHOSTUNREACH || errno == ENETUNREACH) {
+            atomic_fetch_add(&t->sideband_errors, 1);
+            return 0;
+        }
+        perror("Transport: send");
+        return -1;
+    }
+    atomic_fetch_add(&t->sideband, 1);
+    return 0;
+}
+
+uint32_t transport_take_cursor_request(Transport *t) {
+    return t ? atomic_exchange(&t->cursor_request, 0) : 0;
+}
+
+void transport_get_stats(Transport *t, TransportStats *stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (!t) return;
+    stats->frames = atomic_load(&t->frames);
+    stats->bytes = atomic_load(&t->bytes);
+    stats->nacks = atomic_load(&t->nacks);
+    stats->send_errors = atomic_load(&t->send_errors);
+    stats->oversize = atomic_load(&t->oversize);
+}
+
+void transport_print_stats(Transport *t, FILE *out) {
+    if (!t) return;
+    
+    fprintf(out, "Transport: %lu frames, %lu packets (%lu parity), %.1f MB, %lu send errors, %lu oversize\n",
+            t->frames, t->packets, t->parity, t->bytes / 1e6, t->send_errors, t->oversize);
+    fprintf(out, "  NACKs: %lu (%lu not for the kept keyframe), %lu packets resent; zerocopy %s (%lu sends)\n",
+            t->nacks, t->nacks_ignored, t->resent, t->zerocopy ? "on" : "off", t->zc_sends);
+    if (atomic_load(&t->sideband) || atomic_load(&t->sideband_errors)) {
+        fprintf(out, "  cursor: %lu packets, %lu lost to a full socket\n",
+                atomic_load(&t->sideband), atomic_load(&t->sideband_errors));
+    }
+}
+
+void transport_close(Transport *t) {
+    if (!t) return;
+    if (t->fd >= 0) close(t->fd);
+    for (int i = 0; i < TRANSPORT_STAGING; i++) free(t->staging[i].packets);
+    free(t->keyframe.packets);
+    free(t);
+}
+
+// Send the frame's encoded packet, after answering any NACKs that came in -
+// and remember when it went out if the probe is on
+int transport_stage_process(void *ctx, FrameDesc *frame) {
+    Transport *t = ctx;
+    if (!t || !frame) return -1;
+    
+    const EncodedPacket *packet = frame->stage_data[PIPE_ENCODE];
+    if (!packet || packet->size == 0) return 1;
+    
+    if (transport_poll_feedback(t) < 0) return -1;
+    int result = transport_send_frame(t, packet->data, packet->size, packet->keyframe, frame->captured_ns);
+    if (result == 0 && t->probe) {
+        latency_probe_sent(t->probe, t->next_frame - 1, frame->captured_ns, frame->done_ns[PIPE_ENCODE], timing_now());
+    }
+    return result;
+}
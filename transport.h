@@ -0,0 +1,143 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "pipeline.h"
+
+// UDP transport to the tablet client. Each encoded frame is cut into
+// sequenced datagrams no larger than TRANSPORT_MTU, optionally followed by one
+// XOR parity datagram per TRANSPORT_FEC_GROUP data datagrams, and sent in
+// sendmmsg batches spread over part of the frame period so a frame never
+// bursts into the Wi-Fi queue. Lost packets are not retransmitted except for
+// keyframes: the client NACKs them and the last keyframe is kept for resends.
+// Everything else is repaired by FEC or by the encoder's intra refresh.
+// MSG_ZEROCOPY is used when the socket supports it, until the kernel reports
+// that it copied anyway.
+//
+// Wire format (network byte order, see TransportHeader / TransportNack):
+//   frame datagram  = header + payload, data packets 0 .. data_count - 1
+//                     then parity packets data_count .. data_count + parity_count - 1;
+//                     every data payload is TRANSPORT_PAYLOAD bytes except the
+//                     last, parity covers the zero-padded payloads of its group
+//   NACK (client)   = TransportNack, bit i of mask = packet base + i is missing
+//   cursor          = TransportCursor (+ ARGB payload for shapes), flags
+//                     TRANSPORT_FLAG_CURSOR; sent from the capture thread
+//   shape request   = TransportNack of type TRANSPORT_FEEDBACK_CURSOR, frame
+//                     holding the cursor serial the client has no shape for
+//   probe echo      = TransportProbe, for every displayed frame that carried
+//                     TRANSPORT_FLAG_PROBE (see latency_probe.h)
+
+#define TRANSPORT_MAGIC 0x5443          // "TC"
+#define TRANSPORT_VERSION 1
+#define TRANSPORT_MTU 1200              // Whole datagram - fits any Wi-Fi, VPN or tethering path
+#define TRANSPORT_PAYLOAD (TRANSPORT_MTU - (int)sizeof(TransportHeader))
+#define TRANSPORT_MAX_PACKETS 1024      // Per frame, parity included (~1.2 MB)
+#define TRANSPORT_BATCH 16              // Datagrams per sendmmsg
+#define TRANSPORT_FEC_GROUP 8           // Data packets covered by one parity packet
+#define TRANSPORT_PACE_SHARE 0.5        // Share of the frame period one frame's packets are spread over
+#define TRANSPORT_STAGING 4             // Frame staging buffers, so zerocopy sends can complete while later frames go out
+
+enum {
+    TRANSPORT_FLAG_KEYFRAME   = 1 << 0,
+    TRANSPORT_FLAG_PARITY     = 1 << 1,
+    TRANSPORT_FLAG_RETRANSMIT = 1 << 2,
+    TRANSPORT_FLAG_CURSOR     = 1 << 3,   // Sideband cursor packet, not frame data
+    TRANSPORT_FLAG_PROBE      = 1 << 4,   // Echo a TransportProbe once this frame is on screen
+};
+
+enum {
+    TRANSPORT_FEEDBACK_NACK = 1,
+    TRANSPORT_FEEDBACK_CURSOR = 2,
+    TRANSPORT_FEEDBACK_PROBE = 3,
+};
+
+enum {
+    TRANSPORT_CURSOR_POSITION = 1,
+    TRANSPORT_CURSOR_SHAPE = 2,
+};
+
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t flags;
+    uint32_t frame;                     // Frames sent before this one
+    uint16_t index;                     // Packet within the frame
+    uint16_t data_count;
+    uint16_t parity_count;
+    uint16_t length;                    // Payload bytes in this datagram
+    uint32_t frame_bytes;               // Encoded frame size - trims the last packet after recovery
+    uint32_t timestamp_us;              // Capture time, CLOCK_MONOTONIC microseconds (wraps)
+} TransportHeader;
+
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t type;                       // TRANSPORT_FEEDBACK_NACK
+    uint32_t frame;
+    uint16_t base;
+    uint16_t reserved;
+    uint64_t mask;
+} TransportNack;
+
+// Latency probe echo from the client
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t type;                       // TRANSPORT_FEEDBACK_PROBE
+    uint32_t frame;                     // From the frame's header
+    uint32_t timestamp_us;              // The header's capture stamp, unchanged
+    uint32_t hold_us;                   // Frame displayed -> this echo sent, on the client's clock
+} TransportProbe;
+
+// Cursor sideband packet. Shapes follow as premultiplied ARGB32 in network
+// order, cut into chunks that fill TRANSPORT_MTU
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t flags;                      // TRANSPORT_FLAG_CURSOR
+    uint8_t kind;                       // TRANSPORT_CURSOR_POSITION / _SHAPE
+    uint8_t visible;                    // Position: pointer is over this output
+    uint16_t chunk;                     // Shape: chunk index
+    uint32_t serial;                    // XFixes cursor serial (shape to draw / shape carried)
+    int16_t x;                          // Position: output-relative, clipped to it. Shape: hotspot
+    int16_t y;
+    uint16_t width;                     // Shape only
+    uint16_t height;
+    uint32_t timestamp_us;              // CLOCK_MONOTONIC microseconds (wraps)
+} TransportCursor;
+
+typedef struct {
+    const char *address;                // "host:port" or "[v6 address]:port"
+    double refresh_hz;                  // Pacing period (0 = frame clock default)
+    bool fec;
+    struct LatencyProbe *probe;         // Ask for probe echoes and record them here (NULL = off)
+} TransportConfig;
+
+// Running totals for rate control, readable while the send stage runs
+typedef struct {
+    unsigned long frames;               // Frames sent
+    unsigned long long bytes;           // Datagram bytes handed to the kernel, headers and parity included
+    unsigned long nacks;                // NACKs received
+    unsigned long send_errors;          // Datagrams the kernel refused
+    unsigned long oversize;             // Frames dropped for exceeding TRANSPORT_MAX_PACKETS
+} TransportStats;
+
+typedef struct Transport Transport;
+
+Transport* transport_open(const TransportConfig *config);          // NULL on failure
+void transport_set_refresh(Transport *transport, double refresh_hz); // New pacing period after a mode change
+int transport_send_frame(Transport *transport, const uint8_t *data, size_t size,
+                         bool keyframe, uint64_t captured_ns);    // Packetize, pace and send - returns 0 on success, 1 if dropped, -1 on error
+int transport_poll_feedback(Transport *transport);                 // Serve pending NACKs - returns packets resent, -1 on error
+int transport_send_sideband(Transport *transport, const void *packet, size_t size); // One datagram, safe alongside the send stage - returns 0 on success, -1 on error
+uint32_t transport_take_cursor_request(Transport *transport);       // Cursor serial the client asked for since the last call (0 = none)
+void transport_get_stats(Transport *transport, TransportStats *stats); // Totals so far, safe from any thread (zeroes for NULL)
+void transport_print_stats(Transport *transport, FILE *out);
+void transport_close(Transport *transport);                        // Safe to call with NULL
+
+int transport_stage_process(void *transport, FrameDesc *frame);   // PipelineStageFn - sends stage_data[PIPE_ENCODE]
+
+#endif